@@ -9,6 +9,12 @@ struct ObjectConstants
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 };
 
+// Per instance data of instanced draws, read by the vertex shader from a structured buffer
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+};
+
 struct PassConstants
 {
     DirectX::XMFLOAT4X4 View = MathHelper::Identity4x4();
@@ -53,10 +59,17 @@ public:
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
+    // World matrices of the render items drawn instanced this frame, one slot per object
+    std::unique_ptr<UploadBuffer<InstanceData>> InstanceBuffer = nullptr;
+
     // We cannot update a dynamic vertex buffer until the GPU is done processing
     // the commands that reference it.  So each frame needs their own.
     std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
+    // Waves::GetVersion() the WavesVB contents are at, so only rows that changed since this
+    // frame resource was last used get rewritten.
+    UINT64 WavesVersion = 0;
+
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
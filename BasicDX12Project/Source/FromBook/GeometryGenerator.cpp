@@ -3,20 +3,94 @@
 //***************************************************************************************
 
 #include "GeometryGenerator.h"
+#include "../ThreadPool.h"
 #include <algorithm>
 
 using namespace DirectX;
 
-GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
+GeometryGenerator::uint32 GeometryGenerator::MeshDataSoA::GetStreams()const
 {
-    MeshData meshData;
+	uint32 streams = 0;
+	if(!Positions.empty()) streams |= StreamPosition;
+	if(!Normals.empty())   streams |= StreamNormal;
+	if(!TangentUs.empty()) streams |= StreamTangentU;
+	if(!TexCs.empty())     streams |= StreamTexC;
 
-    //
-	// Create the vertices.
-	//
+	return streams;
+}
+
+void GeometryGenerator::MeshDataSoA::Resize(size_t vertexCount, uint32 streams)
+{
+	// Positions define the vertex count, so they are always present.
+	Positions.resize(vertexCount);
+
+	Normals.resize((streams & StreamNormal) ? vertexCount : 0);
+	TangentUs.resize((streams & StreamTangentU) ? vertexCount : 0);
+	TexCs.resize((streams & StreamTexC) ? vertexCount : 0);
+}
+
+void GeometryGenerator::MeshDataSoA::SetVertex(size_t i, const Vertex& v)
+{
+	Positions[i] = v.Position;
 
-	Vertex v[24];
+	if(!Normals.empty())   Normals[i] = v.Normal;
+	if(!TangentUs.empty()) TangentUs[i] = v.TangentU;
+	if(!TexCs.empty())     TexCs[i] = v.TexC;
+}
 
+GeometryGenerator::Vertex GeometryGenerator::MeshDataSoA::GetVertex(size_t i)const
+{
+	Vertex v(
+		Positions[i],
+		Normals.empty()   ? XMFLOAT3(0.0f, 0.0f, 0.0f) : Normals[i],
+		TangentUs.empty() ? XMFLOAT3(0.0f, 0.0f, 0.0f) : TangentUs[i],
+		TexCs.empty()     ? XMFLOAT2(0.0f, 0.0f)       : TexCs[i]);
+
+	return v;
+}
+
+GeometryGenerator::MeshDataSoA GeometryGenerator::MeshDataSoA::FromMeshData(const MeshData& meshData, uint32 streams)
+{
+	MeshDataSoA soa;
+	soa.Resize(meshData.Vertices.size(), streams);
+	soa.Indices32 = meshData.Indices32;
+
+	// One pass per stream keeps every write sequential.
+	const size_t vertexCount = meshData.Vertices.size();
+	for(size_t i = 0; i < vertexCount; ++i)
+		soa.Positions[i] = meshData.Vertices[i].Position;
+
+	for(size_t i = 0; i < soa.Normals.size(); ++i)
+		soa.Normals[i] = meshData.Vertices[i].Normal;
+
+	for(size_t i = 0; i < soa.TangentUs.size(); ++i)
+		soa.TangentUs[i] = meshData.Vertices[i].TangentU;
+
+	for(size_t i = 0; i < soa.TexCs.size(); ++i)
+		soa.TexCs[i] = meshData.Vertices[i].TexC;
+
+	return soa;
+}
+
+GeometryGenerator::MeshData GeometryGenerator::MeshDataSoA::ToMeshData()const
+{
+	MeshData meshData;
+	meshData.Vertices.resize(VertexCount());
+	meshData.Indices32 = Indices32;
+
+	for(size_t i = 0; i < meshData.Vertices.size(); ++i)
+		meshData.Vertices[i] = GetVertex(i);
+
+	return meshData;
+}
+
+GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
+{
+	return CreateBox<StreamAll>(width, height, depth, numSubdivisions);
+}
+
+void GeometryGenerator::GetBoxCorners(float width, float height, float depth, Vertex v[24])
+{
 	float w2 = 0.5f*width;
 	float h2 = 0.5f*height;
 	float d2 = 0.5f*depth;
@@ -56,260 +130,115 @@ GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float heig
 	v[21] = Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
 	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
 	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[24]);
- 
-	//
-	// Create the indices.
-	//
-
-	uint32 i[36];
-
-	// Fill in the front face index data
-	i[0] = 0; i[1] = 1; i[2] = 2;
-	i[3] = 0; i[4] = 2; i[5] = 3;
-
-	// Fill in the back face index data
-	i[6] = 4; i[7]  = 5; i[8]  = 6;
-	i[9] = 4; i[10] = 6; i[11] = 7;
-
-	// Fill in the top face index data
-	i[12] = 8; i[13] =  9; i[14] = 10;
-	i[15] = 8; i[16] = 10; i[17] = 11;
-
-	// Fill in the bottom face index data
-	i[18] = 12; i[19] = 13; i[20] = 14;
-	i[21] = 12; i[22] = 14; i[23] = 15;
-
-	// Fill in the left face index data
-	i[24] = 16; i[25] = 17; i[26] = 18;
-	i[27] = 16; i[28] = 18; i[29] = 19;
-
-	// Fill in the right face index data
-	i[30] = 20; i[31] = 21; i[32] = 22;
-	i[33] = 20; i[34] = 22; i[35] = 23;
-
-	meshData.Indices32.assign(&i[0], &i[36]);
-
-    // Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
-
-    for(uint32 i = 0; i < numSubdivisions; ++i)
-        Subdivide(meshData);
-
-    return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
 {
-    MeshData meshData;
-
-	//
-	// Compute the vertices stating at the top pole and moving down the stacks.
+	return CreateSphere<StreamAll>(radius, sliceCount, stackCount);
+}
+ 
+void GeometryGenerator::Subdivide(std::vector<uint32>& indices, uint32 vertexCount, std::vector<uint32>& edgeEnds)
+{
+	//       v1
+	//       *
+	//      / \
+	//     /   \
+	//  m0*-----*m1
+	//   / \   / \
+	//  /   \ /   \
+	// *-----*-----*
+	// v0    m2     v2
 	//
+	// The corner vertices stay where they are and each edge midpoint is appended
+	// once.  An interior edge is shared by two triangles, so the midpoint created
+	// for the first triangle is looked up in the cache and reused by the second.
 
-	// Poles: note that there will be texture coordinate distortion as there is
-	// not a unique point on the texture map to assign to the pole when mapping
-	// a rectangular texture onto a sphere.
-	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-
-	meshData.Vertices.push_back( topVertex );
-
-	float phiStep   = XM_PI/stackCount;
-	float thetaStep = 2.0f*XM_PI/sliceCount;
+	uint32 numTris = (uint32)indices.size()/3;
 
-	// Compute vertices for each stack ring (do not count the poles as rings).
-	for(uint32 i = 1; i <= stackCount-1; ++i)
+	// A closed mesh has 3/2 edges per triangle; open meshes can have up to 3.
+	// The cache is a flat open-addressed table big enough for the worst case,
+	// which avoids a node allocation per edge and keeps lookups in one cache line.
+	struct EdgeSlot
 	{
-		float phi = i*phiStep;
-
-		// Vertices of ring.
-        for(uint32 j = 0; j <= sliceCount; ++j)
-		{
-			float theta = j*thetaStep;
-
-			Vertex v;
-
-			// spherical to cartesian
-			v.Position.x = radius*sinf(phi)*cosf(theta);
-			v.Position.y = radius*cosf(phi);
-			v.Position.z = radius*sinf(phi)*sinf(theta);
-
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
-
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
-
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+		uint64 Key;
+		uint32 MidPoint;
+	};
 
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
+	const uint64 kEmptySlot = ~0ull;
 
-			meshData.Vertices.push_back( v );
-		}
-	}
+	size_t maxEdges = (size_t)numTris*3;
+	size_t tableSize = 1;
+	while(tableSize < maxEdges + maxEdges/4)
+		tableSize <<= 1;
 
-	meshData.Vertices.push_back( bottomVertex );
+	std::vector<EdgeSlot> midpointCache(tableSize, EdgeSlot{ kEmptySlot, 0 });
 
-	//
-	// Compute indices for top stack.  The top stack was written first to the vertex buffer
-	// and connects the top pole to the first ring.
-	//
+	edgeEnds.clear();
+	edgeEnds.reserve((size_t)numTris*3);
 
-    for(uint32 i = 1; i <= sliceCount; ++i)
+	auto getMidPoint = [&](uint32 a, uint32 b) -> uint32
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
-	}
-	
-	//
-	// Compute indices for inner stacks (not connected to poles).
-	//
+		uint64 key = a < b ? ((uint64)a << 32) | b : ((uint64)b << 32) | a;
 
-	// Offset the indices to the index of the first vertex in the first ring.
-	// This is just skipping the top pole vertex.
-    uint32 baseIndex = 1;
-    uint32 ringVertexCount = sliceCount + 1;
-	for(uint32 i = 0; i < stackCount-2; ++i)
-	{
-		for(uint32 j = 0; j < sliceCount; ++j)
+		// Fibonacci hashing, then linear probing.
+		size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (tableSize - 1);
+		while(midpointCache[slot].Key != kEmptySlot)
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			if(midpointCache[slot].Key == key)
+				return midpointCache[slot].MidPoint;
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+			slot = (slot + 1) & (tableSize - 1);
 		}
-	}
-
-	//
-	// Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer
-	// and connects the bottom pole to the bottom ring.
-	//
-
-	// South pole vertex was added last.
-	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
-
-	// Offset the indices to the index of the first vertex in the last ring.
-	baseIndex = southPoleIndex - ringVertexCount;
-	
-	for(uint32 i = 0; i < sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
-	}
-
-    return meshData;
-}
- 
-void GeometryGenerator::Subdivide(MeshData& meshData)
-{
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+		uint32 index = vertexCount + (uint32)(edgeEnds.size()/2);
+		edgeEnds.push_back(a);
+		edgeEnds.push_back(b);
 
-	//       v1
-	//       *
-	//      / \
-	//     /   \
-	//  m0*-----*m1
-	//   / \   / \
-	//  /   \ /   \
-	// *-----*-----*
-	// v0    m2     v2
+		midpointCache[slot] = EdgeSlot{ key, index };
+		return index;
+	};
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
-	for(uint32 i = 0; i < numTris; ++i)
+	// Every triangle becomes four, so triangle i is rewritten to slots [4i, 4i+4).
+	// Walking backwards means we never overwrite a triangle we have not read yet,
+	// which lets us subdivide the index buffer in place.
+	indices.resize((size_t)numTris*12);
+	for(uint32 i = numTris; i-- > 0;)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		uint32 v0 = indices[i*3+0];
+		uint32 v1 = indices[i*3+1];
+		uint32 v2 = indices[i*3+2];
 
 		//
-		// Generate the midpoints.
+		// Generate (or reuse) the midpoints.
 		//
 
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
+		uint32 m0 = getMidPoint(v0, v1);
+		uint32 m1 = getMidPoint(v1, v2);
+		uint32 m2 = getMidPoint(v0, v2);
 
 		//
 		// Add new geometry.
 		//
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
-
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
-
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+		uint32* tri = &indices[(size_t)i*12];
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+		tri[0]  = v0; tri[1]  = m0; tri[2]  = m2;
+		tri[3]  = m0; tri[4]  = m1; tri[5]  = m2;
+		tri[6]  = m2; tri[7]  = m1; tri[8]  = v2;
+		tri[9]  = m0; tri[10] = v1; tri[11] = m1;
 	}
 }
 
-GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
+GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
 {
-    XMVECTOR p0 = XMLoadFloat3(&v0.Position);
-    XMVECTOR p1 = XMLoadFloat3(&v1.Position);
-
-    XMVECTOR n0 = XMLoadFloat3(&v0.Normal);
-    XMVECTOR n1 = XMLoadFloat3(&v1.Normal);
-
-    XMVECTOR tan0 = XMLoadFloat3(&v0.TangentU);
-    XMVECTOR tan1 = XMLoadFloat3(&v1.TangentU);
-
-    XMVECTOR tex0 = XMLoadFloat2(&v0.TexC);
-    XMVECTOR tex1 = XMLoadFloat2(&v1.TexC);
-
-    // Compute the midpoints of all the attributes.  Vectors need to be normalized
-    // since linear interpolating can make them not unit length.  
-    XMVECTOR pos = 0.5f*(p0 + p1);
-    XMVECTOR normal = XMVector3Normalize(0.5f*(n0 + n1));
-    XMVECTOR tangent = XMVector3Normalize(0.5f*(tan0+tan1));
-    XMVECTOR tex = 0.5f*(tex0 + tex1);
-
-    Vertex v;
-    XMStoreFloat3(&v.Position, pos);
-    XMStoreFloat3(&v.Normal, normal);
-    XMStoreFloat3(&v.TangentU, tangent);
-    XMStoreFloat2(&v.TexC, tex);
-
-    return v;
+	return CreateGeosphere<StreamAll>(radius, numSubdivisions);
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
+void GeometryGenerator::SubdivideIcosahedron(uint32 numSubdivisions, PositionStreams& positions, std::vector<uint32>& indices)
 {
-    MeshData meshData;
-
 	// Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+	if(numSubdivisions > kMaxSubdivisions)
+		numSubdivisions = kMaxSubdivisions;
 
 	// Approximate a sphere by tessellating an icosahedron.
 
@@ -334,283 +263,93 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
 	};
 
-    meshData.Vertices.resize(12);
-    meshData.Indices32.assign(&k[0], &k[60]);
-
-	for(uint32 i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
+	indices.assign(&k[0], &k[60]);
 
+	// Every level adds one vertex per edge, and a closed triangle mesh has V+F-2 edges.
+	// Size the streams for the final count up front so they are allocated once.
+	size_t finalVertexCount = 12;
+	size_t faceCount = 20;
 	for(uint32 i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
-
-	// Project vertices onto sphere and scale.
-	for(uint32 i = 0; i < meshData.Vertices.size(); ++i)
 	{
-		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
-
-		// Project onto sphere.
-		XMVECTOR p = radius*n;
-
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
-
-		// Derive texture coordinates from spherical coordinates.
-        float theta = atan2f(meshData.Vertices[i].Position.z, meshData.Vertices[i].Position.x);
-
-        // Put in [0, 2pi].
-        if(theta < 0.0f)
-            theta += XM_2PI;
-
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
-
-		meshData.Vertices[i].TexC.x = theta/XM_2PI;
-		meshData.Vertices[i].TexC.y = phi/XM_PI;
-
-		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius*sinf(phi)*sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius*sinf(phi)*cosf(theta);
-
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
+		finalVertexCount += finalVertexCount + faceCount - 2;
+		faceCount *= 4;
 	}
 
-    return meshData;
-}
-
-GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
-{
-    MeshData meshData;
-
-	//
-	// Build Stacks.
-	// 
+	size_t paddedVertexCount = (finalVertexCount + 3) & ~(size_t)3;
+	positions.X.resize(paddedVertexCount);
+	positions.Y.resize(paddedVertexCount);
+	positions.Z.resize(paddedVertexCount);
 
-	float stackHeight = height / stackCount;
-
-	// Amount to increment radius as we move up each stack level from bottom to top.
-	float radiusStep = (topRadius - bottomRadius) / stackCount;
-
-	uint32 ringCount = stackCount+1;
-
-	// Compute vertices for each stack ring starting at the bottom and moving up.
-	for(uint32 i = 0; i < ringCount; ++i)
+	for(uint32 i = 0; i < 12; ++i)
 	{
-		float y = -0.5f*height + i*stackHeight;
-		float r = bottomRadius + i*radiusStep;
-
-		// vertices of ring
-		float dTheta = 2.0f*XM_PI/sliceCount;
-		for(uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j*dTheta);
-			float s = sinf(j*dTheta);
-
-			vertex.Position = XMFLOAT3(r*c, y, r*s);
-
-			vertex.TexC.x = (float)j/sliceCount;
-			vertex.TexC.y = 1.0f - (float)i/stackCount;
-
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius-topRadius;
-			XMFLOAT3 bitangent(dr*c, -height, dr*s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
+		positions.X[i] = pos[i].x;
+		positions.Y[i] = pos[i].y;
+		positions.Z[i] = pos[i].z;
 	}
 
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount+1;
-
-	// Compute indices for each stack.
-	for(uint32 i = 0; i < stackCount; ++i)
+	uint32 vertexCount = 12;
+	std::vector<uint32> edgeEnds;
+	for(uint32 level = 0; level < numSubdivisions; ++level)
 	{
-		for(uint32 j = 0; j < sliceCount; ++j)
+		Subdivide(indices, vertexCount, edgeEnds);
+
+		// Place the new midpoints four at a time.  The subdivision stays flat until it is
+		// projected, so a midpoint is just the average of the edge's end points.
+		float* x = positions.X.data();
+		float* y = positions.Y.data();
+		float* z = positions.Z.data();
+		const uint32* ends = edgeEnds.data();
+		uint32 newVertexCount = (uint32)(edgeEnds.size()/2);
+		XMVECTOR half = XMVectorReplicate(0.5f);
+
+		uint32 i = 0;
+		for(; i + 4 <= newVertexCount; i += 4, ends += 8)
 		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
+			XMVECTOR ax = XMVectorSet(x[ends[0]], x[ends[2]], x[ends[4]], x[ends[6]]);
+			XMVECTOR bx = XMVectorSet(x[ends[1]], x[ends[3]], x[ends[5]], x[ends[7]]);
+			XMVECTOR ay = XMVectorSet(y[ends[0]], y[ends[2]], y[ends[4]], y[ends[6]]);
+			XMVECTOR by = XMVectorSet(y[ends[1]], y[ends[3]], y[ends[5]], y[ends[7]]);
+			XMVECTOR az = XMVectorSet(z[ends[0]], z[ends[2]], z[ends[4]], z[ends[6]]);
+			XMVECTOR bz = XMVectorSet(z[ends[1]], z[ends[3]], z[ends[5]], z[ends[7]]);
+
+			uint32 m = vertexCount + i;
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&x[m]), XMVectorMultiply(XMVectorAdd(ax, bx), half));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&y[m]), XMVectorMultiply(XMVectorAdd(ay, by), half));
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&z[m]), XMVectorMultiply(XMVectorAdd(az, bz), half));
 		}
-	}
-
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-
-    return meshData;
-}
-
-void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
-{
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
-
-	float y = 0.5f*height;
-	float dTheta = 2.0f*XM_PI/sliceCount;
-
-	// Duplicate cap ring vertices because the texture coordinates and normals differ.
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = topRadius*cosf(i*dTheta);
-		float z = topRadius*sinf(i*dTheta);
 
-		// Scale down by the height to try and make top cap texture coord area
-		// proportional to base.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
+		for(; i < newVertexCount; ++i, ends += 2)
+		{
+			uint32 m = vertexCount + i;
+			x[m] = 0.5f*(x[ends[0]] + x[ends[1]]);
+			y[m] = 0.5f*(y[ends[0]] + y[ends[1]]);
+			z[m] = 0.5f*(z[ends[0]] + z[ends[1]]);
+		}
 
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
+		vertexCount += newVertexCount;
 	}
 
-	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
+	assert(vertexCount == finalVertexCount);
 
-	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
-
-	for(uint32 i = 0; i < sliceCount; ++i)
+	// The padding repeats vertex 0, so the four-wide passes never see garbage.
+	for(size_t i = vertexCount; i < paddedVertexCount; ++i)
 	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
+		positions.X[i] = positions.X[0];
+		positions.Y[i] = positions.Y[0];
+		positions.Z[i] = positions.Z[0];
 	}
+
+	positions.VertexCount = vertexCount;
 }
 
-void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
+GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
-	// 
-	// Build bottom cap.
-	//
-
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
-	float y = -0.5f*height;
-
-	// vertices of ring
-	float dTheta = 2.0f*XM_PI/sliceCount;
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = bottomRadius*cosf(i*dTheta);
-		float z = bottomRadius*sinf(i*dTheta);
-
-		// Scale down by the height to try and make top cap texture coord area
-		// proportional to base.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
-
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
-	}
-
-	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
-
-	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
-
-	for(uint32 i = 0; i < sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
-	}
+	return CreateCylinder<StreamAll>(bottomRadius, topRadius, height, sliceCount, stackCount);
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
-    MeshData meshData;
-
-	uint32 vertexCount = m*n;
-	uint32 faceCount   = (m-1)*(n-1)*2;
-
-	//
-	// Create the vertices.
-	//
-
-	float halfWidth = 0.5f*width;
-	float halfDepth = 0.5f*depth;
-
-	float dx = width / (n-1);
-	float dz = depth / (m-1);
-
-	float du = 1.0f / (n-1);
-	float dv = 1.0f / (m-1);
-
-	meshData.Vertices.resize(vertexCount);
-	for(uint32 i = 0; i < m; ++i)
-	{
-		float z = halfDepth - i*dz;
-		for(uint32 j = 0; j < n; ++j)
-		{
-			float x = -halfWidth + j*dx;
-
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-
-			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
-		}
-	}
- 
-    //
-	// Create the indices.
-	//
-
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
-
-	// Iterate over each quad and compute indices.
-	uint32 k = 0;
-	for(uint32 i = 0; i < m-1; ++i)
-	{
-		for(uint32 j = 0; j < n-1; ++j)
-		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
-
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
-
-			k += 6; // next quad
-		}
-	}
-
-    return meshData;
+	return CreateGrid<StreamAll>(width, depth, m, n);
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
@@ -655,3 +394,20 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
 
     return meshData;
 }
+
+void GeometryGenerator::SetThreadPool(ThreadPool* threadPool)
+{
+	mThreadPool = threadPool;
+}
+
+void GeometryGenerator::ForEachRow(uint32 rowCount, uint32 rowVertexCount, const std::function<void(uint32, uint32)>& buildRows)
+{
+	// Vertices handed to a thread at once.
+	const size_t kMinVerticesPerTask = 16384;
+
+	size_t rowsPerTask = std::max<size_t>(kMinVerticesPerTask / std::max<uint32>(rowVertexCount, 1u), 1);
+	ThreadPool::ParallelFor(mThreadPool, 0, rowCount, rowsPerTask, [&](size_t rowBegin, size_t rowEnd)
+	{
+		buildRows((uint32)rowBegin, (uint32)rowEnd);
+	});
+}
@@ -14,16 +14,22 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <DirectXMath.h>
+#include <functional>
 #include <vector>
 
+class ThreadPool;
+
 class GeometryGenerator
 {
 public:
 
     using uint16 = std::uint16_t;
     using uint32 = std::uint32_t;
+    using uint64 = std::uint64_t;
 
 	struct Vertex
 	{
@@ -58,25 +64,79 @@ public:
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 
-        std::vector<uint16>& GetIndices16()
+        // Returns a 16-bit copy of the indices.  Only valid when every index fits in
+        // 16 bits; pack larger meshes with IndexPacker, which splits them into chunks.
+        std::vector<uint16> GetIndices16()const
         {
-			if(mIndices16.empty())
-			{
-				mIndices16.resize(Indices32.size());
-				for(size_t i = 0; i < Indices32.size(); ++i)
-					mIndices16[i] = static_cast<uint16>(Indices32[i]);
-			}
-
-			return mIndices16;
+			assert(Vertices.size() <= 0x10000 && "Indices do not fit in 16 bits");
+
+			std::vector<uint16> indices16(Indices32.size());
+			for(size_t i = 0; i < Indices32.size(); ++i)
+				indices16[i] = static_cast<uint16>(Indices32[i]);
+
+			return indices16;
         }
+	};
 
-	private:
-		std::vector<uint16> mIndices16;
+	// Bit flags naming the vertex attribute streams of a MeshDataSoA, and the attributes the
+	// templated Create functions below compute.
+	enum VertexStreamFlags : uint32
+	{
+		StreamPosition = 0x1,
+		StreamNormal   = 0x2,
+		StreamTangentU = 0x4,
+		StreamTexC     = 0x8,
+		StreamAll      = StreamPosition | StreamNormal | StreamTangentU | StreamTexC
 	};
 
+	///<summary>
+	/// Structure-of-arrays counterpart of MeshData.  Every attribute lives in its own
+	/// tightly packed stream, so code that only needs positions (bounds, depth and
+	/// shadow passes, SIMD transforms) reads 12 bytes per vertex instead of 44.
+	/// Streams that were not requested are left empty.
+	///</summary>
+	struct MeshDataSoA
+	{
+		std::vector<DirectX::XMFLOAT3> Positions;
+		std::vector<DirectX::XMFLOAT3> Normals;
+		std::vector<DirectX::XMFLOAT3> TangentUs;
+		std::vector<DirectX::XMFLOAT2> TexCs;
+		std::vector<uint32> Indices32;
+
+		size_t VertexCount()const { return Positions.size(); }
+		uint32 GetStreams()const;
+
+		// Resizes the requested streams and clears the others.
+		void Resize(size_t vertexCount, uint32 streams = StreamAll);
+
+		// Writes/reads one vertex across the streams that are present.
+		void SetVertex(size_t i, const Vertex& v);
+		Vertex GetVertex(size_t i)const;
+
+		// Splits an AoS mesh into the requested streams.  Indices are always copied.
+		static MeshDataSoA FromMeshData(const MeshData& meshData, uint32 streams = StreamAll);
+
+		// Interleaves the streams back into a MeshData.  Missing streams are zeroed.
+		MeshData ToMeshData()const;
+	};
+
+	///<summary>
+	/// Builds the rows of CreateSphere, CreateCylinder and CreateGrid, and projects the
+	/// vertices of CreateGeosphere, across the given pool.  The output is identical to the serial path.  Pass nullptr to go back to
+	/// generating on the calling thread.
+	///</summary>
+	void SetThreadPool(ThreadPool* threadPool);
+
+	///<summary>
+	/// The deepest level CreateBox and CreateGeosphere build; deeper requests are clamped
+	/// to it.  At level 15 the geosphere's vertex count no longer fits in 32 bits.
+	///</summary>
+	static const uint32 kMaxSubdivisions = 14;
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
-    /// face has m rows and n columns of vertices.
+    /// face is a grid of 2^numSubdivisions quads per side.  numSubdivisions is capped
+    /// at kMaxSubdivisions.
 	///</summary>
     MeshData CreateBox(float width, float height, float depth, uint32 numSubdivisions);
 
@@ -88,7 +148,8 @@ public:
 
 	///<summary>
 	/// Creates a geosphere centered at the origin with the given radius.  The
-	/// depth controls the level of tessellation.
+	/// depth controls the level of tessellation.  Each level quadruples the
+	/// triangle count; the depth is capped at kMaxSubdivisions.
 	///</summary>
     MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
 
@@ -110,10 +171,85 @@ public:
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 
+	///<summary>
+	/// Versions of CreateBox, CreateSphere, CreateGeosphere, CreateCylinder and CreateGrid that write straight
+	/// into a caller's vertex type.  Only the attributes in the Attributes mask
+	/// (VertexStreamFlags) are computed; the math for the others is compiled out and they
+	/// are zero in the Vertex passed to makeVertex, which converts it to an OutVertex.
+	/// Both buffers are sized once and filled in a single pass.  makeVertex may be called
+	/// from the thread pool's threads.
+	///</summary>
+	template<uint32 Attributes, typename OutVertex, typename MakeVertex>
+	void CreateBox(float width, float height, float depth, uint32 numSubdivisions,
+		std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex);
+	template<uint32 Attributes, typename OutVertex, typename MakeVertex>
+	void CreateSphere(float radius, uint32 sliceCount, uint32 stackCount,
+		std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex);
+	template<uint32 Attributes, typename OutVertex, typename MakeVertex>
+	void CreateGeosphere(float radius, uint32 numSubdivisions,
+		std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex);
+	template<uint32 Attributes, typename OutVertex, typename MakeVertex>
+	void CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex);
+	template<uint32 Attributes, typename OutVertex, typename MakeVertex>
+	void CreateGrid(float width, float depth, uint32 m, uint32 n,
+		std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex);
+
+	///<summary>
+	/// The same with MeshData as the output, e.g. CreateSphere<StreamPosition>(...) for
+	/// geometry that is only ever drawn flat colored or into a depth buffer.
+	///</summary>
+	template<uint32 Attributes>
+	MeshData CreateBox(float width, float height, float depth, uint32 numSubdivisions);
+	template<uint32 Attributes>
+	MeshData CreateSphere(float radius, uint32 sliceCount, uint32 stackCount);
+	template<uint32 Attributes>
+	MeshData CreateGeosphere(float radius, uint32 numSubdivisions);
+	template<uint32 Attributes>
+	MeshData CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount);
+	template<uint32 Attributes>
+	MeshData CreateGrid(float width, float depth, uint32 m, uint32 n);
+
+private:
+	// Geosphere positions with one stream per component, so the vertex math can run on
+	// four vertices per XMVECTOR.  The streams are padded to a multiple of four with
+	// copies of vertex 0; VertexCount is the real count.
+	struct PositionStreams
+	{
+		std::vector<float> X;
+		std::vector<float> Y;
+		std::vector<float> Z;
+		uint32 VertexCount = 0;
+	};
+
+	// Splits every triangle into four in place, sharing edge midpoints between
+	// neighbouring triangles.  Only builds the topology: the k-th new vertex is the
+	// midpoint of edgeEnds[2k] and edgeEnds[2k+1] and gets index vertexCount+k.
+	void Subdivide(std::vector<uint32>& indices, uint32 vertexCount, std::vector<uint32>& edgeEnds);
+
+	// The subdivided icosahedron of CreateGeosphere, before it is projected onto the sphere.
+	void SubdivideIcosahedron(uint32 numSubdivisions, PositionStreams& positions, std::vector<uint32>& indices);
+
+	// The four corners of each box face, ordered so the face is the triangles (0,1,2) and
+	// (0,2,3).  v[4*f+1] and v[4*f+3] are the neighbours of v[4*f] along the face's edges.
+	static void GetBoxCorners(float width, float height, float depth, Vertex v[24]);
+
+	// Zeroes the attributes that are not in the mask.
+	template<uint32 Attributes>
+	static Vertex KeepAttributes(const Vertex& v);
+
+	// Writes the ring and center of a cylinder cap to vertices [baseIndex, baseIndex+sliceCount+2)
+	// and its triangles to indices.
+	template<uint32 Attributes, typename OutVertex, typename MakeVertex>
+	void BuildCylinderCap(float radius, float y, float height, uint32 sliceCount, bool isTop,
+		OutVertex* vertices, uint32 baseIndex, uint32* indices, MakeVertex& makeVertex);
+
+	// Runs buildRows over [0, rowCount), split into row ranges across mThreadPool when the
+	// mesh is big enough to be worth it.  Each row must only write to its own slots.
+	void ForEachRow(uint32 rowCount, uint32 rowVertexCount, const std::function<void(uint32, uint32)>& buildRows);
+
 private:
-	void Subdivide(MeshData& meshData);
-    Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+	ThreadPool* mThreadPool = nullptr;
 };
 
+#include "GeometryGenerator.inl"
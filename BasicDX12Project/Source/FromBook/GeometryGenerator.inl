@@ -0,0 +1,619 @@
+//***************************************************************************************
+// GeometryGenerator.inl
+//
+// Attribute masked generators.  The Attributes mask is a template argument, so every
+// "if(Attributes & ...)" below is a constant and the compiler drops the branches (and the
+// trigonometry in them) for attributes the caller did not ask for.
+//***************************************************************************************
+
+template<GeometryGenerator::uint32 Attributes>
+GeometryGenerator::Vertex GeometryGenerator::KeepAttributes(const Vertex& v)
+{
+	Vertex out(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	if(Attributes & StreamPosition) out.Position = v.Position;
+	if(Attributes & StreamNormal)   out.Normal = v.Normal;
+	if(Attributes & StreamTangentU) out.TangentU = v.TangentU;
+	if(Attributes & StreamTexC)     out.TexC = v.TexC;
+
+	return out;
+}
+
+template<GeometryGenerator::uint32 Attributes, typename OutVertex, typename MakeVertex>
+void GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions,
+	std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex)
+{
+	using namespace DirectX;
+
+	// Put a cap on the number of subdivisions.
+	if(numSubdivisions > kMaxSubdivisions)
+		numSubdivisions = kMaxSubdivisions;
+
+	Vertex corners[24];
+	GetBoxCorners(width, height, depth, corners);
+
+	// Subdividing the two triangles of a face numSubdivisions times gives a regular grid of
+	// 2^numSubdivisions quads per side, each split along the same diagonal as the face.  Lay
+	// that grid out directly instead of subdividing, which needs no edge lookups and lets
+	// every vertex be written once.
+	uint32 quadsPerSide = 1u << numSubdivisions;
+	uint32 sideVertexCount = quadsPerSide + 1;
+	uint32 faceVertexCount = sideVertexCount*sideVertexCount;
+	size_t faceIndexCount = (size_t)quadsPerSide*quadsPerSide*6;
+
+	vertices.resize((size_t)6*faceVertexCount);
+	indices.resize(6*faceIndexCount);
+
+	float step = 1.0f / quadsPerSide;
+	for(uint32 f = 0; f < 6; ++f)
+	{
+		const Vertex& v0 = corners[4*f];
+		const Vertex& v1 = corners[4*f+1];
+		const Vertex& v3 = corners[4*f+3];
+
+		XMVECTOR p0 = XMLoadFloat3(&v0.Position);
+		XMVECTOR pa = XMLoadFloat3(&v1.Position) - p0;
+		XMVECTOR pb = XMLoadFloat3(&v3.Position) - p0;
+
+		XMVECTOR t0 = XMLoadFloat2(&v0.TexC);
+		XMVECTOR ta = XMLoadFloat2(&v1.TexC) - t0;
+		XMVECTOR tb = XMLoadFloat2(&v3.TexC) - t0;
+
+		// Normal and tangent are constant across a face.
+		Vertex v = KeepAttributes<Attributes & (StreamNormal | StreamTangentU)>(v0);
+
+		OutVertex* face = &vertices[(size_t)f*faceVertexCount];
+		for(uint32 b = 0; b <= quadsPerSide; ++b)
+		{
+			for(uint32 a = 0; a <= quadsPerSide; ++a)
+			{
+				float s = a*step;
+				float t = b*step;
+
+				if(Attributes & StreamPosition)
+					XMStoreFloat3(&v.Position, p0 + s*pa + t*pb);
+
+				if(Attributes & StreamTexC)
+					XMStoreFloat2(&v.TexC, t0 + s*ta + t*tb);
+
+				face[b*sideVertexCount + a] = makeVertex(v);
+			}
+		}
+
+		uint32 baseIndex = f*faceVertexCount;
+		uint32* faceIndices = &indices[f*faceIndexCount];
+		for(uint32 b = 0; b < quadsPerSide; ++b)
+		{
+			for(uint32 a = 0; a < quadsPerSide; ++a)
+			{
+				uint32 i0 = baseIndex + b*sideVertexCount + a;
+				uint32 i1 = i0 + 1;
+				uint32 i3 = i0 + sideVertexCount;
+				uint32 i2 = i3 + 1;
+
+				*faceIndices++ = i0; *faceIndices++ = i1; *faceIndices++ = i2;
+				*faceIndices++ = i0; *faceIndices++ = i2; *faceIndices++ = i3;
+			}
+		}
+	}
+}
+
+template<GeometryGenerator::uint32 Attributes, typename OutVertex, typename MakeVertex>
+void GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount,
+	std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex)
+{
+	using namespace DirectX;
+
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount + 1;
+
+	// Every ring and every stack writes to its own slots, so size the buffers up front
+	// and let the rows be filled in any order.
+	vertices.resize(2 + (size_t)(stackCount-1)*ringVertexCount);
+	indices.resize((size_t)sliceCount*6 + (size_t)(stackCount-2)*sliceCount*6);
+
+	//
+	// Compute the vertices stating at the top pole and moving down the stacks.
+	//
+
+	// Poles: note that there will be texture coordinate distortion as there is
+	// not a unique point on the texture map to assign to the pole when mapping
+	// a rectangular texture onto a sphere.
+	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+
+	vertices.front() = makeVertex(KeepAttributes<Attributes>(topVertex));
+
+	float phiStep   = XM_PI/stackCount;
+	float thetaStep = 2.0f*XM_PI/sliceCount;
+
+	// Compute vertices for each stack ring (do not count the poles as rings).
+	ForEachRow(stackCount-1, ringVertexCount, [&](uint32 rowBegin, uint32 rowEnd)
+	{
+		Vertex v = KeepAttributes<0>(topVertex);
+		for(uint32 i = rowBegin+1; i <= rowEnd; ++i)
+		{
+			float phi = i*phiStep;
+			float sinPhi = sinf(phi);
+			float cosPhi = cosf(phi);
+
+			// Vertices of ring.
+			OutVertex* ring = &vertices[1 + (size_t)(i-1)*ringVertexCount];
+			for(uint32 j = 0; j <= sliceCount; ++j)
+			{
+				float theta = j*thetaStep;
+				float sinTheta = sinf(theta);
+				float cosTheta = cosf(theta);
+
+				// spherical to cartesian
+				XMFLOAT3 position(radius*sinPhi*cosTheta, radius*cosPhi, radius*sinPhi*sinTheta);
+
+				if(Attributes & StreamPosition)
+					v.Position = position;
+
+				// Partial derivative of P with respect to theta
+				if(Attributes & StreamTangentU)
+				{
+					v.TangentU.x = -radius*sinPhi*sinTheta;
+					v.TangentU.y = 0.0f;
+					v.TangentU.z = +radius*sinPhi*cosTheta;
+
+					XMVECTOR T = XMLoadFloat3(&v.TangentU);
+					XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+				}
+
+				if(Attributes & StreamNormal)
+				{
+					XMVECTOR p = XMLoadFloat3(&position);
+					XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+				}
+
+				if(Attributes & StreamTexC)
+				{
+					v.TexC.x = theta / XM_2PI;
+					v.TexC.y = phi / XM_PI;
+				}
+
+				ring[j] = makeVertex(v);
+			}
+		}
+	});
+
+	vertices.back() = makeVertex(KeepAttributes<Attributes>(bottomVertex));
+
+	//
+	// Compute indices for top stack.  The top stack was written first to the vertex buffer
+	// and connects the top pole to the first ring.
+	//
+
+	uint32* topIndices = indices.data();
+    for(uint32 i = 1; i <= sliceCount; ++i)
+	{
+		*topIndices++ = 0;
+		*topIndices++ = i+1;
+		*topIndices++ = i;
+	}
+
+	//
+	// Compute indices for inner stacks (not connected to poles).
+	//
+
+	// Offset the indices to the index of the first vertex in the first ring.
+	// This is just skipping the top pole vertex.
+    uint32 baseIndex = 1;
+	uint32* innerIndices = topIndices;
+	ForEachRow(stackCount-2, ringVertexCount, [&](uint32 rowBegin, uint32 rowEnd)
+	{
+		for(uint32 i = rowBegin; i < rowEnd; ++i)
+		{
+			uint32* stack = innerIndices + (size_t)i*sliceCount*6;
+			for(uint32 j = 0; j < sliceCount; ++j)
+			{
+				*stack++ = baseIndex + i*ringVertexCount + j;
+				*stack++ = baseIndex + i*ringVertexCount + j+1;
+				*stack++ = baseIndex + (i+1)*ringVertexCount + j;
+
+				*stack++ = baseIndex + (i+1)*ringVertexCount + j;
+				*stack++ = baseIndex + i*ringVertexCount + j+1;
+				*stack++ = baseIndex + (i+1)*ringVertexCount + j+1;
+			}
+		}
+	});
+	uint32* bottomIndices = innerIndices + (size_t)(stackCount-2)*sliceCount*6;
+
+	//
+	// Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer
+	// and connects the bottom pole to the bottom ring.
+	//
+
+	// South pole vertex was added last.
+	uint32 southPoleIndex = (uint32)vertices.size()-1;
+
+	// Offset the indices to the index of the first vertex in the last ring.
+	baseIndex = southPoleIndex - ringVertexCount;
+
+	for(uint32 i = 0; i < sliceCount; ++i)
+	{
+		*bottomIndices++ = southPoleIndex;
+		*bottomIndices++ = baseIndex+i;
+		*bottomIndices++ = baseIndex+i+1;
+	}
+}
+
+template<GeometryGenerator::uint32 Attributes, typename OutVertex, typename MakeVertex>
+void GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions,
+	std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex)
+{
+	using namespace DirectX;
+
+	PositionStreams positions;
+	SubdivideIcosahedron(numSubdivisions, positions, indices);
+
+	vertices.resize(positions.VertexCount);
+
+	// Project the vertices onto the sphere and derive their attributes four at a time, with
+	// each XMVECTOR holding one component of four vertices.  The streams are padded, so
+	// every group is full; only the writes are limited to the real vertices.
+	uint32 groupCount = (positions.VertexCount + 3)/4;
+	ForEachRow(groupCount, 4, [&](uint32 groupBegin, uint32 groupEnd)
+	{
+		XMVECTOR zero = XMVectorZero();
+		XMVECTOR one = XMVectorSplatOne();
+
+		Vertex v = KeepAttributes<0>(Vertex());
+
+		for(uint32 group = groupBegin; group < groupEnd; ++group)
+		{
+			uint32 first = group*4;
+			XMVECTOR x = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&positions.X[first]));
+			XMVECTOR y = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&positions.Y[first]));
+			XMVECTOR z = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&positions.Z[first]));
+
+			// Project onto unit sphere.
+			XMVECTOR length = XMVectorSqrt(XMVectorMultiplyAdd(x, x, XMVectorMultiplyAdd(y, y, XMVectorMultiply(z, z))));
+			XMVECTOR nx = XMVectorDivide(x, length);
+			XMVECTOR ny = XMVectorDivide(y, length);
+			XMVECTOR nz = XMVectorDivide(z, length);
+
+			XMFLOAT4 px, py, pz, tu, tv, tx, tz;
+
+			// Project onto sphere.
+			if(Attributes & StreamPosition)
+			{
+				XMVECTOR r = XMVectorReplicate(radius);
+				XMStoreFloat4(&px, XMVectorMultiply(nx, r));
+				XMStoreFloat4(&py, XMVectorMultiply(ny, r));
+				XMStoreFloat4(&pz, XMVectorMultiply(nz, r));
+			}
+
+			// Derive texture coordinates from spherical coordinates, with theta put in [0, 2pi].
+			if(Attributes & StreamTexC)
+			{
+				XMVECTOR theta = XMVectorATan2(nz, nx);
+				theta = XMVectorSelect(theta, XMVectorAdd(theta, XMVectorReplicate(XM_2PI)), XMVectorLess(theta, zero));
+
+				XMVECTOR phi = XMVectorACos(XMVectorClamp(ny, XMVectorNegate(one), one));
+
+				XMStoreFloat4(&tu, XMVectorMultiply(theta, XMVectorReplicate(1.0f/XM_2PI)));
+				XMStoreFloat4(&tv, XMVectorMultiply(phi, XMVectorReplicate(1.0f/XM_PI)));
+			}
+
+			// The partial derivative of P with respect to theta is r*sin(phi)*(-sin(theta), 0, cos(theta)),
+			// which normalized is (-z, 0, x)/sqrt(x*x + z*z) without any trigonometry.  At the poles
+			// atan2 gives theta = 0, so use its tangent (0, 0, 1) there.
+			if(Attributes & StreamTangentU)
+			{
+				XMVECTOR lengthXZ = XMVectorSqrt(XMVectorMultiplyAdd(nx, nx, XMVectorMultiply(nz, nz)));
+				XMVECTOR isPole = XMVectorEqual(lengthXZ, zero);
+				XMStoreFloat4(&tx, XMVectorSelect(XMVectorNegate(XMVectorDivide(nz, lengthXZ)), zero, isPole));
+				XMStoreFloat4(&tz, XMVectorSelect(XMVectorDivide(nx, lengthXZ), one, isPole));
+			}
+
+			XMFLOAT4 n[3];
+			if(Attributes & StreamNormal)
+			{
+				XMStoreFloat4(&n[0], nx);
+				XMStoreFloat4(&n[1], ny);
+				XMStoreFloat4(&n[2], nz);
+			}
+
+			// Interleave the lanes into the output vertices.
+			uint32 count = std::min<uint32>(4, positions.VertexCount - first);
+			for(uint32 lane = 0; lane < count; ++lane)
+			{
+				if(Attributes & StreamPosition)
+					v.Position = XMFLOAT3((&px.x)[lane], (&py.x)[lane], (&pz.x)[lane]);
+
+				if(Attributes & StreamNormal)
+					v.Normal = XMFLOAT3((&n[0].x)[lane], (&n[1].x)[lane], (&n[2].x)[lane]);
+
+				if(Attributes & StreamTangentU)
+				{
+					v.TangentU.x = (&tx.x)[lane];
+					v.TangentU.z = (&tz.x)[lane];
+				}
+
+				if(Attributes & StreamTexC)
+					v.TexC = XMFLOAT2((&tu.x)[lane], (&tv.x)[lane]);
+
+				vertices[first + lane] = makeVertex(v);
+			}
+		}
+	});
+}
+
+template<GeometryGenerator::uint32 Attributes, typename OutVertex, typename MakeVertex>
+void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+	std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex)
+{
+	using namespace DirectX;
+
+	uint32 ringCount = stackCount+1;
+
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount+1;
+
+	// The stacks come first, then the top and bottom caps, each a duplicated ring plus a
+	// center vertex.  Everything has a fixed place, so size the buffers once.
+	uint32 stackVertexCount = ringCount*ringVertexCount;
+	uint32 capVertexCount = ringVertexCount + 1;
+	size_t stackIndexCount = (size_t)stackCount*sliceCount*6;
+	size_t capIndexCount = (size_t)sliceCount*3;
+
+	vertices.resize((size_t)stackVertexCount + 2*capVertexCount);
+	indices.resize(stackIndexCount + 2*capIndexCount);
+
+	//
+	// Build Stacks.
+	//
+
+	float stackHeight = height / stackCount;
+
+	// Amount to increment radius as we move up each stack level from bottom to top.
+	float radiusStep = (topRadius - bottomRadius) / stackCount;
+
+	// Compute vertices for each stack ring starting at the bottom and moving up.
+	ForEachRow(ringCount, ringVertexCount, [&](uint32 rowBegin, uint32 rowEnd)
+	{
+		Vertex vertex = KeepAttributes<0>(Vertex());
+		for(uint32 i = rowBegin; i < rowEnd; ++i)
+		{
+			float y = -0.5f*height + i*stackHeight;
+			float r = bottomRadius + i*radiusStep;
+
+			// vertices of ring
+			OutVertex* ring = &vertices[(size_t)i*ringVertexCount];
+			float dTheta = 2.0f*XM_PI/sliceCount;
+			for(uint32 j = 0; j <= sliceCount; ++j)
+			{
+				float c = cosf(j*dTheta);
+				float s = sinf(j*dTheta);
+
+				if(Attributes & StreamPosition)
+					vertex.Position = XMFLOAT3(r*c, y, r*s);
+
+				if(Attributes & StreamTexC)
+				{
+					vertex.TexC.x = (float)j/sliceCount;
+					vertex.TexC.y = 1.0f - (float)i/stackCount;
+				}
+
+				// Cylinder can be parameterized as follows, where we introduce v
+				// parameter that goes in the same direction as the v tex-coord
+				// so that the bitangent goes in the same direction as the v tex-coord.
+				//   Let r0 be the bottom radius and let r1 be the top radius.
+				//   y(v) = h - hv for v in [0,1].
+				//   r(v) = r1 + (r0-r1)v
+				//
+				//   x(t, v) = r(v)*cos(t)
+				//   y(t, v) = h - hv
+				//   z(t, v) = r(v)*sin(t)
+				//
+				//  dx/dt = -r(v)*sin(t)
+				//  dy/dt = 0
+				//  dz/dt = +r(v)*cos(t)
+				//
+				//  dx/dv = (r0-r1)*cos(t)
+				//  dy/dv = -h
+				//  dz/dv = (r0-r1)*sin(t)
+
+				// This is unit length.
+				XMFLOAT3 tangent(-s, 0.0f, c);
+
+				if(Attributes & StreamTangentU)
+					vertex.TangentU = tangent;
+
+				if(Attributes & StreamNormal)
+				{
+					float dr = bottomRadius-topRadius;
+					XMFLOAT3 bitangent(dr*c, -height, dr*s);
+
+					XMVECTOR T = XMLoadFloat3(&tangent);
+					XMVECTOR B = XMLoadFloat3(&bitangent);
+					XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
+					XMStoreFloat3(&vertex.Normal, N);
+				}
+
+				ring[j] = makeVertex(vertex);
+			}
+		}
+	});
+
+	// Compute indices for each stack.
+	ForEachRow(stackCount, ringVertexCount, [&](uint32 rowBegin, uint32 rowEnd)
+	{
+		for(uint32 i = rowBegin; i < rowEnd; ++i)
+		{
+			uint32* stack = &indices[(size_t)i*sliceCount*6];
+			for(uint32 j = 0; j < sliceCount; ++j)
+			{
+				*stack++ = i*ringVertexCount + j;
+				*stack++ = (i+1)*ringVertexCount + j;
+				*stack++ = (i+1)*ringVertexCount + j+1;
+
+				*stack++ = i*ringVertexCount + j;
+				*stack++ = (i+1)*ringVertexCount + j+1;
+				*stack++ = i*ringVertexCount + j+1;
+			}
+		}
+	});
+
+	BuildCylinderCap<Attributes>(topRadius, 0.5f*height, height, sliceCount, true,
+		vertices.data(), stackVertexCount, &indices[stackIndexCount], makeVertex);
+	BuildCylinderCap<Attributes>(bottomRadius, -0.5f*height, height, sliceCount, false,
+		vertices.data(), stackVertexCount + capVertexCount, &indices[stackIndexCount + capIndexCount], makeVertex);
+}
+
+template<GeometryGenerator::uint32 Attributes, typename OutVertex, typename MakeVertex>
+void GeometryGenerator::BuildCylinderCap(float radius, float y, float height, uint32 sliceCount, bool isTop,
+	OutVertex* vertices, uint32 baseIndex, uint32* indices, MakeVertex& makeVertex)
+{
+	using namespace DirectX;
+
+	float ny = isTop ? 1.0f : -1.0f;
+
+	// Duplicate cap ring vertices because the texture coordinates and normals differ.
+	float dTheta = 2.0f*XM_PI/sliceCount;
+	for(uint32 i = 0; i <= sliceCount; ++i)
+	{
+		float x = radius*cosf(i*dTheta);
+		float z = radius*sinf(i*dTheta);
+
+		// Scale down by the height to try and make top cap texture coord area
+		// proportional to base.
+		float u = x/height + 0.5f;
+		float v = z/height + 0.5f;
+
+		vertices[baseIndex + i] = makeVertex(KeepAttributes<Attributes>(Vertex(x, y, z, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, u, v)));
+	}
+
+	// Cap center vertex.
+	uint32 centerIndex = baseIndex + sliceCount + 1;
+	vertices[centerIndex] = makeVertex(KeepAttributes<Attributes>(Vertex(0.0f, y, 0.0f, 0.0f, ny, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f)));
+
+	// The top cap faces up and the bottom one down, so they wind in opposite directions.
+	for(uint32 i = 0; i < sliceCount; ++i)
+	{
+		*indices++ = centerIndex;
+		*indices++ = isTop ? baseIndex + i+1 : baseIndex + i;
+		*indices++ = isTop ? baseIndex + i : baseIndex + i+1;
+	}
+}
+
+template<GeometryGenerator::uint32 Attributes, typename OutVertex, typename MakeVertex>
+void GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n,
+	std::vector<OutVertex>& vertices, std::vector<uint32>& indices, MakeVertex makeVertex)
+{
+	using namespace DirectX;
+
+	uint32 vertexCount = m*n;
+	uint32 faceCount   = (m-1)*(n-1)*2;
+
+	//
+	// Create the vertices.
+	//
+
+	float halfWidth = 0.5f*width;
+	float halfDepth = 0.5f*depth;
+
+	float dx = width / (n-1);
+	float dz = depth / (m-1);
+
+	float du = 1.0f / (n-1);
+	float dv = 1.0f / (m-1);
+
+	vertices.resize(vertexCount);
+	ForEachRow(m, n, [&](uint32 rowBegin, uint32 rowEnd)
+	{
+		Vertex v = KeepAttributes<Attributes>(Vertex(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+		for(uint32 i = rowBegin; i < rowEnd; ++i)
+		{
+			float z = halfDepth - i*dz;
+			for(uint32 j = 0; j < n; ++j)
+			{
+				float x = -halfWidth + j*dx;
+
+				if(Attributes & StreamPosition)
+					v.Position = XMFLOAT3(x, 0.0f, z);
+
+				// Stretch texture over grid.
+				if(Attributes & StreamTexC)
+				{
+					v.TexC.x = j*du;
+					v.TexC.y = i*dv;
+				}
+
+				vertices[(size_t)i*n+j] = makeVertex(v);
+			}
+		}
+	});
+
+    //
+	// Create the indices.
+	//
+
+	indices.resize((size_t)faceCount*3); // 3 indices per face
+
+	// Iterate over each quad and compute indices.  Each row of quads owns a fixed
+	// range of the index buffer, so rows can be filled independently.
+	ForEachRow(m-1, n, [&](uint32 rowBegin, uint32 rowEnd)
+	{
+		for(uint32 i = rowBegin; i < rowEnd; ++i)
+		{
+			size_t k = (size_t)i*(n-1)*6;
+			for(uint32 j = 0; j < n-1; ++j)
+			{
+				indices[k]   = i*n+j;
+				indices[k+1] = i*n+j+1;
+				indices[k+2] = (i+1)*n+j;
+
+				indices[k+3] = (i+1)*n+j;
+				indices[k+4] = i*n+j+1;
+				indices[k+5] = (i+1)*n+j+1;
+
+				k += 6; // next quad
+			}
+		}
+	});
+}
+
+template<GeometryGenerator::uint32 Attributes>
+GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
+{
+	MeshData meshData;
+	CreateBox<Attributes>(width, height, depth, numSubdivisions, meshData.Vertices, meshData.Indices32, [](const Vertex& v) { return v; });
+	return meshData;
+}
+
+template<GeometryGenerator::uint32 Attributes>
+GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
+{
+	MeshData meshData;
+	CreateSphere<Attributes>(radius, sliceCount, stackCount, meshData.Vertices, meshData.Indices32, [](const Vertex& v) { return v; });
+	return meshData;
+}
+
+template<GeometryGenerator::uint32 Attributes>
+GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
+{
+	MeshData meshData;
+	CreateGeosphere<Attributes>(radius, numSubdivisions, meshData.Vertices, meshData.Indices32, [](const Vertex& v) { return v; });
+	return meshData;
+}
+
+template<GeometryGenerator::uint32 Attributes>
+GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
+{
+	MeshData meshData;
+	CreateCylinder<Attributes>(bottomRadius, topRadius, height, sliceCount, stackCount, meshData.Vertices, meshData.Indices32, [](const Vertex& v) { return v; });
+	return meshData;
+}
+
+template<GeometryGenerator::uint32 Attributes>
+GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
+{
+	MeshData meshData;
+	CreateGrid<Attributes>(width, depth, m, n, meshData.Vertices, meshData.Indices32, [](const Vertex& v) { return v; });
+	return meshData;
+}
@@ -55,6 +55,26 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Pointer to the mapped elements starting at elementIndex, for writing runs of them in
+    // place. Only for buffers that are not constant buffers, whose elements are tightly packed.
+    T* MappedData(int elementIndex)
+    {
+        assert(!mIsConstantBuffer);
+        return reinterpret_cast<T*>(&mMappedData[elementIndex*mElementByteSize]);
+    }
+
+    // Start of the mapped elements and the distance between them, for writing constant buffer
+    // elements in place
+    BYTE* MappedBytes()
+    {
+        return mMappedData;
+    }
+
+    UINT ElementByteSize()const
+    {
+        return mElementByteSize;
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
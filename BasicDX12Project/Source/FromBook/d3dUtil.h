@@ -142,6 +142,15 @@ public:
     int LineNumber = -1;
 };
 
+// A part of a submesh's index range drawn with its own BaseVertexLocation, so meshes
+// that address more than 65536 vertices can still use 16-bit indices.
+struct IndexChunk
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	INT BaseVertexLocation = 0;
+};
+
 // Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
 // geometries are stored in one vertex and index buffer.  It provides the offsets
 // and data needed to draw a subset of geometry stores in the vertex and index 
@@ -155,6 +164,17 @@ struct SubmeshGeometry
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// Bounding sphere of the same geometry, centered on Bounds.
+	DirectX::BoundingSphere Sphere;
+
+	// The draws that make up the index range when it had to be split (see IndexPacker).
+	// Empty when one draw with the values above covers the submesh.
+	std::vector<IndexChunk> Chunks;
+
+	// Format of the submesh's indices when its buffer mixes 16 and 32-bit ones (see IndexPacker).
+	// DXGI_FORMAT_UNKNOWN for the buffer's MeshGeometry::IndexFormat.
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_UNKNOWN;
 };
 
 struct MeshGeometry
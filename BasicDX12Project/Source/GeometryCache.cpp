@@ -0,0 +1,344 @@
+#include "GeometryCache.h"
+#include "MeshBounds.h"
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	void HashCombine(std::uint64_t& hash, std::uint32_t value)
+	{
+		// FNV-1a over the bytes of value
+		for (int i = 0; i < 4; ++i)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	}
+
+	std::uint32_t FloatBits(float value)
+	{
+		// -0 and 0 compare equal, so they have to hash the same
+		if (value == 0.0f)
+		{
+			value = 0.0f;
+		}
+
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	GeometryKey MakeKey(GeometryShape shape, std::array<float, 3> dimensions, std::array<GeometryGenerator::uint32, 2> tessellation,
+		VertexFormat format, const XMFLOAT4& color)
+	{
+		GeometryKey key;
+		key.Shape = shape;
+		key.Dimensions = dimensions;
+		key.Tessellation = tessellation;
+		key.Format = format;
+		key.Color = color;
+		return key;
+	}
+}
+
+//=========================================================================================
+GeometryKey GeometryKey::Box(float width, float height, float depth, GeometryGenerator::uint32 numSubdivisions,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return MakeKey(GeometryShape::Box, { width, height, depth }, { numSubdivisions, 0 }, format, color);
+}
+
+//=========================================================================================
+GeometryKey GeometryKey::Sphere(float radius, GeometryGenerator::uint32 sliceCount, GeometryGenerator::uint32 stackCount,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return MakeKey(GeometryShape::Sphere, { radius, 0.0f, 0.0f }, { sliceCount, stackCount }, format, color);
+}
+
+//=========================================================================================
+GeometryKey GeometryKey::Geosphere(float radius, GeometryGenerator::uint32 numSubdivisions,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return MakeKey(GeometryShape::Geosphere, { radius, 0.0f, 0.0f }, { numSubdivisions, 0 }, format, color);
+}
+
+//=========================================================================================
+GeometryKey GeometryKey::Cylinder(float bottomRadius, float topRadius, float height, GeometryGenerator::uint32 sliceCount, GeometryGenerator::uint32 stackCount,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return MakeKey(GeometryShape::Cylinder, { bottomRadius, topRadius, height }, { sliceCount, stackCount }, format, color);
+}
+
+//=========================================================================================
+GeometryKey GeometryKey::Grid(float width, float depth, GeometryGenerator::uint32 m, GeometryGenerator::uint32 n,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return MakeKey(GeometryShape::Grid, { width, depth, 0.0f }, { m, n }, format, color);
+}
+
+//=========================================================================================
+bool GeometryKey::operator==(const GeometryKey& rhs) const
+{
+	return Shape == rhs.Shape && Dimensions == rhs.Dimensions && Tessellation == rhs.Tessellation && Format == rhs.Format &&
+		Color.x == rhs.Color.x && Color.y == rhs.Color.y && Color.z == rhs.Color.z && Color.w == rhs.Color.w;
+}
+
+//=========================================================================================
+GeometryKey GeometryKey::GetMeshKey() const
+{
+	return MakeKey(Shape, Dimensions, Tessellation, VertexFormat::FullPrecision, GeometryKey().Color);
+}
+
+//=========================================================================================
+size_t GeometryKeyHash::operator()(const GeometryKey& key) const
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	HashCombine(hash, (std::uint32_t)key.Shape);
+	for (float dimension : key.Dimensions)
+	{
+		HashCombine(hash, FloatBits(dimension));
+	}
+	for (GeometryGenerator::uint32 tessellation : key.Tessellation)
+	{
+		HashCombine(hash, tessellation);
+	}
+	HashCombine(hash, (std::uint32_t)key.Format);
+	HashCombine(hash, FloatBits(key.Color.x));
+	HashCombine(hash, FloatBits(key.Color.y));
+	HashCombine(hash, FloatBits(key.Color.z));
+	HashCombine(hash, FloatBits(key.Color.w));
+	return (size_t)hash;
+}
+
+//=========================================================================================
+void GeometryCache::SetThreadPool(ThreadPool* threadPool)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	Generator.SetThreadPool(threadPool);
+	Pool = threadPool;
+}
+
+//=========================================================================================
+void GeometryCache::SetPrepareFunction(PrepareFunction prepare)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	Prepare = std::move(prepare);
+	Entries.clear();
+	Meshes.clear();
+	Submeshes.clear();
+}
+
+//=========================================================================================
+void GeometryCache::SetPositionOnly(bool positionOnly)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	PositionOnly = positionOnly;
+	Entries.clear();
+	Meshes.clear();
+	Submeshes.clear();
+}
+
+//=========================================================================================
+std::shared_ptr<const CachedGeometry> GeometryCache::GetBox(float width, float height, float depth, uint32 numSubdivisions,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return Get(GeometryKey::Box(width, height, depth, numSubdivisions, format, color));
+}
+
+//=========================================================================================
+std::shared_ptr<const CachedGeometry> GeometryCache::GetSphere(float radius, uint32 sliceCount, uint32 stackCount,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return Get(GeometryKey::Sphere(radius, sliceCount, stackCount, format, color));
+}
+
+//=========================================================================================
+std::shared_ptr<const CachedGeometry> GeometryCache::GetGeosphere(float radius, uint32 numSubdivisions,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return Get(GeometryKey::Geosphere(radius, numSubdivisions, format, color));
+}
+
+//=========================================================================================
+std::shared_ptr<const CachedGeometry> GeometryCache::GetCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return Get(GeometryKey::Cylinder(bottomRadius, topRadius, height, sliceCount, stackCount, format, color));
+}
+
+//=========================================================================================
+std::shared_ptr<const CachedGeometry> GeometryCache::GetGrid(float width, float depth, uint32 m, uint32 n,
+	VertexFormat format, const XMFLOAT4& color)
+{
+	return Get(GeometryKey::Grid(width, depth, m, n, format, color));
+}
+
+//=========================================================================================
+std::shared_ptr<const CachedGeometry> GeometryCache::Get(const GeometryKey& key)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+
+	auto found = Entries.find(key);
+	if (found != Entries.end())
+	{
+		++Stats.Hits;
+		return found->second;
+	}
+
+	++Stats.Misses;
+
+	std::shared_ptr<CachedGeometry> entry = std::make_shared<CachedGeometry>();
+	entry->Key = key;
+	entry->Mesh = GetMesh(key.GetMeshKey());
+
+	const std::vector<GeometryGenerator::Vertex>& vertices = entry->Mesh->Vertices;
+	const XMFLOAT3* positions = vertices.empty() ? nullptr : &vertices[0].Position;
+	entry->Bounds = MeshBounds::ComputeBox(positions, vertices.size(), sizeof(GeometryGenerator::Vertex), Pool);
+	entry->Sphere = MeshBounds::ComputeSphere(positions, vertices.size(), sizeof(GeometryGenerator::Vertex), entry->Bounds, Pool);
+
+	entry->Vertices.resize(entry->Mesh->Vertices.size() * VertexCompression::GetVertexStride(key.Format));
+	if (!entry->Vertices.empty())
+	{
+		VertexCompression::EncodeColorVertices(key.Format, entry->Mesh->Vertices, key.Color, entry->Bounds, entry->Vertices.data());
+	}
+
+	Entries[key] = entry;
+	return entry;
+}
+
+//=========================================================================================
+std::shared_ptr<const GeometryGenerator::MeshData> GeometryCache::GetMesh(const GeometryKey& meshKey)
+{
+	auto found = Meshes.find(meshKey);
+	if (found != Meshes.end())
+	{
+		return found->second;
+	}
+
+	++Stats.MeshesGenerated;
+
+	// Generated straight into the mesh that is stored, there is no copy of the vertices
+	std::shared_ptr<GeometryGenerator::MeshData> mesh = std::make_shared<GeometryGenerator::MeshData>();
+	if (PositionOnly)
+	{
+		Generate<GeometryGenerator::StreamPosition>(meshKey, *mesh);
+	}
+	else
+	{
+		Generate<GeometryGenerator::StreamAll>(meshKey, *mesh);
+	}
+
+	if (Prepare)
+	{
+		Prepare(*mesh);
+	}
+
+	Meshes[meshKey] = mesh;
+	return mesh;
+}
+
+//=========================================================================================
+template <GeometryGenerator::uint32 Attributes>
+void GeometryCache::Generate(const GeometryKey& meshKey, GeometryGenerator::MeshData& mesh)
+{
+	const std::array<float, 3>& d = meshKey.Dimensions;
+	const std::array<uint32, 2>& t = meshKey.Tessellation;
+	auto keepVertex = [](const GeometryGenerator::Vertex& v) { return v; };
+
+	switch (meshKey.Shape)
+	{
+		case GeometryShape::Box:
+			Generator.CreateBox<Attributes>(d[0], d[1], d[2], t[0], mesh.Vertices, mesh.Indices32, keepVertex);
+			break;
+		case GeometryShape::Sphere:
+			Generator.CreateSphere<Attributes>(d[0], t[0], t[1], mesh.Vertices, mesh.Indices32, keepVertex);
+			break;
+		case GeometryShape::Geosphere:
+			Generator.CreateGeosphere<Attributes>(d[0], t[0], mesh.Vertices, mesh.Indices32, keepVertex);
+			break;
+		case GeometryShape::Cylinder:
+			Generator.CreateCylinder<Attributes>(d[0], d[1], d[2], t[0], t[1], mesh.Vertices, mesh.Indices32, keepVertex);
+			break;
+		case GeometryShape::Grid:
+			Generator.CreateGrid<Attributes>(d[0], d[1], t[0], t[1], mesh.Vertices, mesh.Indices32, keepVertex);
+			break;
+	}
+}
+
+//=========================================================================================
+bool GeometryCache::FindSubmesh(const GeometryKey& key, MeshGeometry** geometry, SubmeshGeometry* submesh)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+
+	auto found = Submeshes.find(key);
+	if (found == Submeshes.end())
+	{
+		return false;
+	}
+
+	++Stats.SubmeshHits;
+	*geometry = found->second.Geometry;
+	*submesh = found->second.Submesh;
+	return true;
+}
+
+//=========================================================================================
+void GeometryCache::RegisterSubmesh(const GeometryKey& key, MeshGeometry* geometry, const SubmeshGeometry& submesh)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+
+	SubmeshLocation& location = Submeshes[key];
+	location.Geometry = geometry;
+	location.Submesh = submesh;
+}
+
+//=========================================================================================
+void GeometryCache::UnregisterGeometry(const MeshGeometry* geometry)
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+
+	for (auto it = Submeshes.begin(); it != Submeshes.end();)
+	{
+		if (it->second.Geometry == geometry)
+		{
+			it = Submeshes.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+//=========================================================================================
+void GeometryCache::Clear()
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+	Entries.clear();
+	Meshes.clear();
+	Submeshes.clear();
+}
+
+//=========================================================================================
+GeometryCacheStats GeometryCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(Mutex);
+
+	GeometryCacheStats stats = Stats;
+	stats.EntryCount = Entries.size();
+	stats.MeshCount = Meshes.size();
+	stats.SubmeshCount = Submeshes.size();
+
+	for (const auto& mesh : Meshes)
+	{
+		stats.MeshBytes += mesh.second->Vertices.size() * sizeof(GeometryGenerator::Vertex) +
+			mesh.second->Indices32.size() * sizeof(uint32);
+	}
+	for (const auto& entry : Entries)
+	{
+		stats.EncodedVertexBytes += entry.second->Vertices.size();
+	}
+
+	return stats;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "FromBook/d3dUtil.h"
+#include "FromBook/GeometryGenerator.h"
+#include "VertexCompression.h"
+
+// Shapes GeometryGenerator can build
+enum class GeometryShape
+{
+	Box,
+	Sphere,
+	Geosphere,
+	Cylinder,
+	Grid
+};
+
+// Everything that determines a cached mesh and its encoded vertices
+struct GeometryKey
+{
+	GeometryShape Shape = GeometryShape::Box;
+
+	// Parameters in the order the GeometryGenerator function takes them, unused ones are 0
+	std::array<float, 3> Dimensions = {};
+	std::array<GeometryGenerator::uint32, 2> Tessellation = {};
+
+	// Encoding of the vertices, with the color baked into them
+	VertexFormat Format = VertexFormat::FullPrecision;
+	DirectX::XMFLOAT4 Color = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+	// Keys of the GeometryGenerator shapes, taking the same parameters
+	static GeometryKey Box(float width, float height, float depth, GeometryGenerator::uint32 numSubdivisions,
+		VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+	static GeometryKey Sphere(float radius, GeometryGenerator::uint32 sliceCount, GeometryGenerator::uint32 stackCount,
+		VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+	static GeometryKey Geosphere(float radius, GeometryGenerator::uint32 numSubdivisions,
+		VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+	static GeometryKey Cylinder(float bottomRadius, float topRadius, float height, GeometryGenerator::uint32 sliceCount, GeometryGenerator::uint32 stackCount,
+		VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+	static GeometryKey Grid(float width, float depth, GeometryGenerator::uint32 m, GeometryGenerator::uint32 n,
+		VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+
+	bool operator==(const GeometryKey& rhs) const;
+
+	// The same shape and parameters with the default encoding, which every encoding of the
+	// shape shares the generated mesh under
+	GeometryKey GetMeshKey() const;
+};
+
+struct GeometryKeyHash
+{
+	size_t operator()(const GeometryKey& key) const;
+};
+
+// Immutable result of a cache lookup, shared by everyone who asks for the same key
+struct CachedGeometry
+{
+	GeometryKey Key;
+
+	// Shared between all vertex formats and colors of the shape
+	std::shared_ptr<const GeometryGenerator::MeshData> Mesh;
+	DirectX::BoundingBox Bounds;
+	DirectX::BoundingSphere Sphere;
+
+	// Mesh vertices encoded with Key.Format and Key.Color
+	std::vector<BYTE> Vertices;
+};
+
+struct GeometryCacheStats
+{
+	std::uint64_t Hits = 0;
+	std::uint64_t Misses = 0;
+
+	// Misses that had to run the generator, the rest reused a mesh of another encoding
+	std::uint64_t MeshesGenerated = 0;
+
+	// FindSubmesh calls that found a submesh already uploaded in some MeshGeometry
+	std::uint64_t SubmeshHits = 0;
+
+	size_t EntryCount = 0;
+	size_t MeshCount = 0;
+	size_t SubmeshCount = 0;
+
+	// CPU memory held by the generated meshes (vertices and 32-bit indices) and by the
+	// encoded vertex streams
+	size_t MeshBytes = 0;
+	size_t EncodedVertexBytes = 0;
+};
+
+// Memoizes procedural geometry by generator parameters, so asking for the same shape again
+// costs a hash lookup instead of a regeneration. Also remembers which MeshGeometry holds
+// the uploaded submesh of a key, so GPU buffers are not duplicated between geometries.
+// All functions are thread safe.
+class GeometryCache
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+		using PrepareFunction = std::function<void(GeometryGenerator::MeshData&)>;
+
+		void SetThreadPool(ThreadPool* threadPool);
+
+		// Runs once on every newly generated mesh before it is stored and encoded, for
+		// example to optimize it. Clears the cache since its meshes were prepared differently.
+		void SetPrepareFunction(PrepareFunction prepare);
+
+		// Generates only the positions of the meshes, their normals, tangents and texture
+		// coordinates are left zero and cost nothing to build. For users that never read
+		// them, like the color vertex formats. Clears the cache.
+		void SetPositionOnly(bool positionOnly);
+
+		std::shared_ptr<const CachedGeometry> GetBox(float width, float height, float depth, uint32 numSubdivisions,
+			VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+		std::shared_ptr<const CachedGeometry> GetSphere(float radius, uint32 sliceCount, uint32 stackCount,
+			VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+		std::shared_ptr<const CachedGeometry> GetGeosphere(float radius, uint32 numSubdivisions,
+			VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+		std::shared_ptr<const CachedGeometry> GetCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+			VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+		std::shared_ptr<const CachedGeometry> GetGrid(float width, float depth, uint32 m, uint32 n,
+			VertexFormat format = VertexFormat::FullPrecision, const DirectX::XMFLOAT4& color = { 1.0f, 1.0f, 1.0f, 1.0f });
+
+		std::shared_ptr<const CachedGeometry> Get(const GeometryKey& key);
+
+		// Looks up the MeshGeometry and submesh an earlier RegisterSubmesh stored for the key
+		bool FindSubmesh(const GeometryKey& key, MeshGeometry** geometry, SubmeshGeometry* submesh);
+		void RegisterSubmesh(const GeometryKey& key, MeshGeometry* geometry, const SubmeshGeometry& submesh);
+
+		// Forgets the submeshes of a MeshGeometry that is about to be released
+		void UnregisterGeometry(const MeshGeometry* geometry);
+
+		// Drops every entry. Meshes still referenced elsewhere stay alive until released.
+		void Clear();
+
+		GeometryCacheStats GetStats() const;
+
+	private:
+		std::shared_ptr<const GeometryGenerator::MeshData> GetMesh(const GeometryKey& meshKey);
+
+		template <GeometryGenerator::uint32 Attributes>
+		void Generate(const GeometryKey& meshKey, GeometryGenerator::MeshData& mesh);
+
+	private:
+		struct SubmeshLocation
+		{
+			MeshGeometry* Geometry = nullptr;
+			SubmeshGeometry Submesh;
+		};
+
+		mutable std::mutex Mutex;
+
+		GeometryGenerator Generator;
+		ThreadPool* Pool = nullptr;
+		PrepareFunction Prepare;
+		bool PositionOnly = false;
+
+		std::unordered_map<GeometryKey, std::shared_ptr<const CachedGeometry>, GeometryKeyHash> Entries;
+		std::unordered_map<GeometryKey, std::shared_ptr<const GeometryGenerator::MeshData>, GeometryKeyHash> Meshes;
+		std::unordered_map<GeometryKey, SubmeshLocation, GeometryKeyHash> Submeshes;
+
+		GeometryCacheStats Stats;
+};
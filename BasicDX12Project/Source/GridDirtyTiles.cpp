@@ -0,0 +1,142 @@
+#include "GridDirtyTiles.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace DirectX;
+
+const GridDirtyTiles::uint32 GridDirtyTiles::kTileSize;
+
+namespace
+{
+	// Tiles handed to a thread at once
+	const size_t kMinTilesPerTask = 4;
+}
+
+//=========================================================================================
+GridDirtyTiles::GridDirtyTiles(uint32 rowCount, uint32 columnCount)
+: RowCount(rowCount)
+, ColumnCount(columnCount)
+, TileRowCount((rowCount + kTileSize - 1) / kTileSize)
+, TileColumnCount((columnCount + kTileSize - 1) / kTileSize)
+{
+	IsTileDirty.assign(GetTileCount(), false);
+}
+
+//=========================================================================================
+GridDirtyTiles::uint32 GridDirtyTiles::GetRowCount() const
+{
+	return RowCount;
+}
+
+//=========================================================================================
+GridDirtyTiles::uint32 GridDirtyTiles::GetColumnCount() const
+{
+	return ColumnCount;
+}
+
+//=========================================================================================
+GridDirtyTiles::uint32 GridDirtyTiles::GetTileCount() const
+{
+	return TileRowCount * TileColumnCount;
+}
+
+//=========================================================================================
+void GridDirtyTiles::MarkRect(uint32 firstRow, uint32 lastRow, uint32 firstColumn, uint32 lastColumn)
+{
+	lastRow = std::min<uint32>(lastRow, RowCount);
+	lastColumn = std::min<uint32>(lastColumn, ColumnCount);
+	if (firstRow >= lastRow || firstColumn >= lastColumn)
+	{
+		return;
+	}
+
+	for (uint32 tileRow = firstRow / kTileSize; tileRow <= (lastRow - 1) / kTileSize; ++tileRow)
+	{
+		for (uint32 tileColumn = firstColumn / kTileSize; tileColumn <= (lastColumn - 1) / kTileSize; ++tileColumn)
+		{
+			uint32 tile = tileRow * TileColumnCount + tileColumn;
+			if (!IsTileDirty[tile])
+			{
+				IsTileDirty[tile] = true;
+				DirtyTiles.push_back(tile);
+			}
+		}
+	}
+}
+
+//=========================================================================================
+void GridDirtyTiles::MarkVertex(uint32 row, uint32 column)
+{
+	MarkRect(row > 0 ? row - 1 : 0, row + 2, column > 0 ? column - 1 : 0, column + 2);
+}
+
+//=========================================================================================
+void GridDirtyTiles::MarkAll()
+{
+	MarkRect(0, RowCount, 0, ColumnCount);
+}
+
+//=========================================================================================
+void GridDirtyTiles::Clear()
+{
+	for (uint32 tile : DirtyTiles)
+	{
+		IsTileDirty[tile] = false;
+	}
+	DirtyTiles.clear();
+}
+
+//=========================================================================================
+const std::vector<GridDirtyTiles::uint32>& GridDirtyTiles::GetDirtyTiles() const
+{
+	return DirtyTiles;
+}
+
+//=========================================================================================
+void GridDirtyTiles::GetTileRect(uint32 tile, uint32& firstRow, uint32& lastRow, uint32& firstColumn, uint32& lastColumn) const
+{
+	firstRow = (tile / TileColumnCount) * kTileSize;
+	firstColumn = (tile % TileColumnCount) * kTileSize;
+	lastRow = std::min<uint32>(firstRow + kTileSize, RowCount);
+	lastColumn = std::min<uint32>(firstColumn + kTileSize, ColumnCount);
+}
+
+//=========================================================================================
+void GridDirtyTiles::UpdateFrames(GeometryGenerator::MeshData& grid, ThreadPool* threadPool)
+{
+	std::vector<GeometryGenerator::Vertex>& vertices = grid.Vertices;
+
+	// Central differences, one-sided on the border. Along a row x grows, down a column z
+	// shrinks, so the normal is (towards -row) x (towards +column).
+	auto updateTiles = [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; ++t)
+		{
+			uint32 firstRow, lastRow, firstColumn, lastColumn;
+			GetTileRect(DirtyTiles[t], firstRow, lastRow, firstColumn, lastColumn);
+
+			for (uint32 i = firstRow; i < lastRow; ++i)
+			{
+				const GeometryGenerator::Vertex* up = &vertices[(size_t)(i > 0 ? i - 1 : i) * ColumnCount];
+				const GeometryGenerator::Vertex* down = &vertices[(size_t)(i + 1 < RowCount ? i + 1 : i) * ColumnCount];
+				GeometryGenerator::Vertex* row = &vertices[(size_t)i * ColumnCount];
+
+				for (uint32 j = firstColumn; j < lastColumn; ++j)
+				{
+					uint32 left = j > 0 ? j - 1 : j;
+					uint32 right = j + 1 < ColumnCount ? j + 1 : j;
+
+					XMVECTOR alongRow = XMVectorSubtract(XMLoadFloat3(&row[right].Position), XMLoadFloat3(&row[left].Position));
+					XMVECTOR alongColumn = XMVectorSubtract(XMLoadFloat3(&up[j].Position), XMLoadFloat3(&down[j].Position));
+
+					XMStoreFloat3(&row[j].Normal, XMVector3Normalize(XMVector3Cross(alongColumn, alongRow)));
+					XMStoreFloat3(&row[j].TangentU, XMVector3Normalize(alongRow));
+				}
+			}
+		}
+	};
+
+	ThreadPool::ParallelFor(threadPool, 0, DirtyTiles.size(), kMinTilesPerTask, updateTiles);
+
+	Clear();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "FromBook/GeometryGenerator.h"
+
+class ThreadPool;
+
+// Tracks which parts of a rowCount x columnCount vertex grid (the layout of
+// GeometryGenerator::CreateGrid) need their normals and tangents recomputed after the heights
+// changed. The grid is split into square tiles; marking is done per vertex rectangle and
+// whole tiles are recomputed, so the cost follows the changed area instead of the grid size.
+class GridDirtyTiles
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		// Vertices per tile side
+		static const uint32 kTileSize = 32;
+
+		GridDirtyTiles(uint32 rowCount, uint32 columnCount);
+
+		uint32 GetRowCount() const;
+		uint32 GetColumnCount() const;
+		uint32 GetTileCount() const;
+
+		// Marks the vertices [firstRow, lastRow) x [firstColumn, lastColumn), clipped to the grid
+		void MarkRect(uint32 firstRow, uint32 lastRow, uint32 firstColumn, uint32 lastColumn);
+
+		// Marks the vertices whose normal depends on the position of the vertex, as the 3x3
+		// block around it
+		void MarkVertex(uint32 row, uint32 column);
+
+		void MarkAll();
+		void Clear();
+
+		// Dirty tiles in the order they were marked
+		const std::vector<uint32>& GetDirtyTiles() const;
+
+		// Vertex rectangle [firstRow, lastRow) x [firstColumn, lastColumn) of a tile
+		void GetTileRect(uint32 tile, uint32& firstRow, uint32& lastRow, uint32& firstColumn, uint32& lastColumn) const;
+
+		// Recomputes the normals and tangents of the vertices in the dirty tiles of a grid
+		// MeshData from the positions around them, then clears the tiles. Tiles are spread
+		// across the pool when there is one.
+		void UpdateFrames(GeometryGenerator::MeshData& grid, ThreadPool* threadPool = nullptr);
+
+	private:
+		uint32 RowCount = 0;
+		uint32 ColumnCount = 0;
+		uint32 TileRowCount = 0;
+		uint32 TileColumnCount = 0;
+
+		std::vector<bool> IsTileDirty;
+		std::vector<uint32> DirtyTiles;
+};
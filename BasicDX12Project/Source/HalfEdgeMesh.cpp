@@ -0,0 +1,364 @@
+#include "HalfEdgeMesh.h"
+#include <algorithm>
+#include <cmath>
+
+const HalfEdgeMesh::uint32 HalfEdgeMesh::kInvalid;
+
+namespace
+{
+	using uint32 = HalfEdgeMesh::uint32;
+
+	// Vertices closer than this fraction of the mesh size are treated as one position
+	const double kWeldTolerance = 1e-5;
+
+	// Stable sort of items by key(item) < keyCount, O(items + keyCount)
+	template <typename Key>
+	void CountingSort(const std::vector<uint32>& items, std::vector<uint32>& sorted, std::vector<uint32>& counts, uint32 keyCount, Key key)
+	{
+		counts.assign(keyCount + 1, 0);
+		for (uint32 item : items)
+		{
+			++counts[key(item) + 1];
+		}
+		for (uint32 k = 0; k < keyCount; ++k)
+		{
+			counts[k + 1] += counts[k];
+		}
+
+		sorted.resize(items.size());
+		for (uint32 item : items)
+		{
+			sorted[counts[key(item)]++] = item;
+		}
+	}
+
+	// Welded vertex of every vertex, numbered in order of first appearance
+	std::vector<uint32> WeldPositions(const std::vector<GeometryGenerator::Vertex>& vertices, uint32& weldedCount)
+	{
+		// The generators compute seam and rim vertices separately, so the copies can differ in
+		// the last bits and are matched on a grid fine enough to keep distinct vertices apart
+		float extent = 0.0f;
+		for (const GeometryGenerator::Vertex& v : vertices)
+		{
+			extent = std::max({ extent, fabsf(v.Position.x), fabsf(v.Position.y), fabsf(v.Position.z) });
+		}
+		const double weldScale = extent > 0.0f ? 1.0 / (extent * kWeldTolerance) : 1.0;
+		const double weldOffset = 1.0 / kWeldTolerance;
+
+		std::vector<uint32> keys(vertices.size() * 3);
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const DirectX::XMFLOAT3& p = vertices[i].Position;
+			keys[i * 3 + 0] = (uint32)llround(p.x * weldScale + weldOffset);
+			keys[i * 3 + 1] = (uint32)llround(p.y * weldScale + weldOffset);
+			keys[i * 3 + 2] = (uint32)llround(p.z * weldScale + weldOffset);
+		}
+
+		// Radix sort by the grid cell, 16 bits at a time. Being stable, equal cells end up in
+		// runs that start with their lowest vertex.
+		std::vector<uint32> order(vertices.size());
+		for (uint32 i = 0; i < (uint32)order.size(); ++i)
+		{
+			order[i] = i;
+		}
+
+		std::vector<uint32> sorted;
+		std::vector<uint32> counts;
+		for (int pass = 0; pass < 6; ++pass)
+		{
+			int component = 2 - pass / 2;
+			int shift = (pass % 2) * 16;
+			CountingSort(order, sorted, counts, 0x10000, [&](uint32 v) { return (keys[v * 3 + component] >> shift) & 0xFFFF; });
+			order.swap(sorted);
+		}
+
+		std::vector<uint32> first(vertices.size());
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			bool isSame = i > 0 && std::equal(&keys[order[i] * 3], &keys[order[i] * 3] + 3, &keys[order[i - 1] * 3]);
+			first[order[i]] = isSame ? first[order[i - 1]] : order[i];
+		}
+
+		std::vector<uint32> remap(vertices.size());
+		weldedCount = 0;
+		for (uint32 v = 0; v < (uint32)vertices.size(); ++v)
+		{
+			remap[v] = first[v] == v ? weldedCount++ : remap[first[v]];
+		}
+		return remap;
+	}
+}
+
+//=========================================================================================
+HalfEdgeMesh::HalfEdgeMesh(const GeometryGenerator::MeshData& meshData, bool weldPositions)
+{
+	uint32 vertexCount = (uint32)meshData.Vertices.size();
+	size_t halfEdgeCount = meshData.Indices32.size() / 3 * 3;
+
+	if (weldPositions)
+	{
+		VertexRemap = WeldPositions(meshData.Vertices, vertexCount);
+		MeshCorners.assign(meshData.Indices32.begin(), meshData.Indices32.begin() + halfEdgeCount);
+
+		Origins.resize(halfEdgeCount);
+		for (size_t h = 0; h < halfEdgeCount; ++h)
+		{
+			Origins[h] = VertexRemap[MeshCorners[h]];
+		}
+	}
+	else
+	{
+		Origins.assign(meshData.Indices32.begin(), meshData.Indices32.begin() + halfEdgeCount);
+	}
+
+	Outgoing.resize(vertexCount);
+	BuildTwins();
+	BuildOutgoing();
+}
+
+//=========================================================================================
+void HalfEdgeMesh::BuildTwins()
+{
+	uint32 halfEdgeCount = GetHalfEdgeCount();
+	uint32 vertexCount = GetVertexCount();
+	Twins.assign(halfEdgeCount, kInvalid);
+
+	std::vector<uint32> halfEdges;
+	halfEdges.reserve(halfEdgeCount);
+	for (uint32 h = 0; h < halfEdgeCount; ++h)
+	{
+		// Degenerate edges have nothing to pair with
+		if (GetOrigin(h) != GetTarget(h))
+		{
+			halfEdges.push_back(h);
+		}
+	}
+
+	// Sort by the larger then (stably) by the smaller vertex of the edge, so both directions
+	// of an edge end up next to each other
+	std::vector<uint32> sorted;
+	std::vector<uint32> counts;
+	CountingSort(halfEdges, sorted, counts, vertexCount, [this](uint32 h) { return std::max<uint32>(GetOrigin(h), GetTarget(h)); });
+	CountingSort(sorted, halfEdges, counts, vertexCount, [this](uint32 h) { return std::min<uint32>(GetOrigin(h), GetTarget(h)); });
+
+	NonManifoldEdgeCount = 0;
+	for (size_t i = 0; i < halfEdges.size();)
+	{
+		uint32 h = halfEdges[i];
+		uint32 low = std::min<uint32>(GetOrigin(h), GetTarget(h));
+		uint32 high = std::max<uint32>(GetOrigin(h), GetTarget(h));
+
+		size_t runEnd = i + 1;
+		while (runEnd < halfEdges.size() && std::min<uint32>(GetOrigin(halfEdges[runEnd]), GetTarget(halfEdges[runEnd])) == low &&
+			std::max<uint32>(GetOrigin(halfEdges[runEnd]), GetTarget(halfEdges[runEnd])) == high)
+		{
+			++runEnd;
+		}
+
+		if (runEnd - i == 2 && GetOrigin(h) == GetTarget(halfEdges[i + 1]))
+		{
+			Twins[h] = halfEdges[i + 1];
+			Twins[halfEdges[i + 1]] = h;
+		}
+		else if (runEnd - i >= 2)
+		{
+			++NonManifoldEdgeCount;
+		}
+
+		i = runEnd;
+	}
+}
+
+//=========================================================================================
+void HalfEdgeMesh::BuildOutgoing()
+{
+	std::fill(Outgoing.begin(), Outgoing.end(), kInvalid);
+
+	// The first boundary half-edge of each vertex, or its first half-edge. Degenerate edges
+	// look like boundary edges but don't lead anywhere.
+	for (uint32 h = 0; h < GetHalfEdgeCount(); ++h)
+	{
+		if (GetOrigin(h) == GetTarget(h))
+		{
+			continue;
+		}
+
+		uint32& outgoing = Outgoing[GetOrigin(h)];
+		if (outgoing == kInvalid || (IsBoundary(h) && !IsBoundary(outgoing)))
+		{
+			outgoing = h;
+		}
+	}
+}
+
+//=========================================================================================
+HalfEdgeMesh::uint32 HalfEdgeMesh::GetVertexCount() const
+{
+	return (uint32)Outgoing.size();
+}
+
+//=========================================================================================
+HalfEdgeMesh::uint32 HalfEdgeMesh::GetFaceCount() const
+{
+	return (uint32)Origins.size() / 3;
+}
+
+//=========================================================================================
+HalfEdgeMesh::uint32 HalfEdgeMesh::GetHalfEdgeCount() const
+{
+	return (uint32)Origins.size();
+}
+
+//=========================================================================================
+HalfEdgeMesh::uint32 HalfEdgeMesh::GetNonManifoldEdgeCount() const
+{
+	return NonManifoldEdgeCount;
+}
+
+//=========================================================================================
+size_t HalfEdgeMesh::GetMemoryUsage() const
+{
+	size_t elements = Origins.capacity() + Twins.capacity() + MeshCorners.capacity() + Outgoing.capacity() + VertexRemap.capacity();
+	return sizeof(*this) + elements * sizeof(uint32);
+}
+
+//=========================================================================================
+HalfEdgeMesh::uint32 HalfEdgeMesh::GetVertex(uint32 meshVertex) const
+{
+	return VertexRemap.empty() ? meshVertex : VertexRemap[meshVertex];
+}
+
+//=========================================================================================
+HalfEdgeMesh::uint32 HalfEdgeMesh::GetOutgoing(uint32 vertex) const
+{
+	return Outgoing[vertex];
+}
+
+//=========================================================================================
+bool HalfEdgeMesh::IsBoundaryVertex(uint32 vertex) const
+{
+	return Outgoing[vertex] != kInvalid && IsBoundary(Outgoing[vertex]);
+}
+
+//=========================================================================================
+std::vector<std::vector<HalfEdgeMesh::uint32>> HalfEdgeMesh::GetBoundaryLoops() const
+{
+	std::vector<std::vector<uint32>> loops;
+	std::vector<bool> isVisited(GetHalfEdgeCount(), false);
+
+	for (uint32 start = 0; start < GetHalfEdgeCount(); ++start)
+	{
+		if (!IsBoundary(start) || isVisited[start] || GetOrigin(start) == GetTarget(start))
+		{
+			continue;
+		}
+
+		std::vector<uint32> loop;
+		uint32 halfEdge = start;
+		while (!isVisited[halfEdge])
+		{
+			isVisited[halfEdge] = true;
+			loop.push_back(halfEdge);
+
+			// Turn around the target until the fan opens up again
+			halfEdge = GetNext(halfEdge);
+			while (!IsBoundary(halfEdge))
+			{
+				halfEdge = GetNext(Twins[halfEdge]);
+			}
+		}
+		loops.push_back(std::move(loop));
+	}
+
+	return loops;
+}
+
+//=========================================================================================
+bool HalfEdgeMesh::FlipEdge(uint32 halfEdge)
+{
+	uint32 twin = Twins[halfEdge];
+	if (twin == kInvalid)
+	{
+		return false;
+	}
+
+	// Triangles (a, b, c) and (b, a, d) become (d, c, a) and (c, d, b)
+	uint32 hNext = GetNext(halfEdge);
+	uint32 hPrev = GetPrev(halfEdge);
+	uint32 tNext = GetNext(twin);
+	uint32 tPrev = GetPrev(twin);
+
+	uint32 a = Origins[halfEdge];
+	uint32 b = Origins[twin];
+	uint32 c = Origins[hPrev];
+	uint32 d = Origins[tPrev];
+	if (c == d || c == a || c == b || d == a || d == b)
+	{
+		return false;
+	}
+
+	bool isConnected = false;
+	ForEachNeighbor(c, [&](uint32 neighbor) { isConnected = isConnected || neighbor == d; });
+	if (isConnected)
+	{
+		return false;
+	}
+
+	Origins[halfEdge] = d;
+	Origins[hNext] = c;
+	Origins[hPrev] = a;
+	Origins[twin] = c;
+	Origins[tNext] = d;
+	Origins[tPrev] = b;
+
+	if (!MeshCorners.empty())
+	{
+		uint32 cornerA = MeshCorners[halfEdge];
+		uint32 cornerB = MeshCorners[twin];
+		uint32 cornerC = MeshCorners[hPrev];
+		uint32 cornerD = MeshCorners[tPrev];
+		MeshCorners[halfEdge] = cornerD;
+		MeshCorners[hNext] = cornerC;
+		MeshCorners[hPrev] = cornerA;
+		MeshCorners[twin] = cornerC;
+		MeshCorners[tNext] = cornerD;
+		MeshCorners[tPrev] = cornerB;
+	}
+
+	// The four outer edges moved to other slots of the two triangles
+	uint32 outerTwins[4] = { Twins[hPrev], Twins[tNext], Twins[tPrev], Twins[hNext] };
+	uint32 outerSlots[4] = { hNext, hPrev, tNext, tPrev };
+	for (int i = 0; i < 4; ++i)
+	{
+		Twins[outerSlots[i]] = outerTwins[i];
+		if (outerTwins[i] != kInvalid)
+		{
+			Twins[outerTwins[i]] = outerSlots[i];
+		}
+	}
+
+	if (Outgoing[a] == halfEdge || Outgoing[a] == tNext)
+	{
+		Outgoing[a] = hPrev;
+	}
+	if (Outgoing[b] == twin || Outgoing[b] == hNext)
+	{
+		Outgoing[b] = tPrev;
+	}
+	if (Outgoing[c] == hPrev)
+	{
+		Outgoing[c] = hNext;
+	}
+	if (Outgoing[d] == tPrev)
+	{
+		Outgoing[d] = tNext;
+	}
+
+	return true;
+}
+
+//=========================================================================================
+std::vector<HalfEdgeMesh::uint32> HalfEdgeMesh::GetIndices() const
+{
+	return MeshCorners.empty() ? Origins : MeshCorners;
+}
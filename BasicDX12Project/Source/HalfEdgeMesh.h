@@ -0,0 +1,174 @@
+#pragma once
+
+#include "FromBook/GeometryGenerator.h"
+
+// Index based half-edge connectivity of a triangle list, for neighbor queries in
+// simplification, welding, smoothing and silhouette passes.
+//
+// Half-edges are implicit: triangle t owns half-edges 3t, 3t + 1 and 3t + 2, going from
+// corner k to corner k + 1, so next, previous and face are arithmetic and only the origin
+// and twin of each half-edge are stored. Twins are paired by two counting sort passes over
+// the edge's vertex pair instead of a hash map, so building is O(n) and deterministic.
+//
+// With weldPositions, vertices that share a position (up to a small fraction of the mesh
+// size) are one half-edge vertex, so UV seams and hard edges don't split the surface. Edges used by more than two triangles,
+// or twice in the same direction, are non-manifold and left as boundary edges.
+class HalfEdgeMesh
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		static const uint32 kInvalid = 0xFFFFFFFF;
+
+		explicit HalfEdgeMesh(const GeometryGenerator::MeshData& meshData, bool weldPositions = true);
+
+		uint32 GetVertexCount() const;
+		uint32 GetFaceCount() const;
+		uint32 GetHalfEdgeCount() const;
+		uint32 GetNonManifoldEdgeCount() const;
+
+		// Bytes held by the structure, for budgeting
+		size_t GetMemoryUsage() const;
+
+		// Half-edge vertex a vertex of the source mesh was welded into
+		uint32 GetVertex(uint32 meshVertex) const;
+
+		static uint32 GetFace(uint32 halfEdge);
+		static uint32 GetNext(uint32 halfEdge);
+		static uint32 GetPrev(uint32 halfEdge);
+
+		uint32 GetOrigin(uint32 halfEdge) const;
+		uint32 GetTarget(uint32 halfEdge) const;
+
+		// kInvalid on boundary edges
+		uint32 GetTwin(uint32 halfEdge) const;
+
+		// A half-edge leaving the vertex, the one on the boundary if the vertex has one.
+		// kInvalid for vertices no triangle uses.
+		uint32 GetOutgoing(uint32 vertex) const;
+
+		bool IsBoundary(uint32 halfEdge) const;
+		bool IsBoundaryVertex(uint32 vertex) const;
+
+		// Calls func(halfEdge) for the half-edges leaving the vertex, in order around it. A
+		// vertex where several fans meet (a bow tie) only visits the fan of GetOutgoing.
+		template <typename Func>
+		void ForEachOutgoing(uint32 vertex, Func func) const;
+
+		// Calls func(neighbor) for the one-ring of the vertex, in order around it
+		template <typename Func>
+		void ForEachNeighbor(uint32 vertex, Func func) const;
+
+		// Boundary half-edges of each hole or open border, in order along the loop
+		std::vector<std::vector<uint32>> GetBoundaryLoops() const;
+
+		// Replaces the interior edge of the half-edge with the other diagonal of its two
+		// triangles. Returns false, leaving the mesh as it was, for boundary edges and for
+		// flips that would duplicate an existing edge. The half-edge and its twin stay on
+		// the new edge.
+		bool FlipEdge(uint32 halfEdge);
+
+		// Triangle list of the current faces into the vertices of the source mesh
+		std::vector<uint32> GetIndices() const;
+
+	private:
+		void BuildTwins();
+		void BuildOutgoing();
+
+	private:
+		// Per half-edge
+		std::vector<uint32> Origins;
+		std::vector<uint32> Twins;
+
+		// Per half-edge vertex of the source mesh at the origin, only kept when welding
+		std::vector<uint32> MeshCorners;
+
+		// Per vertex
+		std::vector<uint32> Outgoing;
+
+		// Per vertex of the source mesh, only kept when welding
+		std::vector<uint32> VertexRemap;
+
+		uint32 NonManifoldEdgeCount = 0;
+};
+
+//=========================================================================================
+inline HalfEdgeMesh::uint32 HalfEdgeMesh::GetFace(uint32 halfEdge)
+{
+	return halfEdge / 3;
+}
+
+//=========================================================================================
+inline HalfEdgeMesh::uint32 HalfEdgeMesh::GetNext(uint32 halfEdge)
+{
+	return halfEdge % 3 == 2 ? halfEdge - 2 : halfEdge + 1;
+}
+
+//=========================================================================================
+inline HalfEdgeMesh::uint32 HalfEdgeMesh::GetPrev(uint32 halfEdge)
+{
+	return halfEdge % 3 == 0 ? halfEdge + 2 : halfEdge - 1;
+}
+
+//=========================================================================================
+inline HalfEdgeMesh::uint32 HalfEdgeMesh::GetOrigin(uint32 halfEdge) const
+{
+	return Origins[halfEdge];
+}
+
+//=========================================================================================
+inline HalfEdgeMesh::uint32 HalfEdgeMesh::GetTarget(uint32 halfEdge) const
+{
+	return Origins[GetNext(halfEdge)];
+}
+
+//=========================================================================================
+inline HalfEdgeMesh::uint32 HalfEdgeMesh::GetTwin(uint32 halfEdge) const
+{
+	return Twins[halfEdge];
+}
+
+//=========================================================================================
+inline bool HalfEdgeMesh::IsBoundary(uint32 halfEdge) const
+{
+	return Twins[halfEdge] == kInvalid;
+}
+
+//=========================================================================================
+template <typename Func>
+void HalfEdgeMesh::ForEachOutgoing(uint32 vertex, Func func) const
+{
+	uint32 start = Outgoing[vertex];
+	if (start == kInvalid)
+	{
+		return;
+	}
+
+	// Outgoing starts a boundary fan on its boundary edge, so turning through the fan
+	// either comes back to the start or runs into the other side of the fan
+	uint32 halfEdge = start;
+	do
+	{
+		func(halfEdge);
+		halfEdge = Twins[GetPrev(halfEdge)];
+	}
+	while (halfEdge != kInvalid && halfEdge != start);
+}
+
+//=========================================================================================
+template <typename Func>
+void HalfEdgeMesh::ForEachNeighbor(uint32 vertex, Func func) const
+{
+	uint32 last = kInvalid;
+	ForEachOutgoing(vertex, [&](uint32 halfEdge)
+	{
+		func(GetTarget(halfEdge));
+		last = halfEdge;
+	});
+
+	// An open fan has one more neighbor than outgoing half-edges
+	if (last != kInvalid && IsBoundary(GetPrev(last)))
+	{
+		func(Origins[GetPrev(last)]);
+	}
+}
@@ -0,0 +1,179 @@
+#include "IndexPacker.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+	// Largest vertex range a chunk can address with 16-bit indices
+	const std::uint32_t kMaxChunkVertexSpan = 0xFFFF;
+}
+
+//=========================================================================================
+size_t IndexPacker::AddSubmesh(const std::vector<std::uint32_t>& indices, INT baseVertexLocation)
+{
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)indices.size();
+	submesh.StartIndexLocation = (UINT)Indices32.size();
+	submesh.BaseVertexLocation = baseVertexLocation;
+
+	// Grow each chunk triangle by triangle until its vertices no longer fit in 16 bits.
+	// Meshes that went through MeshOptimizer::OptimizeVertexFetch reference their vertices
+	// roughly in order, so this only cuts where it has to.
+	IndexChunk chunk;
+	chunk.StartIndexLocation = submesh.StartIndexLocation;
+	std::uint32_t chunkMin = UINT32_MAX;
+	std::uint32_t chunkMax = 0;
+	bool needsFullIndices = false;
+
+	auto closeChunk = [&]()
+	{
+		chunk.IndexCount = (UINT)Indices32.size() - chunk.StartIndexLocation;
+		chunk.BaseVertexLocation = baseVertexLocation + (INT)chunkMin;
+
+		// Store the indices relative to the chunk's first vertex
+		for (size_t i = chunk.StartIndexLocation; i < Indices32.size(); ++i)
+		{
+			Indices32[i] -= chunkMin;
+		}
+		submesh.Chunks.push_back(chunk);
+
+		chunk.StartIndexLocation = (UINT)Indices32.size();
+		chunkMin = UINT32_MAX;
+		chunkMax = 0;
+	};
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		std::uint32_t triangleMin = std::min<std::uint32_t>({ indices[i], indices[i + 1], indices[i + 2] });
+		std::uint32_t triangleMax = std::max<std::uint32_t>({ indices[i], indices[i + 1], indices[i + 2] });
+		if (triangleMax - triangleMin > kMaxChunkVertexSpan)
+		{
+			needsFullIndices = true;
+		}
+
+		if (std::max<std::uint32_t>(chunkMax, triangleMax) - std::min<std::uint32_t>(chunkMin, triangleMin) > kMaxChunkVertexSpan && chunkMin != UINT32_MAX)
+		{
+			closeChunk();
+		}
+
+		chunkMin = std::min<std::uint32_t>(chunkMin, triangleMin);
+		chunkMax = std::max<std::uint32_t>(chunkMax, triangleMax);
+		Indices32.insert(Indices32.end(), indices.begin() + i, indices.begin() + i + 3);
+	}
+
+	if (chunkMin != UINT32_MAX)
+	{
+		closeChunk();
+	}
+
+	// A single chunk is the plain submesh
+	if (submesh.Chunks.size() == 1)
+	{
+		submesh.BaseVertexLocation = submesh.Chunks[0].BaseVertexLocation;
+		submesh.Chunks.clear();
+	}
+
+	Submeshes.push_back(std::move(submesh));
+	NeedsFullIndices.push_back(needsFullIndices);
+	return Submeshes.size() - 1;
+}
+
+//=========================================================================================
+void IndexPacker::Pack()
+{
+	// Each submesh on its own: only the ones 16-bit chunks can't serve well pay for 32 bits
+	std::vector<bool> usesFullIndices(Submeshes.size());
+	size_t indexCount16 = 0;
+	size_t indexCount32 = 0;
+	for (size_t s = 0; s < Submeshes.size(); ++s)
+	{
+		const SubmeshGeometry& submesh = Submeshes[s];
+		usesFullIndices[s] = NeedsFullIndices[s] || submesh.Chunks.size() > 1 + submesh.IndexCount / kMinIndicesPerChunk;
+		if (usesFullIndices[s])
+		{
+			indexCount32 += submesh.IndexCount;
+		}
+		else
+		{
+			indexCount16 += submesh.IndexCount;
+		}
+	}
+	Format = indexCount16 == 0 && indexCount32 > 0 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+
+	// The 16-bit submeshes come first. The 32-bit ones follow from a 4 byte boundary, so their
+	// StartIndexLocation counts 32-bit indices from the start of the same buffer.
+	const size_t byteSize16 = indexCount16 * sizeof(std::uint16_t);
+	const size_t first32 = (byteSize16 + sizeof(std::uint32_t) - 1) / sizeof(std::uint32_t);
+	Data.assign(indexCount32 > 0 ? (first32 + indexCount32) * sizeof(std::uint32_t) : byteSize16, 0);
+
+	std::uint16_t* indices16 = reinterpret_cast<std::uint16_t*>(Data.data());
+	std::uint32_t* indices32 = reinterpret_cast<std::uint32_t*>(Data.data());
+	UINT next16 = 0;
+	UINT next32 = (UINT)first32;
+	for (size_t s = 0; s < Submeshes.size(); ++s)
+	{
+		SubmeshGeometry& submesh = Submeshes[s];
+		const std::uint32_t* source = Indices32.data() + submesh.StartIndexLocation;
+		if (!usesFullIndices[s])
+		{
+			for (UINT i = 0; i < submesh.IndexCount; ++i)
+			{
+				indices16[next16 + i] = (std::uint16_t)source[i];
+			}
+
+			// The chunks move along with the submesh
+			for (IndexChunk& chunk : submesh.Chunks)
+			{
+				chunk.StartIndexLocation = chunk.StartIndexLocation - submesh.StartIndexLocation + next16;
+			}
+			submesh.StartIndexLocation = next16;
+			submesh.IndexFormat = DXGI_FORMAT_R16_UINT;
+			next16 += submesh.IndexCount;
+			continue;
+		}
+
+		std::copy(source, source + submesh.IndexCount, indices32 + next32);
+
+		// Undo the chunking, 32-bit indices reach every vertex of the submesh
+		for (const IndexChunk& chunk : submesh.Chunks)
+		{
+			std::uint32_t rebase = (std::uint32_t)(chunk.BaseVertexLocation - submesh.BaseVertexLocation);
+			std::uint32_t* chunkIndices = indices32 + next32 + (chunk.StartIndexLocation - submesh.StartIndexLocation);
+			for (UINT i = 0; i < chunk.IndexCount; ++i)
+			{
+				chunkIndices[i] += rebase;
+			}
+		}
+		submesh.Chunks.clear();
+		submesh.StartIndexLocation = next32;
+		submesh.IndexFormat = DXGI_FORMAT_R32_UINT;
+		next32 += submesh.IndexCount;
+	}
+
+	// Don't keep the staging copy around
+	std::vector<std::uint32_t>().swap(Indices32);
+}
+
+//=========================================================================================
+DXGI_FORMAT IndexPacker::GetFormat() const
+{
+	return Format;
+}
+
+//=========================================================================================
+const void* IndexPacker::GetData() const
+{
+	return Data.data();
+}
+
+//=========================================================================================
+UINT IndexPacker::GetByteSize() const
+{
+	return (UINT)Data.size();
+}
+
+//=========================================================================================
+SubmeshGeometry IndexPacker::GetSubmesh(size_t id) const
+{
+	return Submeshes[id];
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "FromBook/d3dUtil.h"
+
+// Packs the index lists of several submeshes into one index buffer. 16-bit indices are used
+// wherever possible: a submesh whose vertices are too far apart for them is split into
+// chunks that each get their own BaseVertexLocation, so nothing is truncated. A submesh that
+// still can't use them gets 32-bit indices of its own after the 16-bit ones, and says so in
+// its IndexFormat.
+class IndexPacker
+{
+	public:
+		// Submeshes may average no fewer indices per 16-bit chunk than this, otherwise the
+		// extra draws cost more than the halved index bandwidth saves and the submesh uses
+		// 32-bit indices instead
+		static const UINT kMinIndicesPerChunk = 8192;
+
+		// Queues the triangle list of a submesh whose vertices start at baseVertexLocation in
+		// the vertex buffer. Returns the id to get the submesh with after Pack.
+		size_t AddSubmesh(const std::vector<std::uint32_t>& indices, INT baseVertexLocation);
+
+		// Chooses the index format of each submesh and builds the buffer
+		void Pack();
+
+		// Format for MeshGeometry::IndexFormat: 16-bit unless every submesh fell back to
+		// 32-bit indices
+		DXGI_FORMAT GetFormat() const;
+		const void* GetData() const;
+		UINT GetByteSize() const;
+
+		// IndexCount, StartIndexLocation, BaseVertexLocation, Chunks and IndexFormat of a
+		// queued submesh. StartIndexLocation counts indices of its own format.
+		SubmeshGeometry GetSubmesh(size_t id) const;
+
+	private:
+		std::vector<SubmeshGeometry> Submeshes;
+
+		// Every index relative to the first vertex of its chunk, until Pack
+		std::vector<std::uint32_t> Indices32;
+
+		// By submesh: some triangle spans more than 65536 vertices on its own
+		std::vector<bool> NeedsFullIndices;
+
+		// The packed buffer
+		std::vector<std::uint8_t> Data;
+
+		DXGI_FORMAT Format = DXGI_FORMAT_R16_UINT;
+};
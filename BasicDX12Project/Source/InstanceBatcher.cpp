@@ -0,0 +1,101 @@
+#include "InstanceBatcher.h"
+
+namespace
+{
+	// FNV-1a taking 8 bytes per step, the lookup runs once per drawn item
+	void HashCombine(std::uint64_t& hash, std::uint64_t value)
+	{
+		hash = (hash ^ value) * 1099511628211ull;
+	}
+}
+
+//=========================================================================================
+bool InstanceKey::operator==(const InstanceKey& rhs) const
+{
+	return Geometry == rhs.Geometry && PipelineState == rhs.PipelineState && IndexCount == rhs.IndexCount &&
+		StartIndexLocation == rhs.StartIndexLocation && BaseVertexLocation == rhs.BaseVertexLocation;
+}
+
+//=========================================================================================
+size_t InstanceKeyHash::operator()(const InstanceKey& key) const
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	HashCombine(hash, (std::uint64_t)(uintptr_t)key.Geometry);
+	HashCombine(hash, (std::uint64_t)(uintptr_t)key.PipelineState);
+	HashCombine(hash, ((std::uint64_t)key.StartIndexLocation << 32) | key.IndexCount);
+	HashCombine(hash, (std::uint32_t)key.BaseVertexLocation);
+	return (size_t)(hash ^ (hash >> 32));
+}
+
+//=========================================================================================
+void InstanceBatcher::Clear()
+{
+	BatchIndices.clear();
+	Batches.clear();
+	Items.clear();
+	ItemBatches.clear();
+	Instances.clear();
+}
+
+//=========================================================================================
+void InstanceBatcher::Add(const InstanceKey& key, UINT item)
+{
+	// Lists are often sorted by submesh, so most items go where the one before them went
+	UINT batchIndex = ItemBatches.empty() ? 0 : ItemBatches.back();
+	if (ItemBatches.empty() || !(Batches[batchIndex].Key == key))
+	{
+		// Look up before inserting, emplace allocates a node even when the key is there
+		auto found = BatchIndices.find(key);
+		if (found != BatchIndices.end())
+		{
+			batchIndex = found->second;
+		}
+		else
+		{
+			batchIndex = (UINT)Batches.size();
+			BatchIndices.emplace(key, batchIndex);
+
+			InstanceBatch batch;
+			batch.Key = key;
+			Batches.push_back(batch);
+		}
+	}
+
+	++Batches[batchIndex].InstanceCount;
+
+	Items.push_back(item);
+	ItemBatches.push_back(batchIndex);
+}
+
+//=========================================================================================
+void InstanceBatcher::Build()
+{
+	UINT offset = 0;
+	for (InstanceBatch& batch : Batches)
+	{
+		batch.InstanceOffset = offset;
+		offset += batch.InstanceCount;
+
+		// Counted again while scattering
+		batch.InstanceCount = 0;
+	}
+
+	Instances.resize(Items.size());
+	for (size_t i = 0; i < Items.size(); ++i)
+	{
+		InstanceBatch& batch = Batches[ItemBatches[i]];
+		Instances[batch.InstanceOffset + batch.InstanceCount++] = Items[i];
+	}
+}
+
+//=========================================================================================
+const std::vector<InstanceBatch>& InstanceBatcher::GetBatches() const
+{
+	return Batches;
+}
+
+//=========================================================================================
+const std::vector<UINT>& InstanceBatcher::GetInstances() const
+{
+	return Instances;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <unordered_map>
+#include "FromBook/d3dUtil.h"
+
+// What two render items must share to be drawn by one instanced call: the same index range
+// of the same geometry with the same pipeline state
+struct InstanceKey
+{
+	const MeshGeometry* Geometry = nullptr;
+	const ID3D12PipelineState* PipelineState = nullptr;
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	INT BaseVertexLocation = 0;
+
+	bool operator==(const InstanceKey& rhs) const;
+};
+
+struct InstanceKeyHash
+{
+	size_t operator()(const InstanceKey& key) const;
+};
+
+// Items sharing a key, drawn with one call
+struct InstanceBatch
+{
+	InstanceKey Key;
+
+	// Range of the batch in InstanceBatcher::GetInstances()
+	UINT InstanceOffset = 0;
+	UINT InstanceCount = 0;
+};
+
+// Groups the items queued for a frame by InstanceKey. Batches come in the order of their first
+// item and items keep their order within a batch, so a front to back sorted list stays
+// roughly sorted. Grouping is two linear passes: a hash lookup per item, then a scatter into
+// the batch ranges.
+class InstanceBatcher
+{
+	public:
+		// Forgets the queued items, keeping the memory for the next frame
+		void Clear();
+
+		// Queues item, any index the caller maps back to its render item
+		void Add(const InstanceKey& key, UINT item);
+
+		// Groups everything queued since Clear
+		void Build();
+
+		const std::vector<InstanceBatch>& GetBatches() const;
+
+		// Queued items ordered by batch
+		const std::vector<UINT>& GetInstances() const;
+
+	private:
+		std::unordered_map<InstanceKey, UINT, InstanceKeyHash> BatchIndices;
+		std::vector<InstanceBatch> Batches;
+
+		// Queued items and the batch each of them went to
+		std::vector<UINT> Items;
+		std::vector<UINT> ItemBatches;
+
+		std::vector<UINT> Instances;
+};
@@ -0,0 +1,245 @@
+#include "MeshBounds.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// Positions handed to a thread at once
+	const size_t kMinPositionsPerTask = 65536;
+
+	const float* GetPosition(const XMFLOAT3* positions, size_t i, size_t stride)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const BYTE*>(positions) + i * stride);
+	}
+
+	// Turns four tightly packed positions (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) into the x,
+	// y and z of four lanes
+	void Deinterleave(__m128 a, __m128 b, __m128 c, __m128& xs, __m128& ys, __m128& zs)
+	{
+		xs = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		ys = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		zs = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	// Loads the four positions starting at p as the x, y and z of four lanes. Reads 16 bytes
+	// from each position, so the last position of the buffer must not be one of them unless
+	// the positions are tightly packed.
+	void LoadFour(const float* p, size_t stride, __m128& xs, __m128& ys, __m128& zs)
+	{
+		if (stride == sizeof(XMFLOAT3))
+		{
+			Deinterleave(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), xs, ys, zs);
+			return;
+		}
+
+		const size_t floatStride = stride / sizeof(float);
+		__m128 p0 = _mm_loadu_ps(p);
+		__m128 p1 = _mm_loadu_ps(p + floatStride);
+		__m128 p2 = _mm_loadu_ps(p + 2 * floatStride);
+		__m128 p3 = _mm_loadu_ps(p + 3 * floatStride);
+		_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+		xs = p0;
+		ys = p1;
+		zs = p2;
+	}
+
+	// x, y and z of a position in the first three lanes
+	__m128 LoadOne(const float* p)
+	{
+		return _mm_setr_ps(p[0], p[1], p[2], p[2]);
+	}
+
+	// Positions [first, last) go four at a time while whole groups of four fit, then one by
+	// one. The one by one part always includes the last position of the buffer.
+	size_t GetFourWideEnd(size_t first, size_t last, size_t count, size_t stride)
+	{
+		size_t end = last;
+		if (stride != sizeof(XMFLOAT3) && last == count && last > first)
+		{
+			--end;
+		}
+		return first + ((end - first) & ~(size_t)3);
+	}
+
+	float HorizontalMin(__m128 v)
+	{
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(v);
+	}
+
+	float HorizontalMax(__m128 v)
+	{
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(v);
+	}
+}
+
+//=========================================================================================
+BoundingBox MeshBounds::ComputeBox(const XMFLOAT3* positions, size_t count, size_t stride, ThreadPool* threadPool)
+{
+	assert(stride >= sizeof(XMFLOAT3) && stride % sizeof(float) == 0);
+
+	BoundingBox box(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+	if (count == 0)
+	{
+		return box;
+	}
+
+	// Min and max are exact, so merging the ranges in any order gives the same box
+	std::mutex mergeMutex;
+	XMFLOAT3 minPoint(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 maxPoint(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	ThreadPool::ParallelFor(threadPool, 0, count, kMinPositionsPerTask, [&](size_t first, size_t last)
+	{
+		__m128 rangeMin = _mm_set1_ps(FLT_MAX);
+		__m128 rangeMax = _mm_set1_ps(-FLT_MAX);
+
+		// Min and max don't care which lane holds which coordinate, so the positions are
+		// reduced as they are laid out in memory and only sorted into x, y and z at the end
+		size_t i = first;
+		size_t fourWideEnd = GetFourWideEnd(first, last, count, stride);
+		if (stride == sizeof(XMFLOAT3))
+		{
+			__m128 minA = rangeMin, minB = rangeMin, minC = rangeMin;
+			__m128 maxA = rangeMax, maxB = rangeMax, maxC = rangeMax;
+			for (; i < fourWideEnd; i += 4)
+			{
+				const float* p = GetPosition(positions, i, stride);
+				__m128 a = _mm_loadu_ps(p);
+				__m128 b = _mm_loadu_ps(p + 4);
+				__m128 c = _mm_loadu_ps(p + 8);
+				minA = _mm_min_ps(minA, a);
+				minB = _mm_min_ps(minB, b);
+				minC = _mm_min_ps(minC, c);
+				maxA = _mm_max_ps(maxA, a);
+				maxB = _mm_max_ps(maxB, b);
+				maxC = _mm_max_ps(maxC, c);
+			}
+
+			__m128 xs, ys, zs;
+			Deinterleave(minA, minB, minC, xs, ys, zs);
+			rangeMin = _mm_setr_ps(HorizontalMin(xs), HorizontalMin(ys), HorizontalMin(zs), FLT_MAX);
+			Deinterleave(maxA, maxB, maxC, xs, ys, zs);
+			rangeMax = _mm_setr_ps(HorizontalMax(xs), HorizontalMax(ys), HorizontalMax(zs), -FLT_MAX);
+		}
+		else
+		{
+			// Each load has x, y and z in the first three lanes and whatever follows in the last
+			const size_t floatStride = stride / sizeof(float);
+			__m128 minB = rangeMin;
+			__m128 maxB = rangeMax;
+			for (; i < fourWideEnd; i += 4)
+			{
+				const float* p = GetPosition(positions, i, stride);
+				__m128 p0 = _mm_loadu_ps(p);
+				__m128 p1 = _mm_loadu_ps(p + floatStride);
+				__m128 p2 = _mm_loadu_ps(p + 2 * floatStride);
+				__m128 p3 = _mm_loadu_ps(p + 3 * floatStride);
+				rangeMin = _mm_min_ps(rangeMin, _mm_min_ps(p0, p1));
+				minB = _mm_min_ps(minB, _mm_min_ps(p2, p3));
+				rangeMax = _mm_max_ps(rangeMax, _mm_max_ps(p0, p1));
+				maxB = _mm_max_ps(maxB, _mm_max_ps(p2, p3));
+			}
+			rangeMin = _mm_min_ps(rangeMin, minB);
+			rangeMax = _mm_max_ps(rangeMax, maxB);
+		}
+
+		for (; i < last; ++i)
+		{
+			__m128 p = LoadOne(GetPosition(positions, i, stride));
+			rangeMin = _mm_min_ps(rangeMin, p);
+			rangeMax = _mm_max_ps(rangeMax, p);
+		}
+
+		XMFLOAT4 rangeMinPoint, rangeMaxPoint;
+		_mm_storeu_ps(&rangeMinPoint.x, rangeMin);
+		_mm_storeu_ps(&rangeMaxPoint.x, rangeMax);
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		minPoint.x = std::min<float>(minPoint.x, rangeMinPoint.x);
+		minPoint.y = std::min<float>(minPoint.y, rangeMinPoint.y);
+		minPoint.z = std::min<float>(minPoint.z, rangeMinPoint.z);
+		maxPoint.x = std::max<float>(maxPoint.x, rangeMaxPoint.x);
+		maxPoint.y = std::max<float>(maxPoint.y, rangeMaxPoint.y);
+		maxPoint.z = std::max<float>(maxPoint.z, rangeMaxPoint.z);
+	});
+
+	BoundingBox::CreateFromPoints(box, XMLoadFloat3(&minPoint), XMLoadFloat3(&maxPoint));
+	return box;
+}
+
+//=========================================================================================
+BoundingSphere MeshBounds::ComputeSphere(const XMFLOAT3* positions, size_t count, size_t stride, const BoundingBox& box, ThreadPool* threadPool)
+{
+	assert(stride >= sizeof(XMFLOAT3) && stride % sizeof(float) == 0);
+
+	std::mutex mergeMutex;
+	float maxDistanceSq = 0.0f;
+
+	ThreadPool::ParallelFor(threadPool, 0, count, kMinPositionsPerTask, [&](size_t first, size_t last)
+	{
+		__m128 centerX = _mm_set1_ps(box.Center.x);
+		__m128 centerY = _mm_set1_ps(box.Center.y);
+		__m128 centerZ = _mm_set1_ps(box.Center.z);
+		__m128 maxSq = _mm_setzero_ps();
+
+		size_t i = first;
+		size_t fourWideEnd = GetFourWideEnd(first, last, count, stride);
+		for (; i < fourWideEnd; i += 4)
+		{
+			__m128 xs, ys, zs;
+			LoadFour(GetPosition(positions, i, stride), stride, xs, ys, zs);
+			__m128 dx = _mm_sub_ps(xs, centerX);
+			__m128 dy = _mm_sub_ps(ys, centerY);
+			__m128 dz = _mm_sub_ps(zs, centerZ);
+			__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			maxSq = _mm_max_ps(maxSq, distanceSq);
+		}
+
+		float rangeMaxSq = HorizontalMax(maxSq);
+		for (; i < last; ++i)
+		{
+			const float* p = GetPosition(positions, i, stride);
+			float dx = p[0] - box.Center.x;
+			float dy = p[1] - box.Center.y;
+			float dz = p[2] - box.Center.z;
+			rangeMaxSq = std::max<float>(rangeMaxSq, (dx * dx + dy * dy) + dz * dz);
+		}
+
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		maxDistanceSq = std::max<float>(maxDistanceSq, rangeMaxSq);
+	});
+
+	return BoundingSphere(box.Center, sqrtf(maxDistanceSq));
+}
+
+//=========================================================================================
+void MeshBounds::ComputeSubmeshBounds(const XMFLOAT3* positions, size_t count, size_t stride, SubmeshGeometry& submesh, ThreadPool* threadPool)
+{
+	submesh.Bounds = ComputeBox(positions, count, stride, threadPool);
+	submesh.Sphere = ComputeSphere(positions, count, stride, submesh.Bounds, threadPool);
+}
+
+//=========================================================================================
+void MeshBounds::TransformBox(const BoundingBox& box, FXMMATRIX transform, BoundingBox& result)
+{
+	// Each new extent is the sum of the old extents scaled by how much of each axis the
+	// matrix turns into it
+	XMVECTOR extents = XMLoadFloat3(&box.Extents);
+	XMVECTOR newExtents = XMVectorMultiply(XMVectorSplatX(extents), XMVectorAbs(transform.r[0]));
+	newExtents = XMVectorMultiplyAdd(XMVectorSplatY(extents), XMVectorAbs(transform.r[1]), newExtents);
+	newExtents = XMVectorMultiplyAdd(XMVectorSplatZ(extents), XMVectorAbs(transform.r[2]), newExtents);
+
+	XMStoreFloat3(&result.Center, XMVector3Transform(XMLoadFloat3(&box.Center), transform));
+	XMStoreFloat3(&result.Extents, newExtents);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "FromBook/d3dUtil.h"
+
+class ThreadPool;
+
+// Bounding volumes of vertex positions, computed four positions at a time with SSE and split
+// across the thread pool for large meshes. Positions are read in place from any vertex
+// layout: pass the address of the first position and the vertex stride.
+class MeshBounds
+{
+	public:
+		// Tightest axis-aligned box around the positions. Zero sized at the origin when there
+		// are none.
+		static DirectX::BoundingBox ComputeBox(const DirectX::XMFLOAT3* positions, size_t count, size_t stride, ThreadPool* threadPool = nullptr);
+
+		// Sphere at the center of box through the position farthest from it, box being the
+		// ComputeBox of the same positions
+		static DirectX::BoundingSphere ComputeSphere(const DirectX::XMFLOAT3* positions, size_t count, size_t stride,
+			const DirectX::BoundingBox& box, ThreadPool* threadPool = nullptr);
+
+		// Fills the Bounds and Sphere of a submesh drawn from the given vertices
+		static void ComputeSubmeshBounds(const DirectX::XMFLOAT3* positions, size_t count, size_t stride, SubmeshGeometry& submesh,
+			ThreadPool* threadPool = nullptr);
+
+		// Box around box after transforming it, from the center and the absolute values of the
+		// matrix (Arvo) instead of transforming its eight corners. As tight as transforming
+		// the corners.
+		static void TransformBox(const DirectX::BoundingBox& box, DirectX::FXMMATRIX transform, DirectX::BoundingBox& result);
+};
@@ -0,0 +1,698 @@
+#include "MeshCodec.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <emmintrin.h>
+
+const size_t MeshCodec::kMaxVertexStride;
+
+namespace
+{
+	using uint8 = std::uint8_t;
+	using uint32 = MeshCodec::uint32;
+
+	const uint32 kMagic = 0x444F434D; // "MCOD"
+	const uint32 kVersion = 1;
+
+	struct CodecHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 VertexCount;
+		uint32 IndexCount;
+		uint32 VertexByteSize;
+		uint32 IndexByteSize;
+	};
+
+	// Vertex bytes decoded at once, small enough to stay in the L1 cache while they are
+	// written out as vertices
+	const size_t kBlockByteSize = 8192;
+	const size_t kMaxBlockVertexCount = 256;
+
+	// Values sharing a bit width, one SSE register of bytes
+	const size_t kGroupSize = 16;
+
+	// Bits per value of a group for each 2-bit group header
+	const uint32 kGroupBits[4] = { 0, 2, 4, 8 };
+
+	// Entries of the edge and vertex FIFOs of the index coder
+	const uint32 kFifoSize = 16;
+
+	// High nibble of a triangle code: the index of its first edge in the edge FIFO, or this
+	// when it starts with no known edge and all three vertices are coded
+	const uint32 kNoEdgeCode = 15;
+	const uint32 kMaxEdgeFifoIndex = 14;
+
+	// Vertex codes: the next vertex never seen before, (code - 1) in the vertex FIFO, or an
+	// explicit index in the data stream
+	const uint32 kNextVertexCode = 0;
+	const uint32 kExplicitVertexCode = 15;
+	const uint32 kMaxVertexFifoIndex = 13;
+
+	size_t GetBlockVertexCount(size_t stride)
+	{
+		size_t count = (kBlockByteSize / stride) & ~(kGroupSize - 1);
+		return std::min<size_t>(count, kMaxBlockVertexCount);
+	}
+
+	size_t GetGroupCount(size_t vertexCount)
+	{
+		return (vertexCount + kGroupSize - 1) / kGroupSize;
+	}
+
+	// Four 2-bit group headers per byte
+	size_t GetHeaderByteSize(size_t groupCount)
+	{
+		return (groupCount + 3) / 4;
+	}
+
+	uint8 ZigZag(uint8 delta)
+	{
+		return (uint8)((delta << 1) ^ ((std::int8_t)delta >> 7));
+	}
+
+	uint32 ZigZag32(uint32 delta)
+	{
+		return (delta << 1) ^ (uint32)((std::int32_t)delta >> 31);
+	}
+
+	uint32 UnZigZag32(uint32 value)
+	{
+		return (value >> 1) ^ (0u - (value & 1));
+	}
+
+	// Appends one column of a vertex block: the headers of its groups, then the groups
+	// packed at the fewest bits that hold their largest value
+	void EncodeColumn(const uint8* values, size_t groupCount, std::vector<uint8>& out)
+	{
+		size_t headerOffset = out.size();
+		out.resize(headerOffset + GetHeaderByteSize(groupCount), 0);
+
+		for (size_t g = 0; g < groupCount; ++g)
+		{
+			const uint8* group = values + g * kGroupSize;
+			uint8 largest = *std::max_element(group, group + kGroupSize);
+			uint32 code = largest == 0 ? 0 : largest < 4 ? 1 : largest < 16 ? 2 : 3;
+			out[headerOffset + g / 4] |= (uint8)(code << (g % 4 * 2));
+
+			if (code == 1)
+			{
+				for (size_t j = 0; j < kGroupSize; j += 4)
+				{
+					out.push_back((uint8)((group[j] << 6) | (group[j + 1] << 4) | (group[j + 2] << 2) | group[j + 3]));
+				}
+			}
+			else if (code == 2)
+			{
+				for (size_t j = 0; j < kGroupSize; j += 2)
+				{
+					out.push_back((uint8)((group[j] << 4) | group[j + 1]));
+				}
+			}
+			else if (code == 3)
+			{
+				out.insert(out.end(), group, group + kGroupSize);
+			}
+		}
+	}
+
+	// Unpacks the 16 values of a group coded with the given bits per value
+	__m128i UnpackGroup(const uint8* data, uint32 bits)
+	{
+		switch (bits)
+		{
+			case 0:
+			{
+				return _mm_setzero_si128();
+			}
+			case 2:
+			{
+				int word;
+				std::memcpy(&word, data, sizeof(word));
+				__m128i packed = _mm_cvtsi32_si128(word);
+				__m128i mask = _mm_set1_epi8(3);
+				__m128i a = _mm_and_si128(_mm_srli_epi16(packed, 6), mask);
+				__m128i b = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+				__m128i c = _mm_and_si128(_mm_srli_epi16(packed, 2), mask);
+				__m128i d = _mm_and_si128(packed, mask);
+				return _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, b), _mm_unpacklo_epi8(c, d));
+			}
+			case 4:
+			{
+				__m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+				__m128i mask = _mm_set1_epi8(15);
+				return _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), _mm_and_si128(packed, mask));
+			}
+			default:
+			{
+				return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			}
+		}
+	}
+
+	// Turns a group of zigzag deltas into bytes, continuing from the byte before the group
+	// held in every lane of carry, and leaves the last byte of the group in carry
+	__m128i DecodeGroup(__m128i zigzag, __m128i& carry)
+	{
+		__m128i magnitude = _mm_and_si128(_mm_srli_epi16(zigzag, 1), _mm_set1_epi8(0x7f));
+		__m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(zigzag, _mm_set1_epi8(1)));
+		__m128i values = _mm_xor_si128(magnitude, sign);
+
+		// Prefix sum in four steps
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 1));
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 2));
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 4));
+		values = _mm_add_epi8(values, _mm_slli_si128(values, 8));
+		values = _mm_add_epi8(values, carry);
+
+		__m128i last = _mm_unpackhi_epi8(values, values);
+		last = _mm_unpackhi_epi16(last, last);
+		carry = _mm_shuffle_epi32(last, _MM_SHUFFLE(3, 3, 3, 3));
+		return values;
+	}
+
+	// Stores the four 32-bit lanes of v stride bytes apart
+	void StoreLanes(__m128i v, uint8* out, size_t stride)
+	{
+		for (size_t lane = 0; lane < 4; ++lane)
+		{
+			int word = _mm_cvtsi128_si32(v);
+			std::memcpy(out + lane * stride, &word, sizeof(word));
+			v = _mm_srli_si128(v, 4);
+		}
+	}
+
+	// Writes the first count vertices of a decoded block, stored as columns pitch bytes apart,
+	// as vertices. Sixteen vertices and four columns are transposed at a time.
+	void WriteVertices(const uint8* block, size_t pitch, size_t count, size_t stride, uint8* out)
+	{
+		size_t i = 0;
+		for (; i + kGroupSize <= count; i += kGroupSize)
+		{
+			for (size_t k = 0; k < stride; k += 4)
+			{
+				const uint8* column = block + k * pitch + i;
+				__m128i c0 = _mm_load_si128(reinterpret_cast<const __m128i*>(column));
+				__m128i c1 = _mm_load_si128(reinterpret_cast<const __m128i*>(column + pitch));
+				__m128i c2 = _mm_load_si128(reinterpret_cast<const __m128i*>(column + 2 * pitch));
+				__m128i c3 = _mm_load_si128(reinterpret_cast<const __m128i*>(column + 3 * pitch));
+
+				__m128i t0 = _mm_unpacklo_epi8(c0, c1);
+				__m128i t1 = _mm_unpackhi_epi8(c0, c1);
+				__m128i t2 = _mm_unpacklo_epi8(c2, c3);
+				__m128i t3 = _mm_unpackhi_epi8(c2, c3);
+
+				uint8* vertex = out + i * stride + k;
+				StoreLanes(_mm_unpacklo_epi16(t0, t2), vertex, stride);
+				StoreLanes(_mm_unpackhi_epi16(t0, t2), vertex + 4 * stride, stride);
+				StoreLanes(_mm_unpacklo_epi16(t1, t3), vertex + 8 * stride, stride);
+				StoreLanes(_mm_unpackhi_epi16(t1, t3), vertex + 12 * stride, stride);
+			}
+		}
+
+		for (; i < count; ++i)
+		{
+			for (size_t k = 0; k < stride; ++k)
+			{
+				out[i * stride + k] = block[k * pitch + i];
+			}
+		}
+	}
+
+	// The last kFifoSize edges, newest first
+	struct EdgeFifo
+	{
+		uint32 A[kFifoSize] = {};
+		uint32 B[kFifoSize] = {};
+		uint32 Offset = 0;
+
+		void Push(uint32 a, uint32 b)
+		{
+			A[Offset % kFifoSize] = a;
+			B[Offset % kFifoSize] = b;
+			++Offset;
+		}
+
+		uint32 GetSlot(uint32 index) const
+		{
+			return (Offset - 1 - index) % kFifoSize;
+		}
+
+		int Find(uint32 a, uint32 b) const
+		{
+			for (uint32 i = 0; i <= kMaxEdgeFifoIndex; ++i)
+			{
+				uint32 slot = GetSlot(i);
+				if (A[slot] == a && B[slot] == b)
+				{
+					return (int)i;
+				}
+			}
+			return -1;
+		}
+	};
+
+	// The last kFifoSize vertices that were new or explicit, newest first
+	struct VertexFifo
+	{
+		uint32 Vertices[kFifoSize] = {};
+		uint32 Offset = 0;
+
+		void Push(uint32 v)
+		{
+			Vertices[Offset % kFifoSize] = v;
+			++Offset;
+		}
+
+		uint32 Get(uint32 index) const
+		{
+			return Vertices[(Offset - 1 - index) % kFifoSize];
+		}
+
+		int Find(uint32 v) const
+		{
+			for (uint32 i = 0; i <= kMaxVertexFifoIndex; ++i)
+			{
+				if (Get(i) == v)
+				{
+					return (int)i;
+				}
+			}
+			return -1;
+		}
+	};
+
+	// What the index encoder and decoder both know after each triangle
+	struct IndexCoderState
+	{
+		EdgeFifo Edges;
+		VertexFifo Vertices;
+
+		// One past the largest vertex seen so far, and the last explicit vertex
+		uint32 Next = 0;
+		uint32 Last = 0;
+
+		void AddVertex(uint32 v, uint32 code)
+		{
+			if (code == kNextVertexCode || code == kExplicitVertexCode)
+			{
+				Vertices.Push(v);
+			}
+			if (code == kExplicitVertexCode)
+			{
+				Last = v;
+			}
+			if (v >= Next)
+			{
+				Next = v + 1;
+			}
+		}
+
+		// Remembers the edges as a neighbour would walk them, in the opposite direction
+		void AddTriangle(uint32 a, uint32 b, uint32 c, bool firstEdgeIsNew)
+		{
+			if (firstEdgeIsNew)
+			{
+				Edges.Push(b, a);
+			}
+			Edges.Push(c, b);
+			Edges.Push(a, c);
+		}
+	};
+
+	void WriteVarint(uint32 value, std::vector<uint8>& out)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back((uint8)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8)value);
+	}
+
+	bool ReadVarint(const uint8*& data, const uint8* end, uint32& value)
+	{
+		value = 0;
+		for (uint32 shift = 0; shift < 35; shift += 7)
+		{
+			if (data == end)
+			{
+				return false;
+			}
+			uint8 byte = *data++;
+			value |= (uint32)(byte & 0x7f) << shift;
+			if (byte < 0x80)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Codes vertex v and updates state the way the decoder will. Explicit vertices append
+	// their index to data.
+	uint32 EncodeVertex(uint32 v, IndexCoderState& state, std::vector<uint8>& data)
+	{
+		uint32 code = kExplicitVertexCode;
+		int fifoIndex = state.Vertices.Find(v);
+		if (v == state.Next)
+		{
+			code = kNextVertexCode;
+		}
+		else if (fifoIndex >= 0)
+		{
+			code = (uint32)fifoIndex + 1;
+		}
+		else
+		{
+			WriteVarint(ZigZag32(v - state.Last), data);
+		}
+
+		state.AddVertex(v, code);
+		return code;
+	}
+
+	bool DecodeVertex(uint32 code, IndexCoderState& state, const uint8*& data, const uint8* end, size_t vertexCount, uint32& v)
+	{
+		if (code == kNextVertexCode)
+		{
+			v = state.Next;
+		}
+		else if (code == kExplicitVertexCode)
+		{
+			uint32 delta;
+			if (!ReadVarint(data, end, delta))
+			{
+				return false;
+			}
+			v = state.Last + UnZigZag32(delta);
+		}
+		else
+		{
+			v = state.Vertices.Get(code - 1);
+		}
+
+		if (v >= vertexCount)
+		{
+			return false;
+		}
+
+		state.AddVertex(v, code);
+		return true;
+	}
+}
+
+//=========================================================================================
+std::vector<std::uint8_t> MeshCodec::EncodeVertices(const void* vertices, size_t count, size_t stride)
+{
+	assert(stride > 0 && stride % 4 == 0 && stride <= kMaxVertexStride);
+
+	const uint8* bytes = static_cast<const uint8*>(vertices);
+	const size_t blockVertexCount = GetBlockVertexCount(stride);
+
+	std::vector<uint8> out;
+	out.reserve(count * stride / 2);
+
+	// Each byte of the vertex is coded against the same byte of the vertex before it
+	uint8 previous[kMaxVertexStride] = {};
+	uint8 values[kMaxBlockVertexCount];
+
+	for (size_t first = 0; first < count; first += blockVertexCount)
+	{
+		size_t blockCount = std::min<size_t>(blockVertexCount, count - first);
+		size_t groupCount = GetGroupCount(blockCount);
+
+		for (size_t k = 0; k < stride; ++k)
+		{
+			// The last group is padded by repeating the last vertex, which codes as zeros
+			for (size_t i = 0; i < groupCount * kGroupSize; ++i)
+			{
+				uint8 value = i < blockCount ? bytes[(first + i) * stride + k] : previous[k];
+				values[i] = ZigZag((uint8)(value - previous[k]));
+				previous[k] = value;
+			}
+			EncodeColumn(values, groupCount, out);
+		}
+	}
+
+	return out;
+}
+
+//=========================================================================================
+bool MeshCodec::DecodeVertices(void* vertices, size_t count, size_t stride, const std::uint8_t* data, size_t byteSize, std::string* error)
+{
+	if (stride == 0 || stride % 4 != 0 || stride > kMaxVertexStride)
+	{
+		return Fail(error, "unsupported vertex stride " + std::to_string(stride));
+	}
+
+	uint8* out = static_cast<uint8*>(vertices);
+	const uint8* end = data + byteSize;
+	const size_t blockVertexCount = GetBlockVertexCount(stride);
+
+	uint8 previous[kMaxVertexStride] = {};
+	alignas(16) uint8 block[kBlockByteSize];
+
+	for (size_t first = 0; first < count; first += blockVertexCount)
+	{
+		size_t blockCount = std::min<size_t>(blockVertexCount, count - first);
+		size_t groupCount = GetGroupCount(blockCount);
+		size_t headerByteSize = GetHeaderByteSize(groupCount);
+
+		for (size_t k = 0; k < stride; ++k)
+		{
+			if ((size_t)(end - data) < headerByteSize)
+			{
+				return Fail(error, "vertex data is truncated");
+			}
+			const uint8* headers = data;
+			data += headerByteSize;
+
+			uint8* column = block + k * blockVertexCount;
+			__m128i carry = _mm_set1_epi8((char)previous[k]);
+			for (size_t g = 0; g < groupCount; ++g)
+			{
+				uint32 bits = kGroupBits[(headers[g / 4] >> (g % 4 * 2)) & 3];
+				size_t groupByteSize = bits * kGroupSize / 8;
+				if ((size_t)(end - data) < groupByteSize)
+				{
+					return Fail(error, "vertex data is truncated");
+				}
+
+				__m128i values = DecodeGroup(UnpackGroup(data, bits), carry);
+				_mm_store_si128(reinterpret_cast<__m128i*>(column + g * kGroupSize), values);
+				data += groupByteSize;
+			}
+			previous[k] = (uint8)_mm_cvtsi128_si32(carry);
+		}
+
+		WriteVertices(block, blockVertexCount, blockCount, stride, out + first * stride);
+	}
+
+	if (data != end)
+	{
+		return Fail(error, "vertex data is followed by unknown bytes");
+	}
+	return true;
+}
+
+//=========================================================================================
+std::vector<std::uint8_t> MeshCodec::EncodeIndices(const uint32* indices, size_t indexCount)
+{
+	assert(indexCount % 3 == 0);
+
+	const size_t triangleCount = indexCount / 3;
+	IndexCoderState state;
+
+	// One code per triangle, then everything that doesn't fit in the codes
+	std::vector<uint8> codes;
+	std::vector<uint8> data;
+	std::vector<uint8> explicitVertices;
+	codes.reserve(triangleCount);
+
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32* triangle = indices + t * 3;
+
+		// Start at the corner whose first edge is known and whose third vertex is cheapest
+		int bestRotation = -1;
+		int bestEdge = -1;
+		int bestCost = 3;
+		for (int r = 0; r < 3; ++r)
+		{
+			uint32 a = triangle[r];
+			uint32 b = triangle[(r + 1) % 3];
+			uint32 c = triangle[(r + 2) % 3];
+
+			int edge = state.Edges.Find(a, b);
+			if (edge < 0)
+			{
+				continue;
+			}
+
+			int cost = c == state.Next ? 0 : state.Vertices.Find(c) >= 0 ? 1 : 2;
+			if (cost < bestCost)
+			{
+				bestRotation = r;
+				bestEdge = edge;
+				bestCost = cost;
+			}
+		}
+
+		if (bestRotation >= 0)
+		{
+			uint32 a = triangle[bestRotation];
+			uint32 b = triangle[(bestRotation + 1) % 3];
+			uint32 c = triangle[(bestRotation + 2) % 3];
+
+			uint32 code = EncodeVertex(c, state, data);
+			codes.push_back((uint8)((bestEdge << 4) | code));
+			state.AddTriangle(a, b, c, false);
+		}
+		else
+		{
+			uint32 a = triangle[0];
+			uint32 b = triangle[1];
+			uint32 c = triangle[2];
+
+			// The codes of a and b come before their explicit indices in the data stream
+			explicitVertices.clear();
+			uint32 codeA = EncodeVertex(a, state, explicitVertices);
+			uint32 codeB = EncodeVertex(b, state, explicitVertices);
+			uint32 codeC = EncodeVertex(c, state, explicitVertices);
+			codes.push_back((uint8)((kNoEdgeCode << 4) | codeC));
+			data.push_back((uint8)((codeA << 4) | codeB));
+			data.insert(data.end(), explicitVertices.begin(), explicitVertices.end());
+			state.AddTriangle(a, b, c, true);
+		}
+	}
+
+	codes.insert(codes.end(), data.begin(), data.end());
+	return codes;
+}
+
+//=========================================================================================
+bool MeshCodec::DecodeIndices(uint32* indices, size_t indexCount, size_t vertexCount, const std::uint8_t* data, size_t byteSize, std::string* error)
+{
+	if (indexCount % 3 != 0)
+	{
+		return Fail(error, "index count is not a multiple of 3");
+	}
+
+	const size_t triangleCount = indexCount / 3;
+	if (byteSize < triangleCount)
+	{
+		return Fail(error, "index data is truncated");
+	}
+
+	const uint8* codes = data;
+	const uint8* extra = data + triangleCount;
+	const uint8* end = data + byteSize;
+	IndexCoderState state;
+
+	for (size_t t = 0; t < triangleCount; ++t)
+	{
+		uint32 code = codes[t];
+		uint32 edge = code >> 4;
+		uint32* triangle = indices + t * 3;
+
+		if (edge != kNoEdgeCode)
+		{
+			uint32 slot = state.Edges.GetSlot(edge);
+			triangle[0] = state.Edges.A[slot];
+			triangle[1] = state.Edges.B[slot];
+			if (!DecodeVertex(code & 15, state, extra, end, vertexCount, triangle[2]))
+			{
+				return Fail(error, "index data is corrupt");
+			}
+			state.AddTriangle(triangle[0], triangle[1], triangle[2], false);
+		}
+		else
+		{
+			if (extra == end)
+			{
+				return Fail(error, "index data is truncated");
+			}
+			uint32 codesAB = *extra++;
+			if (!DecodeVertex(codesAB >> 4, state, extra, end, vertexCount, triangle[0]) ||
+				!DecodeVertex(codesAB & 15, state, extra, end, vertexCount, triangle[1]) ||
+				!DecodeVertex(code & 15, state, extra, end, vertexCount, triangle[2]))
+			{
+				return Fail(error, "index data is corrupt");
+			}
+			state.AddTriangle(triangle[0], triangle[1], triangle[2], true);
+		}
+	}
+
+	if (extra != end)
+	{
+		return Fail(error, "index data is followed by unknown bytes");
+	}
+	return true;
+}
+
+//=========================================================================================
+std::vector<std::uint8_t> MeshCodec::Encode(const GeometryGenerator::MeshData& meshData)
+{
+	const auto& vertices = meshData.Vertices;
+	const auto& indices = meshData.Indices32;
+
+	std::vector<uint8> vertexData = EncodeVertices(vertices.data(), vertices.size(), sizeof(GeometryGenerator::Vertex));
+	std::vector<uint8> indexData = EncodeIndices(indices.data(), indices.size());
+
+	CodecHeader header;
+	header.Magic = kMagic;
+	header.Version = kVersion;
+	header.VertexCount = (uint32)vertices.size();
+	header.IndexCount = (uint32)indices.size();
+	header.VertexByteSize = (uint32)vertexData.size();
+	header.IndexByteSize = (uint32)indexData.size();
+
+	std::vector<uint8> out(sizeof(header));
+	std::memcpy(out.data(), &header, sizeof(header));
+	out.insert(out.end(), vertexData.begin(), vertexData.end());
+	out.insert(out.end(), indexData.begin(), indexData.end());
+	return out;
+}
+
+//=========================================================================================
+bool MeshCodec::Decode(const std::uint8_t* data, size_t byteSize, GeometryGenerator::MeshData& meshData, std::string* error)
+{
+	CodecHeader header;
+	if (byteSize < sizeof(header))
+	{
+		return Fail(error, "data is smaller than the header");
+	}
+	std::memcpy(&header, data, sizeof(header));
+
+	if (header.Magic != kMagic)
+	{
+		return Fail(error, "not an encoded mesh");
+	}
+	if (header.Version != kVersion)
+	{
+		return Fail(error, "version " + std::to_string(header.Version) + ", expected " + std::to_string(kVersion));
+	}
+	if ((std::uint64_t)sizeof(header) + header.VertexByteSize + header.IndexByteSize != byteSize)
+	{
+		return Fail(error, "stream sizes don't match the data size");
+	}
+
+	const uint8* vertexData = data + sizeof(header);
+	const uint8* indexData = vertexData + header.VertexByteSize;
+
+	meshData.Vertices.resize(header.VertexCount);
+	meshData.Indices32.resize(header.IndexCount);
+	return DecodeVertices(meshData.Vertices.data(), header.VertexCount, sizeof(GeometryGenerator::Vertex), vertexData, header.VertexByteSize, error) &&
+		DecodeIndices(meshData.Indices32.data(), header.IndexCount, header.VertexCount, indexData, header.IndexByteSize, error);
+}
+
+//=========================================================================================
+bool MeshCodec::Fail(std::string* error, const std::string& message)
+{
+	if (error != nullptr)
+	{
+		*error = message;
+	}
+	return false;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "FromBook/GeometryGenerator.h"
+
+// Lossless compression of vertex and index buffers for storing geometry on disk, with
+// decoders fast enough to run while streaming it in.
+//
+// Vertices are split into blocks and every byte position of the vertex is coded as its own
+// column: the difference to the same byte of the previous vertex, zigzag folded so small
+// steps either way are small numbers, bit packed in groups of 16 at 0, 2, 4 or 8 bits. The
+// decoder unpacks, unfolds and prefix sums a group at a time with SSE2.
+//
+// Triangles are coded against a FIFO of recently seen edges and one of recently seen
+// vertices, so a triangle next to the previous ones costs one byte. Decoded triangles keep
+// their winding but may start at a different corner.
+//
+// Both compress best after MeshOptimizer::Optimize: neighbouring vertices are then close in
+// memory and triangles reuse the edges of the ones just before them.
+class MeshCodec
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		// Vertices are coded byte by byte without looking at their format. stride must be a
+		// multiple of 4 and at most kMaxVertexStride.
+		static const size_t kMaxVertexStride = 256;
+
+		static std::vector<std::uint8_t> EncodeVertices(const void* vertices, size_t count, size_t stride);
+		static bool DecodeVertices(void* vertices, size_t count, size_t stride, const std::uint8_t* data, size_t byteSize, std::string* error = nullptr);
+
+		// indexCount must be a multiple of 3. Decoding fails on any index at or past
+		// vertexCount.
+		static std::vector<std::uint8_t> EncodeIndices(const uint32* indices, size_t indexCount);
+		static bool DecodeIndices(uint32* indices, size_t indexCount, size_t vertexCount, const std::uint8_t* data, size_t byteSize, std::string* error = nullptr);
+
+		// Vertex and index counts followed by both streams
+		static std::vector<std::uint8_t> Encode(const GeometryGenerator::MeshData& meshData);
+		static bool Decode(const std::uint8_t* data, size_t byteSize, GeometryGenerator::MeshData& meshData, std::string* error = nullptr);
+
+	private:
+		static bool Fail(std::string* error, const std::string& message);
+};
@@ -0,0 +1,580 @@
+#include "MeshFile.h"
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint64_t kAlignment = 16;
+
+	// What the reader needs of the memory it is given, the largest alignment of any field.
+	// Heap allocations only guarantee 8 bytes on 32-bit builds.
+	const size_t kMinDataAlignment = 8;
+
+	std::uint64_t AlignUp(std::uint64_t offset)
+	{
+		return (offset + kAlignment - 1) & ~(kAlignment - 1);
+	}
+
+	// FNV-1a taking 8 bytes per step instead of one, so checking a file runs at memory speed
+	std::uint64_t ComputeChecksum(const BYTE* data, size_t byteSize)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+
+		size_t i = 0;
+		for (; i + 8 <= byteSize; i += 8)
+		{
+			std::uint64_t word;
+			std::memcpy(&word, data + i, sizeof(word));
+			hash = (hash ^ word) * 1099511628211ull;
+		}
+		for (; i < byteSize; ++i)
+		{
+			hash = (hash ^ data[i]) * 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	// A range of byteSize bytes at offset lies inside a file of fileSize bytes
+	bool IsRangeInside(std::uint64_t offset, std::uint64_t byteSize, std::uint64_t fileSize)
+	{
+		return offset <= fileSize && byteSize <= fileSize - offset;
+	}
+
+	template <typename IndexType>
+	bool AreIndicesInside(const BYTE* indexData, std::uint64_t begin, std::uint64_t count, std::int64_t baseVertex, std::int64_t vertexCount)
+	{
+		const IndexType* indices = reinterpret_cast<const IndexType*>(indexData) + begin;
+		for (std::uint64_t i = 0; i < count; ++i)
+		{
+			std::int64_t vertex = baseVertex + indices[i];
+			if (vertex < 0 || vertex >= vertexCount)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+//=========================================================================================
+void MeshFileWriter::SetVertices(VertexFormat format, const void* data, UINT byteSize)
+{
+	Format = format;
+	Vertices.Data = data;
+	Vertices.ByteSize = byteSize;
+}
+
+//=========================================================================================
+void MeshFileWriter::SetIndices(DXGI_FORMAT format, const void* data, UINT byteSize)
+{
+	IndexFormat = format;
+	Indices.Data = data;
+	Indices.ByteSize = byteSize;
+}
+
+//=========================================================================================
+void MeshFileWriter::AddSubmesh(const std::string& name, const SubmeshGeometry& submesh)
+{
+	Submeshes.push_back({ name, submesh });
+}
+
+//=========================================================================================
+void MeshFileWriter::AddSection(const std::string& name, const void* data, size_t byteSize)
+{
+	Blob section;
+	section.Name = name;
+	section.Data = data;
+	section.ByteSize = byteSize;
+	Sections.push_back(section);
+}
+
+//=========================================================================================
+std::vector<BYTE> MeshFileWriter::Serialize(std::uint64_t sourceHash) const
+{
+	MeshFileHeader header;
+	header.Magic = kMagic;
+	header.Version = kVersion;
+	header.SourceHash = sourceHash;
+
+	// Lay out the tables and the string table they refer to
+	std::string strings;
+	std::vector<IndexChunk> chunks;
+
+	std::vector<MeshFileSubmesh> submeshes(Submeshes.size());
+	for (size_t i = 0; i < Submeshes.size(); ++i)
+	{
+		const SubmeshGeometry& submesh = Submeshes[i].second;
+		MeshFileSubmesh& fileSubmesh = submeshes[i];
+
+		fileSubmesh.NameOffset = (std::uint32_t)strings.size();
+		fileSubmesh.NameLength = (std::uint32_t)Submeshes[i].first.size();
+		strings += Submeshes[i].first;
+
+		fileSubmesh.IndexCount = submesh.IndexCount;
+		fileSubmesh.StartIndexLocation = submesh.StartIndexLocation;
+		fileSubmesh.BaseVertexLocation = submesh.BaseVertexLocation;
+		fileSubmesh.FirstChunk = (std::uint32_t)chunks.size();
+		fileSubmesh.ChunkCount = (std::uint32_t)submesh.Chunks.size();
+		fileSubmesh.IndexFormat = (std::uint32_t)(submesh.IndexFormat != DXGI_FORMAT_UNKNOWN ? submesh.IndexFormat : IndexFormat);
+		fileSubmesh.BoundsCenter = submesh.Bounds.Center;
+		fileSubmesh.BoundsExtents = submesh.Bounds.Extents;
+		fileSubmesh.SphereCenter = submesh.Sphere.Center;
+		fileSubmesh.SphereRadius = submesh.Sphere.Radius;
+		chunks.insert(chunks.end(), submesh.Chunks.begin(), submesh.Chunks.end());
+	}
+
+	std::vector<MeshFileSection> sections(Sections.size());
+	for (size_t i = 0; i < Sections.size(); ++i)
+	{
+		sections[i].NameOffset = (std::uint32_t)strings.size();
+		sections[i].NameLength = (std::uint32_t)Sections[i].Name.size();
+		sections[i].ByteSize = Sections[i].ByteSize;
+		strings += Sections[i].Name;
+	}
+
+	header.VertexFormat = (std::uint32_t)Format;
+	header.VertexByteStride = VertexCompression::GetVertexStride(Format);
+	header.VertexDataByteSize = Vertices.ByteSize;
+	header.IndexFormat = (std::uint32_t)IndexFormat;
+	header.IndexDataByteSize = Indices.ByteSize;
+	header.SubmeshCount = (std::uint32_t)submeshes.size();
+	header.ChunkCount = (std::uint32_t)chunks.size();
+	header.SectionCount = (std::uint32_t)sections.size();
+	header.StringsByteSize = (std::uint32_t)strings.size();
+
+	std::uint64_t offset = AlignUp(sizeof(MeshFileHeader));
+	header.VertexDataOffset = offset;
+	offset = AlignUp(offset + header.VertexDataByteSize);
+	header.IndexDataOffset = offset;
+	offset = AlignUp(offset + header.IndexDataByteSize);
+	header.SubmeshOffset = offset;
+	offset = AlignUp(offset + submeshes.size() * sizeof(MeshFileSubmesh));
+	header.ChunkOffset = offset;
+	offset = AlignUp(offset + chunks.size() * sizeof(IndexChunk));
+	header.SectionOffset = offset;
+	offset = AlignUp(offset + sections.size() * sizeof(MeshFileSection));
+	for (MeshFileSection& section : sections)
+	{
+		section.Offset = offset;
+		offset = AlignUp(offset + section.ByteSize);
+	}
+	header.StringsOffset = offset;
+	header.FileSize = offset + strings.size();
+
+	// Padding stays zero so the checksum only depends on the contents
+	std::vector<BYTE> file((size_t)header.FileSize, 0);
+	auto copyTo = [&file](std::uint64_t dstOffset, const void* src, size_t byteSize)
+	{
+		if (byteSize > 0)
+		{
+			std::memcpy(&file[(size_t)dstOffset], src, byteSize);
+		}
+	};
+
+	copyTo(header.VertexDataOffset, Vertices.Data, Vertices.ByteSize);
+	copyTo(header.IndexDataOffset, Indices.Data, Indices.ByteSize);
+	copyTo(header.SubmeshOffset, submeshes.data(), submeshes.size() * sizeof(MeshFileSubmesh));
+	copyTo(header.ChunkOffset, chunks.data(), chunks.size() * sizeof(IndexChunk));
+	copyTo(header.SectionOffset, sections.data(), sections.size() * sizeof(MeshFileSection));
+	for (size_t i = 0; i < Sections.size(); ++i)
+	{
+		copyTo(sections[i].Offset, Sections[i].Data, Sections[i].ByteSize);
+	}
+	copyTo(header.StringsOffset, strings.data(), strings.size());
+
+	header.Checksum = ComputeChecksum(file.data() + sizeof(MeshFileHeader), file.size() - sizeof(MeshFileHeader));
+	copyTo(0, &header, sizeof(header));
+
+	return file;
+}
+
+//=========================================================================================
+bool MeshFileWriter::WriteFile(const std::wstring& path, const std::vector<BYTE>& file, std::string* error)
+{
+	std::wstring temporaryPath = path + L".tmp";
+	std::ofstream fout(temporaryPath, std::ios::binary | std::ios::trunc);
+	fout.write((const char*)file.data(), file.size());
+	fout.close();
+
+	if (!fout)
+	{
+		if (error != nullptr)
+		{
+			*error = "could not write the mesh file";
+		}
+		DeleteFileW(temporaryPath.c_str());
+		return false;
+	}
+
+	if (!MoveFileExW(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		if (error != nullptr)
+		{
+			*error = "could not replace the mesh file";
+		}
+		DeleteFileW(temporaryPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+//=========================================================================================
+bool MeshFileReader::Open(const void* data, size_t byteSize, std::uint64_t expectedSourceHash, bool validateContents, std::string* error)
+{
+	Close();
+
+	if (data == nullptr || byteSize < sizeof(MeshFileHeader))
+	{
+		return Fail(error, "file is smaller than the header");
+	}
+	if (((size_t)data & (kMinDataAlignment - 1)) != 0)
+	{
+		return Fail(error, "file data is not aligned");
+	}
+
+	const BYTE* bytes = (const BYTE*)data;
+	const MeshFileHeader* header = (const MeshFileHeader*)data;
+	if (header->Magic != MeshFileWriter::kMagic)
+	{
+		return Fail(error, "not a mesh file");
+	}
+	if (header->Version != MeshFileWriter::kVersion)
+	{
+		return Fail(error, "version " + std::to_string(header->Version) + ", expected " + std::to_string(MeshFileWriter::kVersion));
+	}
+	if (header->FileSize != byteSize)
+	{
+		return Fail(error, "file is truncated");
+	}
+	if (header->SourceHash != expectedSourceHash)
+	{
+		return Fail(error, "file is stale");
+	}
+
+	// Vertex format descriptor
+	if (header->VertexFormat > VertexFormat::QuantizedPosition ||
+		header->VertexByteStride != VertexCompression::GetVertexStride((VertexFormat)header->VertexFormat))
+	{
+		return Fail(error, "unknown vertex format");
+	}
+	if (header->IndexFormat != DXGI_FORMAT_R16_UINT && header->IndexFormat != DXGI_FORMAT_R32_UINT)
+	{
+		return Fail(error, "unknown index format");
+	}
+	const std::uint64_t indexSize = header->IndexFormat == DXGI_FORMAT_R16_UINT ? 2 : 4;
+
+	// Every stream and table has to be aligned and inside the file. Buffer sizes are UINTs
+	// in D3D12, so the streams have to fit in 32 bits as well.
+	const struct
+	{
+		std::uint64_t Offset;
+		std::uint64_t ByteSize;
+	} ranges[] =
+	{
+		{ header->VertexDataOffset, header->VertexDataByteSize },
+		{ header->IndexDataOffset, header->IndexDataByteSize },
+		{ header->SubmeshOffset, (std::uint64_t)header->SubmeshCount * sizeof(MeshFileSubmesh) },
+		{ header->ChunkOffset, (std::uint64_t)header->ChunkCount * sizeof(IndexChunk) },
+		{ header->SectionOffset, (std::uint64_t)header->SectionCount * sizeof(MeshFileSection) },
+		{ header->StringsOffset, header->StringsByteSize },
+	};
+	for (const auto& range : ranges)
+	{
+		if ((range.Offset & (kAlignment - 1)) != 0 || range.Offset < sizeof(MeshFileHeader) || !IsRangeInside(range.Offset, range.ByteSize, byteSize))
+		{
+			return Fail(error, "table outside of the file");
+		}
+	}
+	if (header->VertexDataByteSize > UINT32_MAX || header->IndexDataByteSize > UINT32_MAX ||
+		header->VertexDataByteSize % header->VertexByteStride != 0 || header->IndexDataByteSize % indexSize != 0)
+	{
+		return Fail(error, "invalid stream size");
+	}
+
+	if (validateContents && header->Checksum != ComputeChecksum(bytes + sizeof(MeshFileHeader), byteSize - sizeof(MeshFileHeader)))
+	{
+		return Fail(error, "checksum mismatch");
+	}
+
+	const MeshFileSubmesh* submeshes = (const MeshFileSubmesh*)(bytes + header->SubmeshOffset);
+	const IndexChunk* chunks = (const IndexChunk*)(bytes + header->ChunkOffset);
+	const MeshFileSection* sections = (const MeshFileSection*)(bytes + header->SectionOffset);
+
+	const std::int64_t vertexCount = (std::int64_t)(header->VertexDataByteSize / header->VertexByteStride);
+	const BYTE* indexData = bytes + header->IndexDataOffset;
+
+	for (std::uint32_t i = 0; i < header->SubmeshCount; ++i)
+	{
+		const MeshFileSubmesh& submesh = submeshes[i];
+		if (!IsRangeInside(submesh.NameOffset, submesh.NameLength, header->StringsByteSize))
+		{
+			return Fail(error, "submesh name outside of the string table");
+		}
+		if (submesh.IndexFormat != DXGI_FORMAT_R16_UINT && submesh.IndexFormat != DXGI_FORMAT_R32_UINT)
+		{
+			return Fail(error, "unknown submesh index format");
+		}
+
+		// Ranges count indices of the submesh's own format
+		const bool isIndex16 = submesh.IndexFormat == DXGI_FORMAT_R16_UINT;
+		const std::uint64_t indexCount = header->IndexDataByteSize / (isIndex16 ? 2 : 4);
+		auto areIndicesInside = [&](std::uint64_t begin, std::uint64_t count, std::int64_t baseVertex)
+		{
+			return isIndex16 ?
+				AreIndicesInside<std::uint16_t>(indexData, begin, count, baseVertex, vertexCount) :
+				AreIndicesInside<std::uint32_t>(indexData, begin, count, baseVertex, vertexCount);
+		};
+
+		if (!IsRangeInside(submesh.StartIndexLocation, submesh.IndexCount, indexCount) ||
+			!IsRangeInside(submesh.FirstChunk, submesh.ChunkCount, header->ChunkCount))
+		{
+			return Fail(error, "submesh range outside of the file");
+		}
+
+		// Chunks have to tile the submesh's index range
+		std::uint64_t chunkEnd = submesh.StartIndexLocation;
+		for (std::uint32_t c = submesh.FirstChunk; c < submesh.FirstChunk + submesh.ChunkCount; ++c)
+		{
+			if (chunks[c].StartIndexLocation != chunkEnd)
+			{
+				return Fail(error, "submesh chunks do not cover it");
+			}
+			chunkEnd += chunks[c].IndexCount;
+			if (chunkEnd > (std::uint64_t)submesh.StartIndexLocation + submesh.IndexCount)
+			{
+				return Fail(error, "submesh chunks do not cover it");
+			}
+
+			if (validateContents && !areIndicesInside(chunks[c].StartIndexLocation, chunks[c].IndexCount, chunks[c].BaseVertexLocation))
+			{
+				return Fail(error, "index outside of the vertex stream");
+			}
+		}
+		if (submesh.ChunkCount > 0 && chunkEnd != (std::uint64_t)submesh.StartIndexLocation + submesh.IndexCount)
+		{
+			return Fail(error, "submesh chunks do not cover it");
+		}
+
+		if (validateContents && submesh.ChunkCount == 0 && !areIndicesInside(submesh.StartIndexLocation, submesh.IndexCount, submesh.BaseVertexLocation))
+		{
+			return Fail(error, "index outside of the vertex stream");
+		}
+	}
+
+	for (std::uint32_t i = 0; i < header->SectionCount; ++i)
+	{
+		const MeshFileSection& section = sections[i];
+		if (!IsRangeInside(section.NameOffset, section.NameLength, header->StringsByteSize) ||
+			(section.Offset & (kAlignment - 1)) != 0 || !IsRangeInside(section.Offset, section.ByteSize, byteSize))
+		{
+			return Fail(error, "section outside of the file");
+		}
+	}
+
+	Data = bytes;
+	Header = header;
+	Submeshes = submeshes;
+	Chunks = chunks;
+	Sections = sections;
+	Strings = (const char*)(bytes + header->StringsOffset);
+	return true;
+}
+
+//=========================================================================================
+void MeshFileReader::Close()
+{
+	Data = nullptr;
+	Header = nullptr;
+	Submeshes = nullptr;
+	Chunks = nullptr;
+	Sections = nullptr;
+	Strings = nullptr;
+}
+
+//=========================================================================================
+bool MeshFileReader::IsOpen() const
+{
+	return Header != nullptr;
+}
+
+//=========================================================================================
+VertexFormat MeshFileReader::GetVertexFormat() const
+{
+	return (VertexFormat)Header->VertexFormat;
+}
+
+//=========================================================================================
+UINT MeshFileReader::GetVertexByteStride() const
+{
+	return Header->VertexByteStride;
+}
+
+//=========================================================================================
+const void* MeshFileReader::GetVertexData() const
+{
+	return Data + Header->VertexDataOffset;
+}
+
+//=========================================================================================
+UINT MeshFileReader::GetVertexBufferByteSize() const
+{
+	return (UINT)Header->VertexDataByteSize;
+}
+
+//=========================================================================================
+DXGI_FORMAT MeshFileReader::GetIndexFormat() const
+{
+	return (DXGI_FORMAT)Header->IndexFormat;
+}
+
+//=========================================================================================
+const void* MeshFileReader::GetIndexData() const
+{
+	return Data + Header->IndexDataOffset;
+}
+
+//=========================================================================================
+UINT MeshFileReader::GetIndexBufferByteSize() const
+{
+	return (UINT)Header->IndexDataByteSize;
+}
+
+//=========================================================================================
+void MeshFileReader::GetDrawArgs(std::unordered_map<std::string, SubmeshGeometry>& drawArgs) const
+{
+	for (std::uint32_t i = 0; i < Header->SubmeshCount; ++i)
+	{
+		const MeshFileSubmesh& fileSubmesh = Submeshes[i];
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = fileSubmesh.IndexCount;
+		submesh.StartIndexLocation = fileSubmesh.StartIndexLocation;
+		submesh.BaseVertexLocation = fileSubmesh.BaseVertexLocation;
+		submesh.Bounds.Center = fileSubmesh.BoundsCenter;
+		submesh.Bounds.Extents = fileSubmesh.BoundsExtents;
+		submesh.Sphere.Center = fileSubmesh.SphereCenter;
+		submesh.Sphere.Radius = fileSubmesh.SphereRadius;
+		submesh.Chunks.assign(Chunks + fileSubmesh.FirstChunk, Chunks + fileSubmesh.FirstChunk + fileSubmesh.ChunkCount);
+		submesh.IndexFormat = (DXGI_FORMAT)fileSubmesh.IndexFormat;
+
+		drawArgs[GetString(fileSubmesh.NameOffset, fileSubmesh.NameLength)] = submesh;
+	}
+}
+
+//=========================================================================================
+bool MeshFileReader::GetSection(const std::string& name, const void** data, size_t* byteSize) const
+{
+	for (std::uint32_t i = 0; i < Header->SectionCount; ++i)
+	{
+		const MeshFileSection& section = Sections[i];
+		if (section.NameLength == name.size() && std::memcmp(Strings + section.NameOffset, name.data(), name.size()) == 0)
+		{
+			*data = Data + section.Offset;
+			*byteSize = (size_t)section.ByteSize;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//=========================================================================================
+bool MeshFileReader::Fail(std::string* error, const std::string& message)
+{
+	if (error != nullptr)
+	{
+		*error = message;
+	}
+	Close();
+	return false;
+}
+
+//=========================================================================================
+std::string MeshFileReader::GetString(std::uint32_t offset, std::uint32_t length) const
+{
+	return std::string(Strings + offset, length);
+}
+
+//=========================================================================================
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+//=========================================================================================
+bool MappedFile::Open(const std::wstring& path, std::string* error)
+{
+	Close();
+
+	File = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (File == INVALID_HANDLE_VALUE)
+	{
+		if (error != nullptr)
+		{
+			*error = "could not open the file";
+		}
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(File, &fileSize) || fileSize.QuadPart == 0 || (std::uint64_t)fileSize.QuadPart > SIZE_MAX)
+	{
+		if (error != nullptr)
+		{
+			*error = "file is empty";
+		}
+		Close();
+		return false;
+	}
+
+	Mapping = CreateFileMappingW(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	View = Mapping != nullptr ? MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (View == nullptr)
+	{
+		if (error != nullptr)
+		{
+			*error = "could not map the file";
+		}
+		Close();
+		return false;
+	}
+
+	ByteSize = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+//=========================================================================================
+void MappedFile::Close()
+{
+	if (View != nullptr)
+	{
+		UnmapViewOfFile(View);
+		View = nullptr;
+	}
+	if (Mapping != nullptr)
+	{
+		CloseHandle(Mapping);
+		Mapping = nullptr;
+	}
+	if (File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(File);
+		File = INVALID_HANDLE_VALUE;
+	}
+	ByteSize = 0;
+}
+
+//=========================================================================================
+const void* MappedFile::GetData() const
+{
+	return View;
+}
+
+//=========================================================================================
+size_t MappedFile::GetByteSize() const
+{
+	return ByteSize;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "FromBook/d3dUtil.h"
+#include "VertexCompression.h"
+
+// On disk layout of a mesh file: the header, then the vertex stream, index stream, submesh
+// table, chunk table, section table and string table. Offsets are from the start of the
+// file and 16 byte aligned, so everything can be used in place from a memory mapping.
+// Values are stored in the byte order of the machine that wrote them (little endian).
+struct MeshFileHeader
+{
+	std::uint32_t Magic = 0;
+	std::uint32_t Version = 0;
+	std::uint64_t FileSize = 0;
+
+	// Identifies what the file was generated from, a file whose hash differs is stale
+	std::uint64_t SourceHash = 0;
+
+	// FNV-1a over the 8 byte words of everything after the header
+	std::uint64_t Checksum = 0;
+
+	// Vertex format descriptor, VertexFormat and its stride
+	std::uint32_t VertexFormat = 0;
+	std::uint32_t VertexByteStride = 0;
+	std::uint64_t VertexDataOffset = 0;
+	std::uint64_t VertexDataByteSize = 0;
+
+	// DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT
+	std::uint32_t IndexFormat = 0;
+	std::uint32_t Reserved = 0;
+	std::uint64_t IndexDataOffset = 0;
+	std::uint64_t IndexDataByteSize = 0;
+
+	std::uint32_t SubmeshCount = 0;
+	std::uint32_t ChunkCount = 0;
+	std::uint32_t SectionCount = 0;
+	std::uint32_t StringsByteSize = 0;
+	std::uint64_t SubmeshOffset = 0;
+	std::uint64_t ChunkOffset = 0;
+	std::uint64_t SectionOffset = 0;
+	std::uint64_t StringsOffset = 0;
+};
+
+// A SubmeshGeometry, its chunks are Chunks[FirstChunk, FirstChunk + ChunkCount) of the
+// file's IndexChunk table
+struct MeshFileSubmesh
+{
+	std::uint32_t NameOffset = 0;
+	std::uint32_t NameLength = 0;
+
+	std::uint32_t IndexCount = 0;
+	std::uint32_t StartIndexLocation = 0;
+	std::int32_t BaseVertexLocation = 0;
+
+	std::uint32_t FirstChunk = 0;
+	std::uint32_t ChunkCount = 0;
+
+	// DXGI_FORMAT_R16_UINT or DXGI_FORMAT_R32_UINT. Differs from the header's when the index
+	// stream mixes both, StartIndexLocation and the chunks count indices of this format.
+	std::uint32_t IndexFormat = 0;
+
+	DirectX::XMFLOAT3 BoundsCenter = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 BoundsExtents = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 SphereCenter = { 0.0f, 0.0f, 0.0f };
+	float SphereRadius = 0.0f;
+};
+
+// Named blob of extra data stored with the mesh, e.g. meshlets
+struct MeshFileSection
+{
+	std::uint32_t NameOffset = 0;
+	std::uint32_t NameLength = 0;
+	std::uint64_t Offset = 0;
+	std::uint64_t ByteSize = 0;
+};
+
+// Collects the streams and tables of a mesh file and lays them out. Only pointers to the
+// data are kept, it has to stay alive until Serialize returns.
+class MeshFileWriter
+{
+	public:
+		static const std::uint32_t kMagic = 0x4853454D; // "MESH"
+		static const std::uint32_t kVersion = 3;
+
+		void SetVertices(VertexFormat format, const void* data, UINT byteSize);
+		void SetIndices(DXGI_FORMAT format, const void* data, UINT byteSize);
+		void AddSubmesh(const std::string& name, const SubmeshGeometry& submesh);
+		void AddSection(const std::string& name, const void* data, size_t byteSize);
+
+		std::vector<BYTE> Serialize(std::uint64_t sourceHash) const;
+
+		// Writes a serialized file to a temporary file first and renames it, so a reader never
+		// maps a partly written file
+		static bool WriteFile(const std::wstring& path, const std::vector<BYTE>& file, std::string* error = nullptr);
+
+	private:
+		struct Blob
+		{
+			std::string Name;
+			const void* Data = nullptr;
+			size_t ByteSize = 0;
+		};
+
+		VertexFormat Format = VertexFormat::FullPrecision;
+		Blob Vertices;
+
+		DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
+		Blob Indices;
+
+		std::vector<std::pair<std::string, SubmeshGeometry>> Submeshes;
+		std::vector<Blob> Sections;
+};
+
+// Validates a mesh file in memory and gives access to its contents in place. Nothing is
+// copied, the memory has to outlive the reader and be at least 8 byte aligned.
+class MeshFileReader
+{
+	public:
+		// Checks the header and that every offset, count and range lies inside the file.
+		// validateContents additionally verifies the checksum and that every index stays
+		// inside the vertex stream, which touches every byte of the file.
+		bool Open(const void* data, size_t byteSize, std::uint64_t expectedSourceHash, bool validateContents = true, std::string* error = nullptr);
+		void Close();
+
+		bool IsOpen() const;
+
+		VertexFormat GetVertexFormat() const;
+		UINT GetVertexByteStride() const;
+		const void* GetVertexData() const;
+		UINT GetVertexBufferByteSize() const;
+
+		DXGI_FORMAT GetIndexFormat() const;
+		const void* GetIndexData() const;
+		UINT GetIndexBufferByteSize() const;
+
+		// Builds the SubmeshGeometry of every submesh, the only part of the file that is copied
+		void GetDrawArgs(std::unordered_map<std::string, SubmeshGeometry>& drawArgs) const;
+
+		// Returns false when the file has no section of that name
+		bool GetSection(const std::string& name, const void** data, size_t* byteSize) const;
+
+	private:
+		bool Fail(std::string* error, const std::string& message);
+		std::string GetString(std::uint32_t offset, std::uint32_t length) const;
+
+	private:
+		const BYTE* Data = nullptr;
+		const MeshFileHeader* Header = nullptr;
+		const MeshFileSubmesh* Submeshes = nullptr;
+		const IndexChunk* Chunks = nullptr;
+		const MeshFileSection* Sections = nullptr;
+		const char* Strings = nullptr;
+};
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile& rhs) = delete;
+		MappedFile& operator=(const MappedFile& rhs) = delete;
+		~MappedFile();
+
+		bool Open(const std::wstring& path, std::string* error = nullptr);
+		void Close();
+
+		const void* GetData() const;
+		size_t GetByteSize() const;
+
+	private:
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+		const void* View = nullptr;
+		size_t ByteSize = 0;
+};
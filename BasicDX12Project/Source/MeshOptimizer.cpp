@@ -0,0 +1,386 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+using namespace DirectX;
+
+namespace
+{
+	// Tuning values from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+	const int kForsythCacheSize = 32;
+	const float kCacheDecayPower = 1.5f;
+	const float kLastTriangleScore = 0.75f;
+	const float kValenceBoostScale = 2.0f;
+	const float kValenceBoostPower = 0.5f;
+
+	float ForsythVertexScore(int cachePosition, MeshOptimizer::uint32 remainingTriangles)
+	{
+		// No triangles left to use this vertex, so it should never be picked
+		if (remainingTriangles == 0)
+		{
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// The vertices of the last triangle get a fixed score so we don't just
+				// strip along the most recent edge
+				score = kLastTriangleScore;
+			}
+			else
+			{
+				const float scaler = 1.0f / (kForsythCacheSize - 3);
+				score = powf(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+			}
+		}
+
+		// Boost vertices with few triangles left so we finish off lone vertices
+		// instead of leaving them to cost a transform later
+		score += kValenceBoostScale * powf((float)remainingTriangles, -kValenceBoostPower);
+
+		return score;
+	}
+}
+
+//=========================================================================================
+MeshOptimizer::OptimizeReport MeshOptimizer::Optimize(GeometryGenerator::MeshData& meshData)
+{
+	OptimizeReport report;
+	report.Before = AnalyzeVertexCache(meshData.Indices32, meshData.Vertices.size());
+
+	OptimizeVertexCache(meshData.Indices32, meshData.Vertices.size());
+	OptimizeOverdraw(meshData.Indices32, meshData.Vertices);
+	OptimizeVertexFetch(meshData);
+
+	report.After = AnalyzeVertexCache(meshData.Indices32, meshData.Vertices.size());
+	return report;
+}
+
+//=========================================================================================
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<uint32>& indices, size_t vertexCount, uint32 cacheSize)
+{
+	CacheStats stats;
+	if (indices.empty())
+	{
+		return stats;
+	}
+
+	// Hardware post-transform caches behave close to a FIFO: a hit does not refresh the entry.
+	// Each vertex remembers the miss counter value it was inserted at, so it is still cached
+	// until more than cacheSize misses happened since then.
+	std::vector<uint32> insertedAt(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+
+	uint32 misses = 0;
+	uint32 referencedCount = 0;
+	for (uint32 index : indices)
+	{
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			++referencedCount;
+		}
+		else if (misses - insertedAt[index] <= cacheSize)
+		{
+			continue;
+		}
+
+		insertedAt[index] = misses;
+		++misses;
+	}
+
+	stats.Acmr = (float)misses / (indices.size() / 3);
+	stats.Atvr = (float)misses / referencedCount;
+	return stats;
+}
+
+//=========================================================================================
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32>& indices, size_t vertexCount)
+{
+	const uint32 triangleCount = (uint32)(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Build the vertex -> triangle adjacency as one flat array with per-vertex offsets.
+	// RemainingTriangles counts how many of a vertex's triangles have not been emitted
+	// and is also how far into its slice the live triangles go.
+	std::vector<uint32> remainingTriangles(vertexCount, 0);
+	for (uint32 index : indices)
+	{
+		++remainingTriangles[index];
+	}
+
+	std::vector<uint32> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remainingTriangles[v];
+	}
+
+	std::vector<uint32> adjacency(indices.size());
+	{
+		std::vector<uint32> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32 t = 0; t < triangleCount; ++t)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32 v = indices[t * 3 + k];
+				adjacency[fill[v]++] = t;
+			}
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		vertexScore[v] = ForsythVertexScore(-1, remainingTriangles[v]);
+	}
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (uint32 t = 0; t < triangleCount; ++t)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+	}
+
+	// Start at the best triangle overall
+	uint32 bestTriangle = (uint32)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+	std::vector<uint32> cache;
+	std::vector<uint32> newCache;
+	cache.reserve(kForsythCacheSize + 3);
+	newCache.reserve(kForsythCacheSize + 3);
+
+	std::vector<uint32> output(indices.size());
+	uint32 nextUnemitted = 0;
+
+	for (uint32 outTriangle = 0; outTriangle < triangleCount; ++outTriangle)
+	{
+		if (bestTriangle == UINT32_MAX)
+		{
+			// Nothing in the cache has triangles left, so continue with the next triangle in
+			// the original order. Everything before nextUnemitted is done already.
+			while (emitted[nextUnemitted])
+			{
+				++nextUnemitted;
+			}
+			bestTriangle = nextUnemitted;
+		}
+
+		emitted[bestTriangle] = true;
+		const uint32* tri = &indices[bestTriangle * 3];
+		output[outTriangle * 3 + 0] = tri[0];
+		output[outTriangle * 3 + 1] = tri[1];
+		output[outTriangle * 3 + 2] = tri[2];
+
+		// Drop the triangle from its vertices' live adjacency lists
+		for (int k = 0; k < 3; ++k)
+		{
+			uint32 v = tri[k];
+			uint32* begin = &adjacency[adjacencyOffsets[v]];
+			uint32* end = begin + remainingTriangles[v];
+			uint32* found = std::find(begin, end, bestTriangle);
+			std::swap(*found, *(end - 1));
+			--remainingTriangles[v];
+		}
+
+		// The triangle's vertices move to the front of the LRU cache
+		newCache.assign(tri, tri + 3);
+		for (uint32 v : cache)
+		{
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+			{
+				newCache.push_back(v);
+			}
+		}
+
+		// Rescore everything that was or still is in the cache. Vertices past the cache size
+		// fall out, but still need their score lowered.
+		for (size_t i = 0; i < newCache.size(); ++i)
+		{
+			uint32 v = newCache[i];
+			cachePosition[v] = i < (size_t)kForsythCacheSize ? (int)i : -1;
+
+			float newScore = ForsythVertexScore(cachePosition[v], remainingTriangles[v]);
+			float delta = newScore - vertexScore[v];
+			vertexScore[v] = newScore;
+
+			const uint32* live = &adjacency[adjacencyOffsets[v]];
+			for (uint32 j = 0; j < remainingTriangles[v]; ++j)
+			{
+				triangleScore[live[j]] += delta;
+			}
+		}
+
+		if (newCache.size() > (size_t)kForsythCacheSize)
+		{
+			newCache.resize(kForsythCacheSize);
+		}
+		std::swap(cache, newCache);
+
+		// The next triangle is the best one touching a cached vertex
+		bestTriangle = UINT32_MAX;
+		float bestScore = -1.0f;
+		for (uint32 v : cache)
+		{
+			const uint32* live = &adjacency[adjacencyOffsets[v]];
+			for (uint32 j = 0; j < remainingTriangles[v]; ++j)
+			{
+				if (triangleScore[live[j]] > bestScore)
+				{
+					bestScore = triangleScore[live[j]];
+					bestTriangle = live[j];
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+//=========================================================================================
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32>& indices, const std::vector<GeometryGenerator::Vertex>& vertices)
+{
+	const uint32 triangleCount = (uint32)(indices.size() / 3);
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Replay the cache and start a new cluster at every triangle that misses on all three
+	// vertices. Those triangles pay for a full cache reload wherever they are drawn, so
+	// moving whole clusters around does not change the cache cost.
+	std::vector<uint32> clusterStarts;
+	{
+		std::vector<uint32> insertedAt(vertices.size(), 0);
+		std::vector<bool> seen(vertices.size(), false);
+		uint32 misses = 0;
+
+		for (uint32 t = 0; t < triangleCount; ++t)
+		{
+			int triangleMisses = 0;
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32 v = indices[t * 3 + k];
+				if (seen[v] && misses - insertedAt[v] <= kDefaultCacheSize)
+				{
+					continue;
+				}
+
+				seen[v] = true;
+				insertedAt[v] = misses++;
+				++triangleMisses;
+			}
+
+			if (t == 0 || triangleMisses == 3)
+			{
+				clusterStarts.push_back(t);
+			}
+		}
+	}
+
+	if (clusterStarts.size() <= 1)
+	{
+		return;
+	}
+	clusterStarts.push_back(triangleCount);
+
+	// Clusters facing outward from the mesh center occlude the rest of the mesh, so they
+	// should be drawn first. Sort by how far along its own normal each cluster sits.
+	XMVECTOR meshCenter = XMVectorZero();
+	for (const GeometryGenerator::Vertex& v : vertices)
+	{
+		meshCenter += XMLoadFloat3(&v.Position);
+	}
+	meshCenter = meshCenter / (float)std::max<size_t>(vertices.size(), 1);
+
+	const size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<float> sortKey(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+
+		for (uint32 t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[t * 3 + 0]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[t * 3 + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[t * 3 + 2]].Position);
+
+			// Area weighted, the cross product length is twice the triangle area
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			float triangleArea = XMVectorGetX(XMVector3Length(n));
+
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+
+		if (area <= 0.0f)
+		{
+			sortKey[c] = -FLT_MAX;
+			continue;
+		}
+
+		centroid = centroid / area;
+		normal = XMVector3Normalize(normal);
+		sortKey[c] = XMVectorGetX(XMVector3Dot(centroid - meshCenter, normal));
+	}
+
+	std::vector<uint32> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKey](uint32 a, uint32 b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<uint32> output;
+	output.reserve(indices.size());
+	for (uint32 c : order)
+	{
+		output.insert(output.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+
+	indices.swap(output);
+}
+
+//=========================================================================================
+void MeshOptimizer::OptimizeVertexFetch(GeometryGenerator::MeshData& meshData)
+{
+	const uint32 vertexCount = (uint32)meshData.Vertices.size();
+	const uint32 kUnassigned = UINT32_MAX;
+
+	std::vector<uint32> remap(vertexCount, kUnassigned);
+	uint32 nextVertex = 0;
+
+	for (uint32& index : meshData.Indices32)
+	{
+		if (remap[index] == kUnassigned)
+		{
+			remap[index] = nextVertex++;
+		}
+		index = remap[index];
+	}
+
+	// Keep unreferenced vertices, after all the referenced ones
+	for (uint32& slot : remap)
+	{
+		if (slot == kUnassigned)
+		{
+			slot = nextVertex++;
+		}
+	}
+
+	std::vector<GeometryGenerator::Vertex> reordered(vertexCount);
+	for (uint32 v = 0; v < vertexCount; ++v)
+	{
+		reordered[remap[v]] = meshData.Vertices[v];
+	}
+
+	meshData.Vertices.swap(reordered);
+}
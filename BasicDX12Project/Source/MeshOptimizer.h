@@ -0,0 +1,50 @@
+#pragma once
+
+#include "FromBook/GeometryGenerator.h"
+
+// Reorders GeometryGenerator meshes so they are cheaper for the GPU to draw
+class MeshOptimizer
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		// Vertex cache efficiency of an index buffer, measured with a FIFO cache simulation
+		struct CacheStats
+		{
+			// Average cache miss ratio: transformed vertices per triangle (0.5 is ideal for big
+			// regular meshes, 3.0 is the worst case)
+			float Acmr = 0.0f;
+
+			// Average transform to vertex ratio: transformed vertices per referenced vertex
+			// (1.0 is ideal)
+			float Atvr = 0.0f;
+		};
+
+		struct OptimizeReport
+		{
+			CacheStats Before;
+			CacheStats After;
+		};
+
+		// Default size of the simulated post-transform cache used for the stats
+		static const uint32 kDefaultCacheSize = 16;
+
+		// Runs the vertex cache, overdraw and vertex fetch passes on the mesh, in that order,
+		// and reports the cache stats before and after
+		static OptimizeReport Optimize(GeometryGenerator::MeshData& meshData);
+
+		static CacheStats AnalyzeVertexCache(const std::vector<uint32>& indices, size_t vertexCount, uint32 cacheSize = kDefaultCacheSize);
+
+		// Reorders triangles for post-transform cache reuse with Tom Forsyth's linear-speed
+		// vertex cache optimization
+		static void OptimizeVertexCache(std::vector<uint32>& indices, size_t vertexCount);
+
+		// Cuts an already cache-optimized index buffer into clusters where the cache is
+		// flushed anyway, then sorts the clusters so the ones facing away from the mesh
+		// center are drawn first. This lowers overdraw without hurting cache reuse.
+		static void OptimizeOverdraw(std::vector<uint32>& indices, const std::vector<GeometryGenerator::Vertex>& vertices);
+
+		// Renumbers vertices in the order the index buffer first uses them so vertex fetches
+		// walk memory linearly. Vertices that are never referenced are moved to the end.
+		static void OptimizeVertexFetch(GeometryGenerator::MeshData& meshData);
+};
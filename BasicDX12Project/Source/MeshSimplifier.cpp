@@ -0,0 +1,822 @@
+#include "MeshSimplifier.h"
+#include "TangentFrames.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <queue>
+
+namespace
+{
+	using uint32 = MeshSimplifier::uint32;
+	using uint64 = GeometryGenerator::uint64;
+
+	// Border edges add a plane perpendicular to the surface so open meshes keep their outline.
+	// The weight makes moving the outline cost more than bending the surface.
+	const double kBorderWeight = 10.0;
+
+	// A collapse may not turn any remaining triangle by more than ~78 degrees
+	const double kMinNormalCos = 0.2;
+
+	// Tie breaker for collapses of equal quadric error, as a fraction of the squared edge length
+	// the collapse is allowed to move the surface (area weighted quadrics scale with length^4)
+	const double kEdgeLengthWeight = 1e-4;
+
+	// Vertices closer than this fraction of the mesh size are treated as one position
+	const double kWeldTolerance = 1e-5;
+
+	// Collapses run in double precision, small position errors add up over many collapses
+	struct Vec3d
+	{
+		double x = 0.0;
+		double y = 0.0;
+		double z = 0.0;
+	};
+
+	Vec3d Subtract(const Vec3d& a, const Vec3d& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	Vec3d Cross(const Vec3d& a, const Vec3d& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	double Dot(const Vec3d& a, const Vec3d& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	double Length(const Vec3d& a)
+	{
+		return sqrt(Dot(a, a));
+	}
+
+	// Sum of squared distances to a set of weighted planes, stored as the upper half of the
+	// symmetric 4x4 matrix from Garland and Heckbert
+	struct Quadric
+	{
+		double A00 = 0.0, A01 = 0.0, A02 = 0.0, A11 = 0.0, A12 = 0.0, A22 = 0.0;
+		double B0 = 0.0, B1 = 0.0, B2 = 0.0;
+		double C = 0.0;
+
+		// Plane dot(n, p) + d = 0 with a unit length n
+		void AddPlane(const Vec3d& n, double d, double weight)
+		{
+			A00 += weight * n.x * n.x;
+			A01 += weight * n.x * n.y;
+			A02 += weight * n.x * n.z;
+			A11 += weight * n.y * n.y;
+			A12 += weight * n.y * n.z;
+			A22 += weight * n.z * n.z;
+			B0 += weight * n.x * d;
+			B1 += weight * n.y * d;
+			B2 += weight * n.z * d;
+			C += weight * d * d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			A00 += q.A00; A01 += q.A01; A02 += q.A02;
+			A11 += q.A11; A12 += q.A12; A22 += q.A22;
+			B0 += q.B0; B1 += q.B1; B2 += q.B2;
+			C += q.C;
+		}
+
+		double Evaluate(const Vec3d& p) const
+		{
+			double error =
+				A00 * p.x * p.x + A11 * p.y * p.y + A22 * p.z * p.z +
+				2.0 * (A01 * p.x * p.y + A02 * p.x * p.z + A12 * p.y * p.z) +
+				2.0 * (B0 * p.x + B1 * p.y + B2 * p.z) +
+				C;
+
+			// Rounding can take a zero error slightly negative
+			return std::max(error, 0.0);
+		}
+	};
+
+	// Distance from p to the triangle abc (closest point from Ericson's "Real-Time Collision Detection")
+	double DistanceToTriangle(const Vec3d& p, const Vec3d& a, const Vec3d& b, const Vec3d& c)
+	{
+		Vec3d ab = Subtract(b, a);
+		Vec3d ac = Subtract(c, a);
+		Vec3d ap = Subtract(p, a);
+
+		auto pointAt = [&a, &ab, &ac](double v, double w)
+		{
+			return Vec3d{ a.x + ab.x * v + ac.x * w, a.y + ab.y * v + ac.y * w, a.z + ab.z * v + ac.z * w };
+		};
+
+		double d1 = Dot(ab, ap);
+		double d2 = Dot(ac, ap);
+		if (d1 <= 0.0 && d2 <= 0.0)
+		{
+			return Length(ap);
+		}
+
+		Vec3d bp = Subtract(p, b);
+		double d3 = Dot(ab, bp);
+		double d4 = Dot(ac, bp);
+		if (d3 >= 0.0 && d4 <= d3)
+		{
+			return Length(bp);
+		}
+
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+		{
+			return Length(Subtract(p, pointAt(d1 / (d1 - d3), 0.0)));
+		}
+
+		Vec3d cp = Subtract(p, c);
+		double d5 = Dot(ab, cp);
+		double d6 = Dot(ac, cp);
+		if (d6 >= 0.0 && d5 <= d6)
+		{
+			return Length(cp);
+		}
+
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+		{
+			return Length(Subtract(p, pointAt(0.0, d2 / (d2 - d6))));
+		}
+
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+		{
+			double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+			return Length(Subtract(p, pointAt(1.0 - w, w)));
+		}
+
+		double denom = 1.0 / (va + vb + vc);
+		return Length(Subtract(p, pointAt(vb * denom, vc * denom)));
+	}
+
+	struct Collapse
+	{
+		double Cost;
+		uint32 From;
+		uint32 To;
+
+		// Stamps of both groups when the cost was computed, the entry is stale once either changes
+		uint32 FromStamp;
+		uint32 ToStamp;
+
+		bool operator>(const Collapse& rhs) const
+		{
+			return Cost > rhs.Cost;
+		}
+	};
+
+	// Runs the collapses of one mesh. Collapses work on groups of vertices that share a
+	// position, so UV seams, hard edges and the duplicated rims of the generator shapes are
+	// simplified like the rest of the surface instead of tearing open. Each vertex of the
+	// group that is removed is remapped to the vertex of the target group it shares a
+	// triangle with, which keeps the attribute split intact.
+	class EdgeCollapser
+	{
+		public:
+			explicit EdgeCollapser(const GeometryGenerator::MeshData& meshData);
+
+			// Collapses the cheapest edges until at most targetTriangleCount triangles are left
+			void CollapseTo(size_t targetTriangleCount);
+
+			std::vector<uint32> GetIndices() const;
+
+			// Largest distance from the position of a removed group to the closest point of
+			// the simplified surface
+			float MeasureMaxError() const;
+
+		private:
+			void PushCollapse(uint32 from, uint32 to);
+			bool TryCollapse(uint32 from, uint32 to);
+
+			// Drops dead triangles from the group's list
+			void PruneTriangles(uint32 group);
+
+			// Sorted groups that share a triangle with the group, excluding the group itself
+			void GatherNeighbors(uint32 group, std::vector<uint32>& neighbors) const;
+
+			uint32 GetCornerInGroup(uint32 triangle, uint32 group) const;
+
+		private:
+			std::vector<uint32> VertexGroups;
+			std::vector<Vec3d> GroupPositions;
+			std::vector<Quadric> GroupQuadrics;
+			std::vector<std::vector<uint32>> GroupTriangles;
+			std::vector<uint32> GroupStamps;
+			std::vector<uint32> CollapsedInto;
+			std::vector<bool> IsGroupAlive;
+			std::vector<bool> IsBorderGroup;
+
+			std::vector<uint32> Triangles;
+			std::vector<bool> IsTriangleAlive;
+			size_t LiveTriangleCount = 0;
+
+			std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> Collapses;
+
+			// Scratch space reused by every TryCollapse
+			std::vector<std::pair<uint32, uint32>> VertexRemap;
+			std::vector<uint32> FromNeighbors;
+			std::vector<uint32> ToNeighbors;
+	};
+
+	//=========================================================================================
+	EdgeCollapser::EdgeCollapser(const GeometryGenerator::MeshData& meshData)
+	{
+		const std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+
+		// Group vertices by position. The generators compute seam and rim vertices separately, so
+		// the copies can differ in the last bits and are matched on a grid fine enough to keep
+		// distinct vertices apart.
+		float extent = 0.0f;
+		for (const GeometryGenerator::Vertex& v : vertices)
+		{
+			extent = std::max({ extent, fabsf(v.Position.x), fabsf(v.Position.y), fabsf(v.Position.z) });
+		}
+		const double weldScale = extent > 0.0f ? 1.0 / (extent * kWeldTolerance) : 1.0;
+
+		std::vector<std::array<long long, 3>> weldKeys(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const DirectX::XMFLOAT3& p = vertices[i].Position;
+			weldKeys[i] = { llround(p.x * weldScale), llround(p.y * weldScale), llround(p.z * weldScale) };
+		}
+
+		std::vector<uint32> order(vertices.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&weldKeys](uint32 a, uint32 b) { return weldKeys[a] < weldKeys[b]; });
+
+		VertexGroups.resize(vertices.size());
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			if (i == 0 || weldKeys[order[i - 1]] != weldKeys[order[i]])
+			{
+				const DirectX::XMFLOAT3& p = vertices[order[i]].Position;
+				GroupPositions.push_back({ p.x, p.y, p.z });
+			}
+			VertexGroups[order[i]] = (uint32)GroupPositions.size() - 1;
+		}
+
+		size_t groupCount = GroupPositions.size();
+		GroupQuadrics.resize(groupCount);
+		GroupTriangles.resize(groupCount);
+		GroupStamps.resize(groupCount, 0);
+		CollapsedInto.resize(groupCount);
+		std::iota(CollapsedInto.begin(), CollapsedInto.end(), 0);
+		IsGroupAlive.resize(groupCount, true);
+		IsBorderGroup.resize(groupCount, false);
+
+		// Triangles that are degenerate by position can not be collapsed sensibly, leave them out
+		Triangles = meshData.Indices32;
+		size_t triangleCount = Triangles.size() / 3;
+		IsTriangleAlive.resize(triangleCount, false);
+
+		std::vector<Vec3d> triangleNormals(triangleCount);
+		std::vector<std::pair<uint64, uint32>> edges;
+		edges.reserve(Triangles.size());
+
+		for (uint32 t = 0; t < triangleCount; ++t)
+		{
+			uint32 g0 = VertexGroups[Triangles[t * 3 + 0]];
+			uint32 g1 = VertexGroups[Triangles[t * 3 + 1]];
+			uint32 g2 = VertexGroups[Triangles[t * 3 + 2]];
+			if (g0 == g1 || g1 == g2 || g2 == g0)
+			{
+				continue;
+			}
+
+			IsTriangleAlive[t] = true;
+			++LiveTriangleCount;
+
+			GroupTriangles[g0].push_back(t);
+			GroupTriangles[g1].push_back(t);
+			GroupTriangles[g2].push_back(t);
+
+			Vec3d normal = Cross(Subtract(GroupPositions[g1], GroupPositions[g0]), Subtract(GroupPositions[g2], GroupPositions[g0]));
+			double doubleArea = Length(normal);
+			if (doubleArea > 0.0)
+			{
+				normal = { normal.x / doubleArea, normal.y / doubleArea, normal.z / doubleArea };
+
+				// Weight by area so a fine region of the mesh does not outvote a coarse one
+				Quadric plane;
+				plane.AddPlane(normal, -Dot(normal, GroupPositions[g0]), 0.5 * doubleArea);
+				GroupQuadrics[g0].Add(plane);
+				GroupQuadrics[g1].Add(plane);
+				GroupQuadrics[g2].Add(plane);
+			}
+			triangleNormals[t] = normal;
+
+			uint32 groups[3] = { g0, g1, g2 };
+			for (int i = 0; i < 3; ++i)
+			{
+				uint32 a = std::min(groups[i], groups[(i + 1) % 3]);
+				uint32 b = std::max(groups[i], groups[(i + 1) % 3]);
+				edges.push_back({ ((uint64)a << 32) | b, t });
+			}
+		}
+
+		// Edges used by a single triangle are on the border of the mesh
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t runEnd = i + 1;
+			while (runEnd < edges.size() && edges[runEnd].first == edges[i].first)
+			{
+				++runEnd;
+			}
+
+			uint32 a = (uint32)(edges[i].first >> 32);
+			uint32 b = (uint32)(edges[i].first & 0xFFFFFFFF);
+			if (runEnd - i == 1)
+			{
+				Vec3d edge = Subtract(GroupPositions[b], GroupPositions[a]);
+				Vec3d normal = Cross(edge, triangleNormals[edges[i].second]);
+				double length = Length(normal);
+				if (length > 0.0)
+				{
+					normal = { normal.x / length, normal.y / length, normal.z / length };
+
+					Quadric plane;
+					plane.AddPlane(normal, -Dot(normal, GroupPositions[a]), kBorderWeight * Dot(edge, edge));
+					GroupQuadrics[a].Add(plane);
+					GroupQuadrics[b].Add(plane);
+				}
+
+				IsBorderGroup[a] = true;
+				IsBorderGroup[b] = true;
+			}
+
+			i = runEnd;
+		}
+
+		for (size_t i = 0; i < edges.size(); ++i)
+		{
+			if (i == 0 || edges[i].first != edges[i - 1].first)
+			{
+				uint32 a = (uint32)(edges[i].first >> 32);
+				uint32 b = (uint32)(edges[i].first & 0xFFFFFFFF);
+				PushCollapse(a, b);
+				PushCollapse(b, a);
+			}
+		}
+	}
+
+	//=========================================================================================
+	void EdgeCollapser::PushCollapse(uint32 from, uint32 to)
+	{
+		// Border groups can only move along the border, see TryCollapse
+		if (IsBorderGroup[from] && !IsBorderGroup[to])
+		{
+			return;
+		}
+
+		Quadric quadric = GroupQuadrics[from];
+		quadric.Add(GroupQuadrics[to]);
+
+		// Flat regions cost nothing to collapse. Preferring short edges there keeps one vertex
+		// from swallowing the whole region and leaving a fan of slivers behind.
+		Vec3d edge = Subtract(GroupPositions[to], GroupPositions[from]);
+		double edgeLengthSq = Dot(edge, edge);
+		double cost = quadric.Evaluate(GroupPositions[to]) + kEdgeLengthWeight * edgeLengthSq * edgeLengthSq;
+
+		Collapses.push({ cost, from, to, GroupStamps[from], GroupStamps[to] });
+	}
+
+	//=========================================================================================
+	void EdgeCollapser::CollapseTo(size_t targetTriangleCount)
+	{
+		while (LiveTriangleCount > targetTriangleCount && !Collapses.empty())
+		{
+			Collapse collapse = Collapses.top();
+			Collapses.pop();
+
+			if (!IsGroupAlive[collapse.From] || !IsGroupAlive[collapse.To] ||
+				GroupStamps[collapse.From] != collapse.FromStamp || GroupStamps[collapse.To] != collapse.ToStamp)
+			{
+				continue;
+			}
+
+			// A rejected collapse is dropped, it comes back if a collapse into either end
+			// changes the neighborhood
+			TryCollapse(collapse.From, collapse.To);
+		}
+	}
+
+	//=========================================================================================
+	bool EdgeCollapser::TryCollapse(uint32 from, uint32 to)
+	{
+		PruneTriangles(from);
+		PruneTriangles(to);
+
+		const std::vector<uint32>& fromTriangles = GroupTriangles[from];
+
+		// Find the vertex of the target group each vertex of the removed group turns into
+		VertexRemap.clear();
+		uint32 sharedTriangleCount = 0;
+		for (uint32 t : fromTriangles)
+		{
+			uint32 toCorner = GetCornerInGroup(t, to);
+			if (toCorner == UINT32_MAX)
+			{
+				continue;
+			}
+
+			uint32 fromCorner = GetCornerInGroup(t, from);
+			auto remap = std::find_if(VertexRemap.begin(), VertexRemap.end(),
+				[fromCorner](const std::pair<uint32, uint32>& r) { return r.first == fromCorner; });
+			if (remap == VertexRemap.end())
+			{
+				VertexRemap.push_back({ fromCorner, toCorner });
+			}
+			else if (remap->second != toCorner)
+			{
+				return false;
+			}
+
+			++sharedTriangleCount;
+		}
+
+		if (sharedTriangleCount == 0)
+		{
+			return false;
+		}
+
+		// A border group may only slide along a border edge
+		if (IsBorderGroup[from] && sharedTriangleCount != 1)
+		{
+			return false;
+		}
+
+		// Every vertex of the group has to have somewhere to go, otherwise the collapse would
+		// cross an attribute seam
+		for (uint32 t : fromTriangles)
+		{
+			uint32 fromCorner = GetCornerInGroup(t, from);
+			if (std::none_of(VertexRemap.begin(), VertexRemap.end(),
+				[fromCorner](const std::pair<uint32, uint32>& r) { return r.first == fromCorner; }))
+			{
+				return false;
+			}
+		}
+
+		// Link condition: the two ends may only share the neighbors across the removed
+		// triangles, or the mesh turns non-manifold
+		GatherNeighbors(from, FromNeighbors);
+		GatherNeighbors(to, ToNeighbors);
+
+		std::vector<uint32>::iterator commonEnd = std::set_intersection(FromNeighbors.begin(), FromNeighbors.end(),
+			ToNeighbors.begin(), ToNeighbors.end(), FromNeighbors.begin());
+		if ((uint32)(commonEnd - FromNeighbors.begin()) != sharedTriangleCount)
+		{
+			return false;
+		}
+
+		// Reject collapses that fold triangles over
+		const Vec3d& toPosition = GroupPositions[to];
+		for (uint32 t : fromTriangles)
+		{
+			if (GetCornerInGroup(t, to) != UINT32_MAX)
+			{
+				continue;
+			}
+
+			Vec3d oldCorners[3];
+			Vec3d newCorners[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				uint32 group = VertexGroups[Triangles[t * 3 + i]];
+				oldCorners[i] = GroupPositions[group];
+				newCorners[i] = group == from ? toPosition : oldCorners[i];
+			}
+
+			Vec3d oldNormal = Cross(Subtract(oldCorners[1], oldCorners[0]), Subtract(oldCorners[2], oldCorners[0]));
+			Vec3d newNormal = Cross(Subtract(newCorners[1], newCorners[0]), Subtract(newCorners[2], newCorners[0]));
+			if (Dot(oldNormal, newNormal) <= kMinNormalCos * Length(oldNormal) * Length(newNormal))
+			{
+				return false;
+			}
+		}
+
+		// Apply the collapse
+		std::vector<uint32>& toTriangles = GroupTriangles[to];
+		for (uint32 t : fromTriangles)
+		{
+			if (GetCornerInGroup(t, to) != UINT32_MAX)
+			{
+				IsTriangleAlive[t] = false;
+				--LiveTriangleCount;
+				continue;
+			}
+
+			for (int i = 0; i < 3; ++i)
+			{
+				uint32& corner = Triangles[t * 3 + i];
+				if (VertexGroups[corner] == from)
+				{
+					corner = std::find_if(VertexRemap.begin(), VertexRemap.end(),
+						[corner](const std::pair<uint32, uint32>& r) { return r.first == corner; })->second;
+				}
+			}
+			toTriangles.push_back(t);
+		}
+
+		GroupQuadrics[to].Add(GroupQuadrics[from]);
+		GroupTriangles[from].clear();
+		GroupTriangles[from].shrink_to_fit();
+		IsGroupAlive[from] = false;
+		CollapsedInto[from] = to;
+		++GroupStamps[to];
+
+		// Every edge into the target group has a new cost now
+		PruneTriangles(to);
+		GatherNeighbors(to, ToNeighbors);
+		for (uint32 neighbor : ToNeighbors)
+		{
+			PushCollapse(neighbor, to);
+			PushCollapse(to, neighbor);
+		}
+
+		return true;
+	}
+
+	//=========================================================================================
+	void EdgeCollapser::PruneTriangles(uint32 group)
+	{
+		std::vector<uint32>& triangles = GroupTriangles[group];
+		triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+			[this](uint32 t) { return !IsTriangleAlive[t]; }), triangles.end());
+	}
+
+	//=========================================================================================
+	void EdgeCollapser::GatherNeighbors(uint32 group, std::vector<uint32>& neighbors) const
+	{
+		neighbors.clear();
+		for (uint32 t : GroupTriangles[group])
+		{
+			if (!IsTriangleAlive[t])
+			{
+				continue;
+			}
+
+			for (int i = 0; i < 3; ++i)
+			{
+				uint32 neighbor = VertexGroups[Triangles[t * 3 + i]];
+				if (neighbor != group)
+				{
+					neighbors.push_back(neighbor);
+				}
+			}
+		}
+
+		std::sort(neighbors.begin(), neighbors.end());
+		neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+	}
+
+	//=========================================================================================
+	uint32 EdgeCollapser::GetCornerInGroup(uint32 triangle, uint32 group) const
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32 corner = Triangles[triangle * 3 + i];
+			if (VertexGroups[corner] == group)
+			{
+				return corner;
+			}
+		}
+
+		return UINT32_MAX;
+	}
+
+	//=========================================================================================
+	std::vector<uint32> EdgeCollapser::GetIndices() const
+	{
+		std::vector<uint32> indices;
+		indices.reserve(LiveTriangleCount * 3);
+
+		// Keep the source triangle order, it was most likely optimized for the vertex cache
+		for (size_t t = 0; t < IsTriangleAlive.size(); ++t)
+		{
+			if (IsTriangleAlive[t])
+			{
+				indices.insert(indices.end(), &Triangles[t * 3], &Triangles[t * 3] + 3);
+			}
+		}
+
+		return indices;
+	}
+
+	//=========================================================================================
+	float EdgeCollapser::MeasureMaxError() const
+	{
+		std::vector<uint32> liveTriangles;
+		liveTriangles.reserve(LiveTriangleCount);
+		for (uint32 t = 0; t < (uint32)IsTriangleAlive.size(); ++t)
+		{
+			if (IsTriangleAlive[t])
+			{
+				liveTriangles.push_back(t);
+			}
+		}
+
+		if (liveTriangles.empty())
+		{
+			return 0.0f;
+		}
+
+		auto corner = [this](uint32 t, int i) -> const Vec3d& { return GroupPositions[VertexGroups[Triangles[t * 3 + i]]]; };
+
+		// Bin the remaining triangles into a uniform grid with cells about twice the size of
+		// a triangle, so each removed group only tests the triangles around it
+		Vec3d boundsMin = corner(liveTriangles[0], 0);
+		Vec3d boundsMax = boundsMin;
+		double edgeLengthSum = 0.0;
+		for (uint32 t : liveTriangles)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				const Vec3d& p = corner(t, i);
+				boundsMin = { std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z) };
+				boundsMax = { std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z) };
+			}
+			edgeLengthSum += Length(Subtract(corner(t, 1), corner(t, 0)));
+		}
+
+		double cellSize = std::max(2.0 * edgeLengthSum / liveTriangles.size(), 1e-6);
+		int cellCounts[3];
+		for (;;)
+		{
+			cellCounts[0] = (int)((boundsMax.x - boundsMin.x) / cellSize) + 1;
+			cellCounts[1] = (int)((boundsMax.y - boundsMin.y) / cellSize) + 1;
+			cellCounts[2] = (int)((boundsMax.z - boundsMin.z) / cellSize) + 1;
+
+			// Closed surfaces leave most of the volume empty, keep the grid in proportion
+			if ((double)cellCounts[0] * cellCounts[1] * cellCounts[2] <= 4.0 * liveTriangles.size() + 64.0)
+			{
+				break;
+			}
+			cellSize *= 1.5;
+		}
+
+		auto cellOf = [&boundsMin, cellSize, &cellCounts](const Vec3d& p, int cell[3])
+		{
+			cell[0] = std::min(std::max((int)((p.x - boundsMin.x) / cellSize), 0), cellCounts[0] - 1);
+			cell[1] = std::min(std::max((int)((p.y - boundsMin.y) / cellSize), 0), cellCounts[1] - 1);
+			cell[2] = std::min(std::max((int)((p.z - boundsMin.z) / cellSize), 0), cellCounts[2] - 1);
+		};
+
+		// Visits every cell of the box between two points
+		auto forEachCell = [&cellOf, &cellCounts](const Vec3d& lo, const Vec3d& hi, const std::function<void(size_t)>& visit)
+		{
+			int cellLo[3];
+			int cellHi[3];
+			cellOf(lo, cellLo);
+			cellOf(hi, cellHi);
+			for (int z = cellLo[2]; z <= cellHi[2]; ++z)
+			{
+				for (int y = cellLo[1]; y <= cellHi[1]; ++y)
+				{
+					for (int x = cellLo[0]; x <= cellHi[0]; ++x)
+					{
+						visit(((size_t)z * cellCounts[1] + y) * cellCounts[0] + x);
+					}
+				}
+			}
+		};
+
+		auto triangleBounds = [&corner](uint32 t, Vec3d& lo, Vec3d& hi)
+		{
+			const Vec3d& a = corner(t, 0);
+			const Vec3d& b = corner(t, 1);
+			const Vec3d& c = corner(t, 2);
+			lo = { std::min({ a.x, b.x, c.x }), std::min({ a.y, b.y, c.y }), std::min({ a.z, b.z, c.z }) };
+			hi = { std::max({ a.x, b.x, c.x }), std::max({ a.y, b.y, c.y }), std::max({ a.z, b.z, c.z }) };
+		};
+
+		// Counting sort of the triangles into the cells they overlap
+		size_t cellCount = (size_t)cellCounts[0] * cellCounts[1] * cellCounts[2];
+		std::vector<uint32> cellStarts(cellCount + 1, 0);
+		for (uint32 t : liveTriangles)
+		{
+			Vec3d lo;
+			Vec3d hi;
+			triangleBounds(t, lo, hi);
+			forEachCell(lo, hi, [&cellStarts](size_t cell) { ++cellStarts[cell + 1]; });
+		}
+		std::partial_sum(cellStarts.begin(), cellStarts.end(), cellStarts.begin());
+
+		std::vector<uint32> cellTriangles(cellStarts.back());
+		std::vector<uint32> cellFill(cellStarts.begin(), cellStarts.end() - 1);
+		for (uint32 t : liveTriangles)
+		{
+			Vec3d lo;
+			Vec3d hi;
+			triangleBounds(t, lo, hi);
+			forEachCell(lo, hi, [&cellFill, &cellTriangles, t](size_t cell) { cellTriangles[cellFill[cell]++] = t; });
+		}
+
+		double maxError = 0.0;
+		for (uint32 group = 0; group < (uint32)GroupPositions.size(); ++group)
+		{
+			if (IsGroupAlive[group])
+			{
+				continue;
+			}
+
+			const Vec3d& p = GroupPositions[group];
+
+			// The group it was merged into is on the surface, which bounds the search
+			uint32 root = CollapsedInto[group];
+			while (!IsGroupAlive[root])
+			{
+				root = CollapsedInto[root];
+			}
+			double error = GroupTriangles[root].empty() ? DBL_MAX : Length(Subtract(p, GroupPositions[root]));
+
+			Vec3d searchMin = boundsMin;
+			Vec3d searchMax = boundsMax;
+			if (error != DBL_MAX)
+			{
+				searchMin = { p.x - error, p.y - error, p.z - error };
+				searchMax = { p.x + error, p.y + error, p.z + error };
+			}
+
+			forEachCell(searchMin, searchMax, [&](size_t cell)
+			{
+				for (uint32 i = cellStarts[cell]; i < cellStarts[cell + 1]; ++i)
+				{
+					uint32 t = cellTriangles[i];
+					error = std::min(error, DistanceToTriangle(p, corner(t, 0), corner(t, 1), corner(t, 2)));
+				}
+			});
+
+			maxError = std::max(maxError, error);
+		}
+
+		return (float)maxError;
+	}
+}
+
+//=========================================================================================
+std::vector<MeshSimplifier::uint32> MeshSimplifier::Simplify(const GeometryGenerator::MeshData& meshData, size_t targetTriangleCount, float* maxError)
+{
+	EdgeCollapser collapser(meshData);
+	collapser.CollapseTo(targetTriangleCount);
+
+	if (maxError != nullptr)
+	{
+		*maxError = collapser.MeasureMaxError();
+	}
+
+	return collapser.GetIndices();
+}
+
+//=========================================================================================
+std::vector<MeshSimplifier::Lod> MeshSimplifier::BuildLodChain(const GeometryGenerator::MeshData& meshData, const std::vector<float>& targetRatios)
+{
+	EdgeCollapser collapser(meshData);
+	size_t triangleCount = meshData.Indices32.size() / 3;
+
+	std::vector<Lod> lods;
+	for (float ratio : targetRatios)
+	{
+		collapser.CollapseTo((size_t)(ratio * triangleCount));
+
+		Lod lod;
+		lod.TargetRatio = ratio;
+		lod.Indices32 = collapser.GetIndices();
+		lod.MaxError = collapser.MeasureMaxError();
+		lods.push_back(std::move(lod));
+	}
+
+	return lods;
+}
+
+//=========================================================================================
+GeometryGenerator::MeshData MeshSimplifier::CreateLodMesh(const GeometryGenerator::MeshData& meshData, const std::vector<uint32>& lodIndices,
+	ThreadPool* threadPool)
+{
+	// Vertices in the order the LOD first uses them
+	GeometryGenerator::MeshData lodMesh;
+	std::vector<uint32> remap(meshData.Vertices.size(), UINT32_MAX);
+	lodMesh.Indices32.reserve(lodIndices.size());
+	for (uint32 index : lodIndices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = (uint32)lodMesh.Vertices.size();
+			lodMesh.Vertices.push_back(meshData.Vertices[index]);
+		}
+		lodMesh.Indices32.push_back(remap[index]);
+	}
+
+	TangentFrames::Compute(lodMesh, threadPool);
+	return lodMesh;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "FromBook/GeometryGenerator.h"
+
+class ThreadPool;
+
+// Reduces the triangle count of GeometryGenerator meshes by quadric error edge collapse
+// (Garland and Heckbert). Vertices are only ever collapsed onto their neighbors, so the
+// simplified index buffers keep using the original vertex buffer and a LOD can be drawn
+// as just another index range of the same MeshGeometry.
+class MeshSimplifier
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		struct Lod
+		{
+			// Fraction of the original triangle count that was asked for
+			float TargetRatio = 1.0f;
+
+			// Triangle list into the vertices of the source mesh
+			std::vector<uint32> Indices32;
+
+			// Largest distance from a removed vertex of the source mesh to the simplified
+			// surface, in object space units
+			float MaxError = 0.0f;
+		};
+
+		// Simplifies the mesh towards targetTriangleCount triangles. Simplification stops
+		// early when no collapse is left that keeps the mesh manifold and unfolded.
+		static std::vector<uint32> Simplify(const GeometryGenerator::MeshData& meshData, size_t targetTriangleCount, float* maxError = nullptr);
+
+		// Builds one LOD per entry of targetRatios (fractions of the original triangle count,
+		// largest first) in a single simplification pass, so each LOD is a further reduced
+		// version of the previous one and its error is measured against the source mesh.
+		static std::vector<Lod> BuildLodChain(const GeometryGenerator::MeshData& meshData, const std::vector<float>& targetRatios);
+
+		// Standalone mesh of a LOD, for when it is drawn from its own vertex buffer: only the
+		// vertices the LOD uses, with normals and tangents recomputed for the coarser surface
+		// by TangentFrames instead of the ones the full detail triangles gave them
+		static GeometryGenerator::MeshData CreateLodMesh(const GeometryGenerator::MeshData& meshData, const std::vector<uint32>& lodIndices,
+			ThreadPool* threadPool = nullptr);
+};
@@ -0,0 +1,385 @@
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+using namespace DirectX;
+
+namespace
+{
+	// Cones wider than this (about 84 degrees half angle) almost never cull anything
+	const float kMinConeCos = 0.1f;
+
+	const XMFLOAT3& GetPosition(const XMFLOAT3* positions, size_t stride, MeshletBuilder::uint32 v)
+	{
+		return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const std::uint8_t*>(positions) + v * stride);
+	}
+
+	MeshletBounds ComputeMeshletBounds(const XMFLOAT3* meshPositions, size_t stride, const std::vector<XMFLOAT3>& triangleNormals,
+		const std::vector<MeshletBuilder::uint32>& vertices, const std::vector<MeshletBuilder::uint32>& triangles)
+	{
+		MeshletBounds bounds;
+
+		std::vector<XMFLOAT3> positions(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			positions[i] = GetPosition(meshPositions, stride, vertices[i]);
+		}
+		BoundingSphere::CreateFromPoints(bounds.Sphere, positions.size(), positions.data(), sizeof(XMFLOAT3));
+
+		XMVECTOR normalSum = XMVectorZero();
+		for (MeshletBuilder::uint32 t : triangles)
+		{
+			normalSum = XMVectorAdd(normalSum, XMLoadFloat3(&triangleNormals[t]));
+		}
+
+		// Normals that cancel out leave no direction to cull along
+		if (XMVectorGetX(XMVector3LengthSq(normalSum)) < 1e-8f)
+		{
+			return bounds;
+		}
+
+		XMVECTOR axis = XMVector3Normalize(normalSum);
+		float minDot = 1.0f;
+		for (MeshletBuilder::uint32 t : triangles)
+		{
+			minDot = std::min(minDot, XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&triangleNormals[t]))));
+		}
+
+		XMStoreFloat3(&bounds.ConeAxis, axis);
+		if (minDot > kMinConeCos)
+		{
+			bounds.ConeCutoff = sqrtf(1.0f - minDot * minDot);
+		}
+
+		return bounds;
+	}
+}
+
+//=========================================================================================
+MeshletData MeshletBuilder::Build(const GeometryGenerator::MeshData& meshData, uint32 maxVertices, uint32 maxTriangles)
+{
+	const XMFLOAT3* positions = meshData.Vertices.empty() ? nullptr : &meshData.Vertices[0].Position;
+	return Build(positions, sizeof(GeometryGenerator::Vertex), meshData.Vertices.size(), meshData.Indices32, maxVertices, maxTriangles);
+}
+
+//=========================================================================================
+MeshletData MeshletBuilder::Build(const GeometryGenerator::MeshDataSoA& meshData, uint32 maxVertices, uint32 maxTriangles)
+{
+	return Build(meshData.Positions.data(), sizeof(XMFLOAT3), meshData.VertexCount(), meshData.Indices32, maxVertices, maxTriangles);
+}
+
+//=========================================================================================
+MeshletData MeshletBuilder::Build(const XMFLOAT3* positions, size_t stride, size_t vertexCount, const std::vector<uint32>& indices,
+	uint32 maxVertices, uint32 maxTriangles)
+{
+	MeshletData meshletData;
+
+	uint32 triangleCount = (uint32)(indices.size() / 3);
+
+	// Local vertex indices are stored in a byte
+	maxVertices = std::min(std::max(maxVertices, 3u), 256u);
+	maxTriangles = std::max(maxTriangles, 1u);
+
+	std::vector<XMFLOAT3> triangleNormals(triangleCount);
+	for (uint32 t = 0; t < triangleCount; ++t)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&GetPosition(positions, stride, indices[t * 3 + 0]));
+		XMVECTOR p1 = XMLoadFloat3(&GetPosition(positions, stride, indices[t * 3 + 1]));
+		XMVECTOR p2 = XMLoadFloat3(&GetPosition(positions, stride, indices[t * 3 + 2]));
+
+		XMVECTOR normal = XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0));
+		if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f)
+		{
+			normal = XMVector3Normalize(normal);
+		}
+		XMStoreFloat3(&triangleNormals[t], normal);
+	}
+
+	// Triangles around each vertex
+	std::vector<uint32> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32 index : indices)
+	{
+		++adjacencyOffsets[index + 1];
+	}
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+
+	std::vector<uint32> adjacentTriangles(indices.size());
+	std::vector<uint32> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		adjacentTriangles[fill[indices[i]]++] = (uint32)(i / 3);
+	}
+
+	// Triangles per vertex that are not in a meshlet yet, so used up vertices are skipped
+	std::vector<uint32> remainingTriangles(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		remainingTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+	}
+
+	std::vector<bool> isEmitted(triangleCount, false);
+	std::vector<int> localIndices(vertexCount, -1);
+
+	std::vector<uint32> meshletVertices;
+	std::vector<uint32> meshletTriangles;
+	XMVECTOR meshletNormal = XMVectorZero();
+
+	auto addTriangle = [&](uint32 t)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			uint32 v = indices[t * 3 + i];
+			if (localIndices[v] < 0)
+			{
+				localIndices[v] = (int)meshletVertices.size();
+				meshletVertices.push_back(v);
+			}
+			--remainingTriangles[v];
+		}
+
+		isEmitted[t] = true;
+		meshletTriangles.push_back(t);
+		meshletNormal = XMVectorAdd(meshletNormal, XMLoadFloat3(&triangleNormals[t]));
+	};
+
+	auto flushMeshlet = [&]()
+	{
+		Meshlet meshlet;
+		meshlet.VertexOffset = (uint32)meshletData.VertexIndices.size();
+		meshlet.VertexCount = (uint32)meshletVertices.size();
+		meshlet.TriangleOffset = (uint32)(meshletData.TriangleIndices.size() / 3);
+		meshlet.TriangleCount = (uint32)meshletTriangles.size();
+
+		meshletData.VertexIndices.insert(meshletData.VertexIndices.end(), meshletVertices.begin(), meshletVertices.end());
+
+		// Growing by shared vertices does not give a cache friendly order, redo it per meshlet
+		std::vector<uint32> meshletIndices;
+		meshletIndices.reserve(meshletTriangles.size() * 3);
+		for (uint32 t : meshletTriangles)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				meshletIndices.push_back((uint32)localIndices[indices[t * 3 + i]]);
+			}
+		}
+		MeshOptimizer::OptimizeVertexCache(meshletIndices, meshletVertices.size());
+		meshletData.TriangleIndices.insert(meshletData.TriangleIndices.end(), meshletIndices.begin(), meshletIndices.end());
+
+		meshletData.Meshlets.push_back(meshlet);
+		meshletData.Bounds.push_back(ComputeMeshletBounds(positions, stride, triangleNormals, meshletVertices, meshletTriangles));
+
+		for (uint32 v : meshletVertices)
+		{
+			localIndices[v] = -1;
+		}
+		meshletVertices.clear();
+		meshletTriangles.clear();
+		meshletNormal = XMVectorZero();
+	};
+
+	uint32 seedCursor = 0;
+	for (;;)
+	{
+		uint32 next = UINT32_MAX;
+		if (meshletTriangles.empty())
+		{
+			while (seedCursor < triangleCount && isEmitted[seedCursor])
+			{
+				++seedCursor;
+			}
+			if (seedCursor == triangleCount)
+			{
+				break;
+			}
+			next = seedCursor;
+		}
+		else
+		{
+			// Cheapest unused triangle touching the meshlet: each new vertex costs 1, facing
+			// away from the meshlet's average normal costs up to 2
+			XMVECTOR averageNormal = XMVector3Normalize(meshletNormal);
+			float bestScore = FLT_MAX;
+			for (uint32 v : meshletVertices)
+			{
+				if (remainingTriangles[v] == 0)
+				{
+					continue;
+				}
+
+				for (uint32 a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+				{
+					uint32 t = adjacentTriangles[a];
+					if (isEmitted[t])
+					{
+						continue;
+					}
+
+					uint32 newVertexCount = (localIndices[indices[t * 3 + 0]] < 0) + (localIndices[indices[t * 3 + 1]] < 0) + (localIndices[indices[t * 3 + 2]] < 0);
+					if (meshletVertices.size() + newVertexCount > maxVertices)
+					{
+						continue;
+					}
+
+					float score = newVertexCount + 1.0f - XMVectorGetX(XMVector3Dot(averageNormal, XMLoadFloat3(&triangleNormals[t])));
+					if (score < bestScore)
+					{
+						bestScore = score;
+						next = t;
+					}
+				}
+			}
+
+			// Nothing left that is connected and fits
+			if (next == UINT32_MAX)
+			{
+				flushMeshlet();
+				continue;
+			}
+		}
+
+		addTriangle(next);
+		if (meshletTriangles.size() == maxTriangles)
+		{
+			flushMeshlet();
+		}
+	}
+
+	if (!meshletTriangles.empty())
+	{
+		flushMeshlet();
+	}
+
+	return meshletData;
+}
+
+//=========================================================================================
+std::vector<MeshletBuilder::uint32> MeshletBuilder::GetMeshletIndices(const MeshletData& meshletData)
+{
+	std::vector<uint32> indices;
+	indices.reserve(meshletData.TriangleIndices.size());
+
+	for (const Meshlet& meshlet : meshletData.Meshlets)
+	{
+		const std::uint32_t* vertices = &meshletData.VertexIndices[meshlet.VertexOffset];
+		const std::uint8_t* triangles = &meshletData.TriangleIndices[meshlet.TriangleOffset * 3];
+		for (uint32 i = 0; i < meshlet.TriangleCount * 3; ++i)
+		{
+			indices.push_back(vertices[triangles[i]]);
+		}
+	}
+
+	return indices;
+}
+
+//=========================================================================================
+void MeshletBuilder::Cull(const MeshletData& meshletData, const BoundingFrustum& localFrustum,
+	const XMFLOAT3& localEyePosition, std::vector<uint32>& visibleMeshlets, MeshletCullStats* stats)
+{
+	XMVECTOR eye = XMLoadFloat3(&localEyePosition);
+
+	for (uint32 i = 0; i < (uint32)meshletData.Meshlets.size(); ++i)
+	{
+		const Meshlet& meshlet = meshletData.Meshlets[i];
+		const MeshletBounds& bounds = meshletData.Bounds[i];
+
+		if (stats != nullptr)
+		{
+			++stats->MeshletCount;
+			stats->TriangleCount += meshlet.TriangleCount;
+		}
+
+		if (!localFrustum.Intersects(bounds.Sphere))
+		{
+			if (stats != nullptr)
+			{
+				++stats->FrustumCulledMeshlets;
+				stats->CulledTriangles += meshlet.TriangleCount;
+			}
+			continue;
+		}
+
+		// Every triangle faces away when the direction to the meshlet is inside the normal
+		// cone, widened by the sphere so it holds from any point of the meshlet
+		XMVECTOR toCenter = XMVectorSubtract(XMLoadFloat3(&bounds.Sphere.Center), eye);
+		float distance = XMVectorGetX(XMVector3Length(toCenter));
+		float axisDot = XMVectorGetX(XMVector3Dot(toCenter, XMLoadFloat3(&bounds.ConeAxis)));
+		if (axisDot >= bounds.ConeCutoff * distance + bounds.Sphere.Radius)
+		{
+			if (stats != nullptr)
+			{
+				++stats->BackfaceCulledMeshlets;
+				stats->CulledTriangles += meshlet.TriangleCount;
+			}
+			continue;
+		}
+
+		visibleMeshlets.push_back(i);
+	}
+}
+
+//=========================================================================================
+void MeshletBuilder::GetDrawRanges(const MeshletData& meshletData, const std::vector<uint32>& visibleMeshlets,
+	std::vector<MeshletDrawRange>& drawRanges, uint32 maxGap, uint32 maxDrawRanges)
+{
+	drawRanges.clear();
+
+	// Runs of visible meshlets, bridging gaps that are cheaper to draw than to skip
+	for (uint32 i : visibleMeshlets)
+	{
+		const Meshlet& meshlet = meshletData.Meshlets[i];
+		if (!drawRanges.empty())
+		{
+			MeshletDrawRange& last = drawRanges.back();
+			uint32 lastEnd = last.TriangleOffset + last.TriangleCount;
+			if (meshlet.TriangleOffset - lastEnd <= maxGap)
+			{
+				last.TriangleCount = meshlet.TriangleOffset + meshlet.TriangleCount - last.TriangleOffset;
+				continue;
+			}
+		}
+
+		MeshletDrawRange range;
+		range.TriangleOffset = meshlet.TriangleOffset;
+		range.TriangleCount = meshlet.TriangleCount;
+		drawRanges.push_back(range);
+	}
+
+	maxDrawRanges = std::max(maxDrawRanges, 1u);
+	if (drawRanges.size() <= maxDrawRanges)
+	{
+		return;
+	}
+
+	// Too many draws left: close every gap up to the one that leaves maxDrawRanges ranges
+	std::vector<uint32> gaps(drawRanges.size() - 1);
+	for (size_t i = 0; i < gaps.size(); ++i)
+	{
+		gaps[i] = drawRanges[i + 1].TriangleOffset - (drawRanges[i].TriangleOffset + drawRanges[i].TriangleCount);
+	}
+	std::vector<uint32> sortedGaps = gaps;
+	size_t mergeCount = drawRanges.size() - maxDrawRanges;
+	std::nth_element(sortedGaps.begin(), sortedGaps.begin() + (mergeCount - 1), sortedGaps.end());
+	uint32 maxMergedGap = sortedGaps[mergeCount - 1];
+
+	size_t rangeCount = 1;
+	for (size_t i = 0; i < gaps.size(); ++i)
+	{
+		const MeshletDrawRange& next = drawRanges[i + 1];
+		if (gaps[i] <= maxMergedGap)
+		{
+			MeshletDrawRange& last = drawRanges[rangeCount - 1];
+			last.TriangleCount = next.TriangleOffset + next.TriangleCount - last.TriangleOffset;
+		}
+		else
+		{
+			drawRanges[rangeCount++] = next;
+		}
+	}
+	drawRanges.resize(rangeCount);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <DirectXCollision.h>
+#include "FromBook/GeometryGenerator.h"
+
+// A small cluster of triangles of a mesh
+struct Meshlet
+{
+	// Range in MeshletData::VertexIndices
+	std::uint32_t VertexOffset = 0;
+	std::uint32_t VertexCount = 0;
+
+	// Range in MeshletData::TriangleIndices, in triangles
+	std::uint32_t TriangleOffset = 0;
+	std::uint32_t TriangleCount = 0;
+};
+
+// Object space bounds of a meshlet used for culling
+struct MeshletBounds
+{
+	DirectX::BoundingSphere Sphere;
+
+	// Every triangle normal is within the cone around ConeAxis. ConeCutoff is the sine of the
+	// cone's half angle, 1 when the normals spread too far for backface culling.
+	DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 1.0f };
+	float ConeCutoff = 1.0f;
+};
+
+struct MeshletData
+{
+	std::vector<Meshlet> Meshlets;
+	std::vector<MeshletBounds> Bounds;
+
+	// Meshlet local vertex -> vertex of the source mesh
+	std::vector<std::uint32_t> VertexIndices;
+
+	// Three meshlet local vertex indices per triangle
+	std::vector<std::uint8_t> TriangleIndices;
+};
+
+// Triangles [TriangleOffset, TriangleOffset + TriangleCount) of a mesh in meshlet order
+// (MeshletBuilder::GetMeshletIndices), drawn with one call
+struct MeshletDrawRange
+{
+	std::uint32_t TriangleOffset = 0;
+	std::uint32_t TriangleCount = 0;
+};
+
+// Counts accumulated by MeshletBuilder::Cull
+struct MeshletCullStats
+{
+	std::uint32_t MeshletCount = 0;
+	std::uint32_t FrustumCulledMeshlets = 0;
+	std::uint32_t BackfaceCulledMeshlets = 0;
+
+	std::uint32_t TriangleCount = 0;
+	std::uint32_t CulledTriangles = 0;
+};
+
+// Splits meshes into meshlets small enough to cull one by one
+class MeshletBuilder
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		// Limits that suit mesh shaders as well as the CPU culling below
+		static const uint32 kDefaultMaxVertices = 64;
+		static const uint32 kDefaultMaxTriangles = 124;
+
+		// A draw costs more than rasterizing this many culled triangles, which the GPU rejects
+		// early anyway
+		static const uint32 kDefaultMaxDrawGap = 64;
+		static const uint32 kDefaultMaxDrawRanges = 8;
+
+		// Grows each meshlet from a seed triangle over the triangles it shares the most
+		// vertices with, preferring ones that face the same way so the normal cones stay
+		// narrow. Seeds are taken in index buffer order and the triangles of each meshlet are
+		// ordered for the vertex cache. maxVertices is clamped to 256.
+		static MeshletData Build(const GeometryGenerator::MeshData& meshData,
+			uint32 maxVertices = kDefaultMaxVertices, uint32 maxTriangles = kDefaultMaxTriangles);
+
+		// Same meshlets, reading only the position stream of the mesh
+		static MeshletData Build(const GeometryGenerator::MeshDataSoA& meshData,
+			uint32 maxVertices = kDefaultMaxVertices, uint32 maxTriangles = kDefaultMaxTriangles);
+
+		// Index list of the source mesh in meshlet order. Meshlet i covers the indices
+		// [3 * TriangleOffset, 3 * (TriangleOffset + TriangleCount)), so it can be drawn as
+		// a plain index range.
+		static std::vector<uint32> GetMeshletIndices(const MeshletData& meshletData);
+
+		// Appends the meshlets that may be visible to visibleMeshlets, in ascending order.
+		// The frustum and eye position have to be in the object space of the mesh.
+		static void Cull(const MeshletData& meshletData, const DirectX::BoundingFrustum& localFrustum,
+			const DirectX::XMFLOAT3& localEyePosition, std::vector<uint32>& visibleMeshlets, MeshletCullStats* stats = nullptr);
+
+		// Replaces drawRanges with the ranges that draw the visible meshlets (ascending, as Cull
+		// gives them). Neighbouring runs are merged when at most maxGap culled triangles lie
+		// between them, then the closest runs are merged until there are at most maxDrawRanges.
+		static void GetDrawRanges(const MeshletData& meshletData, const std::vector<uint32>& visibleMeshlets,
+			std::vector<MeshletDrawRange>& drawRanges, uint32 maxGap = kDefaultMaxDrawGap, uint32 maxDrawRanges = kDefaultMaxDrawRanges);
+
+	private:
+		// Positions are read in place, stride bytes apart
+		static MeshletData Build(const DirectX::XMFLOAT3* positions, size_t stride, size_t vertexCount, const std::vector<uint32>& indices,
+			uint32 maxVertices, uint32 maxTriangles);
+};
@@ -1,15 +1,205 @@
 #include "MyApp.h"
 #include "FromBook/GeometryGenerator.h"
+#include "IndexPacker.h"
+#include "MeshBounds.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "StaticBatcher.h"
+#include "TerrainGenerator.h"
+#include "VertexCompression.h"
 #include <DirectXColors.h>
 
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
+namespace
+{
+	// Bump when the way the shapes are built changes, so older mesh files count as stale
+	const std::uint64_t kShapesMeshFileRevision = 3;
+	const wchar_t* const kShapesMeshFileName = L"Shapes.meshfile";
+
+	// Directory under %LOCALAPPDATA% (or the temporary directory) that generated files go to
+	const wchar_t* const kCacheDirectoryName = L"BasicDX12Project";
+
+	// Triangle ratios of the simplified versions of each shape
+	const std::vector<float> kShapeLodRatios = { 0.5f, 0.25f, 0.125f };
+
+	// A LOD is drawn once its simplification error covers at most this many pixels
+	const float kMaxLodErrorPixels = 1.0f;
+
+	// Waves of the "LandAndWaves" demo: grid size, spacing, time step, speed and damping
+	const GeometryGenerator::uint32 kWavesRowCount = 128;
+	const GeometryGenerator::uint32 kWavesColumnCount = 128;
+	const float kWavesSpatialStep = 1.0f;
+	const float kWavesTimeStep = 0.03f;
+	const float kWavesSpeed = 4.0f;
+	const float kWavesDamping = 0.2f;
+
+	// Terrain of the "LandAndWaves" demo: size, vertices per side and the noise that shapes it
+	const float kLandSize = 160.0f;
+	const GeometryGenerator::uint32 kLandVertexCount = 128;
+
+	TerrainGenerator::Settings GetLandSettings()
+	{
+		TerrainGenerator::Settings settings;
+		settings.Seed = 1;
+		settings.Type = TerrainGenerator::NoiseType::Fbm;
+		settings.OctaveCount = 6;
+		settings.Frequency = 0.015f;
+		settings.Amplitude = 20.0f;
+		settings.HeightOffset = -2.0f;
+		return settings;
+	}
+
+	// Points the item at a submesh of geometry. Positions in the given format are decoded
+	// against the submesh bounds; meshlets and shape are left unset when not given.
+	void SetRenderItemSubmesh(RenderItem& renderItem, MeshGeometry* geometry, const SubmeshGeometry& submesh,
+		VertexFormat format = VertexFormat::FullPrecision, const MeshletData* meshlets = nullptr, const GeometryKey& shape = GeometryKey())
+	{
+		renderItem.DrawArgs.Geometry = geometry;
+		renderItem.DrawArgs.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		renderItem.DrawArgs.IndexCount = submesh.IndexCount;
+		renderItem.DrawArgs.StartIndexLocation = submesh.StartIndexLocation;
+		renderItem.DrawArgs.BaseVertexLocation = submesh.BaseVertexLocation;
+		renderItem.DrawArgs.IndexChunks = submesh.Chunks;
+		renderItem.DrawArgs.IndexFormat = submesh.IndexFormat;
+		renderItem.DrawArgs.Meshlets = meshlets;
+		renderItem.PositionDecode = VertexCompression::GetPositionDecodeTransform(format, submesh.Bounds);
+		renderItem.Bounds = submesh.Bounds;
+		renderItem.Shape = shape;
+	}
+
+	void SetRenderItemSubmesh(RenderItem& renderItem, MeshGeometry* geometry, const std::string& submeshName,
+		VertexFormat format = VertexFormat::FullPrecision, const MeshletData* meshlets = nullptr, const GeometryKey& shape = GeometryKey())
+	{
+		SetRenderItemSubmesh(renderItem, geometry, geometry->DrawArgs[submeshName], format, meshlets, shape);
+	}
+
+	// Points the item at the submesh of shape in whichever geometry uploaded it
+	void SetRenderItemShape(RenderItem& renderItem, GeometryCache& cache, const GeometryKey& shape, VertexFormat format,
+		const MeshletData* meshlets)
+	{
+		MeshGeometry* geometry = nullptr;
+		SubmeshGeometry submesh;
+		ThrowIfFailed(cache.FindSubmesh(shape, &geometry, &submesh) ? S_OK : E_FAIL);
+		SetRenderItemSubmesh(renderItem, geometry, submesh, format, meshlets, shape);
+	}
+
+	// Gives the item the LODs name_lod1, name_lod2, ... of its geometry with their errors
+	void SetRenderItemLods(RenderItem& renderItem, const std::string& name, const std::vector<float>& maxErrors)
+	{
+		renderItem.DrawArgs.Lods.clear();
+		for (size_t i = 0; i < maxErrors.size(); ++i)
+		{
+			auto found = renderItem.DrawArgs.Geometry->DrawArgs.find(name + "_lod" + std::to_string(i + 1));
+			if (found == renderItem.DrawArgs.Geometry->DrawArgs.end())
+			{
+				break;
+			}
+
+			RenderItemLod lod;
+			lod.IndexCount = found->second.IndexCount;
+			lod.StartIndexLocation = found->second.StartIndexLocation;
+			lod.BaseVertexLocation = found->second.BaseVertexLocation;
+			lod.IndexChunks = found->second.Chunks;
+			lod.IndexFormat = found->second.IndexFormat;
+			lod.MaxError = maxErrors[i];
+			renderItem.DrawArgs.Lods.push_back(lod);
+		}
+	}
+
+	// Path of a generated file in the per-user cache directory, which is created on first use.
+	// Files never land in whatever directory the app was started from. Empty when there is no
+	// directory to write to.
+	std::wstring GetCacheFilePath(const wchar_t* fileName)
+	{
+		wchar_t buffer[MAX_PATH];
+		DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", buffer, MAX_PATH);
+		if (length == 0 || length >= MAX_PATH)
+		{
+			length = GetTempPathW(MAX_PATH, buffer);
+			if (length == 0 || length >= MAX_PATH)
+			{
+				return std::wstring();
+			}
+		}
+
+		std::wstring directory(buffer, length);
+		if (directory.back() != L'\\')
+		{
+			directory += L'\\';
+		}
+		directory += kCacheDirectoryName;
+		if (!CreateDirectoryW(directory.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+		{
+			return std::wstring();
+		}
+		return directory + L'\\' + fileName;
+	}
+
+	template <typename T>
+	void AddSection(MeshFileWriter& writer, const std::string& name, const std::vector<T>& data)
+	{
+		writer.AddSection(name, data.data(), data.size() * sizeof(T));
+	}
+
+	template <typename T>
+	void ReadSection(const MeshFileReader& meshFile, const std::string& name, std::vector<T>& data)
+	{
+		const void* sectionData = nullptr;
+		size_t byteSize = 0;
+		if (!meshFile.GetSection(name, &sectionData, &byteSize))
+		{
+			byteSize = 0;
+		}
+
+		data.resize(byteSize / sizeof(T));
+		CopyMemory(data.data(), sectionData, data.size() * sizeof(T));
+	}
+
+	void AddMeshletSections(MeshFileWriter& writer, const std::string& name, const MeshletData& meshlets)
+	{
+		AddSection(writer, name + ".meshlets", meshlets.Meshlets);
+		AddSection(writer, name + ".meshletBounds", meshlets.Bounds);
+		AddSection(writer, name + ".meshletVertices", meshlets.VertexIndices);
+		AddSection(writer, name + ".meshletTriangles", meshlets.TriangleIndices);
+	}
+
+	// The meshlets are small next to the streams, they are copied out so the file can be
+	// unmapped after upload
+	void ReadMeshletSections(const MeshFileReader& meshFile, const std::string& name, MeshletData& meshlets)
+	{
+		ReadSection(meshFile, name + ".meshlets", meshlets.Meshlets);
+		ReadSection(meshFile, name + ".meshletBounds", meshlets.Bounds);
+		ReadSection(meshFile, name + ".meshletVertices", meshlets.VertexIndices);
+		ReadSection(meshFile, name + ".meshletTriangles", meshlets.TriangleIndices);
+	}
+}
+
 MyApp::MyApp(HINSTANCE hInstance)
 : D3DApp(hInstance)
+, RenderItems(kNumFrameResources)
 {
 	ClientWidth = 1280;
 	ClientHeight = 720;
+
+	// The shapes are drawn flat colored, every vertex format only stores their positions
+	ShapeCache.SetThreadPool(&WorkerPool);
+	Transforms.SetThreadPool(&WorkerPool);
+	ShapeCache.SetPositionOnly(true);
+
+	// Reorder every shape for the post-transform vertex cache and vertex fetch once, when
+	// the cache generates it
+	ShapeCache.SetPrepareFunction([](GeometryGenerator::MeshData& meshData)
+	{
+		MeshOptimizer::OptimizeReport report = MeshOptimizer::Optimize(meshData);
+
+		std::string message = std::to_string(meshData.Vertices.size()) + " vertex shape" +
+			": ACMR " + std::to_string(report.Before.Acmr) + " -> " + std::to_string(report.After.Acmr) +
+			", ATVR " + std::to_string(report.Before.Atvr) + " -> " + std::to_string(report.After.Atvr) + "\n";
+		OutputDebugStringA(message.c_str());
+	});
 }
 
 MyApp::~MyApp()
@@ -33,8 +223,24 @@ bool MyApp::Initialize()
 
 	BuildRootSignature();
 	BuildInputLayoutAndShaders();
-	BuildShapesGeometry();
-	BuildRenderItems();
+	if (demo == DemoType::LandAndWaves)
+	{
+		BuildLandGeometry();
+		BuildWavesGeometry();
+		BuildLandAndWavesRenderItems();
+
+		// The hills are far bigger than the shapes scene
+		Radius = 50.0f;
+	}
+	else
+	{
+		BuildShapesGeometry();
+		BuildRenderItems();
+		if (UseStaticBatching)
+		{
+			BuildStaticBatches();
+		}
+	}
 	BuildFrameResources();
 	BuildDescriptorHeaps();
 	BuildConstantBuffers();
@@ -60,6 +266,8 @@ void MyApp::OnResize()
 	// The window resized, so update the aspect ratio and recompute the projection matrix.
 	XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, GetAspectRatio(), 1.0f, 1000.0f);
 	XMStoreFloat4x4(&Proj, P);
+
+	BoundingFrustum::CreateFromMatrix(CameraFrustum, P);
 }
 
 //=========================================================================================
@@ -96,33 +304,69 @@ void MyApp::Update(const GameTimer& gt)
 	XMStoreFloat4x4(&View, view);
 
 	// Upload the constant buffer with the latest WorldviewProj matrix
+	UpdateTransforms();
 	UpdateObjectConstBuffers(gt);
 	UpdateMainPassConstBuffers(gt);
+
+	if (WaveSimulation != nullptr)
+	{
+		UpdateWaves(gt);
+	}
 }
 
 //=========================================================================================
-void MyApp::UpdateObjectConstBuffers(const GameTimer& gt)
+void MyApp::UpdateWaves(const GameTimer& gt)
 {
-	UploadBuffer<ObjectConstants>* currObjectConstBuffer = CurrFrameResource->ObjectCB.get();
-	for (auto& renderItem : AllRenderItems)
+	// Every quarter second, start a wave somewhere random
+	if (gt.TotalTime() - LastWaveDisturbTime >= 0.25f)
 	{
-		// Only update the cbuffer data if the constants have changed
-		// This needs to be tracked per frame resource
-		if (renderItem->NumFramesDirty > 0)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&renderItem->World);
+		LastWaveDisturbTime += 0.25f;
+
+		int i = MathHelper::Rand(4, WaveSimulation->GetRowCount() - 5);
+		int j = MathHelper::Rand(4, WaveSimulation->GetColumnCount() - 5);
+		WaveSimulation->Disturb(i, j, MathHelper::RandF(0.2f, 0.5f));
+	}
+
+	WaveSimulation->Update(gt.DeltaTime());
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+	// The GPU is done with this frame resource, so the rows of its vertex buffer that are
+	// out of date can be rewritten and drawn from for this frame
+	UploadBuffer<Vertex>* currWavesVB = CurrFrameResource->WavesVB.get();
+	CurrFrameResource->WavesVersion = WaveSimulation->WriteVertices(*currWavesVB, XMFLOAT4(Colors::Blue), CurrFrameResource->WavesVersion);
+	RenderItems.GetDrawArgs()[RenderItems.GetIndex(WavesRenderItem)].Geometry->VertexBufferGPU = currWavesVB->Resource();
+	RenderItems.SetBounds(WavesRenderItem, WaveSimulation->GetBounds());
+}
 
-			currObjectConstBuffer->CopyData(renderItem->ObjConstantBufferIndex, objConstants);
-			
-			// Next FrameResource needs to be updated too
-			renderItem->NumFramesDirty--;
+//=========================================================================================
+void MyApp::UpdateTransforms()
+{
+	// Only the subtrees below the nodes set since the last frame are recomputed. Items whose
+	// node is gone from the pool (merged by static batching) are skipped.
+	Transforms.Update();
+	for (UINT node : Transforms.GetUpdatedNodes())
+	{
+		if (node < NodeRenderItems.size() && RenderItems.IsValid(NodeRenderItems[node]))
+		{
+			RenderItems.SetWorld(NodeRenderItems[node], Transforms.GetWorld(node));
 		}
 	}
 }
 
+//=========================================================================================
+void MyApp::UpdateObjectConstBuffers(const GameTimer& gt)
+{
+	UploadBuffer<ObjectConstants>* currObjectConstBuffer = CurrFrameResource->ObjectCB.get();
+
+	// Only the items whose constants have changed are written, in the slot of their index.
+	// This needs to be tracked per frame resource, which the pool does. Quantized positions
+	// are decoded to object space before the world transform.
+	static_assert(sizeof(ObjectConstants) == sizeof(XMFLOAT4X4), "WriteDirtyConstants only writes the world matrix");
+	RenderItems.WriteDirtyConstants(currObjectConstBuffer->MappedBytes(), currObjectConstBuffer->ElementByteSize(), &WorkerPool);
+
+	// Next FrameResource needs to be updated too
+	RenderItems.CountDownDirtyItems();
+}
+
 //=========================================================================================
 void MyApp::UpdateMainPassConstBuffers(const GameTimer& gt)
 {
@@ -190,7 +434,7 @@ void MyApp::Draw(const GameTimer& gt)
 
 	CommandList->SetGraphicsRootDescriptorTable(1, mainPassCbvHandle);
 	
-	DrawRenderItems(CommandList.Get(), OpaqueRenderItems);
+	DrawRenderItems(CommandList.Get());
 	
 	// Indicate a state transition on the resource usage
 	CommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
@@ -216,29 +460,241 @@ void MyApp::Draw(const GameTimer& gt)
 }
 
 //=========================================================================================
-void MyApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& renderItems)
+void MyApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList)
 {
-	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	XMMATRIX view = XMLoadFloat4x4(&View);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	CullStats = MeshletCullStats();
+
+	BoundingFrustum worldFrustum;
+	CameraFrustum.Transform(worldFrustum, invView);
+
+	// Skip items whose bounds are entirely outside the camera frustum, and pick the LOD of
+	// the ones that are left
+	VisibleRenderItems.clear();
+	VisibleLods.clear();
+	const XMFLOAT4X4* worlds = RenderItems.GetWorlds();
+	const BoundingBox* bounds = RenderItems.GetBounds();
+	const RenderItemDrawArgs* drawArgs = RenderItems.GetDrawArgs();
+	for (UINT i = 0; i < RenderItems.GetCount(); ++i)
+	{
+		XMMATRIX world = XMLoadFloat4x4(&worlds[i]);
+		BoundingBox worldBounds;
+		MeshBounds::TransformBox(bounds[i], world, worldBounds);
+		if (worldFrustum.Intersects(worldBounds))
+		{
+			VisibleRenderItems.push_back(i);
+			VisibleLods.push_back(SelectLod(drawArgs[i], world, worldBounds));
+		}
+	}
 
-	ID3D12Resource* objectCB = CurrFrameResource->ObjectCB->Resource();
+	if (!UseInstancing)
+	{
+		for (size_t i = 0; i < VisibleRenderItems.size(); ++i)
+		{
+			DrawRenderItem(cmdList, VisibleRenderItems[i], VisibleLods[i], invView);
+		}
+		return;
+	}
 
-	for (size_t i = 0; i < renderItems.size(); ++i)
+	// Items only batch with items drawing the same LOD
+	Batcher.Clear();
+	for (size_t i = 0; i < VisibleRenderItems.size(); ++i)
 	{
-		RenderItem* renderItem = renderItems[i];
-		cmdList->IASetVertexBuffers(0, 1, &renderItem->Geometry->VertexBufferView());
-		cmdList->IASetIndexBuffer(&renderItem->Geometry->IndexBufferView());
-		cmdList->IASetPrimitiveTopology(renderItem->PrimitiveType);
+		const RenderItemDrawArgs& args = drawArgs[VisibleRenderItems[i]];
+		const RenderItemLod* lod = VisibleLods[i];
+
+		InstanceKey key;
+		key.Geometry = args.Geometry;
+		key.PipelineState = PipelineStateObject.Get();
+		key.IndexCount = lod != nullptr ? lod->IndexCount : args.IndexCount;
+		key.StartIndexLocation = lod != nullptr ? lod->StartIndexLocation : args.StartIndexLocation;
+		key.BaseVertexLocation = lod != nullptr ? lod->BaseVertexLocation : args.BaseVertexLocation;
+		Batcher.Add(key, (UINT)i);
+	}
+	Batcher.Build();
 
-		// Offset to the CBV in the descriptor heap for this render item and for this frame resource
-		UINT cbvIndex = CurrFrameResourceIndex * (UINT)OpaqueRenderItems.size() + renderItem->ObjConstantBufferIndex;
-		auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(CbvHeap->GetGPUDescriptorHandleForHeapStart());
-		cbvHandle.Offset(cbvIndex, CbvSrvUavDescriptorSize);
+	// Items alone in their batch first, so the pipeline state only changes once
+	const std::vector<UINT>& instances = Batcher.GetInstances();
+	for (const InstanceBatch& batch : Batcher.GetBatches())
+	{
+		if (batch.InstanceCount == 1)
+		{
+			UINT visibleIndex = instances[batch.InstanceOffset];
+			DrawRenderItem(cmdList, VisibleRenderItems[visibleIndex], VisibleLods[visibleIndex], invView);
+		}
+	}
 
-		cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
-		cmdList->DrawIndexedInstanced(renderItem->IndexCount, 1, renderItem->StartIndexLocation, renderItem->BaseVertexLocation, 0);
+	cmdList->SetPipelineState(InstancedPipelineStateObject.Get());
+	cmdList->SetGraphicsRootShaderResourceView(2, CurrFrameResource->InstanceBuffer->Resource()->GetGPUVirtualAddress());
+	for (const InstanceBatch& batch : Batcher.GetBatches())
+	{
+		if (batch.InstanceCount > 1)
+		{
+			DrawInstances(cmdList, batch);
+		}
 	}
 }
 
+//=========================================================================================
+void MyApp::DrawRenderItem(ID3D12GraphicsCommandList* cmdList, UINT index, const RenderItemLod* lod, FXMMATRIX invView)
+{
+	const RenderItemDrawArgs& drawArgs = RenderItems.GetDrawArgs()[index];
+	cmdList->IASetVertexBuffers(0, 1, &drawArgs.Geometry->VertexBufferView());
+	SetIndexBuffer(cmdList, drawArgs, lod);
+	cmdList->IASetPrimitiveTopology(drawArgs.PrimitiveType);
+
+	// Offset to the CBV in the descriptor heap for this render item and for this frame resource
+	UINT cbvIndex = CurrFrameResourceIndex * ObjectCbvCount + index;
+	auto cbvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(CbvHeap->GetGPUDescriptorHandleForHeapStart());
+	cbvHandle.Offset(cbvIndex, CbvSrvUavDescriptorSize);
+
+	cmdList->SetGraphicsRootDescriptorTable(0, cbvHandle);
+
+	// The LODs are not split into meshlets, they are drawn whole
+	if (lod != nullptr)
+	{
+		DrawIndexRange(cmdList, lod->IndexChunks, lod->BaseVertexLocation, lod->StartIndexLocation, lod->IndexCount);
+		return;
+	}
+
+	if (drawArgs.Meshlets == nullptr)
+	{
+		DrawIndexRange(cmdList, drawArgs.IndexChunks, drawArgs.BaseVertexLocation, drawArgs.StartIndexLocation, drawArgs.IndexCount);
+		return;
+	}
+
+	// Cull the meshlets in the object space of the render item
+	XMMATRIX world = XMLoadFloat4x4(&RenderItems.GetWorlds()[index]);
+	XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+
+	BoundingFrustum localFrustum;
+	CameraFrustum.Transform(localFrustum, XMMatrixMultiply(invView, invWorld));
+
+	XMFLOAT3 localEyePos;
+	XMStoreFloat3(&localEyePos, XMVector3TransformCoord(XMLoadFloat3(&EyePos), invWorld));
+
+	VisibleMeshlets.clear();
+	MeshletBuilder::Cull(*drawArgs.Meshlets, localFrustum, localEyePos, VisibleMeshlets, &CullStats);
+
+	// Runs of visible meshlets go in one draw each, merged over small gaps of culled ones and
+	// capped at a few draws per item
+	MeshletBuilder::GetDrawRanges(*drawArgs.Meshlets, VisibleMeshlets, MeshletDrawRanges);
+	for (const MeshletDrawRange& range : MeshletDrawRanges)
+	{
+		UINT startIndex = drawArgs.StartIndexLocation + range.TriangleOffset * 3;
+		DrawIndexRange(cmdList, drawArgs.IndexChunks, drawArgs.BaseVertexLocation, startIndex, range.TriangleCount * 3);
+	}
+}
+
+//=========================================================================================
+void MyApp::DrawInstances(ID3D12GraphicsCommandList* cmdList, const InstanceBatch& batch)
+{
+	// The batch's range of the visible items is its range of the instance buffer
+	UploadBuffer<InstanceData>* instanceBuffer = CurrFrameResource->InstanceBuffer.get();
+	const std::vector<UINT>& instances = Batcher.GetInstances();
+	const XMFLOAT4X4* worlds = RenderItems.GetWorlds();
+	const XMFLOAT4X4* positionDecodes = RenderItems.GetPositionDecodes();
+	for (UINT i = batch.InstanceOffset; i < batch.InstanceOffset + batch.InstanceCount; ++i)
+	{
+		UINT index = VisibleRenderItems[instances[i]];
+		XMMATRIX world = XMMatrixMultiply(XMLoadFloat4x4(&positionDecodes[index]), XMLoadFloat4x4(&worlds[index]));
+
+		InstanceData instanceData;
+		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(world));
+		instanceBuffer->CopyData(i, instanceData);
+	}
+
+	// Every item of the batch draws the same LOD
+	UINT firstVisibleIndex = instances[batch.InstanceOffset];
+	const RenderItemDrawArgs& drawArgs = RenderItems.GetDrawArgs()[VisibleRenderItems[firstVisibleIndex]];
+	const RenderItemLod* lod = VisibleLods[firstVisibleIndex];
+	cmdList->IASetVertexBuffers(0, 1, &drawArgs.Geometry->VertexBufferView());
+	SetIndexBuffer(cmdList, drawArgs, lod);
+	cmdList->IASetPrimitiveTopology(drawArgs.PrimitiveType);
+	cmdList->SetGraphicsRoot32BitConstant(3, batch.InstanceOffset, 0);
+
+	if (lod != nullptr)
+	{
+		DrawIndexRange(cmdList, lod->IndexChunks, lod->BaseVertexLocation, lod->StartIndexLocation, lod->IndexCount, batch.InstanceCount);
+	}
+	else
+	{
+		DrawIndexRange(cmdList, drawArgs.IndexChunks, drawArgs.BaseVertexLocation, drawArgs.StartIndexLocation, drawArgs.IndexCount, batch.InstanceCount);
+	}
+}
+
+//=========================================================================================
+void MyApp::SetIndexBuffer(ID3D12GraphicsCommandList* cmdList, const RenderItemDrawArgs& drawArgs, const RenderItemLod* lod)
+{
+	// A submesh that fell back to 32-bit indices reads the geometry's buffer in its own format
+	D3D12_INDEX_BUFFER_VIEW indexBufferView = drawArgs.Geometry->IndexBufferView();
+	DXGI_FORMAT indexFormat = lod != nullptr ? lod->IndexFormat : drawArgs.IndexFormat;
+	if (indexFormat != DXGI_FORMAT_UNKNOWN)
+	{
+		indexBufferView.Format = indexFormat;
+	}
+	cmdList->IASetIndexBuffer(&indexBufferView);
+}
+
+//=========================================================================================
+void MyApp::DrawIndexRange(ID3D12GraphicsCommandList* cmdList, const std::vector<IndexChunk>& indexChunks, int baseVertexLocation,
+	UINT startIndexLocation, UINT indexCount, UINT instanceCount)
+{
+	if (indexChunks.empty())
+	{
+		cmdList->DrawIndexedInstanced(indexCount, instanceCount, startIndexLocation, baseVertexLocation, 0);
+		return;
+	}
+
+	// Each chunk's indices are relative to its own base vertex, so draw the part of the range
+	// inside every chunk separately
+	UINT endIndexLocation = startIndexLocation + indexCount;
+	for (const IndexChunk& chunk : indexChunks)
+	{
+		UINT first = std::max<UINT>(startIndexLocation, chunk.StartIndexLocation);
+		UINT last = std::min<UINT>(endIndexLocation, chunk.StartIndexLocation + chunk.IndexCount);
+		if (first < last)
+		{
+			cmdList->DrawIndexedInstanced(last - first, instanceCount, first, chunk.BaseVertexLocation, 0);
+		}
+	}
+}
+
+//=========================================================================================
+const RenderItemLod* MyApp::SelectLod(const RenderItemDrawArgs& drawArgs, FXMMATRIX world, const BoundingBox& worldBounds) const
+{
+	if (drawArgs.Lods.empty())
+	{
+		return nullptr;
+	}
+
+	// Distance from the eye to the item's bounding sphere, full detail when the eye is inside
+	XMVECTOR toCenter = XMLoadFloat3(&worldBounds.Center) - XMLoadFloat3(&EyePos);
+	float distance = XMVectorGetX(XMVector3Length(toCenter)) - XMVectorGetX(XMVector3Length(XMLoadFloat3(&worldBounds.Extents)));
+	if (distance <= 0.0f)
+	{
+		return nullptr;
+	}
+
+	// Pixels covered by one object space unit at that distance, scaled by the largest axis
+	// scale of the world matrix
+	float worldScale = XMVectorGetX(XMVectorMax(XMVector3Length(world.r[0]), XMVectorMax(XMVector3Length(world.r[1]), XMVector3Length(world.r[2]))));
+	float pixelsPerUnit = worldScale * 0.5f * ClientHeight * Proj._22 / distance;
+
+	// The errors grow along the chain, so take the last LOD that is still small enough
+	const RenderItemLod* selected = nullptr;
+	for (const RenderItemLod& lod : drawArgs.Lods)
+	{
+		if (lod.MaxError * pixelsPerUnit > kMaxLodErrorPixels)
+		{
+			break;
+		}
+		selected = &lod;
+	}
+	return selected;
+}
+
 //=========================================================================================
 void MyApp::OnMouseDown(WPARAM btnState, int x, int y)
 {
@@ -292,21 +748,20 @@ void MyApp::BuildFrameResources()
 {
 	for (int i = 0; i < kNumFrameResources; ++i)
 	{
-		FrameResources.push_back(std::make_unique<FrameResource>(D3dDevice.Get(), 1, UINT(AllRenderItems.size()), 1));
+		UINT wavesVertexCount = WaveSimulation != nullptr ? WaveSimulation->GetVertexCount() : 1;
+		FrameResources.push_back(std::make_unique<FrameResource>(D3dDevice.Get(), 1, RenderItems.GetCount(), wavesVertexCount));
 	}
 }
 
 //=========================================================================================
 void MyApp::BuildInputLayoutAndShaders()
 {
-	InputLayout =
-	{ 
-		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-		{"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
-	};
+	// The land and waves are written as plain Vertex structs
+	InputLayout = VertexCompression::GetColorInputLayout(demo == DemoType::LandAndWaves ? VertexFormat::FullPrecision : ShapeVertexFormat);
 
 	VertexShaderByteCode = d3dUtil::CompileShader(L"F:/DirectX12Stuff/LearningGraphics/BasicDX12Project/Source/Shaders/color.hlsl", nullptr, "VS", "vs_5_1");
 	PixelShaderByteCode = d3dUtil::CompileShader(L"F:/DirectX12Stuff/LearningGraphics/BasicDX12Project/Source/Shaders/color.hlsl", nullptr, "PS", "ps_5_1");
+	InstancedVertexShaderByteCode = d3dUtil::CompileShader(L"F:/DirectX12Stuff/LearningGraphics/BasicDX12Project/Source/Shaders/color.hlsl", nullptr, "VSInstanced", "vs_5_1");
 
 	// Load from pre-compiled shaders
 	// VertexShaderBytecode = d3dUtil::LoadBinary(L"Shaders/color_vs.cso");
@@ -318,7 +773,7 @@ void MyApp::BuildConstantBuffers()
 {
 	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 
-	UINT objCount = (UINT)OpaqueRenderItems.size();
+	UINT objCount = ObjectCbvCount;
 
 	// Need a CBV descriptor for each object for each frame resouce
 	for (int frameIndex = 0; frameIndex < kNumFrameResources; ++frameIndex)
@@ -369,7 +824,8 @@ void MyApp::BuildConstantBuffers()
 //=========================================================================================
 void MyApp::BuildDescriptorHeaps()
 {
-	UINT objCount = (UINT)OpaqueRenderItems.size();
+	ObjectCbvCount = RenderItems.GetCount();
+	UINT objCount = ObjectCbvCount;
 
 	// Need a CBV descriptor for each object for each frame resource,
 	// +1 for the perPass CBV for each frame resource
@@ -391,7 +847,7 @@ void MyApp::BuildDescriptorHeaps()
 void MyApp::BuildRootSignature()
 {	
 	// Root parameter can be a table, root descriptor or root constants
-	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
 	// Create two descriptor tables of CBVs, one for per object CBs and one for main pass CBs
 	CD3DX12_DESCRIPTOR_RANGE cbvTable0;
@@ -403,8 +859,12 @@ void MyApp::BuildRootSignature()
 	slotRootParameter[0].InitAsDescriptorTable(1, &cbvTable0);
 	slotRootParameter[1].InitAsDescriptorTable(1, &cbvTable1);
 
+	// Instance buffer of the instanced draws and where the current draw's instances start
+	slotRootParameter[2].InitAsShaderResourceView(0);
+	slotRootParameter[3].InitAsConstants(1, 2);
+
 	// A root signature is an array of root parameters
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(2, slotRootParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 	// Create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
 	ComPtr<ID3DBlob> serializedRootSignature = nullptr;
@@ -503,111 +963,215 @@ void MyApp::BuildGeometry()
 }
 
 //=========================================================================================
-void MyApp::BuildShapesGeometry()
+std::vector<std::pair<std::string, GeometryKey>> MyApp::GetShapeKeys() const
 {
-	GeometryGenerator geoGenerator;
-	GeometryGenerator::MeshData box = geoGenerator.CreateBox(1.5f, 0.5f, 1.5f, 3);
-	GeometryGenerator::MeshData grid = geoGenerator.CreateGrid(20.0f, 30.0f, 60, 40);
-	GeometryGenerator::MeshData sphere = geoGenerator.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGenerator.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20);
+	return
+	{
+		{ "box", GeometryKey::Box(1.5f, 0.5f, 1.5f, 3, ShapeVertexFormat, XMFLOAT4(DirectX::Colors::DarkGreen)) },
+		{ "grid", GeometryKey::Grid(20.0f, 30.0f, 60, 40, ShapeVertexFormat, XMFLOAT4(DirectX::Colors::ForestGreen)) },
+		{ "sphere", GeometryKey::Sphere(0.5f, 20, 20, ShapeVertexFormat, XMFLOAT4(DirectX::Colors::Crimson)) },
+		{ "cylinder", GeometryKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 20, ShapeVertexFormat, XMFLOAT4(DirectX::Colors::SteelBlue)) }
+	};
+}
+
+//=========================================================================================
+std::vector<BYTE> MyApp::GenerateShapesMeshFile(const std::vector<std::pair<std::string, GeometryKey>>& shapes, std::uint64_t sourceHash)
+{
+	// The shapes come out of the cache generated, optimized and encoded, so building the
+	// scene again only generates shapes whose parameters changed
+	std::vector<std::shared_ptr<const CachedGeometry>> meshes;
+	for (auto& shape : shapes)
+	{
+		meshes.push_back(ShapeCache.Get(shape.second));
+	}
+
+	// Split each mesh into meshlets for CPU culling. The index buffer is written in meshlet
+	// order, so every meshlet is a contiguous part of the mesh's index range.
+	std::vector<MeshletData> meshlets(meshes.size());
+	std::vector<std::vector<GeometryGenerator::uint32>> meshletIndices(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		meshlets[i] = MeshletBuilder::Build(*meshes[i]->Mesh);
+		meshletIndices[i] = MeshletBuilder::GetMeshletIndices(meshlets[i]);
+	}
 
 	// We are concatenating all the geometry into one big vertex/index buffer,
 	// so define the regions in the buffer each submesh covers
 
 	// Cache the vertex offsets to each object in the concatenated vertex buffer
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-	UINT sphereVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
+	std::vector<UINT> vertexOffsets(meshes.size(), 0);
+	for (size_t i = 1; i < meshes.size(); ++i)
+	{
+		vertexOffsets[i] = vertexOffsets[i - 1] + (UINT)meshes[i - 1]->Mesh->Vertices.size();
+	}
+
+	// Pack the indices of all meshes into one index buffer. Meshes that address more vertices
+	// than 16-bit indices reach are split into chunks instead of being truncated.
+	IndexPacker indexPacker;
+	std::vector<size_t> indexRanges;
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		indexRanges.push_back(indexPacker.AddSubmesh(meshletIndices[i], vertexOffsets[i]));
+	}
 
-	// Do the same for the index buffer
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sphereIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
+	// Simplified versions of each shape only add index ranges, they draw from the vertices
+	// of the full detail mesh
+	struct LodIndexRange
+	{
+		std::string Name;
+		size_t BaseMesh;
+		size_t Id;
+	};
+	std::vector<LodIndexRange> lodIndexRanges;
+	std::vector<std::vector<float>> lodErrors(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		std::vector<MeshSimplifier::Lod> lods = MeshSimplifier::BuildLodChain(*meshes[i]->Mesh, kShapeLodRatios);
+		for (size_t lodIndex = 0; lodIndex < lods.size(); ++lodIndex)
+		{
+			MeshSimplifier::Lod& lod = lods[lodIndex];
+			MeshOptimizer::OptimizeVertexCache(lod.Indices32, meshes[i]->Mesh->Vertices.size());
 
-	// Define the SubmeshGeometry that cover different regions of the vertex/index buffers
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
+			std::string name = shapes[i].first + "_lod" + std::to_string(lodIndex + 1);
+			lodIndexRanges.push_back({ name, i, indexPacker.AddSubmesh(lod.Indices32, vertexOffsets[i]) });
+			lodErrors[i].push_back(lod.MaxError);
 
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
+			std::string message = name + ": " + std::to_string(lod.Indices32.size() / 3) + " triangles, max error " + std::to_string(lod.MaxError) + "\n";
+			OutputDebugStringA(message.c_str());
+		}
+	}
 
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
+	indexPacker.Pack();
 
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
+	// Pack the vertices of all meshes into one vertex buffer, the cache already encoded them
+	// in the selected vertex format
+	std::vector<BYTE> vertices;
+	for (auto& mesh : meshes)
+	{
+		vertices.insert(vertices.end(), mesh->Vertices.begin(), mesh->Vertices.end());
+	}
 
-	// Extract the vertex elements we are interested in and pack the vertices
-	// of all meshes into one vertex buffer
-	auto totalVertexCount = box.Vertices.size() + grid.Vertices.size() + sphere.Vertices.size() + cylinder.Vertices.size();
-	std::vector<Vertex> vertices(totalVertexCount);
+	MeshFileWriter writer;
+	writer.SetVertices(ShapeVertexFormat, vertices.data(), (UINT)vertices.size());
+	writer.SetIndices(indexPacker.GetFormat(), indexPacker.GetData(), indexPacker.GetByteSize());
 
-	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
+	// Bounds of each submesh, which quantized positions are stored relative to. The LODs
+	// share the vertices, and so the bounds, of their full detail mesh.
+	for (size_t i = 0; i < meshes.size(); ++i)
 	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::DarkGreen);
+		SubmeshGeometry submesh = indexPacker.GetSubmesh(indexRanges[i]);
+		submesh.Bounds = meshes[i]->Bounds;
+		submesh.Sphere = meshes[i]->Sphere;
+		writer.AddSubmesh(shapes[i].first, submesh);
+	}
+	for (const LodIndexRange& lodIndexRange : lodIndexRanges)
+	{
+		SubmeshGeometry lodSubmesh = indexPacker.GetSubmesh(lodIndexRange.Id);
+		lodSubmesh.Bounds = meshes[lodIndexRange.BaseMesh]->Bounds;
+		lodSubmesh.Sphere = meshes[lodIndexRange.BaseMesh]->Sphere;
+		writer.AddSubmesh(lodIndexRange.Name, lodSubmesh);
 	}
 
-	for (size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+	for (size_t i = 0; i < meshes.size(); ++i)
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::ForestGreen);
+		AddMeshletSections(writer, shapes[i].first, meshlets[i]);
+		AddSection(writer, shapes[i].first + ".lodErrors", lodErrors[i]);
 	}
 
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	return writer.Serialize(sourceHash);
+}
+
+//=========================================================================================
+void MyApp::BuildShapesGeometry()
+{
+	// Everything the shapes are built from goes into the hash, so the mesh file of a run
+	// with other shape parameters or another vertex format is never used
+	std::vector<std::pair<std::string, GeometryKey>> shapes = GetShapeKeys();
+
+	std::uint64_t sourceHash = kShapesMeshFileRevision;
+	for (auto& shape : shapes)
+	{
+		sourceHash = sourceHash * 1099511628211ull ^ std::hash<std::string>()(shape.first);
+		sourceHash = sourceHash * 1099511628211ull ^ GeometryKeyHash()(shape.second);
+	}
+	for (float ratio : kShapeLodRatios)
 	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::Crimson);
+		sourceHash = sourceHash * 1099511628211ull ^ std::hash<float>()(ratio);
 	}
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	// Nothing is loaded or uploaded when a geometry built earlier already holds every shape
+	bool isUploaded = true;
+	for (auto& shape : shapes)
+	{
+		MeshGeometry* uploadedGeometry = nullptr;
+		SubmeshGeometry uploadedSubmesh;
+		isUploaded = isUploaded && ShapeCache.FindSubmesh(shape.second, &uploadedGeometry, &uploadedSubmesh);
+	}
+	if (isUploaded)
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Color = XMFLOAT4(DirectX::Colors::SteelBlue);
+		return;
 	}
 
-	// Do the same for indices
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
+	// Draw from the file an earlier run wrote, mapped and used in place. Generate the shapes
+	// and write it for the next run when it is missing, stale or fails validation.
+	std::wstring meshFilePath = GetCacheFilePath(kShapesMeshFileName);
+	MappedFile mappedFile;
+	MeshFileReader meshFile;
+	std::vector<BYTE> generatedFile;
+	std::string error = "no cache directory";
+	if (meshFilePath.empty() || !mappedFile.Open(meshFilePath, &error) ||
+		!meshFile.Open(mappedFile.GetData(), mappedFile.GetByteSize(), sourceHash, true, &error))
+	{
+		OutputDebugStringA(("Generating the shapes, the mesh file can't be used: " + error + "\n").c_str());
 
-	const UINT vertexBufferByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	const UINT indexBufferByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+		mappedFile.Close();
+		generatedFile = GenerateShapesMeshFile(shapes, sourceHash);
+		if (!meshFilePath.empty() && !MeshFileWriter::WriteFile(meshFilePath, generatedFile, &error))
+		{
+			OutputDebugStringA(("Could not save the shapes: " + error + "\n").c_str());
+		}
+
+		ThrowIfFailed(meshFile.Open(generatedFile.data(), generatedFile.size(), sourceHash, false, &error) ? S_OK : E_FAIL);
+	}
 
 	std::unique_ptr<MeshGeometry> geometry = std::make_unique<MeshGeometry>();
 	geometry->Name = "shapeGeo";
 
-	ThrowIfFailed(D3DCreateBlob(vertexBufferByteSize, &geometry->VertexBufferCPU));
-	CopyMemory(geometry->VertexBufferCPU->GetBufferPointer(), vertices.data(), vertexBufferByteSize);
+	// The streams are copied straight from the file into the upload buffers. There are no
+	// system memory copies, nothing reads the shapes back on the CPU.
+	geometry->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(),
+		meshFile.GetVertexData(), meshFile.GetVertexBufferByteSize(), geometry->VertexBufferUploader);
+	geometry->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(),
+		meshFile.GetIndexData(), meshFile.GetIndexBufferByteSize(), geometry->IndexBufferUploader);
 
-	ThrowIfFailed(D3DCreateBlob(indexBufferByteSize, &geometry->IndexBufferCPU));
-	CopyMemory(geometry->IndexBufferCPU->GetBufferPointer(), indices.data(), indexBufferByteSize);
+	geometry->VertexByteStride = meshFile.GetVertexByteStride();
+	geometry->VertexBufferByteSize = meshFile.GetVertexBufferByteSize();
+	geometry->IndexFormat = meshFile.GetIndexFormat();
+	geometry->IndexBufferByteSize = meshFile.GetIndexBufferByteSize();
 
-	geometry->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(), vertices.data(), vertexBufferByteSize, geometry->VertexBufferUploader);
-	geometry->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(), indices.data(), indexBufferByteSize, geometry->IndexBufferUploader);
+	meshFile.GetDrawArgs(geometry->DrawArgs);
 
-	geometry->VertexByteStride = sizeof(Vertex);
-	geometry->VertexBufferByteSize = vertexBufferByteSize;
-	geometry->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geometry->IndexBufferByteSize = indexBufferByteSize;
+	for (auto& shape : shapes)
+	{
+		ReadMeshletSections(meshFile, shape.first, ShapeMeshlets[shape.first]);
+		ReadSection(meshFile, shape.first + ".lodErrors", ShapeLodErrors[shape.first]);
+	}
 
-	geometry->DrawArgs["box"] = boxSubmesh;
-	geometry->DrawArgs["grid"] = gridSubmesh;
-	geometry->DrawArgs["sphere"] = sphereSubmesh;
-	geometry->DrawArgs["cylinder"] = cylinderSubmesh;
+	// Let other geometries draw these shapes from this buffer instead of uploading them again
+	auto previousGeometry = Geometries.find(geometry->Name);
+	if (previousGeometry != Geometries.end())
+	{
+		ShapeCache.UnregisterGeometry(previousGeometry->second.get());
+	}
+	for (auto& shape : shapes)
+	{
+		ShapeCache.RegisterSubmesh(shape.second, geometry.get(), geometry->DrawArgs[shape.first]);
+	}
+
+	GeometryCacheStats cacheStats = ShapeCache.GetStats();
+	std::string message = "Shape cache: " + std::to_string(cacheStats.Hits) + " hits, " + std::to_string(cacheStats.Misses) + " misses, " +
+		std::to_string((cacheStats.MeshBytes + cacheStats.EncodedVertexBytes) / 1024) + " KB\n";
+	OutputDebugStringA(message.c_str());
 
 	Geometries[geometry->Name] = std::move(geometry);
 }
@@ -615,89 +1179,251 @@ void MyApp::BuildShapesGeometry()
 //=========================================================================================
 void MyApp::BuildRenderItems()
 {
+	// Nothing in the "Shapes" demo moves after it is built, so every item can be batched
+	std::vector<std::pair<std::string, GeometryKey>> shapes = GetShapeKeys();
+	std::unordered_map<std::string, GeometryKey> shapeKeys(shapes.begin(), shapes.end());
+
 	// Construct the scene for the "Shapes" demo
-	std::unique_ptr<RenderItem> boxRenderItem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRenderItem->World, XMMatrixMultiply(XMMatrixScaling(2.0f, 2.0f, 2.0f), XMMatrixTranslation(0.0f, 0.5f, 0.0f)));
-	boxRenderItem->ObjConstantBufferIndex = 0;
-	boxRenderItem->Geometry = Geometries["shapeGeo"].get();
-	boxRenderItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRenderItem->IndexCount = boxRenderItem->Geometry->DrawArgs["box"].IndexCount;
-	boxRenderItem->StartIndexLocation = boxRenderItem->Geometry->DrawArgs["box"].StartIndexLocation;
-	boxRenderItem->BaseVertexLocation = boxRenderItem->Geometry->DrawArgs["box"].BaseVertexLocation;
+	RenderItem boxRenderItem;
+	XMStoreFloat4x4(&boxRenderItem.World, XMMatrixMultiply(XMMatrixScaling(2.0f, 2.0f, 2.0f), XMMatrixTranslation(0.0f, 0.5f, 0.0f)));
+	SetRenderItemShape(boxRenderItem, ShapeCache, shapeKeys["box"], ShapeVertexFormat, &ShapeMeshlets["box"]);
+	SetRenderItemLods(boxRenderItem, "box", ShapeLodErrors["box"]);
+	boxRenderItem.IsStatic = true;
 
 	// Add to render items list
-	AllRenderItems.push_back(std::move(boxRenderItem));
+	RenderItems.Add(boxRenderItem);
 
-	std::unique_ptr<RenderItem> gridRenderItem = std::make_unique<RenderItem>();
-	gridRenderItem->World = MathHelper::Identity4x4();
-	gridRenderItem->ObjConstantBufferIndex = 1;
-	gridRenderItem->Geometry = Geometries["shapeGeo"].get();
-	gridRenderItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRenderItem->IndexCount = gridRenderItem->Geometry->DrawArgs["grid"].IndexCount;
-	gridRenderItem->StartIndexLocation = gridRenderItem->Geometry->DrawArgs["grid"].StartIndexLocation;
-	gridRenderItem->BaseVertexLocation = gridRenderItem->Geometry->DrawArgs["grid"].BaseVertexLocation;
+	RenderItem gridRenderItem;
+	gridRenderItem.World = MathHelper::Identity4x4();
+	SetRenderItemShape(gridRenderItem, ShapeCache, shapeKeys["grid"], ShapeVertexFormat, &ShapeMeshlets["grid"]);
+	SetRenderItemLods(gridRenderItem, "grid", ShapeLodErrors["grid"]);
+	gridRenderItem.IsStatic = true;
 
 	// Add to render items list
-	AllRenderItems.push_back(std::move(gridRenderItem));
+	RenderItems.Add(gridRenderItem);
+
+	// The spheres sit on top of the columns. They are children of the columns' transforms,
+	// so moving a column carries its sphere along.
+	XMFLOAT4X4 sphereOnColumn;
+	XMStoreFloat4x4(&sphereOnColumn, XMMatrixTranslation(0.0f, 2.0f, 0.0f));
 
 	// Build the columns and spheres in rows
-	UINT objCBIndex = 2;
 	for (int i = 0; i < 5; ++i)
 	{
-		std::unique_ptr<RenderItem> leftCylinderRenderItem = std::make_unique<RenderItem>();
-		std::unique_ptr<RenderItem> leftSphereRenderItem = std::make_unique<RenderItem>();
-		std::unique_ptr<RenderItem> rightCylinderRenderItem = std::make_unique<RenderItem>();
-		std::unique_ptr<RenderItem> rightSphereRenderItem = std::make_unique<RenderItem>();
+		RenderItem leftCylinderRenderItem;
+		RenderItem leftSphereRenderItem;
+		RenderItem rightCylinderRenderItem;
+		RenderItem rightSphereRenderItem;
+
+		XMFLOAT4X4 leftCylinderWorld;
+		XMFLOAT4X4 rightCylinderWorld;
+		XMStoreFloat4x4(&leftCylinderWorld, XMMatrixTranslation(-5.0f, 1.5f, -10.0f + i*5.0f));
+		XMStoreFloat4x4(&rightCylinderWorld, XMMatrixTranslation(5.0f, 1.5f, -10.0f + i * 5.0f));
+
+		UINT leftCylinderNode = Transforms.AddNode(leftCylinderWorld);
+		UINT leftSphereNode = Transforms.AddNode(sphereOnColumn, leftCylinderNode);
+		UINT rightCylinderNode = Transforms.AddNode(rightCylinderWorld);
+		UINT rightSphereNode = Transforms.AddNode(sphereOnColumn, rightCylinderNode);
+
+		SetRenderItemShape(leftCylinderRenderItem, ShapeCache, shapeKeys["cylinder"], ShapeVertexFormat, &ShapeMeshlets["cylinder"]);
+		SetRenderItemLods(leftCylinderRenderItem, "cylinder", ShapeLodErrors["cylinder"]);
+		leftCylinderRenderItem.IsStatic = true;
+
+		SetRenderItemShape(rightCylinderRenderItem, ShapeCache, shapeKeys["cylinder"], ShapeVertexFormat, &ShapeMeshlets["cylinder"]);
+		SetRenderItemLods(rightCylinderRenderItem, "cylinder", ShapeLodErrors["cylinder"]);
+		rightCylinderRenderItem.IsStatic = true;
+
+		SetRenderItemShape(leftSphereRenderItem, ShapeCache, shapeKeys["sphere"], ShapeVertexFormat, &ShapeMeshlets["sphere"]);
+		SetRenderItemLods(leftSphereRenderItem, "sphere", ShapeLodErrors["sphere"]);
+		leftSphereRenderItem.IsStatic = true;
+
+		SetRenderItemShape(rightSphereRenderItem, ShapeCache, shapeKeys["sphere"], ShapeVertexFormat, &ShapeMeshlets["sphere"]);
+		SetRenderItemLods(rightSphereRenderItem, "sphere", ShapeLodErrors["sphere"]);
+		rightSphereRenderItem.IsStatic = true;
+
+		// Their world matrices are filled in from the transforms below
+		NodeRenderItems.resize(Transforms.GetNodeCount());
+		NodeRenderItems[leftCylinderNode] = RenderItems.Add(leftCylinderRenderItem);
+		NodeRenderItems[rightCylinderNode] = RenderItems.Add(rightCylinderRenderItem);
+		NodeRenderItems[leftSphereNode] = RenderItems.Add(leftSphereRenderItem);
+		NodeRenderItems[rightSphereNode] = RenderItems.Add(rightSphereRenderItem);
+	}
+
+	UpdateTransforms();
+}
 
-		XMMATRIX leftCylinderWorld = XMMatrixTranslation(-5.0f, 1.5f, -10.0f + i*5.0f);
-		XMMATRIX leftSphereWorld = XMMatrixTranslation(-5.0f, 3.5f, -10.0f + i * 5.0f);
+//=========================================================================================
+void MyApp::BuildStaticBatches()
+{
+	// The cache hands back the object space mesh of each shape, generating it if the shapes
+	// came from the mesh file. Every shapes item draws with PipelineStateObject.
+	StaticBatcher batcher(ShapeVertexFormat);
+	std::vector<RenderItemHandle> staticItems;
+	for (UINT i = 0; i < RenderItems.GetCount(); ++i)
+	{
+		if (RenderItems.IsStatic(i))
+		{
+			const GeometryKey& shape = RenderItems.GetShape(i);
+			batcher.Add(*ShapeCache.Get(shape)->Mesh, RenderItems.GetWorlds()[i], shape.Color, nullptr);
+			staticItems.push_back(RenderItems.GetHandle(i));
+		}
+	}
+	batcher.Build(&WorkerPool);
+
+	// Each batch is one submesh of a new geometry, with its index buffer in meshlet order so
+	// the parts of it outside the frustum are still culled
+	const std::vector<StaticBatcher::Batch>& batches = batcher.GetBatches();
+	std::vector<std::string> names;
+	std::vector<size_t> indexRanges;
+	std::vector<BYTE> vertices;
+	IndexPacker indexPacker;
+	for (size_t i = 0; i < batches.size(); ++i)
+	{
+		names.push_back("static" + std::to_string(i));
 
-		XMMATRIX rightCylinderWorld = XMMatrixTranslation(5.0f, 1.5f, -10.0f + i * 5.0f);
-		XMMATRIX rightSphereWorld = XMMatrixTranslation(5.0f, 3.5f, -10.0f + i * 5.0f);
+		MeshletData& meshlets = ShapeMeshlets[names[i]];
+		meshlets = MeshletBuilder::Build(batches[i].Mesh);
 
-		XMStoreFloat4x4(&leftCylinderRenderItem->World, leftCylinderWorld);
-		leftCylinderRenderItem->ObjConstantBufferIndex = objCBIndex++;
-		leftCylinderRenderItem->Geometry = Geometries["shapeGeo"].get();
-		leftCylinderRenderItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftCylinderRenderItem->IndexCount = leftCylinderRenderItem->Geometry->DrawArgs["cylinder"].IndexCount;
-		leftCylinderRenderItem->StartIndexLocation = leftCylinderRenderItem->Geometry->DrawArgs["cylinder"].StartIndexLocation;
-		leftCylinderRenderItem->BaseVertexLocation = leftCylinderRenderItem->Geometry->DrawArgs["cylinder"].BaseVertexLocation;
+		UINT vertexOffset = (UINT)(vertices.size() / VertexCompression::GetVertexStride(ShapeVertexFormat));
+		indexRanges.push_back(indexPacker.AddSubmesh(MeshletBuilder::GetMeshletIndices(meshlets), vertexOffset));
+		vertices.insert(vertices.end(), batches[i].Vertices.begin(), batches[i].Vertices.end());
+	}
+	indexPacker.Pack();
 
-		XMStoreFloat4x4(&rightCylinderRenderItem->World, rightCylinderWorld);
-		rightCylinderRenderItem->ObjConstantBufferIndex = objCBIndex++;
-		rightCylinderRenderItem->Geometry = Geometries["shapeGeo"].get();
-		rightCylinderRenderItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightCylinderRenderItem->IndexCount = rightCylinderRenderItem->Geometry->DrawArgs["cylinder"].IndexCount;
-		rightCylinderRenderItem->StartIndexLocation = rightCylinderRenderItem->Geometry->DrawArgs["cylinder"].StartIndexLocation;
-		rightCylinderRenderItem->BaseVertexLocation = rightCylinderRenderItem->Geometry->DrawArgs["cylinder"].BaseVertexLocation;
+	std::unique_ptr<MeshGeometry> geometry = std::make_unique<MeshGeometry>();
+	geometry->Name = "staticGeo";
 
-		XMStoreFloat4x4(&leftSphereRenderItem->World, leftSphereWorld);
-		leftSphereRenderItem->ObjConstantBufferIndex = objCBIndex++;
-		leftSphereRenderItem->Geometry = Geometries["shapeGeo"].get();
-		leftSphereRenderItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftSphereRenderItem->IndexCount = leftSphereRenderItem->Geometry->DrawArgs["sphere"].IndexCount;
-		leftSphereRenderItem->StartIndexLocation = leftSphereRenderItem->Geometry->DrawArgs["sphere"].StartIndexLocation;
-		leftSphereRenderItem->BaseVertexLocation = leftSphereRenderItem->Geometry->DrawArgs["sphere"].BaseVertexLocation;
+	geometry->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(), vertices.data(), vertices.size(), geometry->VertexBufferUploader);
+	geometry->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(),
+		indexPacker.GetData(), indexPacker.GetByteSize(), geometry->IndexBufferUploader);
 
-		XMStoreFloat4x4(&rightSphereRenderItem->World, rightSphereWorld);
-		rightSphereRenderItem->ObjConstantBufferIndex = objCBIndex++;
-		rightSphereRenderItem->Geometry = Geometries["shapeGeo"].get();
-		rightSphereRenderItem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightSphereRenderItem->IndexCount = rightSphereRenderItem->Geometry->DrawArgs["sphere"].IndexCount;
-		rightSphereRenderItem->StartIndexLocation = rightSphereRenderItem->Geometry->DrawArgs["sphere"].StartIndexLocation;
-		rightSphereRenderItem->BaseVertexLocation = rightSphereRenderItem->Geometry->DrawArgs["sphere"].BaseVertexLocation;
+	geometry->VertexByteStride = VertexCompression::GetVertexStride(ShapeVertexFormat);
+	geometry->VertexBufferByteSize = (UINT)vertices.size();
+	geometry->IndexFormat = indexPacker.GetFormat();
+	geometry->IndexBufferByteSize = indexPacker.GetByteSize();
 
-		AllRenderItems.push_back(std::move(leftCylinderRenderItem));
-		AllRenderItems.push_back(std::move(rightCylinderRenderItem));
-		AllRenderItems.push_back(std::move(leftSphereRenderItem));
-		AllRenderItems.push_back(std::move(rightSphereRenderItem));
+	// Constant buffers and descriptors are built after this, for the items that are left
+	UINT itemCount = RenderItems.GetCount();
+	for (RenderItemHandle handle : staticItems)
+	{
+		RenderItems.Remove(handle);
 	}
 
-	// All render items are opaque in the "shapes" scene
-	for (auto& renderItem : AllRenderItems)
+	for (size_t i = 0; i < batches.size(); ++i)
 	{
-		OpaqueRenderItems.push_back(renderItem.get());
+		SubmeshGeometry submesh = indexPacker.GetSubmesh(indexRanges[i]);
+		submesh.Bounds = batches[i].Bounds;
+		submesh.Sphere = batches[i].Sphere;
+		geometry->DrawArgs[names[i]] = submesh;
+
+		// The world transform is in the vertices already
+		RenderItem batchRenderItem;
+		SetRenderItemSubmesh(batchRenderItem, geometry.get(), names[i], ShapeVertexFormat, &ShapeMeshlets[names[i]]);
+		RenderItems.Add(batchRenderItem);
 	}
+
+	std::string message = "Static batching: " + std::to_string(itemCount) + " render items -> " + std::to_string(RenderItems.GetCount()) + "\n";
+	OutputDebugStringA(message.c_str());
+
+	Geometries[geometry->Name] = std::move(geometry);
+}
+
+//=========================================================================================
+void MyApp::BuildLandGeometry()
+{
+	// Heights, normals and colors come out of one pass over the grid; only the indices are
+	// taken from CreateGrid
+	TerrainGenerator terrain(GetLandSettings());
+	terrain.SetThreadPool(&WorkerPool);
+
+	std::vector<Vertex> vertices;
+	terrain.Generate(kLandSize, kLandSize, kLandVertexCount, kLandVertexCount, vertices,
+		[](const XMFLOAT3& position, const XMFLOAT3& /*normal*/, const XMFLOAT4& color)
+	{
+		Vertex vertex;
+		vertex.Pos = position;
+		vertex.Color = color;
+		return vertex;
+	});
+
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid<GeometryGenerator::StreamPosition>(kLandSize, kLandSize, kLandVertexCount, kLandVertexCount);
+
+	IndexPacker indexPacker;
+	size_t indexRange = indexPacker.AddSubmesh(grid.Indices32, 0);
+	indexPacker.Pack();
+
+	const UINT vertexByteSize = (UINT)vertices.size() * sizeof(Vertex);
+
+	std::unique_ptr<MeshGeometry> geometry = std::make_unique<MeshGeometry>();
+	geometry->Name = "landGeo";
+
+	geometry->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(), vertices.data(), vertexByteSize, geometry->VertexBufferUploader);
+	geometry->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(),
+		indexPacker.GetData(), indexPacker.GetByteSize(), geometry->IndexBufferUploader);
+
+	geometry->VertexByteStride = sizeof(Vertex);
+	geometry->VertexBufferByteSize = vertexByteSize;
+	geometry->IndexFormat = indexPacker.GetFormat();
+	geometry->IndexBufferByteSize = indexPacker.GetByteSize();
+
+	geometry->DrawArgs["grid"] = indexPacker.GetSubmesh(indexRange);
+	MeshBounds::ComputeSubmeshBounds(&vertices[0].Pos, vertices.size(), sizeof(Vertex), geometry->DrawArgs["grid"], &WorkerPool);
+
+	Geometries[geometry->Name] = std::move(geometry);
+}
+
+//=========================================================================================
+void MyApp::BuildWavesGeometry()
+{
+	WaveSimulation = std::make_unique<Waves>(kWavesRowCount, kWavesColumnCount, kWavesSpatialStep, kWavesTimeStep, kWavesSpeed, kWavesDamping);
+	WaveSimulation->SetThreadPool(&WorkerPool);
+
+	// Waves lays its vertices out like CreateGrid, so only the grid's indices are needed
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid<GeometryGenerator::StreamPosition>(WaveSimulation->GetWidth(), WaveSimulation->GetDepth(),
+		WaveSimulation->GetRowCount(), WaveSimulation->GetColumnCount());
+
+	IndexPacker indexPacker;
+	size_t indexRange = indexPacker.AddSubmesh(grid.Indices32, 0);
+	indexPacker.Pack();
+
+	std::unique_ptr<MeshGeometry> geometry = std::make_unique<MeshGeometry>();
+	geometry->Name = "waterGeo";
+
+	// The vertex buffer is the WavesVB of the current frame resource, set every frame
+	geometry->VertexBufferGPU = nullptr;
+	geometry->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(D3dDevice.Get(), CommandList.Get(),
+		indexPacker.GetData(), indexPacker.GetByteSize(), geometry->IndexBufferUploader);
+
+	geometry->VertexByteStride = sizeof(Vertex);
+	geometry->VertexBufferByteSize = WaveSimulation->GetVertexCount() * sizeof(Vertex);
+	geometry->IndexFormat = indexPacker.GetFormat();
+	geometry->IndexBufferByteSize = indexPacker.GetByteSize();
+
+	// The bounds follow the heights, see UpdateWaves
+	SubmeshGeometry submesh = indexPacker.GetSubmesh(indexRange);
+	submesh.Bounds = WaveSimulation->GetBounds();
+	BoundingSphere::CreateFromBoundingBox(submesh.Sphere, submesh.Bounds);
+	geometry->DrawArgs["grid"] = submesh;
+
+	Geometries[geometry->Name] = std::move(geometry);
+}
+
+//=========================================================================================
+void MyApp::BuildLandAndWavesRenderItems()
+{
+	RenderItem wavesRenderItem;
+	wavesRenderItem.World = MathHelper::Identity4x4();
+	SetRenderItemSubmesh(wavesRenderItem, Geometries["waterGeo"].get(), "grid");
+
+	WavesRenderItem = RenderItems.Add(wavesRenderItem);
+
+	RenderItem gridRenderItem;
+	gridRenderItem.World = MathHelper::Identity4x4();
+	SetRenderItemSubmesh(gridRenderItem, Geometries["landGeo"].get(), "grid");
+
+	RenderItems.Add(gridRenderItem);
 }
 
 //=========================================================================================
@@ -724,6 +1450,9 @@ void MyApp::BuildPipelineStateObject()
 	pipelineDesc.DSVFormat = DepthStencilFormat;
 	
 	ThrowIfFailed(D3dDevice->CreateGraphicsPipelineState(&pipelineDesc, IID_PPV_ARGS(&PipelineStateObject)));
+
+	pipelineDesc.VS = { reinterpret_cast<BYTE*>(InstancedVertexShaderByteCode->GetBufferPointer()), InstancedVertexShaderByteCode->GetBufferSize() };
+	ThrowIfFailed(D3dDevice->CreateGraphicsPipelineState(&pipelineDesc, IID_PPV_ARGS(&InstancedPipelineStateObject)));
 }
 
 //=========================================================================================
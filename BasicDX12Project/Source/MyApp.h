@@ -1,39 +1,19 @@
 #pragma once
 
 #include "D3dApp.h"
+#include "GeometryCache.h"
+#include "InstanceBatcher.h"
+#include "MeshletBuilder.h"
+#include "RenderItemPool.h"
+#include "ThreadPool.h"
+#include "TransformHierarchy.h"
+#include "VertexCompression.h"
+#include "Waves.h"
 #include "FromBook/FrameResource.h"
 #include "FromBook/UploadBuffer.h"
 
 static const int kNumFrameResources = 3;
 
-// Lightweight structure that stores parameters to draw a shape
-struct RenderItem 
-{
-	RenderItem() = default;
-
-	// World matrix of the shape that describes the object's local space relative to world space,
-	// which defines position, orientation, and scale
-	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
-
-	// Dirty flag indicating the object data has changed and we need
-	// to update the constant buffer. Because we have an object cbuffer for each FrameResource, we have to apply the
-	// update to each FrameResource. Thus, when we modify obect data we should set
-	// NumFramesDirty = kNumFrameResources so that each frame resource gets the update.
-	int NumFramesDirty = kNumFrameResources;
-
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item
-	UINT ObjConstantBufferIndex = -1;
-
-	MeshGeometry* Geometry = nullptr;
-
-	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-
-	// DrawIndexedInstance parameters
-	UINT IndexCount = 0;
-	UINT StartIndexLocation = 0;
-	int BaseVertexLocation = 0;
-};
-
 enum DemoType
 {
 	Shapes,
@@ -52,6 +32,16 @@ class MyApp : public D3DApp
 
 		DemoType demo = DemoType::Shapes;
 
+		// Vertex encoding used for the shapes geometry
+		VertexFormat ShapeVertexFormat = VertexFormat::QuantizedPosition;
+
+		// Draws the visible render items that share a submesh with one instanced call. They
+		// skip meshlet culling, items drawn on their own still use it.
+		bool UseInstancing = true;
+
+		// Replaces the static render items with one pre-transformed item per pipeline state
+		bool UseStaticBatching = false;
+
 	protected:
 		virtual void OnResize() override;
 		virtual void Update(const GameTimer& gt) override;
@@ -61,10 +51,18 @@ class MyApp : public D3DApp
 		virtual void OnMouseUp(WPARAM btnState, int x, int y) override;
 		virtual void OnMouseMove(WPARAM btnState, int x, int y) override;
 
+		void UpdateTransforms();
 		void UpdateObjectConstBuffers(const GameTimer& gt);
 		void UpdateMainPassConstBuffers(const GameTimer& gt);
+		void UpdateWaves(const GameTimer& gt);
 
-		void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& renderItems);
+		void DrawRenderItems(ID3D12GraphicsCommandList* cmdList);
+		void DrawRenderItem(ID3D12GraphicsCommandList* cmdList, UINT index, const RenderItemLod* lod, DirectX::FXMMATRIX invView);
+		void DrawInstances(ID3D12GraphicsCommandList* cmdList, const InstanceBatch& batch);
+		void SetIndexBuffer(ID3D12GraphicsCommandList* cmdList, const RenderItemDrawArgs& drawArgs, const RenderItemLod* lod);
+		void DrawIndexRange(ID3D12GraphicsCommandList* cmdList, const std::vector<IndexChunk>& indexChunks, int baseVertexLocation,
+			UINT startIndexLocation, UINT indexCount, UINT instanceCount = 1);
+		const RenderItemLod* SelectLod(const RenderItemDrawArgs& drawArgs, DirectX::FXMMATRIX world, const DirectX::BoundingBox& worldBounds) const;
 
 		void BuildInputLayoutAndShaders();
 		void BuildDescriptorHeaps();
@@ -72,7 +70,13 @@ class MyApp : public D3DApp
 		void BuildRootSignature();
 		void BuildGeometry();
 		void BuildShapesGeometry();
+		std::vector<std::pair<std::string, GeometryKey>> GetShapeKeys() const;
+		std::vector<BYTE> GenerateShapesMeshFile(const std::vector<std::pair<std::string, GeometryKey>>& shapes, std::uint64_t sourceHash);
 		void BuildRenderItems();
+		void BuildStaticBatches();
+		void BuildLandGeometry();
+		void BuildWavesGeometry();
+		void BuildLandAndWavesRenderItems();
 		void BuildFrameResources();
 		void BuildPipelineStateObject();
 
@@ -81,6 +85,9 @@ class MyApp : public D3DApp
 
 		Microsoft::WRL::ComPtr<ID3D12PipelineState> PipelineStateObject;
 
+		// Same as PipelineStateObject with the world matrices read from the instance buffer
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> InstancedPipelineStateObject;
+
 		Microsoft::WRL::ComPtr<ID3D12RootSignature> RootSignature;
 
 		Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> CbvHeap;
@@ -95,16 +102,56 @@ class MyApp : public D3DApp
 		int CurrFrameResourceIndex = 0;
 
 		UINT PassCbvOffset = 0;
+
+		// Object CBVs per frame resource. Render items index them by their index in the pool,
+		// so the pool holds at most this many items once the descriptors are built.
+		UINT ObjectCbvCount = 0;
 		
-		// Render item lists
-		std::vector<std::unique_ptr<RenderItem>> AllRenderItems;
-		std::vector<RenderItem*> OpaqueRenderItems;
-		std::vector<RenderItem*> TransparentRenderItems;
+		// Every render item of the scene, all drawn with the opaque pipeline state
+		RenderItemPool RenderItems;
+
+		// Parent/child transforms of the render items that are attached to a node, and the item
+		// of each node. UpdateTransforms copies the world matrices that changed to the items.
+		TransformHierarchy Transforms;
+		std::vector<RenderItemHandle> NodeRenderItems;
 
 		PassConstants MainPassConstBuffer;
 
+		// View space camera frustum for meshlet culling
+		DirectX::BoundingFrustum CameraFrustum;
+
+		// Meshlets of the shapes geometry by submesh name
+		std::unordered_map<std::string, MeshletData> ShapeMeshlets;
+
+		// MeshSimplifier errors of each shape's LODs, by shape name
+		std::unordered_map<std::string, std::vector<float>> ShapeLodErrors;
+
+		// Indices of the render items that passed frustum culling this frame, the LOD each one
+		// is drawn with (nullptr for full detail) and their instanced batches
+		std::vector<UINT> VisibleRenderItems;
+		std::vector<const RenderItemLod*> VisibleLods;
+		InstanceBatcher Batcher;
+
+		// Meshlet culling results of the last frame, and the draws of the last item
+		std::vector<GeometryGenerator::uint32> VisibleMeshlets;
+		std::vector<MeshletDrawRange> MeshletDrawRanges;
+		MeshletCullStats CullStats;
+
+		// Worker threads for CPU-heavy build and update work
+		ThreadPool WorkerPool;
+
+		// Generated shapes by parameters and vertex format, kept across scene rebuilds
+		GeometryCache ShapeCache;
+
+		// Simulation behind the waves of the "LandAndWaves" demo, drawn from the WavesVB of
+		// the current frame resource
+		std::unique_ptr<Waves> WaveSimulation;
+		RenderItemHandle WavesRenderItem;
+		float LastWaveDisturbTime = 0.0f;
+
 		Microsoft::WRL::ComPtr<ID3DBlob> VertexShaderByteCode = nullptr;
 		Microsoft::WRL::ComPtr<ID3DBlob> PixelShaderByteCode = nullptr;
+		Microsoft::WRL::ComPtr<ID3DBlob> InstancedVertexShaderByteCode = nullptr;
 
 		DirectX::XMFLOAT3 EyePos = { 0.0f, 0.0f, 0.0f };
 		DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
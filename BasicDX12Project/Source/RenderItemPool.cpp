@@ -0,0 +1,315 @@
+#include "RenderItemPool.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// Dirty items are split into chunks of one cache line of indices
+	const size_t kItemsPerChunk = 16;
+
+	// Items handed to a thread at once
+	const size_t kMinItemsPerTask = 2048;
+
+	// Row of a times the matrix with rows b0 to b3
+	__m128 MultiplyRow(const float* a, __m128 b0, __m128 b1, __m128 b2, __m128 b3)
+	{
+		__m128 row = _mm_mul_ps(_mm_set1_ps(a[0]), b0);
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[1]), b1));
+		row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[2]), b2));
+		return _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[3]), b3));
+	}
+
+	// Stores the transpose of decode * world to dst, which must be 16-byte aligned
+	void StreamTransposedProduct(const XMFLOAT4X4& decode, const XMFLOAT4X4& world, float* dst)
+	{
+		__m128 b0 = _mm_loadu_ps(&world.m[0][0]);
+		__m128 b1 = _mm_loadu_ps(&world.m[1][0]);
+		__m128 b2 = _mm_loadu_ps(&world.m[2][0]);
+		__m128 b3 = _mm_loadu_ps(&world.m[3][0]);
+
+		__m128 r0 = MultiplyRow(decode.m[0], b0, b1, b2, b3);
+		__m128 r1 = MultiplyRow(decode.m[1], b0, b1, b2, b3);
+		__m128 r2 = MultiplyRow(decode.m[2], b0, b1, b2, b3);
+		__m128 r3 = MultiplyRow(decode.m[3], b0, b1, b2, b3);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		_mm_stream_ps(dst, r0);
+		_mm_stream_ps(dst + 4, r1);
+		_mm_stream_ps(dst + 8, r2);
+		_mm_stream_ps(dst + 12, r3);
+	}
+}
+
+//=========================================================================================
+bool RenderItemHandle::operator==(const RenderItemHandle& rhs) const
+{
+	return Slot == rhs.Slot && Generation == rhs.Generation;
+}
+
+//=========================================================================================
+bool RenderItemHandle::operator!=(const RenderItemHandle& rhs) const
+{
+	return !(*this == rhs);
+}
+
+//=========================================================================================
+RenderItemPool::RenderItemPool(int frameResourceCount)
+: FrameResourceCount(frameResourceCount)
+{
+}
+
+//=========================================================================================
+RenderItemHandle RenderItemPool::Add(const RenderItem& renderItem)
+{
+	uint32 slot;
+	if (!FreeSlots.empty())
+	{
+		slot = FreeSlots.back();
+		FreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (uint32)Slots.size();
+		Slots.emplace_back();
+	}
+
+	uint32 index = GetCount();
+	Slots[slot].Index = index;
+
+	Worlds.push_back(renderItem.World);
+	PositionDecodes.push_back(renderItem.PositionDecode);
+	Bounds.push_back(renderItem.Bounds);
+	FramesDirty.push_back(0);
+	DirtyPositions.push_back(UINT32_MAX);
+	DrawArgs.push_back(renderItem.DrawArgs);
+	StaticFlags.push_back(renderItem.IsStatic);
+	Shapes.push_back(renderItem.Shape);
+	IndexSlots.push_back(slot);
+	MarkDirty(index);
+
+	return { slot, Slots[slot].Generation };
+}
+
+//=========================================================================================
+void RenderItemPool::Remove(RenderItemHandle handle)
+{
+	assert(IsValid(handle));
+
+	Slot& slot = Slots[handle.Slot];
+	uint32 last = GetCount() - 1;
+	if (slot.Index != last)
+	{
+		MoveItem(last, slot.Index);
+	}
+	RemoveDirty(last);
+
+	Worlds.pop_back();
+	PositionDecodes.pop_back();
+	Bounds.pop_back();
+	FramesDirty.pop_back();
+	DirtyPositions.pop_back();
+	DrawArgs.pop_back();
+	StaticFlags.pop_back();
+	Shapes.pop_back();
+	IndexSlots.pop_back();
+
+	// Every handle to the item goes stale
+	slot.Index = UINT32_MAX;
+	++slot.Generation;
+	FreeSlots.push_back(handle.Slot);
+}
+
+//=========================================================================================
+void RenderItemPool::MoveItem(uint32 from, uint32 to)
+{
+	Worlds[to] = Worlds[from];
+	PositionDecodes[to] = PositionDecodes[from];
+	Bounds[to] = Bounds[from];
+	DrawArgs[to] = std::move(DrawArgs[from]);
+	StaticFlags[to] = StaticFlags[from];
+	Shapes[to] = Shapes[from];
+	IndexSlots[to] = IndexSlots[from];
+	Slots[IndexSlots[to]].Index = to;
+
+	// Its constants are now expected in another slot of the constant buffers
+	MarkDirty(to);
+}
+
+//=========================================================================================
+void RenderItemPool::MarkDirty(uint32 index)
+{
+	FramesDirty[index] = FrameResourceCount;
+	if (DirtyPositions[index] == UINT32_MAX)
+	{
+		DirtyPositions[index] = (uint32)DirtyItems.size();
+		DirtyItems.push_back(index);
+	}
+}
+
+//=========================================================================================
+void RenderItemPool::RemoveDirty(uint32 index)
+{
+	uint32 position = DirtyPositions[index];
+	if (position == UINT32_MAX)
+	{
+		return;
+	}
+
+	DirtyItems[position] = DirtyItems.back();
+	DirtyPositions[DirtyItems[position]] = position;
+	DirtyItems.pop_back();
+
+	FramesDirty[index] = 0;
+	DirtyPositions[index] = UINT32_MAX;
+}
+
+//=========================================================================================
+void RenderItemPool::Clear()
+{
+	for (uint32 slot : IndexSlots)
+	{
+		Slots[slot].Index = UINT32_MAX;
+		++Slots[slot].Generation;
+		FreeSlots.push_back(slot);
+	}
+
+	Worlds.clear();
+	PositionDecodes.clear();
+	Bounds.clear();
+	FramesDirty.clear();
+	DirtyItems.clear();
+	DirtyPositions.clear();
+	DrawArgs.clear();
+	StaticFlags.clear();
+	Shapes.clear();
+	IndexSlots.clear();
+}
+
+//=========================================================================================
+void RenderItemPool::WriteDirtyConstants(BYTE* constants, UINT slotByteSize, ThreadPool* threadPool) const
+{
+	assert(((uintptr_t)constants & 15) == 0 && slotByteSize % 16 == 0);
+
+	const size_t itemCount = DirtyItems.size();
+	auto writeChunks = [&](size_t firstChunk, size_t lastChunk)
+	{
+		size_t end = std::min<size_t>(lastChunk * kItemsPerChunk, itemCount);
+		for (size_t i = firstChunk * kItemsPerChunk; i < end; ++i)
+		{
+			uint32 index = DirtyItems[i];
+			StreamTransposedProduct(PositionDecodes[index], Worlds[index], reinterpret_cast<float*>(constants + (size_t)index * slotByteSize));
+		}
+
+		// Streaming stores are weakly ordered, make them visible before the GPU is signaled
+		_mm_sfence();
+	};
+
+	size_t chunkCount = (itemCount + kItemsPerChunk - 1) / kItemsPerChunk;
+	ThreadPool::ParallelFor(threadPool, 0, chunkCount, kMinItemsPerTask / kItemsPerChunk, writeChunks);
+}
+
+//=========================================================================================
+bool RenderItemPool::IsValid(RenderItemHandle handle) const
+{
+	return handle.Slot < Slots.size() && Slots[handle.Slot].Generation == handle.Generation && Slots[handle.Slot].Index != UINT32_MAX;
+}
+
+//=========================================================================================
+RenderItemPool::uint32 RenderItemPool::GetCount() const
+{
+	return (uint32)IndexSlots.size();
+}
+
+//=========================================================================================
+RenderItemPool::uint32 RenderItemPool::GetIndex(RenderItemHandle handle) const
+{
+	assert(IsValid(handle));
+	return Slots[handle.Slot].Index;
+}
+
+//=========================================================================================
+RenderItemHandle RenderItemPool::GetHandle(uint32 index) const
+{
+	uint32 slot = IndexSlots[index];
+	return { slot, Slots[slot].Generation };
+}
+
+//=========================================================================================
+void RenderItemPool::SetWorld(RenderItemHandle handle, const XMFLOAT4X4& world)
+{
+	uint32 index = GetIndex(handle);
+	Worlds[index] = world;
+	MarkDirty(index);
+}
+
+//=========================================================================================
+void RenderItemPool::SetBounds(RenderItemHandle handle, const BoundingBox& bounds)
+{
+	Bounds[GetIndex(handle)] = bounds;
+}
+
+//=========================================================================================
+const XMFLOAT4X4* RenderItemPool::GetWorlds() const
+{
+	return Worlds.data();
+}
+
+//=========================================================================================
+const XMFLOAT4X4* RenderItemPool::GetPositionDecodes() const
+{
+	return PositionDecodes.data();
+}
+
+//=========================================================================================
+const BoundingBox* RenderItemPool::GetBounds() const
+{
+	return Bounds.data();
+}
+
+//=========================================================================================
+const RenderItemDrawArgs* RenderItemPool::GetDrawArgs() const
+{
+	return DrawArgs.data();
+}
+
+//=========================================================================================
+const std::vector<RenderItemPool::uint32>& RenderItemPool::GetDirtyItems() const
+{
+	return DirtyItems;
+}
+
+//=========================================================================================
+void RenderItemPool::CountDownDirtyItems()
+{
+	// Items that are up to date everywhere leave the list, the rest are packed in place
+	size_t count = 0;
+	for (uint32 index : DirtyItems)
+	{
+		if (--FramesDirty[index] > 0)
+		{
+			DirtyPositions[index] = (uint32)count;
+			DirtyItems[count++] = index;
+		}
+		else
+		{
+			DirtyPositions[index] = UINT32_MAX;
+		}
+	}
+	DirtyItems.resize(count);
+}
+
+//=========================================================================================
+bool RenderItemPool::IsStatic(uint32 index) const
+{
+	return StaticFlags[index];
+}
+
+//=========================================================================================
+const GeometryKey& RenderItemPool::GetShape(uint32 index) const
+{
+	return Shapes[index];
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "FromBook/d3dUtil.h"
+#include "FromBook/MathHelper.h"
+#include "GeometryCache.h"
+#include "MeshletBuilder.h"
+
+class ThreadPool;
+
+// Simplified version of a submesh, drawn in its place once its error is small on screen
+struct RenderItemLod
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+	std::vector<IndexChunk> IndexChunks;
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_UNKNOWN;
+
+	// Largest object space distance from the full detail surface (MeshSimplifier::Lod)
+	float MaxError = 0.0f;
+};
+
+// What DrawIndexedInstanced and the meshlet culling need to draw a render item
+struct RenderItemDrawArgs
+{
+	MeshGeometry* Geometry = nullptr;
+
+	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	// DrawIndexInstance parameters
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// 16-bit index chunks of the submesh, each with its own base vertex. Empty when the
+	// parameters above cover it in one draw.
+	std::vector<IndexChunk> IndexChunks;
+
+	// Format of the submesh's indices, DXGI_FORMAT_UNKNOWN for the geometry's IndexFormat
+	DXGI_FORMAT IndexFormat = DXGI_FORMAT_UNKNOWN;
+
+	// Meshlets of the submesh, laid out in its index range. When set, only the meshlets that
+	// pass the CPU frustum and backface cone tests are drawn.
+	const MeshletData* Meshlets = nullptr;
+
+	// Coarser versions of the submesh drawing from the same vertices, most detailed first
+	std::vector<RenderItemLod> Lods;
+};
+
+// Lightweight structure that describes a shape to draw, handed to RenderItemPool::Add
+struct RenderItem
+{
+	// World matrix of the shape that describes the object's local space relative to world space,
+	// which defines position, orientation, and scale
+	DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+
+	// Maps the vertex positions of the submesh to object space. Identity unless the positions
+	// are quantized against the submesh bounds.
+	DirectX::XMFLOAT4X4 PositionDecode = MathHelper::Identity4x4();
+
+	// Object space bounds of the submesh. Transformed by World every frame to skip the item
+	// when it is outside the camera frustum.
+	DirectX::BoundingBox Bounds;
+
+	RenderItemDrawArgs DrawArgs;
+
+	// Static items never move after load. MyApp::BuildStaticBatches bakes their World into
+	// the vertices of Shape and merges them.
+	bool IsStatic = false;
+	GeometryKey Shape;
+};
+
+// Refers to an item of a RenderItemPool. Removing the item makes every handle to it stale,
+// also once its slot is reused by a new item.
+struct RenderItemHandle
+{
+	std::uint32_t Slot = UINT32_MAX;
+	std::uint32_t Generation = 0;
+
+	bool operator==(const RenderItemHandle& rhs) const;
+	bool operator!=(const RenderItemHandle& rhs) const;
+};
+
+// Render items stored as one array per field, so the per-frame loops (constant buffer
+// updates, culling) sweep contiguous worlds, bounds and dirty counts instead of chasing a
+// pointer per item.
+//
+// Live items are packed at the front of the arrays: removing one moves the last item into
+// its place. An item's index can therefore change, its handle doesn't. The index doubles as
+// the item's object constant buffer slot, so a moved item is marked dirty.
+//
+// Dirty items are also kept in a list, so writing the constants costs as much as the items
+// that changed rather than the whole scene.
+class RenderItemPool
+{
+	public:
+		using uint32 = std::uint32_t;
+
+		// The item's object constants are rewritten in each of this many frame resources after
+		// it is added, moved or changed
+		explicit RenderItemPool(int frameResourceCount);
+
+		RenderItemHandle Add(const RenderItem& renderItem);
+		void Remove(RenderItemHandle handle);
+		void Clear();
+
+		bool IsValid(RenderItemHandle handle) const;
+
+		uint32 GetCount() const;
+		uint32 GetIndex(RenderItemHandle handle) const;
+		RenderItemHandle GetHandle(uint32 index) const;
+
+		// Moves the item and marks its constants dirty
+		void SetWorld(RenderItemHandle handle, const DirectX::XMFLOAT4X4& world);
+		void SetBounds(RenderItemHandle handle, const DirectX::BoundingBox& bounds);
+
+		// Arrays of GetCount() items by index
+		const DirectX::XMFLOAT4X4* GetWorlds() const;
+		const DirectX::XMFLOAT4X4* GetPositionDecodes() const;
+		const DirectX::BoundingBox* GetBounds() const;
+		const RenderItemDrawArgs* GetDrawArgs() const;
+
+		// Indices of the items whose constants are out of date in at least one frame resource
+		const std::vector<uint32>& GetDirtyItems() const;
+
+		// Call once the constants of every dirty item are written to the current frame resource.
+		// Items stay in the list until they were written to each frame resource.
+		void CountDownDirtyItems();
+
+		// Writes the object constants of the dirty items to a mapped constant buffer, each in
+		// the slot of its index, slotByteSize apart: the transpose of PositionDecode * World.
+		// Large lists are split across the pool. Streaming stores fill whole cache lines of the
+		// write-combined upload heap without reading them.
+		void WriteDirtyConstants(BYTE* constants, UINT slotByteSize, ThreadPool* threadPool = nullptr) const;
+
+		bool IsStatic(uint32 index) const;
+		const GeometryKey& GetShape(uint32 index) const;
+
+	private:
+		// Where a handle's item is, and how many times the slot has been reused
+		struct Slot
+		{
+			uint32 Index = UINT32_MAX;
+			uint32 Generation = 0;
+		};
+
+		// Moves the item at from into the index to, overwriting it
+		void MoveItem(uint32 from, uint32 to);
+
+		// Queues the item's constants to be written to every frame resource
+		void MarkDirty(uint32 index);
+		void RemoveDirty(uint32 index);
+
+	private:
+		int FrameResourceCount;
+
+		std::vector<DirectX::XMFLOAT4X4> Worlds;
+		std::vector<DirectX::XMFLOAT4X4> PositionDecodes;
+		std::vector<DirectX::BoundingBox> Bounds;
+		std::vector<int> FramesDirty;
+
+		// Items with FramesDirty above zero, and where each item is in the list (UINT32_MAX
+		// when it isn't)
+		std::vector<uint32> DirtyItems;
+		std::vector<uint32> DirtyPositions;
+		std::vector<RenderItemDrawArgs> DrawArgs;
+		std::vector<bool> StaticFlags;
+		std::vector<GeometryKey> Shapes;
+
+		// Slot of the item at each index
+		std::vector<uint32> IndexSlots;
+
+		std::vector<Slot> Slots;
+		std::vector<uint32> FreeSlots;
+};
@@ -27,6 +27,19 @@ cbuffer cbPass : register(b1)
 	float gDeltaTime;
 };
 
+// Where the instances of the current instanced draw start in gInstances
+cbuffer cbInstances : register(b2)
+{
+	uint gInstanceOffset;
+};
+
+struct InstanceData
+{
+	float4x4 World;
+};
+
+StructuredBuffer<InstanceData> gInstances : register(t0);
+
 
 struct VertexIn
 {
@@ -57,6 +70,20 @@ VertexOut VS(VertexIn vin)
     return vout;
 }
 
+// VS with the world matrix of each instance read from gInstances
+VertexOut VSInstanced(VertexIn vin, uint instanceID : SV_InstanceID)
+{
+	VertexOut vout;
+
+	float4x4 world = gInstances[gInstanceOffset + instanceID].World;
+	float4 posW = mul(float4(vin.PosL, 1.0f), world);
+	vout.PosH = mul(posW, gViewProj);
+
+	vout.Color = vin.Color;
+
+	return vout;
+}
+
 float4 PS(VertexOut pin) : SV_Target
 {
     return pin.Color;
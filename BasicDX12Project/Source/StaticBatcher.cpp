@@ -0,0 +1,89 @@
+#include "StaticBatcher.h"
+#include "MeshBounds.h"
+
+using namespace DirectX;
+
+//=========================================================================================
+StaticBatcher::StaticBatcher(VertexFormat format)
+: Format(format)
+{
+}
+
+//=========================================================================================
+void StaticBatcher::Add(const GeometryGenerator::MeshData& mesh, const XMFLOAT4X4& world, const XMFLOAT4& color, const void* pipelineState)
+{
+	size_t batchIndex = 0;
+	while (batchIndex < Batches.size() && Batches[batchIndex].PipelineState != pipelineState)
+	{
+		++batchIndex;
+	}
+	if (batchIndex == Batches.size())
+	{
+		Batches.emplace_back();
+		Batches.back().PipelineState = pipelineState;
+	}
+
+	GeometryGenerator::MeshDataSoA& batchMesh = Batches[batchIndex].Mesh;
+	const uint32 firstVertex = (uint32)batchMesh.VertexCount();
+	Parts.push_back({ batchIndex, firstVertex, (uint32)mesh.Vertices.size(), color });
+
+	// Normals go through the inverse transpose so they stay perpendicular under non-uniform
+	// scaling
+	XMMATRIX transform = XMLoadFloat4x4(&world);
+	XMVECTOR determinant = XMMatrixDeterminant(transform);
+	XMMATRIX normalTransform = XMMatrixTranspose(XMMatrixInverse(&determinant, transform));
+
+	batchMesh.Resize(firstVertex + mesh.Vertices.size());
+	for (size_t i = 0; i < mesh.Vertices.size(); ++i)
+	{
+		const GeometryGenerator::Vertex& vertex = mesh.Vertices[i];
+		GeometryGenerator::Vertex out = vertex;
+		XMStoreFloat3(&out.Position, XMVector3TransformCoord(XMLoadFloat3(&vertex.Position), transform));
+		XMStoreFloat3(&out.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.Normal), normalTransform)));
+		XMStoreFloat3(&out.TangentU, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&vertex.TangentU), transform)));
+		batchMesh.SetVertex(firstVertex + i, out);
+	}
+
+	// A mirroring transform turns the triangles inside out, so their winding is flipped back
+	bool mirrored = XMVectorGetX(determinant) < 0.0f;
+	batchMesh.Indices32.reserve(batchMesh.Indices32.size() + mesh.Indices32.size());
+	for (size_t i = 0; i + 2 < mesh.Indices32.size(); i += 3)
+	{
+		batchMesh.Indices32.push_back(firstVertex + mesh.Indices32[i]);
+		batchMesh.Indices32.push_back(firstVertex + mesh.Indices32[mirrored ? i + 2 : i + 1]);
+		batchMesh.Indices32.push_back(firstVertex + mesh.Indices32[mirrored ? i + 1 : i + 2]);
+	}
+}
+
+//=========================================================================================
+void StaticBatcher::Build(ThreadPool* threadPool)
+{
+	for (Batch& batch : Batches)
+	{
+		const std::vector<XMFLOAT3>& positions = batch.Mesh.Positions;
+		if (positions.empty())
+		{
+			continue;
+		}
+
+		batch.Bounds = MeshBounds::ComputeBox(positions.data(), positions.size(), sizeof(XMFLOAT3), threadPool);
+		batch.Sphere = MeshBounds::ComputeSphere(positions.data(), positions.size(), sizeof(XMFLOAT3), batch.Bounds, threadPool);
+		batch.Vertices.resize(positions.size() * VertexCompression::GetVertexStride(Format));
+	}
+
+	// Quantized positions are relative to the bounds of the whole batch, so every part is
+	// encoded once they are known
+	for (const Part& part : Parts)
+	{
+		Batch& batch = Batches[part.BatchIndex];
+		BYTE* dst = batch.Vertices.data() + (size_t)part.FirstVertex * VertexCompression::GetVertexStride(Format);
+		VertexCompression::EncodeColorPositions(Format, batch.Mesh.Positions.data() + part.FirstVertex, part.VertexCount, sizeof(XMFLOAT3),
+			part.Color, batch.Bounds, dst);
+	}
+}
+
+//=========================================================================================
+const std::vector<StaticBatcher::Batch>& StaticBatcher::GetBatches() const
+{
+	return Batches;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "FromBook/GeometryGenerator.h"
+#include "VertexCompression.h"
+
+class ThreadPool;
+
+// Merges meshes that never move after load. Each mesh is transformed to world space once and
+// the meshes drawn with the same pipeline state are appended into one mesh, which draws with
+// a single call and an identity world matrix instead of a draw and constants per mesh.
+class StaticBatcher
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		// The meshes queued with one pipeline state, in world space. The mesh is kept as
+		// streams, so the bounds and the encoding only sweep the packed positions.
+		struct Batch
+		{
+			const void* PipelineState = nullptr;
+			GeometryGenerator::MeshDataSoA Mesh;
+			DirectX::BoundingBox Bounds;
+			DirectX::BoundingSphere Sphere;
+
+			// Mesh.Positions encoded in the batcher's format against Bounds, each in the color
+			// of the mesh it came from
+			std::vector<BYTE> Vertices;
+		};
+
+		explicit StaticBatcher(VertexFormat format);
+
+		// Queues mesh drawn with world in color. pipelineState only groups the meshes, anything
+		// that tells the pipeline states apart works.
+		void Add(const GeometryGenerator::MeshData& mesh, const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4& color, const void* pipelineState);
+
+		// Computes the bounds of every batch and encodes its vertices
+		void Build(ThreadPool* threadPool = nullptr);
+
+		const std::vector<Batch>& GetBatches() const;
+
+	private:
+		// Vertex range of one queued mesh in its batch
+		struct Part
+		{
+			size_t BatchIndex;
+			uint32 FirstVertex;
+			uint32 VertexCount;
+			DirectX::XMFLOAT4 Color;
+		};
+
+		VertexFormat Format;
+		std::vector<Batch> Batches;
+		std::vector<Part> Parts;
+};
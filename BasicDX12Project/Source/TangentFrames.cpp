@@ -0,0 +1,289 @@
+#include "TangentFrames.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+const float TangentFrames::kDefaultCreaseAngle = XM_PI / 3.0f;
+
+namespace
+{
+	using uint32 = TangentFrames::uint32;
+
+	// Items handed to a thread at once
+	const size_t kMinTrianglesPerTask = 16384;
+	const size_t kMinVerticesPerTask = 8192;
+
+	// Frame of one triangle. Directions are unit length and the weights say how much they
+	// count: the normal by twice the triangle area, the tangent by the triangle's area in
+	// position times UV space, negative when the UVs are mirrored.
+	struct TriangleFrame
+	{
+		XMFLOAT3 Normal;
+		float NormalWeight;
+		XMFLOAT3 Tangent;
+		float TangentWeight;
+	};
+
+	// Vertices grouped by position, with the triangle corners around each group
+	struct CornerLists
+	{
+		std::vector<uint32> VertexGroup;
+		std::vector<uint32> GroupStart;
+		std::vector<uint32> Corners;
+	};
+
+	std::uint32_t FloatBits(float value)
+	{
+		// -0 and 0 are the same position
+		if (value == 0.0f)
+		{
+			value = 0.0f;
+		}
+
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	CornerLists BuildCornerLists(const GeometryGenerator::MeshData& meshData)
+	{
+		const std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+		const std::vector<uint32>& indices = meshData.Indices32;
+
+		CornerLists lists;
+		lists.VertexGroup.resize(vertices.size());
+
+		// Weld exactly equal positions with an open addressed table of group representatives
+		size_t tableSize = 1;
+		while (tableSize < vertices.size() * 2)
+		{
+			tableSize <<= 1;
+		}
+		std::vector<uint32> table(tableSize, UINT32_MAX);
+
+		uint32 groupCount = 0;
+		for (uint32 v = 0; v < (uint32)vertices.size(); ++v)
+		{
+			const XMFLOAT3& p = vertices[v].Position;
+			std::uint64_t hash = FloatBits(p.x) * 73856093ull ^ FloatBits(p.y) * 19349663ull ^ FloatBits(p.z) * 83492791ull;
+			size_t slot = (size_t)((hash * 0x9E3779B97F4A7C15ull) >> 32) & (tableSize - 1);
+
+			for (;;)
+			{
+				uint32 other = table[slot];
+				if (other == UINT32_MAX)
+				{
+					table[slot] = v;
+					lists.VertexGroup[v] = groupCount++;
+					break;
+				}
+
+				const XMFLOAT3& q = vertices[other].Position;
+				if (FloatBits(p.x) == FloatBits(q.x) && FloatBits(p.y) == FloatBits(q.y) && FloatBits(p.z) == FloatBits(q.z))
+				{
+					lists.VertexGroup[v] = lists.VertexGroup[other];
+					break;
+				}
+
+				slot = (slot + 1) & (tableSize - 1);
+			}
+		}
+
+		// Counting sort of the corners by group
+		lists.GroupStart.assign(groupCount + 1, 0);
+		for (uint32 index : indices)
+		{
+			++lists.GroupStart[lists.VertexGroup[index] + 1];
+		}
+		for (uint32 g = 0; g < groupCount; ++g)
+		{
+			lists.GroupStart[g + 1] += lists.GroupStart[g];
+		}
+
+		std::vector<uint32> fill(lists.GroupStart.begin(), lists.GroupStart.end() - 1);
+		lists.Corners.resize(indices.size());
+		for (uint32 c = 0; c < (uint32)indices.size(); ++c)
+		{
+			lists.Corners[fill[lists.VertexGroup[indices[c]]]++] = c;
+		}
+
+		return lists;
+	}
+
+	std::vector<TriangleFrame> BuildTriangleFrames(const GeometryGenerator::MeshData& meshData, ThreadPool* threadPool)
+	{
+		const std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+		const std::vector<uint32>& indices = meshData.Indices32;
+
+		std::vector<TriangleFrame> frames(indices.size() / 3);
+		ThreadPool::ParallelFor(threadPool, 0, frames.size(), kMinTrianglesPerTask, [&](size_t begin, size_t end)
+		{
+			for (size_t t = begin; t < end; ++t)
+			{
+				const GeometryGenerator::Vertex& v0 = vertices[indices[t * 3 + 0]];
+				const GeometryGenerator::Vertex& v1 = vertices[indices[t * 3 + 1]];
+				const GeometryGenerator::Vertex& v2 = vertices[indices[t * 3 + 2]];
+
+				XMVECTOR p0 = XMLoadFloat3(&v0.Position);
+				XMVECTOR e1 = XMVectorSubtract(XMLoadFloat3(&v1.Position), p0);
+				XMVECTOR e2 = XMVectorSubtract(XMLoadFloat3(&v2.Position), p0);
+
+				XMVECTOR normal = XMVector3Cross(e1, e2);
+				float normalLength = XMVectorGetX(XMVector3Length(normal));
+
+				// Direction in which u grows across the triangle (Lengyel), scaled by the UV
+				// area instead of divided by it so degenerate UVs give a zero weight
+				float du1 = v1.TexC.x - v0.TexC.x;
+				float dv1 = v1.TexC.y - v0.TexC.y;
+				float du2 = v2.TexC.x - v0.TexC.x;
+				float dv2 = v2.TexC.y - v0.TexC.y;
+				float uvArea = du1 * dv2 - du2 * dv1;
+
+				XMVECTOR tangent = XMVectorSubtract(XMVectorScale(e1, dv2), XMVectorScale(e2, dv1));
+				float tangentLength = XMVectorGetX(XMVector3Length(tangent));
+
+				TriangleFrame& frame = frames[t];
+				XMStoreFloat3(&frame.Normal, normalLength > 0.0f ? XMVectorScale(normal, 1.0f / normalLength) : XMVectorZero());
+				frame.NormalWeight = normalLength;
+
+				bool isMirrored = uvArea < 0.0f;
+				XMStoreFloat3(&frame.Tangent, tangentLength > 0.0f ? XMVectorScale(tangent, (isMirrored ? -1.0f : 1.0f) / tangentLength) : XMVectorZero());
+				frame.TangentWeight = uvArea != 0.0f ? (isMirrored ? -tangentLength : tangentLength) : 0.0f;
+			}
+		});
+
+		return frames;
+	}
+
+	// Any unit vector perpendicular to n, for vertices whose UVs give no direction
+	XMVECTOR GetPerpendicular(FXMVECTOR n)
+	{
+		XMVECTOR axis = fabsf(XMVectorGetX(n)) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		return XMVector3Normalize(XMVector3Cross(XMVector3Cross(n, axis), n));
+	}
+
+	void ComputeFrames(GeometryGenerator::MeshData& meshData, ThreadPool* threadPool, float creaseAngle, bool computeNormals)
+	{
+		std::vector<GeometryGenerator::Vertex>& vertices = meshData.Vertices;
+		const std::vector<uint32>& indices = meshData.Indices32;
+
+		CornerLists lists = BuildCornerLists(meshData);
+		std::vector<TriangleFrame> frames = BuildTriangleFrames(meshData, threadPool);
+		float minCos = cosf(creaseAngle);
+
+		// Every vertex only reads the shared data and writes itself
+		ThreadPool::ParallelFor(threadPool, 0, vertices.size(), kMinVerticesPerTask, [&](size_t begin, size_t end)
+		{
+			for (uint32 v = (uint32)begin; v < (uint32)end; ++v)
+			{
+				uint32 group = lists.VertexGroup[v];
+				const uint32* cornersBegin = &lists.Corners[0] + lists.GroupStart[group];
+				const uint32* cornersEnd = &lists.Corners[0] + lists.GroupStart[group + 1];
+
+				// The vertex's own triangles decide which way it faces and which UV winding it uses
+				XMVECTOR ownNormal = XMVectorZero();
+				float ownWinding = 0.0f;
+				bool isUsed = false;
+				for (const uint32* c = cornersBegin; c != cornersEnd; ++c)
+				{
+					if (indices[*c] == v)
+					{
+						const TriangleFrame& frame = frames[*c / 3];
+						ownNormal = XMVectorAdd(ownNormal, XMVectorScale(XMLoadFloat3(&frame.Normal), frame.NormalWeight));
+						ownWinding += frame.TangentWeight;
+						isUsed = true;
+					}
+				}
+
+				if (!isUsed)
+				{
+					continue;
+				}
+
+				XMVECTOR ownDirection = XMVector3Normalize(ownNormal);
+				XMVECTOR normal = XMLoadFloat3(&vertices[v].Normal);
+				if (computeNormals)
+				{
+					// Blend in the triangles of the other vertices at this position that are
+					// not across a crease
+					XMVECTOR normalSum = XMVectorZero();
+					for (const uint32* c = cornersBegin; c != cornersEnd; ++c)
+					{
+						const TriangleFrame& frame = frames[*c / 3];
+						XMVECTOR faceNormal = XMLoadFloat3(&frame.Normal);
+						if (indices[*c] == v || XMVectorGetX(XMVector3Dot(faceNormal, ownDirection)) >= minCos)
+						{
+							normalSum = XMVectorAdd(normalSum, XMVectorScale(faceNormal, frame.NormalWeight));
+						}
+					}
+
+					// Triangles that cancel out (or have no area) leave the old normal
+					if (XMVectorGetX(XMVector3LengthSq(normalSum)) > 0.0f)
+					{
+						normal = XMVector3Normalize(normalSum);
+						XMStoreFloat3(&vertices[v].Normal, normal);
+					}
+				}
+
+				// Same for the tangent, also skipping triangles with the other UV winding
+				bool isMirrored = ownWinding < 0.0f;
+				XMVECTOR ownTangent = XMVectorZero();
+				for (const uint32* c = cornersBegin; c != cornersEnd; ++c)
+				{
+					const TriangleFrame& frame = frames[*c / 3];
+					if (indices[*c] == v && (frame.TangentWeight < 0.0f) == isMirrored)
+					{
+						ownTangent = XMVectorAdd(ownTangent, XMVectorScale(XMLoadFloat3(&frame.Tangent), fabsf(frame.TangentWeight)));
+					}
+				}
+
+				XMVECTOR tangentSum = ownTangent;
+				if (XMVectorGetX(XMVector3LengthSq(ownTangent)) > 0.0f)
+				{
+					XMVECTOR ownTangentDirection = XMVector3Normalize(ownTangent);
+					for (const uint32* c = cornersBegin; c != cornersEnd; ++c)
+					{
+						const TriangleFrame& frame = frames[*c / 3];
+						if (indices[*c] == v || frame.TangentWeight == 0.0f || (frame.TangentWeight < 0.0f) != isMirrored)
+						{
+							continue;
+						}
+
+						XMVECTOR faceTangent = XMLoadFloat3(&frame.Tangent);
+						if (XMVectorGetX(XMVector3Dot(XMLoadFloat3(&frame.Normal), ownDirection)) >= minCos &&
+							XMVectorGetX(XMVector3Dot(faceTangent, ownTangentDirection)) >= minCos)
+						{
+							tangentSum = XMVectorAdd(tangentSum, XMVectorScale(faceTangent, fabsf(frame.TangentWeight)));
+						}
+					}
+				}
+
+				// Gram-Schmidt against the normal
+				XMVECTOR tangent = XMVectorSubtract(tangentSum, XMVectorScale(normal, XMVectorGetX(XMVector3Dot(normal, tangentSum))));
+				if (XMVectorGetX(XMVector3LengthSq(tangent)) > 1e-20f)
+				{
+					tangent = XMVector3Normalize(tangent);
+				}
+				else
+				{
+					tangent = GetPerpendicular(normal);
+				}
+				XMStoreFloat3(&vertices[v].TangentU, tangent);
+			}
+		});
+	}
+}
+
+//=========================================================================================
+void TangentFrames::Compute(GeometryGenerator::MeshData& meshData, ThreadPool* threadPool, float creaseAngle)
+{
+	ComputeFrames(meshData, threadPool, creaseAngle, true);
+}
+
+//=========================================================================================
+void TangentFrames::ComputeTangents(GeometryGenerator::MeshData& meshData, ThreadPool* threadPool, float creaseAngle)
+{
+	ComputeFrames(meshData, threadPool, creaseAngle, false);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "FromBook/GeometryGenerator.h"
+
+class ThreadPool;
+
+// Recomputes the normals and tangents of a MeshData from its triangles, for meshes whose
+// frames are not analytic any more (imported, simplified, welded or deformed meshes).
+//
+// Each vertex gathers the frames of the triangles around it instead of every triangle
+// scattering into its vertices, so vertices can be processed in parallel without atomics
+// and the result does not depend on the thread count.
+//
+// Vertices that share a position (UV seams, hard edges) are looked at together. Triangles
+// around the position are blended into a vertex's normal unless they meet the vertex's own
+// triangles at more than the crease angle, so UV seams get smooth normals while the edges
+// of a box stay sharp. Tangents are blended the same way, and only between triangles with
+// the same UV winding, so mirrored UV charts don't cancel each other out.
+class TangentFrames
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		// 60 degrees, in radians
+		static const float kDefaultCreaseAngle;
+
+		// Recomputes the normals, then the tangents against them. Normals are area weighted.
+		// Vertices no triangle uses keep their frames.
+		static void Compute(GeometryGenerator::MeshData& meshData, ThreadPool* threadPool = nullptr, float creaseAngle = kDefaultCreaseAngle);
+
+		// Recomputes only the tangents, against the normals the mesh already has
+		static void ComputeTangents(GeometryGenerator::MeshData& meshData, ThreadPool* threadPool = nullptr, float creaseAngle = kDefaultCreaseAngle);
+};
@@ -0,0 +1,440 @@
+#include "TerrainGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	using uint32 = TerrainGenerator::uint32;
+
+	// Rows handed to a thread at once are at least this many vertices, so small grids stay on
+	// one thread
+	const uint32 kMinVerticesPerTask = 16384;
+
+	// Gradient noise with unit gradients peaks at sqrt(1/2), this brings it to about [-1, 1]
+	const float kNoiseScale = 1.41421356f;
+
+	// Eight unit gradients 45 degrees apart, picked by the top three bits of a corner's hash
+	const float kGradientsX[8] = { 1.0f, 0.70710678f, 0.0f, -0.70710678f, -1.0f, -0.70710678f, 0.0f, 0.70710678f };
+	const float kGradientsZ[8] = { 0.0f, 0.70710678f, 1.0f, 0.70710678f, 0.0f, -0.70710678f, -1.0f, -0.70710678f };
+
+	bool IsAvx2Supported()
+	{
+#if defined(_MSC_VER)
+		// The CPU has to have AVX and AVX2 and the OS has to save the upper halves of the registers
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		bool hasAvx = (info[2] & (1 << 28)) != 0;
+		bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		bool hasAvx2 = (info[1] & (1 << 5)) != 0;
+		return hasAvx && osSavesYmm && hasAvx2;
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+
+	// Scrambles the integer coordinates of a lattice corner
+	uint32 Hash(uint32 x, uint32 z, uint32 seed)
+	{
+		uint32 h = seed ^ (x * 0x27d4eb2du) ^ (z * 0x165667b1u);
+		h ^= h >> 15;
+		h *= 0x2c1b3c6du;
+		h ^= h >> 12;
+		h *= 0x297a2d39u;
+		h ^= h >> 15;
+		return h;
+	}
+
+	AVX2_FUNCTION __m256i Hash(__m256i x, __m256i z, __m256i seed)
+	{
+		__m256i h = _mm256_xor_si256(seed, _mm256_mullo_epi32(x, _mm256_set1_epi32(0x27d4eb2d)));
+		h = _mm256_xor_si256(h, _mm256_mullo_epi32(z, _mm256_set1_epi32(0x165667b1)));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+		h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x2c1b3c6d));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+		h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x297a2d39));
+		h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+		return h;
+	}
+
+	using Octave = TerrainGenerator::Octave;
+
+	std::vector<Octave> MakeOctaves(const TerrainGenerator::Settings& settings)
+	{
+		std::vector<Octave> octaves(settings.OctaveCount);
+
+		float frequency = settings.Frequency;
+		float amplitude = 1.0f;
+		float amplitudeSum = 0.0f;
+		for (uint32 o = 0; o < settings.OctaveCount; ++o)
+		{
+			octaves[o].Frequency = frequency;
+			octaves[o].Weight = amplitude;
+			octaves[o].Seed = settings.Seed + o * 0x9e3779b9u;
+			amplitudeSum += amplitude;
+
+			frequency *= settings.Lacunarity;
+			amplitude *= settings.Gain;
+		}
+
+		// The octaves together span about [-Amplitude, Amplitude]
+		for (Octave& octave : octaves)
+		{
+			octave.Weight *= settings.Amplitude / amplitudeSum;
+			octave.SlopeWeight = octave.Weight * octave.Frequency;
+		}
+		return octaves;
+	}
+
+	// Height and normal of the terrain at (x, z). Both versions do the same operations in the
+	// same order, so they give the same bits.
+	struct SampleTerrain
+	{
+		const std::vector<Octave>& Octaves;
+		bool IsRidged;
+		float HeightOffset;
+
+		// Gradient noise at (x, z) and its derivatives, with a quintic fade between the four
+		// lattice corners around the point
+		static void Noise(float x, float z, uint32 seed, float& value, float& dx, float& dz)
+		{
+			float fx = floorf(x);
+			float fz = floorf(z);
+			uint32 ix = (uint32)(int)fx;
+			uint32 iz = (uint32)(int)fz;
+			float tx = x - fx;
+			float tz = z - fz;
+
+			float ux = tx * tx * tx * (tx * (tx * 6.0f - 15.0f) + 10.0f);
+			float uz = tz * tz * tz * (tz * (tz * 6.0f - 15.0f) + 10.0f);
+			float dux = 30.0f * tx * tx * (tx * (tx - 2.0f) + 1.0f);
+			float duz = 30.0f * tz * tz * (tz * (tz - 2.0f) + 1.0f);
+
+			uint32 ha = Hash(ix, iz, seed) >> 29;
+			uint32 hb = Hash(ix + 1, iz, seed) >> 29;
+			uint32 hc = Hash(ix, iz + 1, seed) >> 29;
+			uint32 hd = Hash(ix + 1, iz + 1, seed) >> 29;
+
+			float gax = kGradientsX[ha], gaz = kGradientsZ[ha];
+			float gbx = kGradientsX[hb], gbz = kGradientsZ[hb];
+			float gcx = kGradientsX[hc], gcz = kGradientsZ[hc];
+			float gdx = kGradientsX[hd], gdz = kGradientsZ[hd];
+
+			float va = gax * tx + gaz * tz;
+			float vb = gbx * (tx - 1.0f) + gbz * tz;
+			float vc = gcx * tx + gcz * (tz - 1.0f);
+			float vd = gdx * (tx - 1.0f) + gdz * (tz - 1.0f);
+			float k = va - vb - vc + vd;
+			float uxz = ux * uz;
+
+			value = va + ux * (vb - va) + uz * (vc - va) + uxz * k;
+			dx = gax + ux * (gbx - gax) + uz * (gcx - gax) + uxz * (gax - gbx - gcx + gdx) + dux * (uz * k + (vb - va));
+			dz = gaz + ux * (gbz - gaz) + uz * (gcz - gaz) + uxz * (gaz - gbz - gcz + gdz) + duz * (ux * k + (vc - va));
+		}
+
+		void Scalar(float x, float z, float& height, float& nx, float& ny, float& nz) const
+		{
+			float sum = 0.0f;
+			float slopeX = 0.0f;
+			float slopeZ = 0.0f;
+			for (const Octave& octave : Octaves)
+			{
+				float value, dx, dz;
+				Noise(x * octave.Frequency, z * octave.Frequency, octave.Seed, value, dx, dz);
+				value *= kNoiseScale;
+				dx *= kNoiseScale;
+				dz *= kNoiseScale;
+
+				if (IsRidged)
+				{
+					// 2 * (1 - |v|)^2 - 1, whose derivative is -4 * (1 - |v|) * sign(v) * dv
+					float r = 1.0f - fabsf(value);
+					float slope = -4.0f * r * copysignf(1.0f, value);
+					value = 2.0f * r * r - 1.0f;
+					dx *= slope;
+					dz *= slope;
+				}
+
+				sum += octave.Weight * value;
+				slopeX += octave.SlopeWeight * dx;
+				slopeZ += octave.SlopeWeight * dz;
+			}
+
+			// The normal of y = h(x, z) is (-dh/dx, 1, -dh/dz) normalized
+			float invLength = 1.0f / sqrtf(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+			height = HeightOffset + sum;
+			nx = -slopeX * invLength;
+			ny = invLength;
+			nz = -slopeZ * invLength;
+		}
+
+		static AVX2_FUNCTION void Noise(__m256 x, __m256 z, __m256i seed, __m256& value, __m256& dx, __m256& dz)
+		{
+			const __m256 one = _mm256_set1_ps(1.0f);
+
+			__m256 fx = _mm256_floor_ps(x);
+			__m256 fz = _mm256_floor_ps(z);
+			__m256i ix = _mm256_cvttps_epi32(fx);
+			__m256i iz = _mm256_cvttps_epi32(fz);
+			__m256 tx = _mm256_sub_ps(x, fx);
+			__m256 tz = _mm256_sub_ps(z, fz);
+
+			__m256 six = _mm256_set1_ps(6.0f);
+			__m256 fifteen = _mm256_set1_ps(15.0f);
+			__m256 ten = _mm256_set1_ps(10.0f);
+			__m256 thirty = _mm256_set1_ps(30.0f);
+			__m256 two = _mm256_set1_ps(2.0f);
+
+			__m256 ux = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(tx, tx), tx), _mm256_add_ps(_mm256_mul_ps(tx, _mm256_sub_ps(_mm256_mul_ps(tx, six), fifteen)), ten));
+			__m256 uz = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(tz, tz), tz), _mm256_add_ps(_mm256_mul_ps(tz, _mm256_sub_ps(_mm256_mul_ps(tz, six), fifteen)), ten));
+			__m256 dux = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(thirty, tx), tx), _mm256_add_ps(_mm256_mul_ps(tx, _mm256_sub_ps(tx, two)), one));
+			__m256 duz = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(thirty, tz), tz), _mm256_add_ps(_mm256_mul_ps(tz, _mm256_sub_ps(tz, two)), one));
+
+			__m256i oneInt = _mm256_set1_epi32(1);
+			__m256i ix1 = _mm256_add_epi32(ix, oneInt);
+			__m256i iz1 = _mm256_add_epi32(iz, oneInt);
+			__m256i ha = _mm256_srli_epi32(Hash(ix, iz, seed), 29);
+			__m256i hb = _mm256_srli_epi32(Hash(ix1, iz, seed), 29);
+			__m256i hc = _mm256_srli_epi32(Hash(ix, iz1, seed), 29);
+			__m256i hd = _mm256_srli_epi32(Hash(ix1, iz1, seed), 29);
+
+			__m256 gradientsX = _mm256_loadu_ps(kGradientsX);
+			__m256 gradientsZ = _mm256_loadu_ps(kGradientsZ);
+			__m256 gax = _mm256_permutevar8x32_ps(gradientsX, ha), gaz = _mm256_permutevar8x32_ps(gradientsZ, ha);
+			__m256 gbx = _mm256_permutevar8x32_ps(gradientsX, hb), gbz = _mm256_permutevar8x32_ps(gradientsZ, hb);
+			__m256 gcx = _mm256_permutevar8x32_ps(gradientsX, hc), gcz = _mm256_permutevar8x32_ps(gradientsZ, hc);
+			__m256 gdx = _mm256_permutevar8x32_ps(gradientsX, hd), gdz = _mm256_permutevar8x32_ps(gradientsZ, hd);
+
+			__m256 tx1 = _mm256_sub_ps(tx, one);
+			__m256 tz1 = _mm256_sub_ps(tz, one);
+			__m256 va = _mm256_add_ps(_mm256_mul_ps(gax, tx), _mm256_mul_ps(gaz, tz));
+			__m256 vb = _mm256_add_ps(_mm256_mul_ps(gbx, tx1), _mm256_mul_ps(gbz, tz));
+			__m256 vc = _mm256_add_ps(_mm256_mul_ps(gcx, tx), _mm256_mul_ps(gcz, tz1));
+			__m256 vd = _mm256_add_ps(_mm256_mul_ps(gdx, tx1), _mm256_mul_ps(gdz, tz1));
+			__m256 k = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(va, vb), vc), vd);
+			__m256 uxz = _mm256_mul_ps(ux, uz);
+			__m256 vba = _mm256_sub_ps(vb, va);
+			__m256 vca = _mm256_sub_ps(vc, va);
+
+			value = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(va, _mm256_mul_ps(ux, vba)), _mm256_mul_ps(uz, vca)), _mm256_mul_ps(uxz, k));
+
+			__m256 kx = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(gax, gbx), gcx), gdx);
+			dx = _mm256_add_ps(gax, _mm256_mul_ps(ux, _mm256_sub_ps(gbx, gax)));
+			dx = _mm256_add_ps(dx, _mm256_mul_ps(uz, _mm256_sub_ps(gcx, gax)));
+			dx = _mm256_add_ps(dx, _mm256_mul_ps(uxz, kx));
+			dx = _mm256_add_ps(dx, _mm256_mul_ps(dux, _mm256_add_ps(_mm256_mul_ps(uz, k), vba)));
+
+			__m256 kz = _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(gaz, gbz), gcz), gdz);
+			dz = _mm256_add_ps(gaz, _mm256_mul_ps(ux, _mm256_sub_ps(gbz, gaz)));
+			dz = _mm256_add_ps(dz, _mm256_mul_ps(uz, _mm256_sub_ps(gcz, gaz)));
+			dz = _mm256_add_ps(dz, _mm256_mul_ps(uxz, kz));
+			dz = _mm256_add_ps(dz, _mm256_mul_ps(duz, _mm256_add_ps(_mm256_mul_ps(ux, k), vca)));
+		}
+
+		AVX2_FUNCTION void Avx2(__m256 x, __m256 z, __m256& height, __m256& nx, __m256& ny, __m256& nz) const
+		{
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 signMask = _mm256_set1_ps(-0.0f);
+			const __m256 noiseScale = _mm256_set1_ps(kNoiseScale);
+
+			__m256 sum = _mm256_setzero_ps();
+			__m256 slopeX = _mm256_setzero_ps();
+			__m256 slopeZ = _mm256_setzero_ps();
+			for (const Octave& octave : Octaves)
+			{
+				__m256 frequency = _mm256_set1_ps(octave.Frequency);
+				__m256 value, dx, dz;
+				Noise(_mm256_mul_ps(x, frequency), _mm256_mul_ps(z, frequency), _mm256_set1_epi32((int)octave.Seed), value, dx, dz);
+				value = _mm256_mul_ps(value, noiseScale);
+				dx = _mm256_mul_ps(dx, noiseScale);
+				dz = _mm256_mul_ps(dz, noiseScale);
+
+				if (IsRidged)
+				{
+					__m256 r = _mm256_sub_ps(one, _mm256_andnot_ps(signMask, value));
+					__m256 sign = _mm256_or_ps(_mm256_and_ps(signMask, value), one);
+					__m256 slope = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(-4.0f), r), sign);
+					value = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(2.0f), r), r), one);
+					dx = _mm256_mul_ps(dx, slope);
+					dz = _mm256_mul_ps(dz, slope);
+				}
+
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(octave.Weight), value));
+				slopeX = _mm256_add_ps(slopeX, _mm256_mul_ps(_mm256_set1_ps(octave.SlopeWeight), dx));
+				slopeZ = _mm256_add_ps(slopeZ, _mm256_mul_ps(_mm256_set1_ps(octave.SlopeWeight), dz));
+			}
+
+			__m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(slopeX, slopeX), one), _mm256_mul_ps(slopeZ, slopeZ));
+			__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+			height = _mm256_add_ps(_mm256_set1_ps(HeightOffset), sum);
+			nx = _mm256_mul_ps(_mm256_xor_ps(slopeX, signMask), invLength);
+			ny = invLength;
+			nz = _mm256_mul_ps(_mm256_xor_ps(slopeZ, signMask), invLength);
+		}
+	};
+
+	// Row of samples starting at column j, eight at a time, then the rest one by one
+	AVX2_FUNCTION uint32 SampleRowAvx2(const SampleTerrain& sampleTerrain, float x0, float dx, float z, uint32 n,
+		float* heights, float* normalsX, float* normalsY, float* normalsZ)
+	{
+		__m256 laneOffsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		__m256 rowZ = _mm256_set1_ps(z);
+
+		uint32 j = 0;
+		for (; j + 8 <= n; j += 8)
+		{
+			__m256 columns = _mm256_add_ps(_mm256_set1_ps((float)j), laneOffsets);
+			__m256 x = _mm256_add_ps(_mm256_set1_ps(x0), _mm256_mul_ps(columns, _mm256_set1_ps(dx)));
+
+			__m256 height, nx, ny, nz;
+			sampleTerrain.Avx2(x, rowZ, height, nx, ny, nz);
+			_mm256_storeu_ps(heights + j, height);
+			_mm256_storeu_ps(normalsX + j, nx);
+			_mm256_storeu_ps(normalsY + j, ny);
+			_mm256_storeu_ps(normalsZ + j, nz);
+		}
+		_mm256_zeroupper();
+		return j;
+	}
+}
+
+//=========================================================================================
+TerrainGenerator::TerrainGenerator(const Settings& settings)
+: TerrainSettings(settings)
+, Octaves(MakeOctaves(settings))
+, UseAvx2(IsAvx2Supported())
+{
+}
+
+//=========================================================================================
+const TerrainGenerator::Settings& TerrainGenerator::GetSettings() const
+{
+	return TerrainSettings;
+}
+
+//=========================================================================================
+void TerrainGenerator::SetThreadPool(ThreadPool* threadPool)
+{
+	Pool = threadPool;
+}
+
+//=========================================================================================
+void TerrainGenerator::SetUseAvx2(bool useAvx2)
+{
+	UseAvx2 = useAvx2 && IsAvx2Supported();
+}
+
+//=========================================================================================
+float TerrainGenerator::GetHeight(float x, float z) const
+{
+	SampleTerrain sampleTerrain = { Octaves, TerrainSettings.Type == NoiseType::Ridged, TerrainSettings.HeightOffset };
+
+	float height, nx, ny, nz;
+	sampleTerrain.Scalar(x, z, height, nx, ny, nz);
+	return height;
+}
+
+//=========================================================================================
+XMFLOAT3 TerrainGenerator::GetNormal(float x, float z) const
+{
+	SampleTerrain sampleTerrain = { Octaves, TerrainSettings.Type == NoiseType::Ridged, TerrainSettings.HeightOffset };
+
+	float height;
+	XMFLOAT3 normal;
+	sampleTerrain.Scalar(x, z, height, normal.x, normal.y, normal.z);
+	return normal;
+}
+
+//=========================================================================================
+XMFLOAT4 TerrainGenerator::GetColor(float height, const XMFLOAT3& normal) const
+{
+	const XMFLOAT4 rock(0.45f, 0.39f, 0.34f, 1.0f);
+
+	float t = (height - TerrainSettings.HeightOffset) / TerrainSettings.Amplitude;
+	if (t > 0.6f)
+	{
+		return XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
+	}
+	if (normal.y < 0.7f || t > 0.35f)
+	{
+		return rock;
+	}
+	if (t < -0.3f)
+	{
+		return XMFLOAT4(1.0f, 0.96f, 0.62f, 1.0f);
+	}
+	if (t < 0.1f)
+	{
+		return XMFLOAT4(0.48f, 0.77f, 0.46f, 1.0f);
+	}
+	return XMFLOAT4(0.1f, 0.48f, 0.19f, 1.0f);
+}
+
+//=========================================================================================
+void TerrainGenerator::ForEachRow(float width, float depth, uint32 m, uint32 n, const std::function<void(uint32, const RowSamples&)>& func) const
+{
+	assert(m > 1 && n > 1);
+
+	// Same spacing as CreateGrid, so the positions land exactly on the grid's
+	float halfWidth = 0.5f * width;
+	float halfDepth = 0.5f * depth;
+	float dx = width / (n - 1);
+	float dz = depth / (m - 1);
+
+	auto sampleRows = [&](size_t firstRow, size_t lastRow)
+	{
+		RowSamples samples;
+		samples.X0 = -halfWidth;
+		samples.Dx = dx;
+		samples.Heights.resize(n);
+		samples.NormalsX.resize(n);
+		samples.NormalsY.resize(n);
+		samples.NormalsZ.resize(n);
+
+		for (size_t i = firstRow; i < lastRow; ++i)
+		{
+			samples.Z = halfDepth - (uint32)i * dz;
+			SampleRow(n, samples);
+			func((uint32)i, samples);
+		}
+	};
+
+	size_t rowsPerTask = std::max<size_t>(1, kMinVerticesPerTask / n);
+	ThreadPool::ParallelFor(Pool, 0, m, rowsPerTask, sampleRows);
+}
+
+//=========================================================================================
+void TerrainGenerator::SampleRow(uint32 n, RowSamples& samples) const
+{
+	SampleTerrain sampleTerrain = { Octaves, TerrainSettings.Type == NoiseType::Ridged, TerrainSettings.HeightOffset };
+
+	uint32 j = 0;
+	if (UseAvx2)
+	{
+		j = SampleRowAvx2(sampleTerrain, samples.X0, samples.Dx, samples.Z, n,
+			samples.Heights.data(), samples.NormalsX.data(), samples.NormalsY.data(), samples.NormalsZ.data());
+	}
+
+	for (; j < n; ++j)
+	{
+		float x = samples.X0 + (float)j * samples.Dx;
+		sampleTerrain.Scalar(x, samples.Z, samples.Heights[j], samples.NormalsX[j], samples.NormalsY[j], samples.NormalsZ[j]);
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <functional>
+#include <vector>
+#include "FromBook/GeometryGenerator.h"
+
+class ThreadPool;
+
+// Procedural heightfield terrain from 2D gradient noise summed over octaves, either as
+// plain fBm or as ridges. Vertices are laid out like GeometryGenerator::CreateGrid, so the
+// grid's indices draw them.
+//
+// Heights and normals come out of the same noise evaluation: the noise returns its
+// derivatives along with its value, so the normals are exact instead of finite differences.
+// Rows are evaluated eight vertices at a time with AVX2 when the CPU has it and bands of
+// rows are split across the thread pool. Every vertex only depends on its own position, so
+// the output is the same for any thread count and with or without AVX2.
+class TerrainGenerator
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		enum class NoiseType
+		{
+			// Sum of the octaves, rolling hills
+			Fbm,
+			// Sum of (1 - |octave|)^2, sharp crests where the noise crosses zero
+			Ridged,
+		};
+
+		struct Settings
+		{
+			uint32 Seed = 1;
+			NoiseType Type = NoiseType::Fbm;
+			uint32 OctaveCount = 6;
+
+			// Frequency of the first octave in cycles per unit, and how each octave scales
+			// the frequency and amplitude of the one before it
+			float Frequency = 0.01f;
+			float Lacunarity = 2.0f;
+			float Gain = 0.5f;
+
+			// Height = HeightOffset + Amplitude * noise, where noise roughly spans [-1, 1]
+			float Amplitude = 20.0f;
+			float HeightOffset = 0.0f;
+		};
+
+		// One octave of the noise: where it samples and its share of the height and slope
+		struct Octave
+		{
+			float Frequency;
+			float Weight;
+			float SlopeWeight;
+			uint32 Seed;
+		};
+
+		explicit TerrainGenerator(const Settings& settings);
+
+		const Settings& GetSettings() const;
+
+		// Splits the rows across the pool. Without a pool everything runs on the caller.
+		void SetThreadPool(ThreadPool* threadPool);
+
+		// Falls back to the plain loops even if the CPU has AVX2, for comparing the two
+		void SetUseAvx2(bool useAvx2);
+
+		float GetHeight(float x, float z) const;
+		DirectX::XMFLOAT3 GetNormal(float x, float z) const;
+
+		// Beach, grass, forest, rock and snow by height relative to the amplitude, with rock on
+		// the steep slopes
+		DirectX::XMFLOAT4 GetColor(float height, const DirectX::XMFLOAT3& normal) const;
+
+		// Builds the m x n vertices of a width x depth grid in one pass, writing
+		// makeVertex(position, normal, color) for each of them
+		template <typename OutVertex, typename MakeVertex>
+		void Generate(float width, float depth, uint32 m, uint32 n, std::vector<OutVertex>& vertices, MakeVertex makeVertex) const;
+
+	private:
+		// Heights and normals of one grid row, kept by the thread that evaluated it
+		struct RowSamples
+		{
+			float X0 = 0.0f;
+			float Dx = 0.0f;
+			float Z = 0.0f;
+			std::vector<float> Heights;
+			std::vector<float> NormalsX;
+			std::vector<float> NormalsY;
+			std::vector<float> NormalsZ;
+		};
+
+		// Evaluates the rows of the grid, on the pool when there is one, and runs
+		// func(row, samples) on each of them before moving to the next
+		void ForEachRow(float width, float depth, uint32 m, uint32 n, const std::function<void(uint32, const RowSamples&)>& func) const;
+
+		// Fills samples with n vertices starting at x = samples.X0
+		void SampleRow(uint32 n, RowSamples& samples) const;
+
+	private:
+		Settings TerrainSettings;
+		std::vector<Octave> Octaves;
+		ThreadPool* Pool = nullptr;
+		bool UseAvx2 = false;
+};
+
+//=========================================================================================
+template <typename OutVertex, typename MakeVertex>
+void TerrainGenerator::Generate(float width, float depth, uint32 m, uint32 n, std::vector<OutVertex>& vertices, MakeVertex makeVertex) const
+{
+	vertices.resize((size_t)m * n);
+
+	// The row is still in cache from the noise pass when it is turned into vertices
+	ForEachRow(width, depth, m, n, [&](uint32 i, const RowSamples& samples)
+	{
+		OutVertex* row = &vertices[(size_t)i * n];
+		for (uint32 j = 0; j < n; ++j)
+		{
+			DirectX::XMFLOAT3 position(samples.X0 + j * samples.Dx, samples.Heights[j], samples.Z);
+			DirectX::XMFLOAT3 normal(samples.NormalsX[j], samples.NormalsY[j], samples.NormalsZ[j]);
+			row[j] = makeVertex(position, normal, GetColor(position.y, normal));
+		}
+	});
+}
@@ -0,0 +1,145 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+	// hardware_concurrency may report 0 when it cannot tell
+	numThreads = std::max(numThreads, 1u);
+
+	// The calling thread is the last member of the pool
+	for (unsigned int i = 0; i + 1 < numThreads; ++i)
+	{
+		Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(QueueMutex);
+		IsStopping = true;
+	}
+	QueueCondition.notify_all();
+
+	for (std::thread& worker : Workers)
+	{
+		worker.join();
+	}
+}
+
+//=========================================================================================
+unsigned int ThreadPool::GetThreadCount() const
+{
+	return (unsigned int)Workers.size() + 1;
+}
+
+//=========================================================================================
+void ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(QueueMutex);
+			QueueCondition.wait(lock, [this] { return IsStopping || !Tasks.empty(); });
+
+			if (IsStopping && Tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(Tasks.front());
+			Tasks.pop_front();
+		}
+
+		task();
+	}
+}
+
+//=========================================================================================
+void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& func)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+
+	size_t count = end - begin;
+	grainSize = std::max<size_t>(grainSize, 1);
+
+	// A few chunks per thread evens out chunks that take longer than others. Rounding the
+	// chunk count down keeps every chunk at least grainSize long.
+	size_t chunkCount = std::min<size_t>(count / grainSize, (size_t)GetThreadCount() * 4);
+	if (chunkCount <= 1 || Workers.empty())
+	{
+		func(begin, end);
+		return;
+	}
+
+	size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+	chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	// Helpers may still be queued after the loop has finished, so the shared state
+	// must outlive this call
+	struct LoopState
+	{
+		std::atomic<size_t> NextChunk{ 0 };
+		size_t FinishedChunks = 0;
+		std::mutex DoneMutex;
+		std::condition_variable DoneCondition;
+	};
+	std::shared_ptr<LoopState> state = std::make_shared<LoopState>();
+
+	auto runChunks = [state, &func, begin, end, chunkSize, chunkCount]()
+	{
+		size_t finished = 0;
+		for (size_t chunk = state->NextChunk++; chunk < chunkCount; chunk = state->NextChunk++)
+		{
+			size_t chunkBegin = begin + chunk * chunkSize;
+			func(chunkBegin, std::min(chunkBegin + chunkSize, end));
+			++finished;
+		}
+
+		if (finished > 0)
+		{
+			std::lock_guard<std::mutex> lock(state->DoneMutex);
+			state->FinishedChunks += finished;
+			if (state->FinishedChunks == chunkCount)
+			{
+				state->DoneCondition.notify_one();
+			}
+		}
+	};
+
+	size_t helperCount = std::min(Workers.size(), chunkCount - 1);
+	{
+		std::lock_guard<std::mutex> lock(QueueMutex);
+		for (size_t i = 0; i < helperCount; ++i)
+		{
+			Tasks.emplace_back(runChunks);
+		}
+	}
+	QueueCondition.notify_all();
+
+	// Work on the loop ourselves rather than idle
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(state->DoneMutex);
+	state->DoneCondition.wait(lock, [&state, chunkCount] { return state->FinishedChunks == chunkCount; });
+}
+
+//=========================================================================================
+void ThreadPool::ParallelFor(ThreadPool* threadPool, size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& func)
+{
+	if (threadPool == nullptr)
+	{
+		if (begin < end)
+		{
+			func(begin, end);
+		}
+		return;
+	}
+	threadPool->ParallelFor(begin, end, grainSize, func);
+}
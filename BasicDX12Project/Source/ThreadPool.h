@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads used to split CPU-heavy loops (geometry generation,
+// simulation, constant buffer uploads) across cores. The thread that calls ParallelFor
+// also works on the loop, so nested ParallelFor calls cannot deadlock the pool.
+class ThreadPool
+{
+	public:
+		// numThreads counts the calling thread, so a pool of 1 runs everything inline
+		explicit ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency());
+		ThreadPool(const ThreadPool& rhs) = delete;
+		ThreadPool& operator=(const ThreadPool& rhs) = delete;
+		~ThreadPool();
+
+		// Number of threads that take part in a ParallelFor, including the caller
+		unsigned int GetThreadCount() const;
+
+		// Splits [begin, end) into contiguous chunks of at least grainSize elements and runs
+		// func(chunkBegin, chunkEnd) on each of them. Returns once every chunk has finished.
+		// Chunk boundaries only depend on the range, grain size and thread count. A range
+		// shorter than twice grainSize is one chunk and runs on the caller without waking the
+		// pool, so grainSize is also the smallest amount of work worth handing to a thread.
+		void ParallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& func);
+
+		// Same, or func(begin, end) on the caller when there is no pool
+		static void ParallelFor(ThreadPool* threadPool, size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)>& func);
+
+	private:
+		void WorkerLoop();
+
+	private:
+		std::vector<std::thread> Workers;
+
+		std::mutex QueueMutex;
+		std::condition_variable QueueCondition;
+		std::deque<std::function<void()>> Tasks;
+		bool IsStopping = false;
+};
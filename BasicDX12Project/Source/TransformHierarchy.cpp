@@ -0,0 +1,287 @@
+#include "TransformHierarchy.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace DirectX;
+
+namespace
+{
+	// Nodes handed to a thread at once
+	const size_t kMinNodesPerTask = 4096;
+}
+
+const TransformHierarchy::uint32 TransformHierarchy::kNoParent;
+
+//=========================================================================================
+void TransformHierarchy::SetThreadPool(ThreadPool* threadPool)
+{
+	Pool = threadPool;
+}
+
+//=========================================================================================
+TransformHierarchy::uint32 TransformHierarchy::AddNode(const XMFLOAT4X4& local, uint32 parent)
+{
+	assert(parent == kNoParent || parent < GetNodeCount());
+
+	uint32 node = GetNodeCount();
+	Locals.push_back(local);
+	Worlds.push_back(local);
+	Parents.push_back(kNoParent);
+	FirstChildren.push_back(0);
+	ChildCounts.push_back(0);
+	Nodes.push_back(node);
+	UpdateStamps.push_back(0);
+
+	Indices.push_back(node);
+	NodeParents.push_back(parent);
+	DirtyFlags.push_back(false);
+
+	NeedsSort = true;
+	return node;
+}
+
+//=========================================================================================
+TransformHierarchy::uint32 TransformHierarchy::GetNodeCount() const
+{
+	return (uint32)Indices.size();
+}
+
+//=========================================================================================
+TransformHierarchy::uint32 TransformHierarchy::GetParent(uint32 node) const
+{
+	return NodeParents[node];
+}
+
+//=========================================================================================
+void TransformHierarchy::SetLocal(uint32 node, const XMFLOAT4X4& local)
+{
+	Locals[Indices[node]] = local;
+	if (!DirtyFlags[node])
+	{
+		DirtyFlags[node] = true;
+		DirtyNodes.push_back(node);
+	}
+}
+
+//=========================================================================================
+const XMFLOAT4X4& TransformHierarchy::GetLocal(uint32 node) const
+{
+	return Locals[Indices[node]];
+}
+
+//=========================================================================================
+const XMFLOAT4X4& TransformHierarchy::GetWorld(uint32 node) const
+{
+	return Worlds[Indices[node]];
+}
+
+//=========================================================================================
+void TransformHierarchy::SortNodes()
+{
+	const uint32 nodeCount = GetNodeCount();
+
+	// Children of each node in the order they were added. A parent is always added before
+	// its children, so one pass in id order finds every node's depth.
+	std::vector<uint32> childStarts(nodeCount + 1, 0);
+	std::vector<uint32> depths(nodeCount, 0);
+	for (uint32 node = 0; node < nodeCount; ++node)
+	{
+		if (NodeParents[node] != kNoParent)
+		{
+			++childStarts[NodeParents[node] + 1];
+			depths[node] = depths[NodeParents[node]] + 1;
+		}
+	}
+	for (uint32 node = 0; node < nodeCount; ++node)
+	{
+		childStarts[node + 1] += childStarts[node];
+	}
+
+	std::vector<uint32> children(childStarts[nodeCount]);
+	std::vector<uint32> childCursors(childStarts.begin(), childStarts.end() - 1);
+	for (uint32 node = 0; node < nodeCount; ++node)
+	{
+		if (NodeParents[node] != kNoParent)
+		{
+			children[childCursors[NodeParents[node]]++] = node;
+		}
+	}
+
+	// The roots, then the children of every node in the order the nodes were placed
+	std::vector<uint32> order;
+	order.reserve(nodeCount);
+	for (uint32 node = 0; node < nodeCount; ++node)
+	{
+		if (NodeParents[node] == kNoParent)
+		{
+			order.push_back(node);
+		}
+	}
+
+	std::vector<XMFLOAT4X4> locals(nodeCount);
+	std::vector<XMFLOAT4X4> worlds(nodeCount);
+	LevelStarts.clear();
+	for (uint32 index = 0; index < nodeCount; ++index)
+	{
+		uint32 node = order[index];
+		if (index == 0 || depths[node] != depths[order[index - 1]])
+		{
+			LevelStarts.push_back(index);
+		}
+
+		locals[index] = Locals[Indices[node]];
+		worlds[index] = Worlds[Indices[node]];
+		Nodes[index] = node;
+		Parents[index] = NodeParents[node] != kNoParent ? Indices[NodeParents[node]] : kNoParent;
+		FirstChildren[index] = (uint32)order.size();
+		ChildCounts[index] = childStarts[node + 1] - childStarts[node];
+		order.insert(order.end(), children.begin() + childStarts[node], children.begin() + childStarts[node + 1]);
+
+		// Parents are placed before their children, so Parents above reads the new index
+		Indices[node] = index;
+	}
+	LevelStarts.push_back(nodeCount);
+
+	Locals = std::move(locals);
+	Worlds = std::move(worlds);
+	std::fill(UpdateStamps.begin(), UpdateStamps.end(), 0);
+	UpdateCount = 0;
+
+	// Sorting only happens after nodes were added, the whole hierarchy is recomputed then
+	for (uint32 index = 0; index < LevelStarts[1]; ++index)
+	{
+		if (!DirtyFlags[Nodes[index]])
+		{
+			DirtyFlags[Nodes[index]] = true;
+			DirtyNodes.push_back(Nodes[index]);
+		}
+	}
+
+	NeedsSort = false;
+}
+
+//=========================================================================================
+void TransformHierarchy::AddRange(std::vector<Range>& ranges, uint32 begin, uint32 end)
+{
+	if (!ranges.empty() && ranges.back().End == begin)
+	{
+		ranges.back().End = end;
+	}
+	else
+	{
+		ranges.push_back({ begin, end });
+	}
+}
+
+//=========================================================================================
+void TransformHierarchy::Update()
+{
+	if (NeedsSort)
+	{
+		SortNodes();
+	}
+
+	UpdatedNodes.clear();
+	if (DirtyNodes.empty())
+	{
+		return;
+	}
+	++UpdateCount;
+
+	// Breadth first indices grow with the level, so the sorted indices go level by level
+	std::vector<uint32> dirtyIndices;
+	dirtyIndices.reserve(DirtyNodes.size());
+	for (uint32 node : DirtyNodes)
+	{
+		dirtyIndices.push_back(Indices[node]);
+		DirtyFlags[node] = false;
+	}
+	DirtyNodes.clear();
+	std::sort(dirtyIndices.begin(), dirtyIndices.end());
+
+	std::vector<Range> parentRanges;
+	std::vector<Range> levelRanges;
+	size_t nextDirty = 0;
+	for (size_t level = 0; level + 1 < LevelStarts.size(); ++level)
+	{
+		// Everything below the nodes recomputed on the level above
+		levelRanges.clear();
+		for (const Range& range : parentRanges)
+		{
+			uint32 begin = FirstChildren[range.Begin];
+			uint32 end = FirstChildren[range.End - 1] + ChildCounts[range.End - 1];
+			if (begin < end)
+			{
+				AddRange(levelRanges, begin, end);
+			}
+		}
+
+		// And the nodes set on this level that those didn't cover
+		for (; nextDirty < dirtyIndices.size() && dirtyIndices[nextDirty] < LevelStarts[level + 1]; ++nextDirty)
+		{
+			uint32 index = dirtyIndices[nextDirty];
+			if (Parents[index] == kNoParent || UpdateStamps[Parents[index]] != UpdateCount)
+			{
+				AddRange(levelRanges, index, index + 1);
+			}
+		}
+
+		if (levelRanges.empty() && nextDirty == dirtyIndices.size())
+		{
+			break;
+		}
+
+		UpdateRanges(levelRanges);
+		for (const Range& range : levelRanges)
+		{
+			UpdatedNodes.insert(UpdatedNodes.end(), Nodes.begin() + range.Begin, Nodes.begin() + range.End);
+		}
+		parentRanges.swap(levelRanges);
+	}
+}
+
+//=========================================================================================
+void TransformHierarchy::UpdateRanges(const std::vector<Range>& ranges)
+{
+	auto updateRange = [this](uint32 begin, uint32 end)
+	{
+		for (uint32 i = begin; i < end; ++i)
+		{
+			if (Parents[i] == kNoParent)
+			{
+				Worlds[i] = Locals[i];
+			}
+			else
+			{
+				XMStoreFloat4x4(&Worlds[i], XMMatrixMultiply(XMLoadFloat4x4(&Locals[i]), XMLoadFloat4x4(&Worlds[Parents[i]])));
+			}
+			UpdateStamps[i] = UpdateCount;
+		}
+	};
+
+	// Nodes of a level only read the level above, so the ranges split freely. The pool
+	// splits the nodes as if the ranges were one, rangeStarts maps them back.
+	std::vector<size_t> rangeStarts(ranges.size() + 1, 0);
+	for (size_t r = 0; r < ranges.size(); ++r)
+	{
+		rangeStarts[r + 1] = rangeStarts[r] + (ranges[r].End - ranges[r].Begin);
+	}
+
+	ThreadPool::ParallelFor(Pool, 0, rangeStarts.back(), kMinNodesPerTask, [&](size_t first, size_t last)
+	{
+		size_t r = std::upper_bound(rangeStarts.begin(), rangeStarts.end(), first) - rangeStarts.begin() - 1;
+		for (; first < last; ++r)
+		{
+			size_t end = std::min<size_t>(last, rangeStarts[r + 1]);
+			updateRange(ranges[r].Begin + (uint32)(first - rangeStarts[r]), ranges[r].Begin + (uint32)(end - rangeStarts[r]));
+			first = end;
+		}
+	});
+}
+
+//=========================================================================================
+const std::vector<TransformHierarchy::uint32>& TransformHierarchy::GetUpdatedNodes() const
+{
+	return UpdatedNodes;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "FromBook/d3dUtil.h"
+
+class ThreadPool;
+
+// Parent/child transforms. A node's world matrix is its local matrix times the world matrix
+// of its parent, so moving a node moves everything attached below it.
+//
+// Nodes are stored breadth first: one level after the other, and within a level grouped by
+// parent in the order of the parents. Every level reads only the level above it, and the
+// children of a run of nodes are again one run, so Update sweeps contiguous arrays from the
+// top level down and only visits the subtrees below nodes that changed.
+class TransformHierarchy
+{
+	public:
+		using uint32 = std::uint32_t;
+
+		static const uint32 kNoParent = UINT32_MAX;
+
+		// Splits large levels across the pool. Without a pool everything runs on the caller.
+		void SetThreadPool(ThreadPool* threadPool);
+
+		// Adds a node below parent, which must have been added before it. Returns the node's id,
+		// which stays the same while other nodes are added.
+		uint32 AddNode(const DirectX::XMFLOAT4X4& local, uint32 parent = kNoParent);
+
+		uint32 GetNodeCount() const;
+		uint32 GetParent(uint32 node) const;
+
+		// Moves the node and the nodes below it at the next Update
+		void SetLocal(uint32 node, const DirectX::XMFLOAT4X4& local);
+		const DirectX::XMFLOAT4X4& GetLocal(uint32 node) const;
+
+		// World matrix as of the last Update
+		const DirectX::XMFLOAT4X4& GetWorld(uint32 node) const;
+
+		// Recomputes the world matrices below the nodes set since the last Update
+		void Update();
+
+		// Ids of the nodes whose world matrix the last Update recomputed, parents before
+		// their children
+		const std::vector<uint32>& GetUpdatedNodes() const;
+
+	private:
+		// Run of nodes [Begin, End) in breadth first order
+		struct Range
+		{
+			uint32 Begin;
+			uint32 End;
+		};
+
+		// Sorts the nodes breadth first after nodes were added
+		void SortNodes();
+
+		// Appends the range to ranges, merged with the last one when they touch
+		static void AddRange(std::vector<Range>& ranges, uint32 begin, uint32 end);
+
+		void UpdateRanges(const std::vector<Range>& ranges);
+
+	private:
+		ThreadPool* Pool = nullptr;
+
+		// By breadth first index. Parents holds the index of the parent, and the children of
+		// a node are the ChildCounts[i] nodes starting at FirstChildren[i].
+		std::vector<DirectX::XMFLOAT4X4> Locals;
+		std::vector<DirectX::XMFLOAT4X4> Worlds;
+		std::vector<uint32> Parents;
+		std::vector<uint32> FirstChildren;
+		std::vector<uint32> ChildCounts;
+		std::vector<uint32> Nodes;
+
+		// Update that last recomputed each node, to tell which children it already covered
+		std::vector<uint32> UpdateStamps;
+		uint32 UpdateCount = 0;
+
+		// First breadth first index of each level, and one past the last node
+		std::vector<uint32> LevelStarts;
+
+		// By node id
+		std::vector<uint32> Indices;
+		std::vector<uint32> NodeParents;
+		std::vector<bool> DirtyFlags;
+
+		// Nodes set since the last Update
+		std::vector<uint32> DirtyNodes;
+
+		// Added nodes are appended unsorted until the next Update
+		bool NeedsSort = false;
+
+		std::vector<uint32> UpdatedNodes;
+};
@@ -0,0 +1,287 @@
+#include "VertexCompression.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+using std::int16_t;
+using std::uint32_t;
+
+namespace
+{
+	float SignNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	int16_t FloatToSnorm16(float v)
+	{
+		v = std::min<float>(std::max<float>(v, -1.0f), 1.0f);
+		return (int16_t)lroundf(v * 32767.0f);
+	}
+
+	float Snorm16ToFloat(int16_t v)
+	{
+		// Matches the D3D SNORM conversion, -32768 and -32767 both map to -1
+		return std::max<float>(v / 32767.0f, -1.0f);
+	}
+
+	// A flat axis (e.g. the grid's y) has no extent to divide by, so quantize it against 1
+	XMFLOAT3 QuantizationExtents(const BoundingBox& bounds)
+	{
+		const float kMinExtent = 1e-6f;
+		return XMFLOAT3(
+			bounds.Extents.x > kMinExtent ? bounds.Extents.x : 1.0f,
+			bounds.Extents.y > kMinExtent ? bounds.Extents.y : 1.0f,
+			bounds.Extents.z > kMinExtent ? bounds.Extents.z : 1.0f);
+	}
+}
+
+//=========================================================================================
+UINT VertexCompression::GetVertexStride(VertexFormat format)
+{
+	switch (format)
+	{
+		case VertexFormat::PackedColor:
+			return sizeof(PackedColorVertex);
+		case VertexFormat::QuantizedPosition:
+			return sizeof(QuantizedColorVertex);
+		default:
+			return sizeof(XMFLOAT3) + sizeof(XMFLOAT4);
+	}
+}
+
+//=========================================================================================
+std::vector<D3D12_INPUT_ELEMENT_DESC> VertexCompression::GetColorInputLayout(VertexFormat format)
+{
+	switch (format)
+	{
+		case VertexFormat::PackedColor:
+			return
+			{
+				{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+				{"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+			};
+		case VertexFormat::QuantizedPosition:
+			return
+			{
+				{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+				{"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+			};
+		default:
+			return
+			{
+				{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+				{"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+			};
+	}
+}
+
+//=========================================================================================
+std::vector<D3D12_INPUT_ELEMENT_DESC> VertexCompression::GetCompactMeshInputLayout()
+{
+	// The shader sees NORMAL/TANGENT as the two octahedral components and has to unpack them
+	return
+	{
+		{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+		{"NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+		{"TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+		{"TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+	};
+}
+
+//=========================================================================================
+XMFLOAT4X4 VertexCompression::GetPositionDecodeTransform(VertexFormat format, const BoundingBox& bounds)
+{
+	XMFLOAT4X4 decode;
+	if (format != VertexFormat::QuantizedPosition)
+	{
+		XMStoreFloat4x4(&decode, XMMatrixIdentity());
+		return decode;
+	}
+
+	XMFLOAT3 extents = QuantizationExtents(bounds);
+	XMStoreFloat4x4(&decode, XMMatrixMultiply(
+		XMMatrixScaling(extents.x, extents.y, extents.z),
+		XMMatrixTranslation(bounds.Center.x, bounds.Center.y, bounds.Center.z)));
+
+	return decode;
+}
+
+//=========================================================================================
+void VertexCompression::EncodeColorVertices(VertexFormat format, const std::vector<GeometryGenerator::Vertex>& vertices,
+	const XMFLOAT4& color, const BoundingBox& bounds, void* dst)
+{
+	if (!vertices.empty())
+	{
+		EncodeColorPositions(format, &vertices[0].Position, vertices.size(), sizeof(GeometryGenerator::Vertex), color, bounds, dst);
+	}
+}
+
+//=========================================================================================
+void VertexCompression::EncodeColorPositions(VertexFormat format, const XMFLOAT3* positions, size_t count, size_t stride,
+	const XMFLOAT4& color, const BoundingBox& bounds, void* dst)
+{
+	auto position = [positions, stride](size_t i) -> const XMFLOAT3&
+	{
+		return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const std::uint8_t*>(positions) + i * stride);
+	};
+
+	switch (format)
+	{
+		case VertexFormat::PackedColor:
+		{
+			uint32_t packedColor = EncodeColor(color);
+			PackedColorVertex* out = static_cast<PackedColorVertex*>(dst);
+			for (size_t i = 0; i < count; ++i)
+			{
+				out[i].Pos = position(i);
+				out[i].Color = packedColor;
+			}
+			break;
+		}
+		case VertexFormat::QuantizedPosition:
+		{
+			uint32_t packedColor = EncodeColor(color);
+			QuantizedColorVertex* out = static_cast<QuantizedColorVertex*>(dst);
+			for (size_t i = 0; i < count; ++i)
+			{
+				EncodePosition(position(i), bounds, out[i].Pos);
+				out[i].Color = packedColor;
+			}
+			break;
+		}
+		default:
+		{
+			// Same layout as the Vertex struct in FrameResource.h
+			std::uint8_t* out = static_cast<std::uint8_t*>(dst);
+			for (size_t i = 0; i < count; ++i, out += sizeof(XMFLOAT3) + sizeof(XMFLOAT4))
+			{
+				std::memcpy(out, &position(i), sizeof(XMFLOAT3));
+				std::memcpy(out + sizeof(XMFLOAT3), &color, sizeof(XMFLOAT4));
+			}
+			break;
+		}
+	}
+}
+
+//=========================================================================================
+void VertexCompression::EncodeMeshVertices(const std::vector<GeometryGenerator::Vertex>& vertices, const BoundingBox& bounds, CompactMeshVertex* dst)
+{
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		EncodePosition(vertices[i].Position, bounds, dst[i].Pos);
+		dst[i].Normal = EncodeOctahedral(vertices[i].Normal);
+		dst[i].TangentU = EncodeOctahedral(vertices[i].TangentU);
+		dst[i].TexC = EncodeHalf2(vertices[i].TexC);
+	}
+}
+
+//=========================================================================================
+GeometryGenerator::Vertex VertexCompression::DecodeMeshVertex(const CompactMeshVertex& v, const BoundingBox& bounds)
+{
+	return GeometryGenerator::Vertex(
+		DecodePosition(v.Pos, bounds),
+		DecodeOctahedral(v.Normal),
+		DecodeOctahedral(v.TangentU),
+		DecodeHalf2(v.TexC));
+}
+
+//=========================================================================================
+uint32_t VertexCompression::EncodeOctahedral(const XMFLOAT3& n)
+{
+	// Project onto the octahedron |x|+|y|+|z| = 1, then fold the lower half over the diagonals
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (l1 <= 0.0f)
+	{
+		return 0;
+	}
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if (n.z < 0.0f)
+	{
+		float foldedX = (1.0f - fabsf(y)) * SignNotZero(x);
+		float foldedY = (1.0f - fabsf(x)) * SignNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	return (uint32_t)(uint16_t)FloatToSnorm16(x) | ((uint32_t)(uint16_t)FloatToSnorm16(y) << 16);
+}
+
+//=========================================================================================
+XMFLOAT3 VertexCompression::DecodeOctahedral(uint32_t packed)
+{
+	float x = Snorm16ToFloat((int16_t)(packed & 0xFFFF));
+	float y = Snorm16ToFloat((int16_t)(packed >> 16));
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	// Unfold the lower half
+	if (z < 0.0f)
+	{
+		float unfoldedX = (1.0f - fabsf(y)) * SignNotZero(x);
+		float unfoldedY = (1.0f - fabsf(x)) * SignNotZero(y);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVectorSet(x, y, z, 0.0f)));
+	return n;
+}
+
+//=========================================================================================
+uint32_t VertexCompression::EncodeHalf2(const XMFLOAT2& v)
+{
+	return (uint32_t)PackedVector::XMConvertFloatToHalf(v.x) | ((uint32_t)PackedVector::XMConvertFloatToHalf(v.y) << 16);
+}
+
+//=========================================================================================
+XMFLOAT2 VertexCompression::DecodeHalf2(uint32_t packed)
+{
+	return XMFLOAT2(
+		PackedVector::XMConvertHalfToFloat((PackedVector::HALF)(packed & 0xFFFF)),
+		PackedVector::XMConvertHalfToFloat((PackedVector::HALF)(packed >> 16)));
+}
+
+//=========================================================================================
+uint32_t VertexCompression::EncodeColor(const XMFLOAT4& color)
+{
+	auto toUnorm8 = [](float v) { return (uint32_t)lroundf(std::min<float>(std::max<float>(v, 0.0f), 1.0f) * 255.0f); };
+
+	return toUnorm8(color.x) | (toUnorm8(color.y) << 8) | (toUnorm8(color.z) << 16) | (toUnorm8(color.w) << 24);
+}
+
+//=========================================================================================
+XMFLOAT4 VertexCompression::DecodeColor(uint32_t packed)
+{
+	return XMFLOAT4(
+		(packed & 0xFF) / 255.0f,
+		((packed >> 8) & 0xFF) / 255.0f,
+		((packed >> 16) & 0xFF) / 255.0f,
+		(packed >> 24) / 255.0f);
+}
+
+//=========================================================================================
+void VertexCompression::EncodePosition(const XMFLOAT3& p, const BoundingBox& bounds, int16_t out[4])
+{
+	XMFLOAT3 extents = QuantizationExtents(bounds);
+
+	out[0] = FloatToSnorm16((p.x - bounds.Center.x) / extents.x);
+	out[1] = FloatToSnorm16((p.y - bounds.Center.y) / extents.y);
+	out[2] = FloatToSnorm16((p.z - bounds.Center.z) / extents.z);
+	out[3] = 32767;
+}
+
+//=========================================================================================
+XMFLOAT3 VertexCompression::DecodePosition(const int16_t in[4], const BoundingBox& bounds)
+{
+	XMFLOAT3 extents = QuantizationExtents(bounds);
+
+	return XMFLOAT3(
+		bounds.Center.x + Snorm16ToFloat(in[0]) * extents.x,
+		bounds.Center.y + Snorm16ToFloat(in[1]) * extents.y,
+		bounds.Center.z + Snorm16ToFloat(in[2]) * extents.z);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <d3d12.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include "FromBook/GeometryGenerator.h"
+
+// Vertex layouts the shapes scene can upload its geometry in
+enum VertexFormat
+{
+	// float3 position + float4 color, 28 bytes (the original Vertex)
+	FullPrecision,
+
+	// float3 position + RGBA8 color, 16 bytes
+	PackedColor,
+
+	// SNORM16 position relative to the submesh bounds + RGBA8 color, 12 bytes
+	QuantizedPosition
+};
+
+// 16 bytes, matches VertexFormat::PackedColor
+struct PackedColorVertex
+{
+	DirectX::XMFLOAT3 Pos;
+	std::uint32_t Color;
+};
+
+// 12 bytes, matches VertexFormat::QuantizedPosition. The fourth position component is padding.
+struct QuantizedColorVertex
+{
+	std::int16_t Pos[4];
+	std::uint32_t Color;
+};
+
+// 20 bytes compressed counterpart of the 44 byte GeometryGenerator::Vertex: SNORM16 position
+// relative to the submesh bounds, octahedral SNORM16x2 normal and tangent, half float UVs.
+struct CompactMeshVertex
+{
+	std::int16_t Pos[4];
+	std::uint32_t Normal;
+	std::uint32_t TangentU;
+	std::uint32_t TexC;
+};
+
+// Encode/decode helpers for compressed vertex attributes. The decoders mirror what the input
+// assembler does with the matching DXGI formats, so they can be used to check the error.
+class VertexCompression
+{
+	public:
+		static UINT GetVertexStride(VertexFormat format);
+
+		// Input layouts matching the vertex structs above. Quantized positions come out of the
+		// input assembler in [-1, 1] and need GetPositionDecodeTransform applied before World.
+		static std::vector<D3D12_INPUT_ELEMENT_DESC> GetColorInputLayout(VertexFormat format);
+		static std::vector<D3D12_INPUT_ELEMENT_DESC> GetCompactMeshInputLayout();
+
+		// Maps positions quantized against bounds back to object space (scale by the extents,
+		// then translate to the center). Identity for float positions.
+		static DirectX::XMFLOAT4X4 GetPositionDecodeTransform(VertexFormat format, const DirectX::BoundingBox& bounds);
+
+		// Writes the positions of the mesh with a single color to dst in the given format.
+		// dst must hold vertices.size() * GetVertexStride(format) bytes.
+		static void EncodeColorVertices(VertexFormat format, const std::vector<GeometryGenerator::Vertex>& vertices,
+			const DirectX::XMFLOAT4& color, const DirectX::BoundingBox& bounds, void* dst);
+
+		// Same for count positions stride bytes apart, read in place from any vertex layout or
+		// from the tightly packed position stream of a MeshDataSoA
+		static void EncodeColorPositions(VertexFormat format, const DirectX::XMFLOAT3* positions, size_t count, size_t stride,
+			const DirectX::XMFLOAT4& color, const DirectX::BoundingBox& bounds, void* dst);
+
+		static void EncodeMeshVertices(const std::vector<GeometryGenerator::Vertex>& vertices, const DirectX::BoundingBox& bounds, CompactMeshVertex* dst);
+		static GeometryGenerator::Vertex DecodeMeshVertex(const CompactMeshVertex& v, const DirectX::BoundingBox& bounds);
+
+		// Unit vector <-> octahedral map stored as two SNORM16 values (x in the low half)
+		static std::uint32_t EncodeOctahedral(const DirectX::XMFLOAT3& n);
+		static DirectX::XMFLOAT3 DecodeOctahedral(std::uint32_t packed);
+
+		// float2 <-> two half floats (x in the low half)
+		static std::uint32_t EncodeHalf2(const DirectX::XMFLOAT2& v);
+		static DirectX::XMFLOAT2 DecodeHalf2(std::uint32_t packed);
+
+		// float4 color in [0, 1] <-> RGBA8 UNORM (red in the low byte)
+		static std::uint32_t EncodeColor(const DirectX::XMFLOAT4& color);
+		static DirectX::XMFLOAT4 DecodeColor(std::uint32_t packed);
+
+		// Position <-> SNORM16 relative to bounds
+		static void EncodePosition(const DirectX::XMFLOAT3& p, const DirectX::BoundingBox& bounds, std::int16_t out[4]);
+		static DirectX::XMFLOAT3 DecodePosition(const std::int16_t in[4], const DirectX::BoundingBox& bounds);
+};
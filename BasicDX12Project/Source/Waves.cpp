@@ -0,0 +1,458 @@
+#include "Waves.h"
+#include "ThreadPool.h"
+#include "FromBook/FrameResource.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX_FUNCTION
+#else
+#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	using uint32 = Waves::uint32;
+
+	// Rows handed to a thread at once are at least this many vertices, so small grids stay on
+	// one thread
+	const uint32 kMinVerticesPerTask = 16384;
+
+	// Steps one Update may run to catch up. Beyond that the lost time is dropped instead of
+	// making the next frame even longer.
+	const uint32 kMaxStepsPerUpdate = 4;
+
+	bool IsAvxSupported()
+	{
+#if defined(_MSC_VER)
+		// The CPU has to have AVX and the OS has to save the upper halves of the registers
+		int info[4];
+		__cpuid(info, 1);
+		bool hasAvx = (info[2] & (1 << 28)) != 0;
+		bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+		return hasAvx && osSavesYmm;
+#else
+		return __builtin_cpu_supports("avx") != 0;
+#endif
+	}
+
+	// First and last column of a row that changed, First > Last when none did
+	struct ChangedColumns
+	{
+		uint32 First = UINT32_MAX;
+		uint32 Last = 0;
+
+		void Add(uint32 first, uint32 last)
+		{
+			First = std::min<uint32>(First, first);
+			Last = std::max<uint32>(Last, last);
+		}
+	};
+
+	// next = k1 * prev + k2 * curr + k3 * (sum of the four neighbors), written over prev.
+	// Both versions add in the same order so they give the same heights. The AVX version
+	// records changes eight columns at a time, which only makes the span a little wider.
+	struct StepRow
+	{
+		float K1;
+		float K2;
+		float K3;
+		uint32 ColumnCount;
+
+		void Scalar(const float* up, const float* row, const float* down, float* prev, uint32 j, ChangedColumns& changes) const
+		{
+			for (; j + 1 < ColumnCount; ++j)
+			{
+				float neighbors = (up[j] + down[j]) + (row[j - 1] + row[j + 1]);
+				prev[j] = K1 * prev[j] + K2 * row[j] + K3 * neighbors;
+				if (prev[j] != row[j])
+				{
+					changes.Add(j, j);
+				}
+			}
+		}
+
+		AVX_FUNCTION void Avx(const float* up, const float* row, const float* down, float* prev, ChangedColumns& changes) const
+		{
+			__m256 k1 = _mm256_set1_ps(K1);
+			__m256 k2 = _mm256_set1_ps(K2);
+			__m256 k3 = _mm256_set1_ps(K3);
+
+			uint32 j = 1;
+			for (; j + 8 < ColumnCount; j += 8)
+			{
+				__m256 vertical = _mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j));
+				__m256 horizontal = _mm256_add_ps(_mm256_loadu_ps(row + j - 1), _mm256_loadu_ps(row + j + 1));
+				__m256 neighbors = _mm256_add_ps(vertical, horizontal);
+
+				__m256 curr = _mm256_loadu_ps(row + j);
+				__m256 next = _mm256_mul_ps(k1, _mm256_loadu_ps(prev + j));
+				next = _mm256_add_ps(next, _mm256_mul_ps(k2, curr));
+				next = _mm256_add_ps(next, _mm256_mul_ps(k3, neighbors));
+				_mm256_storeu_ps(prev + j, next);
+
+				if (_mm256_movemask_ps(_mm256_cmp_ps(next, curr, _CMP_NEQ_UQ)) != 0)
+				{
+					changes.Add(j, j + 7);
+				}
+			}
+			_mm256_zeroupper();
+			Scalar(up, row, down, prev, j, changes);
+		}
+	};
+
+	// Normal (l - r, 2 * spatialStep, b - t) normalized, from the heights left, right, above
+	// and below the vertex, for the columns [j, end)
+	struct NormalRow
+	{
+		float TwoSpatialSteps;
+
+		void Scalar(const float* up, const float* row, const float* down, float* nx, float* ny, float* nz, uint32 j, uint32 end) const
+		{
+			for (; j < end; ++j)
+			{
+				float x = row[j - 1] - row[j + 1];
+				float z = down[j] - up[j];
+				float invLength = 1.0f / sqrtf(x * x + TwoSpatialSteps * TwoSpatialSteps + z * z);
+				nx[j] = x * invLength;
+				ny[j] = TwoSpatialSteps * invLength;
+				nz[j] = z * invLength;
+			}
+		}
+
+		AVX_FUNCTION void Avx(const float* up, const float* row, const float* down, float* nx, float* ny, float* nz, uint32 j, uint32 end) const
+		{
+			__m256 y = _mm256_set1_ps(TwoSpatialSteps);
+			__m256 ySq = _mm256_mul_ps(y, y);
+			__m256 one = _mm256_set1_ps(1.0f);
+
+			for (; j + 8 <= end; j += 8)
+			{
+				__m256 x = _mm256_sub_ps(_mm256_loadu_ps(row + j - 1), _mm256_loadu_ps(row + j + 1));
+				__m256 z = _mm256_sub_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+
+				__m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), ySq), _mm256_mul_ps(z, z));
+				__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+
+				_mm256_storeu_ps(nx + j, _mm256_mul_ps(x, invLength));
+				_mm256_storeu_ps(ny + j, _mm256_mul_ps(y, invLength));
+				_mm256_storeu_ps(nz + j, _mm256_mul_ps(z, invLength));
+			}
+			_mm256_zeroupper();
+			Scalar(up, row, down, nx, ny, nz, j, end);
+		}
+	};
+}
+
+//=========================================================================================
+Waves::Waves(uint32 rowCount, uint32 columnCount, float spatialStep, float timeStep, float speed, float damping)
+: RowCount(rowCount)
+, ColumnCount(columnCount)
+, SpatialStep(spatialStep)
+, TimeStep(timeStep)
+, NormalTiles(rowCount, columnCount)
+, UseAvx(IsAvxSupported())
+{
+	float d = damping * timeStep + 2.0f;
+	float e = (speed * speed) * (timeStep * timeStep) / (spatialStep * spatialStep);
+	K1 = (damping * timeStep - 2.0f) / d;
+	K2 = (4.0f - 8.0f * e) / d;
+	K3 = (2.0f * e) / d;
+
+	PrevHeights.assign(GetVertexCount(), 0.0f);
+	CurrHeights.assign(GetVertexCount(), 0.0f);
+
+	NormalsX.assign(GetVertexCount(), 0.0f);
+	NormalsY.assign(GetVertexCount(), 1.0f);
+	NormalsZ.assign(GetVertexCount(), 0.0f);
+
+	// Every row is new to every vertex buffer
+	RowChanges.resize(RowCount);
+	RowVersions.assign(RowCount, Version);
+}
+
+//=========================================================================================
+Waves::uint32 Waves::GetRowCount() const
+{
+	return RowCount;
+}
+
+//=========================================================================================
+Waves::uint32 Waves::GetColumnCount() const
+{
+	return ColumnCount;
+}
+
+//=========================================================================================
+Waves::uint32 Waves::GetVertexCount() const
+{
+	return RowCount * ColumnCount;
+}
+
+//=========================================================================================
+float Waves::GetWidth() const
+{
+	return (ColumnCount - 1) * SpatialStep;
+}
+
+//=========================================================================================
+float Waves::GetDepth() const
+{
+	return (RowCount - 1) * SpatialStep;
+}
+
+//=========================================================================================
+void Waves::SetThreadPool(ThreadPool* threadPool)
+{
+	Pool = threadPool;
+}
+
+//=========================================================================================
+void Waves::SetUseAvx(bool useAvx)
+{
+	UseAvx = useAvx && IsAvxSupported();
+}
+
+//=========================================================================================
+XMFLOAT3 Waves::GetPosition(uint32 index) const
+{
+	uint32 i = index / ColumnCount;
+	uint32 j = index % ColumnCount;
+	return XMFLOAT3(j * SpatialStep - 0.5f * GetWidth(), CurrHeights[index], 0.5f * GetDepth() - i * SpatialStep);
+}
+
+//=========================================================================================
+XMFLOAT3 Waves::GetNormal(uint32 index) const
+{
+	return XMFLOAT3(NormalsX[index], NormalsY[index], NormalsZ[index]);
+}
+
+//=========================================================================================
+XMFLOAT3 Waves::GetTangentX(uint32 index) const
+{
+	uint32 j = index % ColumnCount;
+	if (j == 0 || j + 1 == ColumnCount || index < ColumnCount || index + ColumnCount >= GetVertexCount())
+	{
+		return XMFLOAT3(1.0f, 0.0f, 0.0f);
+	}
+
+	XMFLOAT3 tangent;
+	XMStoreFloat3(&tangent, XMVector3Normalize(XMVectorSet(2.0f * SpatialStep, CurrHeights[index + 1] - CurrHeights[index - 1], 0.0f, 0.0f)));
+	return tangent;
+}
+
+//=========================================================================================
+void Waves::ParallelForRows(uint32 firstRow, uint32 lastRow, const std::function<void(uint32, uint32)>& func) const
+{
+	uint32 rowsPerTask = std::max<uint32>(1, kMinVerticesPerTask / ColumnCount);
+	ThreadPool::ParallelFor(Pool, firstRow, lastRow, rowsPerTask, [&func](size_t begin, size_t end)
+	{
+		func((uint32)begin, (uint32)end);
+	});
+}
+
+//=========================================================================================
+BoundingBox Waves::GetBounds() const
+{
+	float minHeight = 0.0f;
+	float maxHeight = 0.0f;
+	for (float height : CurrHeights)
+	{
+		minHeight = std::min<float>(minHeight, height);
+		maxHeight = std::max<float>(maxHeight, height);
+	}
+
+	// The border is fixed at 0, so the range always includes it
+	return BoundingBox(XMFLOAT3(0.0f, 0.5f * (minHeight + maxHeight), 0.0f), XMFLOAT3(0.5f * GetWidth(), 0.5f * (maxHeight - minHeight), 0.5f * GetDepth()));
+}
+
+//=========================================================================================
+Waves::uint32 Waves::Update(float dt)
+{
+	TimeSinceStep += dt;
+
+	uint32 stepCount = 0;
+	while (TimeSinceStep >= TimeStep && stepCount < kMaxStepsPerUpdate)
+	{
+		Step();
+		TimeSinceStep -= TimeStep;
+		++stepCount;
+	}
+
+	if (stepCount == kMaxStepsPerUpdate)
+	{
+		TimeSinceStep = 0.0f;
+	}
+
+	// The normals are only looked at once a frame, no need to keep them up for every step
+	if (stepCount > 0)
+	{
+		UpdateNormals();
+	}
+	return stepCount;
+}
+
+//=========================================================================================
+void Waves::Step()
+{
+	if (RowCount < 3 || ColumnCount < 3)
+	{
+		return;
+	}
+
+	++Version;
+
+	StepRow stepRow = { K1, K2, K3, ColumnCount };
+	const float* curr = CurrHeights.data();
+	float* prev = PrevHeights.data();
+
+	// Each row only writes itself and its own change records, the border rows stay at 0
+	ParallelForRows(1, RowCount - 1, [&](uint32 firstRow, uint32 lastRow)
+	{
+		for (uint32 i = firstRow; i < lastRow; ++i)
+		{
+			const float* row = curr + (size_t)i * ColumnCount;
+			float* prevRow = prev + (size_t)i * ColumnCount;
+
+			ChangedColumns changes;
+			if (UseAvx)
+			{
+				stepRow.Avx(row - ColumnCount, row, row + ColumnCount, prevRow, changes);
+			}
+			else
+			{
+				stepRow.Scalar(row - ColumnCount, row, row + ColumnCount, prevRow, 1, changes);
+			}
+
+			RowChanges[i] = { changes.First, changes.Last };
+			if (changes.First <= changes.Last)
+			{
+				RowVersions[i] = Version;
+			}
+		}
+	});
+
+	PrevHeights.swap(CurrHeights);
+
+	// A normal depends on the heights next to it, so the changes spread by one vertex
+	for (uint32 i = 1; i + 1 < RowCount; ++i)
+	{
+		const ColumnSpan& changes = RowChanges[i];
+		if (changes.First <= changes.Last)
+		{
+			NormalTiles.MarkRect(i - 1, i + 2, changes.First - 1, changes.Last + 2);
+		}
+	}
+}
+
+//=========================================================================================
+void Waves::UpdateNormals()
+{
+	if (RowCount < 3 || ColumnCount < 3)
+	{
+		NormalTiles.Clear();
+		return;
+	}
+
+	NormalRow normalRow = { 2.0f * SpatialStep };
+	const float* heights = CurrHeights.data();
+	const std::vector<uint32>& dirtyTiles = NormalTiles.GetDirtyTiles();
+
+	// Tiles don't overlap, so they can be updated in any order. The border keeps pointing up.
+	auto updateTiles = [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; ++t)
+		{
+			uint32 firstRow, lastRow, firstColumn, lastColumn;
+			NormalTiles.GetTileRect(dirtyTiles[t], firstRow, lastRow, firstColumn, lastColumn);
+			firstRow = std::max<uint32>(firstRow, 1);
+			lastRow = std::min<uint32>(lastRow, RowCount - 1);
+			firstColumn = std::max<uint32>(firstColumn, 1);
+			lastColumn = std::min<uint32>(lastColumn, ColumnCount - 1);
+
+			for (uint32 i = firstRow; i < lastRow; ++i)
+			{
+				size_t offset = (size_t)i * ColumnCount;
+				const float* row = heights + offset;
+				if (UseAvx)
+				{
+					normalRow.Avx(row - ColumnCount, row, row + ColumnCount, &NormalsX[offset], &NormalsY[offset], &NormalsZ[offset], firstColumn, lastColumn);
+				}
+				else
+				{
+					normalRow.Scalar(row - ColumnCount, row, row + ColumnCount, &NormalsX[offset], &NormalsY[offset], &NormalsZ[offset], firstColumn, lastColumn);
+				}
+			}
+		}
+	};
+
+	size_t tilesPerTask = std::max<size_t>(1, kMinVerticesPerTask / (GridDirtyTiles::kTileSize * GridDirtyTiles::kTileSize));
+	ThreadPool::ParallelFor(Pool, 0, dirtyTiles.size(), tilesPerTask, updateTiles);
+
+	NormalTiles.Clear();
+}
+
+//=========================================================================================
+void Waves::Disturb(uint32 i, uint32 j, float magnitude)
+{
+	// Don't disturb the border
+	assert(i > 1 && i + 2 < RowCount);
+	assert(j > 1 && j + 2 < ColumnCount);
+
+	float halfMagnitude = 0.5f * magnitude;
+
+	size_t index = (size_t)i * ColumnCount + j;
+	CurrHeights[index] += magnitude;
+	CurrHeights[index + 1] += halfMagnitude;
+	CurrHeights[index - 1] += halfMagnitude;
+	CurrHeights[index + ColumnCount] += halfMagnitude;
+	CurrHeights[index - ColumnCount] += halfMagnitude;
+
+	++Version;
+	RowVersions[i - 1] = Version;
+	RowVersions[i] = Version;
+	RowVersions[i + 1] = Version;
+	NormalTiles.MarkRect(i - 2, i + 3, j - 2, j + 3);
+}
+
+//=========================================================================================
+std::uint64_t Waves::GetVersion() const
+{
+	return Version;
+}
+
+//=========================================================================================
+std::uint64_t Waves::WriteVertices(UploadBuffer<Vertex>& vertexBuffer, const XMFLOAT4& color, std::uint64_t bufferVersion) const
+{
+	float left = -0.5f * GetWidth();
+	float top = 0.5f * GetDepth();
+
+	// Whole rows are written in order, so the write-combined upload memory sees full lines
+	ParallelForRows(0, RowCount, [&](uint32 firstRow, uint32 lastRow)
+	{
+		for (uint32 i = firstRow; i < lastRow; ++i)
+		{
+			if (RowVersions[i] <= bufferVersion)
+			{
+				continue;
+			}
+
+			const float* heights = &CurrHeights[(size_t)i * ColumnCount];
+			Vertex* vertices = vertexBuffer.MappedData(i * ColumnCount);
+			float z = top - i * SpatialStep;
+			for (uint32 j = 0; j < ColumnCount; ++j)
+			{
+				vertices[j].Pos = XMFLOAT3(left + j * SpatialStep, heights[j], z);
+				vertices[j].Color = color;
+			}
+		}
+	});
+
+	return Version;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <DirectXCollision.h>
+#include <DirectXMath.h>
+#include <functional>
+#include <vector>
+#include "GridDirtyTiles.h"
+#include "FromBook/GeometryGenerator.h"
+
+class ThreadPool;
+struct Vertex;
+template <typename T> class UploadBuffer;
+
+// Finite difference simulation of the wave equation on a height field, laid out like the
+// vertices of GeometryGenerator::CreateGrid (row i at z = depth / 2 - i * spatialStep, column j
+// at x = j * spatialStep - width / 2), so the grid's index buffer draws it.
+//
+// Heights and normals are kept as separate float arrays. Rows are split across the thread
+// pool and each row is stepped eight columns at a time with AVX when the CPU has it. The
+// border rows and columns are fixed at height 0.
+//
+// Steps record where the heights actually changed, so only the normals around those places
+// are recomputed and only the changed rows are written to the vertex buffers. Still water
+// costs next to nothing beyond the step itself.
+class Waves
+{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+
+		// The simulation advances in fixed steps of timeStep seconds. It is only stable while
+		// speed * timeStep / spatialStep stays below 1 / sqrt(2).
+		Waves(uint32 rowCount, uint32 columnCount, float spatialStep, float timeStep, float speed, float damping);
+		Waves(const Waves& rhs) = delete;
+		Waves& operator=(const Waves& rhs) = delete;
+
+		uint32 GetRowCount() const;
+		uint32 GetColumnCount() const;
+		uint32 GetVertexCount() const;
+		float GetWidth() const;
+		float GetDepth() const;
+
+		// Splits the row loops across the pool. Without a pool everything runs on the caller.
+		void SetThreadPool(ThreadPool* threadPool);
+
+		// Falls back to the plain loops even if the CPU has AVX, for comparing the two
+		void SetUseAvx(bool useAvx);
+
+		// Vertex i * columnCount + j
+		DirectX::XMFLOAT3 GetPosition(uint32 index) const;
+		DirectX::XMFLOAT3 GetNormal(uint32 index) const;
+		DirectX::XMFLOAT3 GetTangentX(uint32 index) const;
+
+		// Box around the current heights
+		DirectX::BoundingBox GetBounds() const;
+
+		// Runs a step for every timeStep that passed since the last steps, then updates the
+		// normals. Returns the number of steps taken.
+		uint32 Update(float dt);
+
+		// Advances the heights by one timeStep without updating the normals
+		void Step();
+
+		// Recomputes the normals around the heights that changed since the last call
+		void UpdateNormals();
+
+		// Raises the vertex at row i, column j and, by half as much, its four neighbors.
+		// The vertex must be at least two rows and columns away from the border.
+		void Disturb(uint32 i, uint32 j, float magnitude);
+
+		// Counts the steps and disturbances, for telling how old a copy of the heights is
+		std::uint64_t GetVersion() const;
+
+		// Writes the rows whose heights changed after bufferVersion (a GetVersion() value, 0
+		// for a buffer that was never written) straight into the mapped vertex buffer, with
+		// the given color. The buffer must hold GetVertexCount() vertices. Returns the version
+		// the buffer is at afterwards.
+		std::uint64_t WriteVertices(UploadBuffer<Vertex>& vertexBuffer, const DirectX::XMFLOAT4& color, std::uint64_t bufferVersion) const;
+
+	private:
+		// Runs func(firstRow, lastRow) over the rows, on the pool when there is one
+		void ParallelForRows(uint32 firstRow, uint32 lastRow, const std::function<void(uint32, uint32)>& func) const;
+
+	private:
+		uint32 RowCount = 0;
+		uint32 ColumnCount = 0;
+
+		float SpatialStep = 0.0f;
+		float TimeStep = 0.0f;
+		float TimeSinceStep = 0.0f;
+
+		// Simulation constants derived from speed and damping
+		float K1 = 0.0f;
+		float K2 = 0.0f;
+		float K3 = 0.0f;
+
+		// Heights of the previous and current step. Stepping overwrites the previous step with
+		// the next one and swaps the two.
+		std::vector<float> PrevHeights;
+		std::vector<float> CurrHeights;
+
+		std::vector<float> NormalsX;
+		std::vector<float> NormalsY;
+		std::vector<float> NormalsZ;
+
+		// Normals to recompute in the next UpdateNormals
+		GridDirtyTiles NormalTiles;
+
+		// Columns whose height changed in the last step, per row. First > Last when none did.
+		struct ColumnSpan
+		{
+			uint32 First;
+			uint32 Last;
+		};
+		std::vector<ColumnSpan> RowChanges;
+
+		// Version at which each row's heights last changed
+		std::uint64_t Version = 1;
+		std::vector<std::uint64_t> RowVersions;
+
+		ThreadPool* Pool = nullptr;
+		bool UseAvx = false;
+};
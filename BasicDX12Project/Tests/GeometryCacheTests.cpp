@@ -0,0 +1,99 @@
+#include "TestRegistry.h"
+#include "GeometryCache.h"
+
+//=========================================================================================
+TEST(GeometryCacheKeys)
+{
+	// -0 and +0 build the same shape, so they are one key with one hash
+	GeometryKey positiveZero = GeometryKey::Grid(0.0f, 2.0f, 4, 4);
+	GeometryKey negativeZero = GeometryKey::Grid(-0.0f, 2.0f, 4, 4);
+	CHECK(positiveZero == negativeZero);
+	CHECK(GeometryKeyHash()(positiveZero) == GeometryKeyHash()(negativeZero));
+
+	GeometryKey blackColor = GeometryKey::Box(1.0f, 1.0f, 1.0f, 1, VertexFormat::PackedColor, DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+	GeometryKey negativeBlackColor = GeometryKey::Box(1.0f, 1.0f, 1.0f, 1, VertexFormat::PackedColor, DirectX::XMFLOAT4(-0.0f, -0.0f, -0.0f, 1.0f));
+	CHECK(blackColor == negativeBlackColor);
+	CHECK(GeometryKeyHash()(blackColor) == GeometryKeyHash()(negativeBlackColor));
+
+	// Every parameter, the shape and the encoding tell keys apart
+	GeometryKey box = GeometryKey::Box(1.0f, 2.0f, 3.0f, 2);
+	CHECK(box == GeometryKey::Box(1.0f, 2.0f, 3.0f, 2));
+	CHECK(!(box == GeometryKey::Box(1.0f, 2.0f, 3.5f, 2)));
+	CHECK(!(box == GeometryKey::Box(1.0f, 2.0f, 3.0f, 3)));
+	CHECK(!(box == GeometryKey::Box(1.0f, 2.0f, 3.0f, 2, VertexFormat::QuantizedPosition)));
+	CHECK(!(box == GeometryKey::Box(1.0f, 2.0f, 3.0f, 2, VertexFormat::FullPrecision, DirectX::XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f))));
+	CHECK(!(GeometryKey::Sphere(1.0f, 8, 8) == GeometryKey::Geosphere(1.0f, 8)));
+
+	// All encodings of a shape share its mesh key
+	CHECK(box.GetMeshKey() == GeometryKey::Box(1.0f, 2.0f, 3.0f, 2, VertexFormat::PackedColor, DirectX::XMFLOAT4(1.0f, 0.0f, 0.0f, 1.0f)).GetMeshKey());
+}
+
+//=========================================================================================
+TEST(GeometryCacheHitsAndMisses)
+{
+	GeometryCache cache;
+	cache.SetPositionOnly(true);
+
+	std::shared_ptr<const CachedGeometry> sphere = cache.GetSphere(1.0f, 12, 8);
+	std::shared_ptr<const CachedGeometry> sphereAgain = cache.GetSphere(1.0f, 12, 8);
+	CHECK(sphere == sphereAgain);
+
+	// Another encoding of the same shape misses, but reuses the generated mesh
+	std::shared_ptr<const CachedGeometry> quantizedSphere = cache.GetSphere(1.0f, 12, 8, VertexFormat::QuantizedPosition);
+	CHECK(quantizedSphere != sphere);
+	CHECK(quantizedSphere->Mesh == sphere->Mesh);
+
+	// -0 finds the entry +0 made
+	std::shared_ptr<const CachedGeometry> grid = cache.GetGrid(4.0f, 0.0f, 3, 3);
+	CHECK(cache.GetGrid(4.0f, -0.0f, 3, 3) == grid);
+
+	GeometryCacheStats stats = cache.GetStats();
+	CHECK(stats.Hits == 2);
+	CHECK(stats.Misses == 3);
+	CHECK(stats.MeshesGenerated == 2);
+	CHECK(stats.EntryCount == 3);
+	CHECK(stats.MeshCount == 2);
+
+	cache.Clear();
+	CHECK(cache.GetSphere(1.0f, 12, 8) != sphere);
+	CHECK(cache.GetStats().MeshesGenerated == 3);
+}
+
+//=========================================================================================
+TEST(GeometryCacheSubmeshes)
+{
+	GeometryCache cache;
+	GeometryKey box = GeometryKey::Box(1.0f, 1.0f, 1.0f, 2);
+	GeometryKey sphere = GeometryKey::Sphere(1.0f, 12, 8);
+
+	MeshGeometry geometry;
+	MeshGeometry otherGeometry;
+	MeshGeometry* found = nullptr;
+	SubmeshGeometry submesh;
+	CHECK(!cache.FindSubmesh(box, &found, &submesh));
+
+	SubmeshGeometry boxSubmesh;
+	boxSubmesh.IndexCount = 36;
+	boxSubmesh.StartIndexLocation = 12;
+	boxSubmesh.BaseVertexLocation = 5;
+	cache.RegisterSubmesh(box, &geometry, boxSubmesh);
+	cache.RegisterSubmesh(sphere, &otherGeometry, SubmeshGeometry());
+
+	CHECK(cache.FindSubmesh(box, &found, &submesh));
+	CHECK(found == &geometry);
+	CHECK(submesh.IndexCount == 36 && submesh.StartIndexLocation == 12 && submesh.BaseVertexLocation == 5);
+
+	// Submeshes are per key, another encoding of the shape was uploaded separately
+	CHECK(!cache.FindSubmesh(GeometryKey::Box(1.0f, 1.0f, 1.0f, 2, VertexFormat::PackedColor), &found, &submesh));
+
+	GeometryCacheStats stats = cache.GetStats();
+	CHECK(stats.SubmeshHits == 1);
+	CHECK(stats.SubmeshCount == 2);
+
+	// Releasing a geometry forgets only its own submeshes
+	cache.UnregisterGeometry(&geometry);
+	CHECK(!cache.FindSubmesh(box, &found, &submesh));
+	CHECK(cache.FindSubmesh(sphere, &found, &submesh));
+	CHECK(found == &otherGeometry);
+	CHECK(cache.GetStats().SubmeshHits == 2);
+}
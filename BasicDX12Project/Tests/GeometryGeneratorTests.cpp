@@ -0,0 +1,185 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "MeshletBuilder.h"
+#include "ThreadPool.h"
+#include "VertexCompression.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	std::vector<GeometryGenerator::MeshData> CreateShapes(GeometryGenerator& geoGen)
+	{
+		return
+		{
+			geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3),
+			geoGen.CreateGrid(20.0f, 30.0f, 60, 40),
+			geoGen.CreateSphere(0.5f, 20, 20),
+			geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20),
+			geoGen.CreateGeosphere(0.5f, 3)
+		};
+	}
+
+	bool HasSameVertices(const std::vector<GeometryGenerator::Vertex>& a, const std::vector<GeometryGenerator::Vertex>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(GeometryGenerator::Vertex)) == 0;
+	}
+
+	// Shapes big enough that ForEachRow hands their rows to the pool
+	std::vector<GeometryGenerator::MeshData> CreateLargeShapes(GeometryGenerator& geoGen)
+	{
+		return
+		{
+			geoGen.CreateGrid(20.0f, 30.0f, 300, 257),
+			geoGen.CreateSphere(0.5f, 301, 200),
+			geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 257, 300),
+			geoGen.CreateGeosphere(0.5f, 6)
+		};
+	}
+
+	bool HasSameMeshlets(const MeshletData& a, const MeshletData& b)
+	{
+		if (a.Meshlets.size() != b.Meshlets.size() || a.VertexIndices != b.VertexIndices || a.TriangleIndices != b.TriangleIndices)
+		{
+			return false;
+		}
+		return std::memcmp(a.Meshlets.data(), b.Meshlets.data(), a.Meshlets.size() * sizeof(Meshlet)) == 0 &&
+			std::memcmp(a.Bounds.data(), b.Bounds.data(), a.Bounds.size() * sizeof(MeshletBounds)) == 0;
+	}
+}
+
+//=========================================================================================
+TEST(MeshDataSoARoundTrip)
+{
+	GeometryGenerator geoGen;
+	for (const GeometryGenerator::MeshData& meshData : CreateShapes(geoGen))
+	{
+		// Every stream survives the split and the interleave bit for bit
+		GeometryGenerator::MeshDataSoA soa = GeometryGenerator::MeshDataSoA::FromMeshData(meshData);
+		CHECK(soa.VertexCount() == meshData.Vertices.size());
+		CHECK(soa.GetStreams() == GeometryGenerator::StreamAll);
+		CHECK(soa.Indices32 == meshData.Indices32);
+
+		GeometryGenerator::MeshData roundTrip = soa.ToMeshData();
+		CHECK(HasSameVertices(roundTrip.Vertices, meshData.Vertices));
+		CHECK(roundTrip.Indices32 == meshData.Indices32);
+
+		// Streams that were left out come back zero, the others unchanged
+		GeometryGenerator::MeshDataSoA positionsOnly = GeometryGenerator::MeshDataSoA::FromMeshData(meshData, GeometryGenerator::StreamPosition);
+		CHECK(positionsOnly.GetStreams() == GeometryGenerator::StreamPosition);
+		CHECK(positionsOnly.Normals.empty() && positionsOnly.TangentUs.empty() && positionsOnly.TexCs.empty());
+
+		GeometryGenerator::MeshData positionRoundTrip = positionsOnly.ToMeshData();
+		bool hasPositionsOnly = positionRoundTrip.Vertices.size() == meshData.Vertices.size();
+		for (size_t i = 0; hasPositionsOnly && i < meshData.Vertices.size(); ++i)
+		{
+			GeometryGenerator::Vertex expected(meshData.Vertices[i].Position, DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f),
+				DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f), DirectX::XMFLOAT2(0.0f, 0.0f));
+			hasPositionsOnly = std::memcmp(&positionRoundTrip.Vertices[i], &expected, sizeof(expected)) == 0;
+		}
+		CHECK(hasPositionsOnly);
+	}
+}
+
+//=========================================================================================
+TEST(MeshDataSoAPositionStreamConsumers)
+{
+	// The meshlets and the color vertex encodings only read positions, so the packed stream
+	// must give exactly what the interleaved vertices give
+	GeometryGenerator geoGen;
+	const DirectX::XMFLOAT4 color(0.25f, 0.5f, 0.75f, 1.0f);
+	for (const GeometryGenerator::MeshData& meshData : CreateShapes(geoGen))
+	{
+		GeometryGenerator::MeshDataSoA soa = GeometryGenerator::MeshDataSoA::FromMeshData(meshData, GeometryGenerator::StreamPosition);
+		CHECK(HasSameMeshlets(MeshletBuilder::Build(meshData), MeshletBuilder::Build(soa)));
+
+		DirectX::BoundingBox bounds;
+		DirectX::BoundingBox::CreateFromPoints(bounds, soa.Positions.size(), soa.Positions.data(), sizeof(DirectX::XMFLOAT3));
+		for (VertexFormat format : { VertexFormat::FullPrecision, VertexFormat::PackedColor, VertexFormat::QuantizedPosition })
+		{
+			size_t byteSize = meshData.Vertices.size() * VertexCompression::GetVertexStride(format);
+			std::vector<BYTE> fromVertices(byteSize);
+			std::vector<BYTE> fromStream(byteSize);
+			VertexCompression::EncodeColorVertices(format, meshData.Vertices, color, bounds, fromVertices.data());
+			VertexCompression::EncodeColorPositions(format, soa.Positions.data(), soa.VertexCount(), sizeof(DirectX::XMFLOAT3), color, bounds, fromStream.data());
+			CHECK(fromVertices == fromStream);
+		}
+	}
+}
+
+//=========================================================================================
+TEST(GeometryGeneratorPooledMatchesSerial)
+{
+	GeometryGenerator serialGen;
+	std::vector<GeometryGenerator::MeshData> serial = CreateLargeShapes(serialGen);
+
+	for (unsigned int threadCount : { 2u, 3u, 4u })
+	{
+		ThreadPool threadPool(threadCount);
+		GeometryGenerator pooledGen;
+		pooledGen.SetThreadPool(&threadPool);
+		std::vector<GeometryGenerator::MeshData> pooled = CreateLargeShapes(pooledGen);
+
+		CHECK(pooled.size() == serial.size());
+		for (size_t i = 0; i < serial.size() && i < pooled.size(); ++i)
+		{
+			CHECK(HasSameVertices(pooled[i].Vertices, serial[i].Vertices));
+			CHECK(pooled[i].Indices32 == serial[i].Indices32);
+		}
+
+		// The position only path splits the same way
+		GeometryGenerator::MeshData serialPositions = serialGen.CreateSphere<GeometryGenerator::StreamPosition>(0.5f, 301, 200);
+		GeometryGenerator::MeshData pooledPositions = pooledGen.CreateSphere<GeometryGenerator::StreamPosition>(0.5f, 301, 200);
+		CHECK(HasSameVertices(pooledPositions.Vertices, serialPositions.Vertices));
+		CHECK(pooledPositions.Indices32 == serialPositions.Indices32);
+	}
+}
+
+//=========================================================================================
+BENCHMARK(GeometryGeneratorScalingBenchmark)
+{
+	// Milliseconds per shape for growing pools, against the generator without one
+	const unsigned int kThreadCounts[] = { 1, 2, 4, 8 };
+	const int kRuns = 10;
+
+	double serialMs[4] = {};
+	for (unsigned int threadCount : kThreadCounts)
+	{
+		ThreadPool threadPool(threadCount);
+		GeometryGenerator geoGen;
+		geoGen.SetThreadPool(threadCount > 1 ? &threadPool : nullptr);
+
+		const char* names[] = { "grid 1024x1024", "sphere 1024x512", "cylinder 1024x512", "geosphere 8" };
+		double ms[4] = {};
+		size_t vertexCount = 0;
+		for (int run = 0; run < kRuns; ++run)
+		{
+			BenchmarkTimer gridTimer;
+			vertexCount += geoGen.CreateGrid(100.0f, 100.0f, 1024, 1024).Vertices.size();
+			ms[0] += gridTimer.GetMilliseconds();
+
+			BenchmarkTimer sphereTimer;
+			vertexCount += geoGen.CreateSphere(1.0f, 1024, 512).Vertices.size();
+			ms[1] += sphereTimer.GetMilliseconds();
+
+			BenchmarkTimer cylinderTimer;
+			vertexCount += geoGen.CreateCylinder(1.0f, 0.5f, 3.0f, 1024, 512).Vertices.size();
+			ms[2] += cylinderTimer.GetMilliseconds();
+
+			BenchmarkTimer geosphereTimer;
+			vertexCount += geoGen.CreateGeosphere(1.0f, 8).Vertices.size();
+			ms[3] += geosphereTimer.GetMilliseconds();
+		}
+
+		for (int i = 0; i < 4; ++i)
+		{
+			ms[i] /= kRuns;
+			if (threadCount == 1)
+			{
+				serialMs[i] = ms[i];
+			}
+			std::printf("  %u threads, %s: %.2f ms, %.2fx\n", threadCount, names[i], ms[i], serialMs[i] / ms[i]);
+		}
+		std::printf("  (%zu vertices per run)\n", vertexCount / kRuns);
+	}
+}
@@ -0,0 +1,332 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace DirectX;
+using uint32 = GeometryGenerator::uint32;
+using uint64 = GeometryGenerator::uint64;
+
+namespace
+{
+	// CreateGeosphere as it was before it went four vertices at a time: every midpoint
+	// interpolates and normalizes all attributes, then each vertex is projected on its own
+	// with the trigonometric functions. Kept as the reference for accuracy and speed.
+	GeometryGenerator::Vertex ScalarMidPoint(const GeometryGenerator::Vertex& v0, const GeometryGenerator::Vertex& v1)
+	{
+		GeometryGenerator::Vertex v;
+		XMStoreFloat3(&v.Position, 0.5f * (XMLoadFloat3(&v0.Position) + XMLoadFloat3(&v1.Position)));
+		XMStoreFloat3(&v.Normal, XMVector3Normalize(0.5f * (XMLoadFloat3(&v0.Normal) + XMLoadFloat3(&v1.Normal))));
+		XMStoreFloat3(&v.TangentU, XMVector3Normalize(0.5f * (XMLoadFloat3(&v0.TangentU) + XMLoadFloat3(&v1.TangentU))));
+		XMStoreFloat2(&v.TexC, 0.5f * (XMLoadFloat2(&v0.TexC) + XMLoadFloat2(&v1.TexC)));
+		return v;
+	}
+
+	void ScalarSubdivide(GeometryGenerator::MeshData& meshData)
+	{
+		struct EdgeSlot
+		{
+			uint64 Key;
+			uint32 MidPoint;
+		};
+		const uint64 kEmptySlot = ~0ull;
+
+		uint32 triangleCount = (uint32)meshData.Indices32.size() / 3;
+		size_t maxEdges = (size_t)triangleCount * 3;
+		size_t tableSize = 1;
+		while (tableSize < maxEdges + maxEdges / 4)
+		{
+			tableSize <<= 1;
+		}
+		std::vector<EdgeSlot> midPoints(tableSize, EdgeSlot{ kEmptySlot, 0 });
+		meshData.Vertices.reserve(meshData.Vertices.size() + (size_t)triangleCount * 3 / 2);
+
+		auto getMidPoint = [&](uint32 a, uint32 b)
+		{
+			uint64 key = a < b ? ((uint64)a << 32) | b : ((uint64)b << 32) | a;
+			size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (tableSize - 1);
+			while (midPoints[slot].Key != kEmptySlot)
+			{
+				if (midPoints[slot].Key == key)
+				{
+					return midPoints[slot].MidPoint;
+				}
+				slot = (slot + 1) & (tableSize - 1);
+			}
+
+			uint32 index = (uint32)meshData.Vertices.size();
+			meshData.Vertices.push_back(ScalarMidPoint(meshData.Vertices[a], meshData.Vertices[b]));
+			midPoints[slot] = EdgeSlot{ key, index };
+			return index;
+		};
+
+		// Backwards, so triangle i can be rewritten in place to [4i, 4i + 4)
+		meshData.Indices32.resize((size_t)triangleCount * 12);
+		for (uint32 i = triangleCount; i-- > 0;)
+		{
+			uint32 v0 = meshData.Indices32[i * 3 + 0];
+			uint32 v1 = meshData.Indices32[i * 3 + 1];
+			uint32 v2 = meshData.Indices32[i * 3 + 2];
+
+			uint32 m0 = getMidPoint(v0, v1);
+			uint32 m1 = getMidPoint(v1, v2);
+			uint32 m2 = getMidPoint(v0, v2);
+
+			uint32* triangles = &meshData.Indices32[(size_t)i * 12];
+			triangles[0] = v0; triangles[1] = m0; triangles[2] = m2;
+			triangles[3] = m0; triangles[4] = m1; triangles[5] = m2;
+			triangles[6] = m2; triangles[7] = m1; triangles[8] = v2;
+			triangles[9] = m0; triangles[10] = v1; triangles[11] = m1;
+		}
+	}
+
+	// Subdivide as the book wrote it: the mesh is copied, and every triangle emits its three
+	// corners and three midpoints as six unshared vertices. The reference for the vertex
+	// counts and memory of the shared-midpoint subdivision.
+	void CopySubdivide(GeometryGenerator::MeshData& meshData)
+	{
+		GeometryGenerator::MeshData inputCopy = meshData;
+		meshData.Vertices.resize(0);
+		meshData.Indices32.resize(0);
+
+		uint32 triangleCount = (uint32)inputCopy.Indices32.size() / 3;
+		for (uint32 i = 0; i < triangleCount; ++i)
+		{
+			const GeometryGenerator::Vertex& v0 = inputCopy.Vertices[inputCopy.Indices32[i * 3 + 0]];
+			const GeometryGenerator::Vertex& v1 = inputCopy.Vertices[inputCopy.Indices32[i * 3 + 1]];
+			const GeometryGenerator::Vertex& v2 = inputCopy.Vertices[inputCopy.Indices32[i * 3 + 2]];
+
+			meshData.Vertices.push_back(v0);
+			meshData.Vertices.push_back(v1);
+			meshData.Vertices.push_back(v2);
+			meshData.Vertices.push_back(ScalarMidPoint(v0, v1));
+			meshData.Vertices.push_back(ScalarMidPoint(v1, v2));
+			meshData.Vertices.push_back(ScalarMidPoint(v0, v2));
+
+			const uint32 kTriangles[12] = { 0, 3, 5,  3, 4, 5,  5, 4, 2,  3, 1, 4 };
+			for (uint32 k : kTriangles)
+			{
+				meshData.Indices32.push_back(i * 6 + k);
+			}
+		}
+	}
+
+	GeometryGenerator::MeshData CreateScalarGeosphere(float radius, uint32 numSubdivisions,
+		void (*subdivide)(GeometryGenerator::MeshData&) = ScalarSubdivide)
+	{
+		const float X = 0.525731f;
+		const float Z = 0.850651f;
+		const XMFLOAT3 kPositions[12] =
+		{
+			XMFLOAT3(-X, 0.0f, Z), XMFLOAT3(X, 0.0f, Z),
+			XMFLOAT3(-X, 0.0f, -Z), XMFLOAT3(X, 0.0f, -Z),
+			XMFLOAT3(0.0f, Z, X), XMFLOAT3(0.0f, Z, -X),
+			XMFLOAT3(0.0f, -Z, X), XMFLOAT3(0.0f, -Z, -X),
+			XMFLOAT3(Z, X, 0.0f), XMFLOAT3(-Z, X, 0.0f),
+			XMFLOAT3(Z, -X, 0.0f), XMFLOAT3(-Z, -X, 0.0f)
+		};
+		const uint32 kIndices[60] =
+		{
+			1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,
+			1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,
+			3,10,7, 10,6,7, 6,11,7, 6,0,11, 6,1,0,
+			10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7
+		};
+
+		GeometryGenerator::MeshData meshData;
+		meshData.Vertices.resize(12);
+		meshData.Indices32.assign(kIndices, kIndices + 60);
+		for (uint32 i = 0; i < 12; ++i)
+		{
+			meshData.Vertices[i].Position = kPositions[i];
+		}
+
+		for (uint32 i = 0; i < numSubdivisions; ++i)
+		{
+			subdivide(meshData);
+		}
+
+		for (GeometryGenerator::Vertex& v : meshData.Vertices)
+		{
+			XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&v.Position));
+			XMStoreFloat3(&v.Position, radius * n);
+			XMStoreFloat3(&v.Normal, n);
+
+			float theta = atan2f(v.Position.z, v.Position.x);
+			if (theta < 0.0f)
+			{
+				theta += XM_2PI;
+			}
+			float phi = acosf(v.Position.y / radius);
+			v.TexC = XMFLOAT2(theta / XM_2PI, phi / XM_PI);
+
+			XMVECTOR tangent = XMVectorSet(-radius * sinf(phi) * sinf(theta), 0.0f, radius * sinf(phi) * cosf(theta), 0.0f);
+			XMStoreFloat3(&v.TangentU, XMVector3Normalize(tangent));
+		}
+
+		return meshData;
+	}
+
+	// The book's CreateBox: the 24 corner vertices of the unsubdivided box, then CopySubdivide
+	GeometryGenerator::MeshData CreateCopyBox(GeometryGenerator& geoGen, float width, float height, float depth, uint32 numSubdivisions)
+	{
+		GeometryGenerator::MeshData meshData = geoGen.CreateBox(width, height, depth, 0);
+		for (uint32 i = 0; i < numSubdivisions; ++i)
+		{
+			CopySubdivide(meshData);
+		}
+		return meshData;
+	}
+
+	double GetMegabytes(const GeometryGenerator::MeshData& meshData)
+	{
+		size_t byteSize = meshData.Vertices.size() * sizeof(GeometryGenerator::Vertex) + meshData.Indices32.size() * sizeof(uint32);
+		return byteSize / (1024.0 * 1024.0);
+	}
+
+	float GetMaxError(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return std::max<float>(fabsf(a.x - b.x), std::max<float>(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+	}
+}
+
+//=========================================================================================
+TEST(GeosphereMatchesScalarPath)
+{
+	GeometryGenerator geoGen;
+	for (uint32 subdivisions = 0; subdivisions <= 5; ++subdivisions)
+	{
+		GeometryGenerator::MeshData simd = geoGen.CreateGeosphere(2.0f, subdivisions);
+		GeometryGenerator::MeshData scalar = CreateScalarGeosphere(2.0f, subdivisions);
+
+		CHECK(simd.Indices32 == scalar.Indices32);
+		CHECK(simd.Vertices.size() == scalar.Vertices.size());
+		if (simd.Vertices.size() != scalar.Vertices.size())
+		{
+			continue;
+		}
+
+		float positionError = 0.0f;
+		float normalError = 0.0f;
+		float tangentError = 0.0f;
+		float texCError = 0.0f;
+		for (size_t i = 0; i < simd.Vertices.size(); ++i)
+		{
+			const GeometryGenerator::Vertex& a = simd.Vertices[i];
+			const GeometryGenerator::Vertex& b = scalar.Vertices[i];
+			positionError = std::max<float>(positionError, GetMaxError(a.Position, b.Position));
+			normalError = std::max<float>(normalError, GetMaxError(a.Normal, b.Normal));
+			texCError = std::max<float>(texCError, std::max<float>(fabsf(a.TexC.x - b.TexC.x), fabsf(a.TexC.y - b.TexC.y)));
+
+			// The scalar path has no consistent tangent at the poles
+			if (b.Position.x != 0.0f || b.Position.z != 0.0f)
+			{
+				tangentError = std::max<float>(tangentError, GetMaxError(a.TangentU, b.TangentU));
+			}
+		}
+
+		// Within a few float ulps, and no vertex jumps across the u seam
+		CHECK(positionError <= 1e-6f);
+		CHECK(normalError <= 1e-6f);
+		CHECK(tangentError <= 1e-6f);
+		CHECK(texCError <= 1e-6f);
+	}
+}
+
+//=========================================================================================
+BENCHMARK(GeosphereBenchmark)
+{
+	GeometryGenerator geoGen;
+	ThreadPool threadPool;
+
+	for (int usePool = 0; usePool < 2; ++usePool)
+	{
+		geoGen.SetThreadPool(usePool ? &threadPool : nullptr);
+		for (uint32 subdivisions : { 5u, 7u })
+		{
+			int runs = subdivisions == 5 ? 200 : 10;
+			size_t vertexCount = 0;
+
+			BenchmarkTimer scalarTimer;
+			for (int run = 0; run < runs; ++run)
+			{
+				vertexCount += CreateScalarGeosphere(1.0f, subdivisions).Vertices.size();
+			}
+			double scalarMs = scalarTimer.GetMilliseconds() / runs;
+
+			BenchmarkTimer simdTimer;
+			for (int run = 0; run < runs; ++run)
+			{
+				vertexCount += geoGen.CreateGeosphere(1.0f, subdivisions).Vertices.size();
+			}
+			double simdMs = simdTimer.GetMilliseconds() / runs;
+
+			BenchmarkTimer positionTimer;
+			for (int run = 0; run < runs; ++run)
+			{
+				vertexCount += geoGen.CreateGeosphere<GeometryGenerator::StreamPosition>(1.0f, subdivisions).Vertices.size();
+			}
+			double positionMs = positionTimer.GetMilliseconds() / runs;
+
+			std::printf("  %s, %u subdivisions: scalar %.3f ms, SIMD %.3f ms, SIMD position only %.3f ms (%zu vertices)\n",
+				usePool ? "pool" : "serial", subdivisions, scalarMs, simdMs, positionMs, vertexCount / (3 * runs));
+		}
+	}
+}
+
+//=========================================================================================
+BENCHMARK(SubdivisionBenchmark)
+{
+	// The book's copying subdivision against the shared-midpoint one, per level: vertex
+	// count, vertex and index megabytes, and milliseconds
+	GeometryGenerator geoGen;
+	for (uint32 subdivisions = 4; subdivisions <= 8; ++subdivisions)
+	{
+		int runs = subdivisions <= 6 ? 20 : 2;
+		GeometryGenerator::MeshData copied;
+		GeometryGenerator::MeshData shared;
+
+		BenchmarkTimer copyTimer;
+		for (int run = 0; run < runs; ++run)
+		{
+			copied = CreateScalarGeosphere(1.0f, subdivisions, CopySubdivide);
+		}
+		double copyMs = copyTimer.GetMilliseconds() / runs;
+
+		BenchmarkTimer sharedTimer;
+		for (int run = 0; run < runs; ++run)
+		{
+			shared = geoGen.CreateGeosphere(1.0f, subdivisions);
+		}
+		double sharedMs = sharedTimer.GetMilliseconds() / runs;
+
+		std::printf("  geosphere level %u: copy %zu vertices / %.1f MB / %.2f ms, shared %zu vertices / %.1f MB / %.2f ms\n",
+			subdivisions, copied.Vertices.size(), GetMegabytes(copied), copyMs, shared.Vertices.size(), GetMegabytes(shared), sharedMs);
+	}
+
+	for (uint32 subdivisions = 4; subdivisions <= 8; ++subdivisions)
+	{
+		int runs = subdivisions <= 6 ? 20 : 2;
+		GeometryGenerator::MeshData copied;
+		GeometryGenerator::MeshData shared;
+
+		BenchmarkTimer copyTimer;
+		for (int run = 0; run < runs; ++run)
+		{
+			copied = CreateCopyBox(geoGen, 1.0f, 1.0f, 1.0f, subdivisions);
+		}
+		double copyMs = copyTimer.GetMilliseconds() / runs;
+
+		BenchmarkTimer sharedTimer;
+		for (int run = 0; run < runs; ++run)
+		{
+			shared = geoGen.CreateBox(1.0f, 1.0f, 1.0f, subdivisions);
+		}
+		double sharedMs = sharedTimer.GetMilliseconds() / runs;
+
+		std::printf("  box level %u: copy %zu vertices / %.1f MB / %.2f ms, shared %zu vertices / %.1f MB / %.2f ms\n",
+			subdivisions, copied.Vertices.size(), GetMegabytes(copied), copyMs, shared.Vertices.size(), GetMegabytes(shared), sharedMs);
+	}
+}
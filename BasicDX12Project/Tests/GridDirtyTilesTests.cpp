@@ -0,0 +1,120 @@
+#include "TestRegistry.h"
+#include "GridDirtyTiles.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+using uint32 = GridDirtyTiles::uint32;
+
+namespace
+{
+	bool HasSameVertices(const GeometryGenerator::MeshData& a, const GeometryGenerator::MeshData& b)
+	{
+		return a.Vertices.size() == b.Vertices.size() &&
+			std::memcmp(a.Vertices.data(), b.Vertices.data(), a.Vertices.size() * sizeof(GeometryGenerator::Vertex)) == 0;
+	}
+
+	// Recomputes every frame of the grid from scratch
+	void UpdateAllFrames(GeometryGenerator::MeshData& grid, uint32 rowCount, uint32 columnCount)
+	{
+		GridDirtyTiles tiles(rowCount, columnCount);
+		tiles.MarkAll();
+		tiles.UpdateFrames(grid);
+	}
+}
+
+//=========================================================================================
+TEST(GridDirtyTilesMarking)
+{
+	// 3 x 4 tiles, the last row and column of tiles only partly covered
+	GridDirtyTiles tiles(70, 100);
+	CHECK(tiles.GetTileCount() == 12);
+
+	uint32 firstRow, lastRow, firstColumn, lastColumn;
+	tiles.GetTileRect(11, firstRow, lastRow, firstColumn, lastColumn);
+	CHECK(firstRow == 64 && lastRow == 70 && firstColumn == 96 && lastColumn == 100);
+
+	// A vertex on a tile corner dirties the four tiles its neighbors are in, once each
+	tiles.MarkVertex(32, 64);
+	tiles.MarkVertex(32, 64);
+	std::vector<uint32> dirtyTiles = tiles.GetDirtyTiles();
+	std::sort(dirtyTiles.begin(), dirtyTiles.end());
+	CHECK(dirtyTiles == std::vector<uint32>({ 1, 2, 5, 6 }));
+
+	// Rectangles are clipped to the grid, empty ones mark nothing
+	tiles.Clear();
+	CHECK(tiles.GetDirtyTiles().empty());
+	tiles.MarkRect(65, 1000, 97, 1000);
+	tiles.MarkRect(10, 10, 0, 100);
+	tiles.MarkRect(70, 80, 0, 100);
+	CHECK(tiles.GetDirtyTiles() == std::vector<uint32>({ 11 }));
+
+	tiles.MarkAll();
+	CHECK(tiles.GetDirtyTiles().size() == tiles.GetTileCount());
+}
+
+//=========================================================================================
+TEST(GridDirtyTilesMatchFullRecompute)
+{
+	// Grid sizes that do and don't fill their last tiles, small enough to stay on the caller
+	// and big enough for the pool to take the tiles
+	const uint32 kGridSizes[][2] = { { 33, 33 }, { 70, 100 }, { 257, 300 } };
+
+	ThreadPool threadPool(4);
+	for (const uint32* size : kGridSizes)
+	{
+		uint32 rowCount = size[0];
+		uint32 columnCount = size[1];
+
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData grid = geoGen.CreateGrid(50.0f, 60.0f, rowCount, columnCount);
+		UpdateAllFrames(grid, rowCount, columnCount);
+
+		for (ThreadPool* pool : { (ThreadPool*)nullptr, &threadPool })
+		{
+			GeometryGenerator::MeshData incremental = grid;
+			GridDirtyTiles tiles(rowCount, columnCount);
+			std::mt19937 random(rowCount * columnCount);
+			std::uniform_int_distribution<uint32> row(0, rowCount - 1);
+			std::uniform_int_distribution<uint32> column(0, columnCount - 1);
+			std::uniform_real_distribution<float> height(-2.0f, 2.0f);
+
+			bool isSame = true;
+			for (int round = 0; round < 20 && isSame; ++round)
+			{
+				// Single vertices anywhere, the border and tile edges included
+				for (int k = 0; k < 10; ++k)
+				{
+					uint32 i = row(random);
+					uint32 j = column(random);
+					incremental.Vertices[(size_t)i * columnCount + j].Position.y += height(random);
+					tiles.MarkVertex(i, j);
+				}
+
+				// A raised block, which moves the frames one vertex around it as well
+				uint32 firstRow = row(random);
+				uint32 firstColumn = column(random);
+				uint32 lastRow = std::min<uint32>(firstRow + 1 + row(random) % 40, rowCount);
+				uint32 lastColumn = std::min<uint32>(firstColumn + 1 + column(random) % 40, columnCount);
+				float raise = height(random);
+				for (uint32 i = firstRow; i < lastRow; ++i)
+				{
+					for (uint32 j = firstColumn; j < lastColumn; ++j)
+					{
+						incremental.Vertices[(size_t)i * columnCount + j].Position.y += raise;
+					}
+				}
+				tiles.MarkRect(firstRow > 0 ? firstRow - 1 : 0, lastRow + 1, firstColumn > 0 ? firstColumn - 1 : 0, lastColumn + 1);
+
+				tiles.UpdateFrames(incremental, pool);
+				CHECK(tiles.GetDirtyTiles().empty());
+
+				GeometryGenerator::MeshData full = incremental;
+				UpdateAllFrames(full, rowCount, columnCount);
+				isSame = HasSameVertices(incremental, full);
+			}
+			CHECK(isSame);
+		}
+	}
+}
@@ -0,0 +1,136 @@
+#include "TestRegistry.h"
+#include "HalfEdgeMesh.h"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+
+namespace
+{
+	using uint32 = HalfEdgeMesh::uint32;
+
+	// Checks twins and one-rings of mesh, and returns its Euler characteristic
+	long CheckConnectivity(const HalfEdgeMesh& mesh)
+	{
+		uint32 boundaryHalfEdges = 0;
+		bool hasConsistentTwins = true;
+		for (uint32 halfEdge = 0; halfEdge < mesh.GetHalfEdgeCount(); ++halfEdge)
+		{
+			if (mesh.IsBoundary(halfEdge))
+			{
+				++boundaryHalfEdges;
+				continue;
+			}
+
+			uint32 twin = mesh.GetTwin(halfEdge);
+			hasConsistentTwins = hasConsistentTwins && mesh.GetTwin(twin) == halfEdge && mesh.GetOrigin(twin) == mesh.GetTarget(halfEdge);
+		}
+		CHECK(hasConsistentTwins);
+
+		// No neighbor is visited twice, and every outgoing half-edge leaves its vertex
+		bool hasSimpleRings = true;
+		for (uint32 vertex = 0; vertex < mesh.GetVertexCount(); ++vertex)
+		{
+			std::set<uint32> neighbors;
+			size_t neighborCount = 0;
+			mesh.ForEachNeighbor(vertex, [&](uint32 neighbor)
+			{
+				neighbors.insert(neighbor);
+				++neighborCount;
+			});
+			mesh.ForEachOutgoing(vertex, [&](uint32 halfEdge)
+			{
+				hasSimpleRings = hasSimpleRings && mesh.GetOrigin(halfEdge) == vertex;
+			});
+			hasSimpleRings = hasSimpleRings && neighbors.size() == neighborCount;
+		}
+		CHECK(hasSimpleRings);
+
+		size_t loopHalfEdges = 0;
+		for (const std::vector<uint32>& loop : mesh.GetBoundaryLoops())
+		{
+			loopHalfEdges += loop.size();
+		}
+		CHECK(loopHalfEdges == boundaryHalfEdges);
+
+		long edgeCount = ((long)mesh.GetHalfEdgeCount() + boundaryHalfEdges) / 2;
+		return (long)mesh.GetVertexCount() - edgeCount + (long)mesh.GetFaceCount();
+	}
+}
+
+//=========================================================================================
+TEST(HalfEdgeMeshShapes)
+{
+	// Welded, every closed shape is a sphere and the grid a disk with one border
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData closedShapes[] =
+	{
+		geoGen.CreateBox(1.0f, 2.0f, 3.0f, 2),
+		geoGen.CreateSphere(1.0f, 20, 20),
+		geoGen.CreateCylinder(1.0f, 0.5f, 2.0f, 30, 5),
+		geoGen.CreateGeosphere(1.0f, 3)
+	};
+	for (const GeometryGenerator::MeshData& meshData : closedShapes)
+	{
+		HalfEdgeMesh mesh(meshData);
+		CHECK(CheckConnectivity(mesh) == 2);
+		CHECK(mesh.GetBoundaryLoops().empty());
+		CHECK(mesh.GetNonManifoldEdgeCount() == 0);
+	}
+
+	HalfEdgeMesh grid(geoGen.CreateGrid(10.0f, 10.0f, 5, 7));
+	CHECK(CheckConnectivity(grid) == 1);
+	CHECK(grid.GetBoundaryLoops().size() == 1);
+}
+
+//=========================================================================================
+TEST(HalfEdgeMeshFlips)
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, 30, 30);
+	HalfEdgeMesh mesh(sphere);
+
+	std::mt19937 random(1);
+	int flipCount = 0;
+	for (int i = 0; i < 20000; ++i)
+	{
+		flipCount += mesh.FlipEdge(random() % mesh.GetHalfEdgeCount()) ? 1 : 0;
+	}
+	CHECK(flipCount > 10000);
+	CHECK(CheckConnectivity(mesh) == 2);
+
+	// Building from the flipped triangles gives the same connectivity
+	sphere.Indices32 = mesh.GetIndices();
+	HalfEdgeMesh rebuilt(sphere);
+	bool isSame = rebuilt.GetHalfEdgeCount() == mesh.GetHalfEdgeCount();
+	for (uint32 halfEdge = 0; isSame && halfEdge < mesh.GetHalfEdgeCount(); ++halfEdge)
+	{
+		isSame = rebuilt.GetTwin(halfEdge) == mesh.GetTwin(halfEdge) && rebuilt.GetOrigin(halfEdge) == mesh.GetOrigin(halfEdge);
+	}
+	CHECK(isSame);
+}
+
+//=========================================================================================
+BENCHMARK(HalfEdgeMeshBenchmark)
+{
+	// Build time and memory on a 1M triangle grid, best of five
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData grid = geoGen.CreateGrid(100.0f, 100.0f, 708, 708);
+	size_t triangleCount = grid.Indices32.size() / 3;
+
+	for (int weldPositions = 0; weldPositions < 2; ++weldPositions)
+	{
+		double buildMs = 1e9;
+		size_t memoryUsage = 0;
+		for (int run = 0; run < 5; ++run)
+		{
+			BenchmarkTimer timer;
+			HalfEdgeMesh mesh(grid, weldPositions != 0);
+			buildMs = std::min<double>(buildMs, timer.GetMilliseconds());
+			memoryUsage = mesh.GetMemoryUsage();
+		}
+
+		std::printf("  %zu triangles, %s: %.1f ms to build, %.1f bytes per triangle\n", triangleCount,
+			weldPositions ? "welded" : "unwelded", buildMs, (double)memoryUsage / triangleCount);
+	}
+}
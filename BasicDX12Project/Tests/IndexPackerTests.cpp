@@ -0,0 +1,225 @@
+#include "TestRegistry.h"
+#include "IndexPacker.h"
+#include "MeshFile.h"
+#include "VertexCompression.h"
+#include <cstring>
+
+namespace
+{
+	// A strip of vertexCount vertices, each triangle using three neighbors
+	std::vector<std::uint32_t> CreateStrip(std::uint32_t vertexCount)
+	{
+		std::vector<std::uint32_t> indices;
+		for (std::uint32_t v = 0; v + 2 < vertexCount; ++v)
+		{
+			indices.insert(indices.end(), { v, v + 1, v + 2 });
+		}
+		return indices;
+	}
+
+	// The vertices a submesh's draws reference, read back from the packed buffer in the
+	// submesh's format and with each chunk's base vertex. Empty if a draw reads outside of
+	// the buffer.
+	std::vector<std::uint32_t> GetDrawnVertices(const void* data, UINT byteSize, DXGI_FORMAT bufferFormat, const SubmeshGeometry& submesh)
+	{
+		DXGI_FORMAT format = submesh.IndexFormat != DXGI_FORMAT_UNKNOWN ? submesh.IndexFormat : bufferFormat;
+		size_t indexSize = format == DXGI_FORMAT_R16_UINT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+
+		std::vector<IndexChunk> draws = submesh.Chunks;
+		if (draws.empty())
+		{
+			IndexChunk draw;
+			draw.IndexCount = submesh.IndexCount;
+			draw.StartIndexLocation = submesh.StartIndexLocation;
+			draw.BaseVertexLocation = submesh.BaseVertexLocation;
+			draws.push_back(draw);
+		}
+
+		std::vector<std::uint32_t> vertices;
+		for (const IndexChunk& draw : draws)
+		{
+			if ((draw.StartIndexLocation + (size_t)draw.IndexCount) * indexSize > byteSize)
+			{
+				return {};
+			}
+			for (UINT i = draw.StartIndexLocation; i < draw.StartIndexLocation + draw.IndexCount; ++i)
+			{
+				std::uint32_t index = 0;
+				std::memcpy(&index, (const BYTE*)data + i * indexSize, indexSize);
+				vertices.push_back(draw.BaseVertexLocation + index);
+			}
+		}
+		return vertices;
+	}
+
+	std::vector<std::uint32_t> GetDrawnVertices(const IndexPacker& packer, size_t id)
+	{
+		return GetDrawnVertices(packer.GetData(), packer.GetByteSize(), packer.GetFormat(), packer.GetSubmesh(id));
+	}
+
+	std::vector<std::uint32_t> AddBase(std::vector<std::uint32_t> indices, std::uint32_t baseVertex)
+	{
+		for (std::uint32_t& index : indices)
+		{
+			index += baseVertex;
+		}
+		return indices;
+	}
+
+	// Byte range of a submesh's indices in the packed buffer
+	std::pair<size_t, size_t> GetByteRange(const SubmeshGeometry& submesh)
+	{
+		size_t indexSize = submesh.IndexFormat == DXGI_FORMAT_R32_UINT ? sizeof(std::uint32_t) : sizeof(std::uint16_t);
+		return { submesh.StartIndexLocation * indexSize, (submesh.StartIndexLocation + (size_t)submesh.IndexCount) * indexSize };
+	}
+
+	bool AreDisjoint(const SubmeshGeometry& a, const SubmeshGeometry& b)
+	{
+		std::pair<size_t, size_t> rangeA = GetByteRange(a);
+		std::pair<size_t, size_t> rangeB = GetByteRange(b);
+		return rangeA.second <= rangeB.first || rangeB.second <= rangeA.first;
+	}
+}
+
+//=========================================================================================
+TEST(IndexPackerChunkRebasing)
+{
+	// A strip over 200000 vertices needs four 16-bit chunks but is long enough to keep them
+	std::vector<std::uint32_t> small = CreateStrip(30);
+	std::vector<std::uint32_t> strip = CreateStrip(200000);
+
+	IndexPacker packer;
+	size_t smallId = packer.AddSubmesh(small, 0);
+	size_t stripId = packer.AddSubmesh(strip, 1000);
+	packer.Pack();
+
+	CHECK(packer.GetFormat() == DXGI_FORMAT_R16_UINT);
+	CHECK(packer.GetByteSize() == (small.size() + strip.size()) * sizeof(std::uint16_t));
+
+	SubmeshGeometry submesh = packer.GetSubmesh(stripId);
+	CHECK(submesh.IndexFormat == DXGI_FORMAT_R16_UINT);
+	CHECK(submesh.Chunks.size() == 4);
+
+	// The chunks tile the submesh's range in order, and each one's base vertex brings its
+	// 16-bit indices back to the original vertices
+	UINT chunkEnd = submesh.StartIndexLocation;
+	for (const IndexChunk& chunk : submesh.Chunks)
+	{
+		CHECK(chunk.StartIndexLocation == chunkEnd);
+		CHECK(chunk.BaseVertexLocation >= 1000);
+		chunkEnd += chunk.IndexCount;
+	}
+	CHECK(chunkEnd == submesh.StartIndexLocation + submesh.IndexCount);
+	CHECK(GetDrawnVertices(packer, stripId) == AddBase(strip, 1000));
+	CHECK(GetDrawnVertices(packer, smallId) == small);
+}
+
+//=========================================================================================
+TEST(IndexPackerWideTriangleFallsBackAlone)
+{
+	// One triangle reaching 70000 vertices back can't be chunked; only its submesh moves to
+	// 32-bit indices, the ones around it stay 16-bit
+	std::vector<std::uint32_t> before = CreateStrip(31);
+	std::vector<std::uint32_t> wide = CreateStrip(100);
+	wide.insert(wide.end(), { 0, 1, 70000 });
+	std::vector<std::uint32_t> after = CreateStrip(50);
+
+	IndexPacker packer;
+	size_t beforeId = packer.AddSubmesh(before, 0);
+	size_t wideId = packer.AddSubmesh(wide, 31);
+	size_t afterId = packer.AddSubmesh(after, 70031);
+	packer.Pack();
+
+	CHECK(packer.GetFormat() == DXGI_FORMAT_R16_UINT);
+	SubmeshGeometry wideSubmesh = packer.GetSubmesh(wideId);
+	CHECK(wideSubmesh.IndexFormat == DXGI_FORMAT_R32_UINT);
+	CHECK(wideSubmesh.Chunks.empty());
+	CHECK(packer.GetSubmesh(beforeId).IndexFormat == DXGI_FORMAT_R16_UINT);
+	CHECK(packer.GetSubmesh(afterId).IndexFormat == DXGI_FORMAT_R16_UINT);
+
+	// The 32-bit indices come after the 16-bit ones without overlapping them
+	CHECK(AreDisjoint(wideSubmesh, packer.GetSubmesh(beforeId)));
+	CHECK(AreDisjoint(wideSubmesh, packer.GetSubmesh(afterId)));
+	CHECK(AreDisjoint(packer.GetSubmesh(beforeId), packer.GetSubmesh(afterId)));
+	CHECK(GetByteRange(wideSubmesh).second == packer.GetByteSize());
+
+	CHECK(GetDrawnVertices(packer, beforeId) == before);
+	CHECK(GetDrawnVertices(packer, wideId) == AddBase(wide, 31));
+	CHECK(GetDrawnVertices(packer, afterId) == AddBase(after, 70031));
+}
+
+//=========================================================================================
+TEST(IndexPackerTooManyChunks)
+{
+	// Triangles alternating between two far apart vertex ranges would need a chunk each, so
+	// the submesh is undone into 32-bit indices rebased to its own base vertex
+	std::vector<std::uint32_t> scattered;
+	for (std::uint32_t k = 0; k < 100; ++k)
+	{
+		std::uint32_t v = (k % 2 ? 100000 : 0) + k;
+		scattered.insert(scattered.end(), { v, v + 1, v + 2 });
+	}
+	std::vector<std::uint32_t> strip = CreateStrip(1000);
+
+	IndexPacker packer;
+	size_t scatteredId = packer.AddSubmesh(scattered, 500);
+	size_t stripId = packer.AddSubmesh(strip, 0);
+	packer.Pack();
+
+	SubmeshGeometry scatteredSubmesh = packer.GetSubmesh(scatteredId);
+	CHECK(scatteredSubmesh.IndexFormat == DXGI_FORMAT_R32_UINT);
+	CHECK(scatteredSubmesh.Chunks.empty());
+	CHECK(scatteredSubmesh.BaseVertexLocation == 500);
+	CHECK(packer.GetSubmesh(stripId).IndexFormat == DXGI_FORMAT_R16_UINT);
+	CHECK(GetDrawnVertices(packer, scatteredId) == AddBase(scattered, 500));
+	CHECK(GetDrawnVertices(packer, stripId) == strip);
+
+	// With no 16-bit submesh left the buffer is plain 32-bit from the start
+	IndexPacker fullPacker;
+	size_t fullId = fullPacker.AddSubmesh(scattered, 500);
+	fullPacker.Pack();
+	CHECK(fullPacker.GetFormat() == DXGI_FORMAT_R32_UINT);
+	CHECK(fullPacker.GetSubmesh(fullId).StartIndexLocation == 0);
+	CHECK(fullPacker.GetByteSize() == scattered.size() * sizeof(std::uint32_t));
+	CHECK(GetDrawnVertices(fullPacker, fullId) == AddBase(scattered, 500));
+}
+
+//=========================================================================================
+TEST(IndexPackerMixedFormatsInMeshFile)
+{
+	// The per submesh formats survive a mesh file round trip and are validated
+	std::vector<std::uint32_t> strip = CreateStrip(99);
+	std::vector<std::uint32_t> wide = CreateStrip(10);
+	wide.insert(wide.end(), { 0, 1, 70000 });
+
+	IndexPacker packer;
+	size_t stripId = packer.AddSubmesh(strip, 0);
+	size_t wideId = packer.AddSubmesh(wide, 99);
+	packer.Pack();
+
+	std::vector<BYTE> vertices((99 + 70001) * VertexCompression::GetVertexStride(VertexFormat::FullPrecision), 0);
+	MeshFileWriter writer;
+	writer.SetVertices(VertexFormat::FullPrecision, vertices.data(), (UINT)vertices.size());
+	writer.SetIndices(packer.GetFormat(), packer.GetData(), packer.GetByteSize());
+	writer.AddSubmesh("strip", packer.GetSubmesh(stripId));
+	writer.AddSubmesh("wide", packer.GetSubmesh(wideId));
+	std::vector<BYTE> file = writer.Serialize(1);
+
+	MeshFileReader reader;
+	CHECK(reader.Open(file.data(), file.size(), 1));
+	if (!reader.IsOpen())
+	{
+		return;
+	}
+	std::unordered_map<std::string, SubmeshGeometry> drawArgs;
+	reader.GetDrawArgs(drawArgs);
+	CHECK(drawArgs["strip"].IndexFormat == DXGI_FORMAT_R16_UINT);
+	CHECK(drawArgs["wide"].IndexFormat == DXGI_FORMAT_R32_UINT);
+	CHECK(GetDrawnVertices(reader.GetIndexData(), reader.GetIndexBufferByteSize(), reader.GetIndexFormat(), drawArgs["wide"]) == AddBase(wide, 99));
+
+	// A submesh without a known index format is rejected before its ranges are looked at
+	const MeshFileHeader* header = reinterpret_cast<const MeshFileHeader*>(file.data());
+	MeshFileSubmesh* submeshes = reinterpret_cast<MeshFileSubmesh*>(file.data() + header->SubmeshOffset);
+	submeshes[1].IndexFormat = DXGI_FORMAT_UNKNOWN;
+	CHECK(!reader.Open(file.data(), file.size(), 1, false));
+}
@@ -0,0 +1,156 @@
+#include "TestRegistry.h"
+#include "InstanceBatcher.h"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+
+namespace
+{
+	const UINT kItemCount = 12000;
+
+	// A scene of kItemCount items over 2 geometries x 6 submeshes x 2 pipeline states,
+	// in random order
+	struct BatcherScene
+	{
+		MeshGeometry Geometries[2];
+
+		// Keys only compare the pipeline state pointers, they are never dereferenced
+		char PipelineStateTags[2];
+
+		std::vector<InstanceKey> Keys;
+		std::vector<UINT> ItemKeys;
+
+		BatcherScene()
+		{
+			for (const MeshGeometry& geometry : Geometries)
+			{
+				for (UINT submesh = 0; submesh < 6; ++submesh)
+				{
+					for (const char& tag : PipelineStateTags)
+					{
+						InstanceKey key;
+						key.Geometry = &geometry;
+						key.PipelineState = reinterpret_cast<const ID3D12PipelineState*>(&tag);
+						key.IndexCount = 36 + submesh * 6;
+						key.StartIndexLocation = submesh * 100;
+						key.BaseVertexLocation = (INT)submesh * 24;
+						Keys.push_back(key);
+					}
+				}
+			}
+
+			std::mt19937 random(11);
+			std::uniform_int_distribution<UINT> keyDistribution(0, (UINT)Keys.size() - 1);
+			for (UINT i = 0; i < kItemCount; ++i)
+			{
+				ItemKeys.push_back(keyDistribution(random));
+			}
+		}
+	};
+
+	// Checks the batches of batcher, which was given item i of scene with the key ItemKeys[i]
+	void CheckBatches(const BatcherScene& scene, const InstanceBatcher& batcher)
+	{
+		const std::vector<InstanceBatch>& batches = batcher.GetBatches();
+		const std::vector<UINT>& instances = batcher.GetInstances();
+
+		// One batch per key, numbered in the order the keys first appear
+		std::vector<UINT> keyBatches(scene.Keys.size(), UINT32_MAX);
+		std::vector<UINT> firstItems;
+		for (UINT i = 0; i < kItemCount; ++i)
+		{
+			UINT& batch = keyBatches[scene.ItemKeys[i]];
+			if (batch == UINT32_MAX)
+			{
+				batch = (UINT)firstItems.size();
+				firstItems.push_back(i);
+			}
+		}
+		CHECK(batches.size() == firstItems.size());
+		CHECK(instances.size() == kItemCount);
+		if (batches.size() != firstItems.size() || instances.size() != kItemCount)
+		{
+			return;
+		}
+
+		// The batches tile the instance list in order, each holding exactly the items of its
+		// key in their queued order
+		UINT offset = 0;
+		bool hasContiguousOffsets = true;
+		bool hasRightMembers = true;
+		for (size_t b = 0; b < batches.size(); ++b)
+		{
+			const InstanceBatch& batch = batches[b];
+			hasContiguousOffsets = hasContiguousOffsets && batch.InstanceOffset == offset;
+			offset += batch.InstanceCount;
+
+			UINT key = scene.ItemKeys[firstItems[b]];
+			CHECK(batch.Key == scene.Keys[key]);
+
+			std::vector<UINT> expected;
+			for (UINT i = 0; i < kItemCount; ++i)
+			{
+				if (scene.ItemKeys[i] == key)
+				{
+					expected.push_back(i);
+				}
+			}
+			hasRightMembers = hasRightMembers && batch.InstanceCount == expected.size() &&
+				std::equal(expected.begin(), expected.end(), instances.begin() + batch.InstanceOffset);
+		}
+		CHECK(hasContiguousOffsets);
+		CHECK(hasRightMembers);
+		CHECK(offset == kItemCount);
+	}
+}
+
+//=========================================================================================
+TEST(InstanceBatcherGroupsByKey)
+{
+	BatcherScene scene;
+	InstanceBatcher batcher;
+
+	// Reused across frames the way MyApp does
+	for (int frame = 0; frame < 2; ++frame)
+	{
+		batcher.Clear();
+		for (UINT i = 0; i < kItemCount; ++i)
+		{
+			batcher.Add(scene.Keys[scene.ItemKeys[i]], i);
+		}
+		batcher.Build();
+
+		CheckBatches(scene, batcher);
+
+		// kItemCount draws become one per key
+		CHECK(batcher.GetBatches().size() == scene.Keys.size());
+		CHECK(kItemCount / batcher.GetBatches().size() >= 500);
+	}
+}
+
+//=========================================================================================
+TEST(InstanceBatcherSortedRuns)
+{
+	// Items sorted by key take the shortcut past the hash lookup and must still group the same
+	BatcherScene scene;
+	std::stable_sort(scene.ItemKeys.begin(), scene.ItemKeys.end());
+
+	InstanceBatcher batcher;
+	for (UINT i = 0; i < kItemCount; ++i)
+	{
+		batcher.Add(scene.Keys[scene.ItemKeys[i]], i);
+	}
+	batcher.Build();
+
+	CheckBatches(scene, batcher);
+	CHECK(batcher.GetBatches().size() == scene.Keys.size());
+}
+
+//=========================================================================================
+TEST(InstanceBatcherEmpty)
+{
+	InstanceBatcher batcher;
+	batcher.Build();
+	CHECK(batcher.GetBatches().empty());
+	CHECK(batcher.GetInstances().empty());
+}
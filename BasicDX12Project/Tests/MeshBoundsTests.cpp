@@ -0,0 +1,150 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "MeshBounds.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// count positions at the given float stride, the floats between them NaN so a stray lane
+	// would show up in the result. The buffer ends right after the last position.
+	std::vector<float> CreatePositions(size_t count, size_t floatStride, std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> coordinate(-100.0f, 100.0f);
+		std::vector<float> floats(count == 0 ? 0 : (count - 1) * floatStride + 3, std::numeric_limits<float>::quiet_NaN());
+		for (size_t i = 0; i < count; ++i)
+		{
+			floats[i * floatStride] = coordinate(random) + 50.0f;
+			floats[i * floatStride + 1] = coordinate(random);
+			floats[i * floatStride + 2] = 0.25f * coordinate(random) - 10.0f;
+		}
+		return floats;
+	}
+
+	// The bounds one position at a time, with the same arithmetic as the SIMD loops
+	void ComputeScalarBounds(const std::vector<float>& floats, size_t count, size_t floatStride, BoundingBox& box, BoundingSphere& sphere)
+	{
+		box = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+		if (count > 0)
+		{
+			XMFLOAT3 minPoint(FLT_MAX, FLT_MAX, FLT_MAX);
+			XMFLOAT3 maxPoint(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (size_t i = 0; i < count; ++i)
+			{
+				const float* p = &floats[i * floatStride];
+				minPoint = XMFLOAT3(std::min<float>(minPoint.x, p[0]), std::min<float>(minPoint.y, p[1]), std::min<float>(minPoint.z, p[2]));
+				maxPoint = XMFLOAT3(std::max<float>(maxPoint.x, p[0]), std::max<float>(maxPoint.y, p[1]), std::max<float>(maxPoint.z, p[2]));
+			}
+			BoundingBox::CreateFromPoints(box, XMLoadFloat3(&minPoint), XMLoadFloat3(&maxPoint));
+		}
+
+		float maxDistanceSq = 0.0f;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const float* p = &floats[i * floatStride];
+			float dx = p[0] - box.Center.x;
+			float dy = p[1] - box.Center.y;
+			float dz = p[2] - box.Center.z;
+			maxDistanceSq = std::max<float>(maxDistanceSq, (dx * dx + dy * dy) + dz * dz);
+		}
+		sphere = BoundingSphere(box.Center, sqrtf(maxDistanceSq));
+	}
+
+	bool IsSameBox(const BoundingBox& a, const BoundingBox& b)
+	{
+		return a.Center.x == b.Center.x && a.Center.y == b.Center.y && a.Center.z == b.Center.z &&
+			a.Extents.x == b.Extents.x && a.Extents.y == b.Extents.y && a.Extents.z == b.Extents.z;
+	}
+
+	bool IsNear(const XMFLOAT3& a, const XMFLOAT3& b, float tolerance)
+	{
+		return std::fabs(a.x - b.x) <= tolerance && std::fabs(a.y - b.y) <= tolerance && std::fabs(a.z - b.z) <= tolerance;
+	}
+}
+
+//=========================================================================================
+TEST(MeshBoundsMatchScalar)
+{
+	// Tightly packed positions, XMFLOAT4s, GeometryGenerator::Vertex and an odd stride, with
+	// counts around multiples of four and one large enough to be split across the pool
+	const size_t kFloatStrides[] = { 3, 4, sizeof(GeometryGenerator::Vertex) / sizeof(float), 5 };
+	const size_t kCounts[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 13, 1001, 200003 };
+
+	ThreadPool threadPool(4);
+	std::mt19937 random(18);
+	for (size_t floatStride : kFloatStrides)
+	{
+		for (size_t count : kCounts)
+		{
+			std::vector<float> floats = CreatePositions(count, floatStride, random);
+			const XMFLOAT3* positions = reinterpret_cast<const XMFLOAT3*>(floats.data());
+			size_t stride = floatStride * sizeof(float);
+
+			BoundingBox expectedBox;
+			BoundingSphere expectedSphere;
+			ComputeScalarBounds(floats, count, floatStride, expectedBox, expectedSphere);
+
+			for (ThreadPool* pool : { (ThreadPool*)nullptr, &threadPool })
+			{
+				BoundingBox box = MeshBounds::ComputeBox(positions, count, stride, pool);
+				BoundingSphere sphere = MeshBounds::ComputeSphere(positions, count, stride, box, pool);
+				CHECK(IsSameBox(box, expectedBox));
+				CHECK(sphere.Radius == expectedSphere.Radius);
+
+				SubmeshGeometry submesh;
+				MeshBounds::ComputeSubmeshBounds(positions, count, stride, submesh, pool);
+				CHECK(IsSameBox(submesh.Bounds, expectedBox));
+				CHECK(submesh.Sphere.Radius == expectedSphere.Radius);
+			}
+		}
+	}
+}
+
+//=========================================================================================
+TEST(MeshBoundsTransformBox)
+{
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> scale(0.1f, 4.0f);
+
+	bool isAsTightAsCorners = true;
+	for (int k = 0; k < 1000; ++k)
+	{
+		BoundingBox box(XMFLOAT3(10.0f * unit(random), 10.0f * unit(random), 10.0f * unit(random)),
+			XMFLOAT3(scale(random), scale(random), scale(random)));
+
+		// Rotation, scale with some axes mirrored, and a shear now and then
+		XMVECTOR axis = XMVectorSet(unit(random), unit(random), unit(random) + 2.0f, 0.0f);
+		XMMATRIX transform = XMMatrixScaling(scale(random) * (k % 2 ? -1.0f : 1.0f), scale(random), scale(random) * (k % 3 ? 1.0f : -1.0f)) *
+			XMMatrixRotationAxis(axis, 3.14159265f * unit(random)) *
+			XMMatrixTranslation(50.0f * unit(random), 50.0f * unit(random), 50.0f * unit(random));
+		if (k % 5 == 0)
+		{
+			XMMATRIX shear = XMMatrixIdentity();
+			shear.r[1] = XMVectorSet(unit(random), 1.0f, unit(random), 0.0f);
+			transform = shear * transform;
+		}
+
+		// The box around the eight transformed corners
+		XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+		for (size_t c = 0; c < BoundingBox::CORNER_COUNT; ++c)
+		{
+			XMVECTOR sign = XMVectorSet(c & 1 ? 1.0f : -1.0f, c & 2 ? 1.0f : -1.0f, c & 4 ? 1.0f : -1.0f, 0.0f);
+			XMVECTOR corner = XMVectorMultiplyAdd(sign, XMLoadFloat3(&box.Extents), XMLoadFloat3(&box.Center));
+			XMStoreFloat3(&corners[c], XMVector3Transform(corner, transform));
+		}
+		BoundingBox expected;
+		BoundingBox::CreateFromPoints(expected, BoundingBox::CORNER_COUNT, corners, sizeof(XMFLOAT3));
+
+		BoundingBox result;
+		MeshBounds::TransformBox(box, transform, result);
+		isAsTightAsCorners = isAsTightAsCorners && IsNear(result.Center, expected.Center, 1e-3f) && IsNear(result.Extents, expected.Extents, 1e-3f);
+	}
+	CHECK(isAsTightAsCorners);
+}
@@ -0,0 +1,130 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// Decoded triangles keep their winding but may be rotated to start at another corner
+	bool HasSameTriangles(const GeometryGenerator::MeshData& expected, const GeometryGenerator::MeshData& decoded)
+	{
+		if (expected.Indices32.size() != decoded.Indices32.size())
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < expected.Indices32.size(); i += 3)
+		{
+			const GeometryGenerator::uint32* a = &expected.Indices32[i];
+			const GeometryGenerator::uint32* b = &decoded.Indices32[i];
+			bool isSame = false;
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				isSame = isSame || (a[corner] == b[0] && a[(corner + 1) % 3] == b[1] && a[(corner + 2) % 3] == b[2]);
+			}
+			if (!isSame)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+//=========================================================================================
+TEST(MeshCodecRoundTrip)
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData shapes[] =
+	{
+		geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3),
+		geoGen.CreateGrid(20.0f, 30.0f, 60, 40),
+		geoGen.CreateSphere(0.5f, 20, 20),
+		geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20),
+		geoGen.CreateGeosphere(0.5f, 5)
+	};
+
+	for (GeometryGenerator::MeshData& meshData : shapes)
+	{
+		MeshOptimizer::Optimize(meshData);
+		std::vector<std::uint8_t> encoded = MeshCodec::Encode(meshData);
+
+		// Lossless, and smaller than the raw buffers
+		GeometryGenerator::MeshData decoded;
+		std::string error;
+		CHECK(MeshCodec::Decode(encoded.data(), encoded.size(), decoded, &error));
+		CHECK(decoded.Vertices.size() == meshData.Vertices.size());
+		CHECK(std::memcmp(decoded.Vertices.data(), meshData.Vertices.data(), meshData.Vertices.size() * sizeof(GeometryGenerator::Vertex)) == 0);
+		CHECK(HasSameTriangles(meshData, decoded));
+		CHECK(encoded.size() < meshData.Vertices.size() * sizeof(GeometryGenerator::Vertex) + meshData.Indices32.size() * sizeof(GeometryGenerator::uint32));
+
+		// Truncated data is rejected instead of read past
+		for (size_t byteSize = 0; byteSize < encoded.size(); byteSize += 13)
+		{
+			CHECK(!MeshCodec::Decode(encoded.data(), byteSize, decoded));
+		}
+	}
+}
+
+//=========================================================================================
+BENCHMARK(MeshCodecDecodeBenchmark)
+{
+	// Decoded megabytes per second of optimized meshes, against copying the raw buffers
+	GeometryGenerator geoGen;
+	const char* names[] = { "grid 1024x1024", "sphere 512x512", "geosphere 7" };
+	GeometryGenerator::MeshData shapes[] =
+	{
+		geoGen.CreateGrid(100.0f, 100.0f, 1024, 1024),
+		geoGen.CreateSphere(1.0f, 512, 512),
+		geoGen.CreateGeosphere(1.0f, 7)
+	};
+	const int kRuns = 10;
+
+	for (int s = 0; s < 3; ++s)
+	{
+		GeometryGenerator::MeshData& meshData = shapes[s];
+		MeshOptimizer::Optimize(meshData);
+
+		const size_t vertexCount = meshData.Vertices.size();
+		const size_t indexCount = meshData.Indices32.size();
+		const size_t vertexBytes = vertexCount * sizeof(GeometryGenerator::Vertex);
+		const size_t indexBytes = indexCount * sizeof(GeometryGenerator::uint32);
+		std::vector<std::uint8_t> encodedVertices = MeshCodec::EncodeVertices(meshData.Vertices.data(), vertexCount, sizeof(GeometryGenerator::Vertex));
+		std::vector<std::uint8_t> encodedIndices = MeshCodec::EncodeIndices(meshData.Indices32.data(), indexCount);
+
+		std::vector<GeometryGenerator::Vertex> vertices(vertexCount);
+		std::vector<GeometryGenerator::uint32> indices(indexCount);
+		bool isDecoded = true;
+
+		BenchmarkTimer vertexTimer;
+		for (int run = 0; run < kRuns; ++run)
+		{
+			isDecoded = MeshCodec::DecodeVertices(vertices.data(), vertexCount, sizeof(GeometryGenerator::Vertex), encodedVertices.data(), encodedVertices.size()) && isDecoded;
+		}
+		double vertexMs = vertexTimer.GetMilliseconds() / kRuns;
+
+		BenchmarkTimer indexTimer;
+		for (int run = 0; run < kRuns; ++run)
+		{
+			isDecoded = MeshCodec::DecodeIndices(indices.data(), indexCount, vertexCount, encodedIndices.data(), encodedIndices.size()) && isDecoded;
+		}
+		double indexMs = indexTimer.GetMilliseconds() / kRuns;
+
+		BenchmarkTimer copyTimer;
+		for (int run = 0; run < kRuns; ++run)
+		{
+			std::memcpy(vertices.data(), meshData.Vertices.data(), vertexBytes);
+			std::memcpy(indices.data(), meshData.Indices32.data(), indexBytes);
+		}
+		double copyMs = copyTimer.GetMilliseconds() / kRuns;
+		CHECK(isDecoded);
+
+		std::printf("  %s, %zu vertices, %zu triangles:\n", names[s], vertexCount, indexCount / 3);
+		std::printf("    vertices %.1f%% of raw, %.2f ms, %.0f MB/s\n", 100.0 * encodedVertices.size() / vertexBytes, vertexMs, vertexBytes / (vertexMs * 1000.0));
+		std::printf("    indices %.1f%% of raw, %.2f ms, %.0f MB/s, %.1f M triangles/s\n", 100.0 * encodedIndices.size() / indexBytes, indexMs,
+			indexBytes / (indexMs * 1000.0), indexCount / 3 / (indexMs * 1000.0));
+		std::printf("    memcpy of both %.2f ms, %.0f MB/s\n", copyMs, (vertexBytes + indexBytes) / (copyMs * 1000.0));
+	}
+}
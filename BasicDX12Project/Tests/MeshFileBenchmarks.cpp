@@ -0,0 +1,216 @@
+#include "TestRegistry.h"
+#include "GeometryCache.h"
+#include "IndexPacker.h"
+#include "MeshFile.h"
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	const std::vector<float> kShapeLodRatios = { 0.5f, 0.25f, 0.125f };
+	const std::wstring kBenchmarkFilePath = L"ShapesBenchmark.meshfile";
+
+	// The "Shapes" scene of MyApp
+	std::vector<std::pair<std::string, GeometryKey>> GetShapeKeys()
+	{
+		return
+		{
+			{ "box", GeometryKey::Box(1.5f, 0.5f, 1.5f, 3, VertexFormat::QuantizedPosition) },
+			{ "grid", GeometryKey::Grid(20.0f, 30.0f, 60, 40, VertexFormat::QuantizedPosition) },
+			{ "sphere", GeometryKey::Sphere(0.5f, 20, 20, VertexFormat::QuantizedPosition) },
+			{ "cylinder", GeometryKey::Cylinder(0.5f, 0.3f, 3.0f, 20, 20, VertexFormat::QuantizedPosition) }
+		};
+	}
+
+	template <typename T>
+	void AddSection(MeshFileWriter& writer, const std::string& name, const std::vector<T>& data)
+	{
+		writer.AddSection(name, data.data(), data.size() * sizeof(T));
+	}
+
+	template <typename T>
+	void ReadSection(const MeshFileReader& meshFile, const std::string& name, std::vector<T>& data)
+	{
+		const void* sectionData = nullptr;
+		size_t byteSize = 0;
+		meshFile.GetSection(name, &sectionData, &byteSize);
+		data.resize(byteSize / sizeof(T));
+		if (!data.empty())
+		{
+			std::memcpy(data.data(), sectionData, data.size() * sizeof(T));
+		}
+	}
+
+	// What MyApp::GenerateShapesMeshFile does on a run without a usable file: generate and
+	// optimize the shapes, split them into meshlets, build the LOD chains and lay out the file
+	std::vector<BYTE> GenerateShapesFile(ThreadPool& threadPool, std::uint64_t sourceHash)
+	{
+		std::vector<std::pair<std::string, GeometryKey>> shapes = GetShapeKeys();
+
+		GeometryCache cache;
+		cache.SetThreadPool(&threadPool);
+		cache.SetPositionOnly(true);
+		cache.SetPrepareFunction([](GeometryGenerator::MeshData& meshData) { MeshOptimizer::Optimize(meshData); });
+
+		std::vector<std::shared_ptr<const CachedGeometry>> meshes;
+		std::vector<MeshletData> meshlets;
+		std::vector<UINT> vertexOffsets;
+		IndexPacker indexPacker;
+		std::vector<size_t> indexRanges;
+		UINT vertexOffset = 0;
+		for (auto& shape : shapes)
+		{
+			meshes.push_back(cache.Get(shape.second));
+			meshlets.push_back(MeshletBuilder::Build(*meshes.back()->Mesh));
+			indexRanges.push_back(indexPacker.AddSubmesh(MeshletBuilder::GetMeshletIndices(meshlets.back()), vertexOffset));
+			vertexOffsets.push_back(vertexOffset);
+			vertexOffset += (UINT)meshes.back()->Mesh->Vertices.size();
+		}
+
+		std::vector<std::pair<size_t, size_t>> lodIndexRanges;
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			for (MeshSimplifier::Lod& lod : MeshSimplifier::BuildLodChain(*meshes[i]->Mesh, kShapeLodRatios))
+			{
+				MeshOptimizer::OptimizeVertexCache(lod.Indices32, meshes[i]->Mesh->Vertices.size());
+				lodIndexRanges.push_back({ i, indexPacker.AddSubmesh(lod.Indices32, vertexOffsets[i]) });
+			}
+		}
+		indexPacker.Pack();
+
+		std::vector<BYTE> vertices;
+		for (auto& mesh : meshes)
+		{
+			vertices.insert(vertices.end(), mesh->Vertices.begin(), mesh->Vertices.end());
+		}
+
+		MeshFileWriter writer;
+		writer.SetVertices(VertexFormat::QuantizedPosition, vertices.data(), (UINT)vertices.size());
+		writer.SetIndices(indexPacker.GetFormat(), indexPacker.GetData(), indexPacker.GetByteSize());
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			SubmeshGeometry submesh = indexPacker.GetSubmesh(indexRanges[i]);
+			submesh.Bounds = meshes[i]->Bounds;
+			submesh.Sphere = meshes[i]->Sphere;
+			writer.AddSubmesh(shapes[i].first, submesh);
+		}
+		for (size_t i = 0; i < lodIndexRanges.size(); ++i)
+		{
+			SubmeshGeometry lodSubmesh = indexPacker.GetSubmesh(lodIndexRanges[i].second);
+			lodSubmesh.Bounds = meshes[lodIndexRanges[i].first]->Bounds;
+			lodSubmesh.Sphere = meshes[lodIndexRanges[i].first]->Sphere;
+			writer.AddSubmesh("lod" + std::to_string(i), lodSubmesh);
+		}
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			AddSection(writer, shapes[i].first + ".meshlets", meshlets[i].Meshlets);
+			AddSection(writer, shapes[i].first + ".meshletBounds", meshlets[i].Bounds);
+			AddSection(writer, shapes[i].first + ".meshletVertices", meshlets[i].VertexIndices);
+			AddSection(writer, shapes[i].first + ".meshletTriangles", meshlets[i].TriangleIndices);
+		}
+
+		return writer.Serialize(sourceHash);
+	}
+
+	// What MyApp::BuildShapesGeometry does with a mapped file, with a copy of the streams
+	// standing in for the upload both paths pay for
+	bool LoadShapes(const void* data, size_t byteSize, std::uint64_t sourceHash, bool validateContents, std::vector<BYTE>& upload)
+	{
+		MeshFileReader meshFile;
+		if (!meshFile.Open(data, byteSize, sourceHash, validateContents))
+		{
+			return false;
+		}
+
+		std::unordered_map<std::string, SubmeshGeometry> drawArgs;
+		meshFile.GetDrawArgs(drawArgs);
+
+		for (auto& shape : GetShapeKeys())
+		{
+			MeshletData meshlets;
+			ReadSection(meshFile, shape.first + ".meshlets", meshlets.Meshlets);
+			ReadSection(meshFile, shape.first + ".meshletBounds", meshlets.Bounds);
+			ReadSection(meshFile, shape.first + ".meshletVertices", meshlets.VertexIndices);
+			ReadSection(meshFile, shape.first + ".meshletTriangles", meshlets.TriangleIndices);
+		}
+
+		upload.resize(meshFile.GetVertexBufferByteSize() + meshFile.GetIndexBufferByteSize());
+		std::memcpy(upload.data(), meshFile.GetVertexData(), meshFile.GetVertexBufferByteSize());
+		std::memcpy(upload.data() + meshFile.GetVertexBufferByteSize(), meshFile.GetIndexData(), meshFile.GetIndexBufferByteSize());
+		return true;
+	}
+}
+
+//=========================================================================================
+TEST(MeshFileRejectsCorruption)
+{
+	const std::uint64_t kSourceHash = 1;
+	ThreadPool threadPool;
+	std::vector<BYTE> file = GenerateShapesFile(threadPool, kSourceHash);
+
+	MeshFileReader meshFile;
+	std::vector<BYTE> upload;
+	CHECK(LoadShapes(file.data(), file.size(), kSourceHash, true, upload));
+	CHECK(!meshFile.Open(file.data(), file.size(), kSourceHash + 1));
+	CHECK(!meshFile.Open(file.data(), file.size() - 16, kSourceHash));
+
+	// Only the full validation reads every byte
+	std::vector<BYTE> corrupt = file;
+	corrupt[corrupt.size() / 2] ^= 1;
+	CHECK(!meshFile.Open(corrupt.data(), corrupt.size(), kSourceHash, true));
+
+	corrupt = file;
+	reinterpret_cast<MeshFileHeader*>(corrupt.data())->IndexDataOffset += 1 << 30;
+	CHECK(!meshFile.Open(corrupt.data(), corrupt.size(), kSourceHash, false));
+
+	corrupt = file;
+	++reinterpret_cast<MeshFileHeader*>(corrupt.data())->Version;
+	CHECK(!meshFile.Open(corrupt.data(), corrupt.size(), kSourceHash, false));
+}
+
+//=========================================================================================
+BENCHMARK(ShapesStartupBenchmark)
+{
+	// Startup of the shapes scene: regenerating everything against loading the mapped file,
+	// best of several runs each
+	const std::uint64_t kSourceHash = 1;
+	ThreadPool threadPool;
+
+	std::vector<BYTE> file;
+	double generateMs = 1e9;
+	for (int run = 0; run < 5; ++run)
+	{
+		BenchmarkTimer timer;
+		file = GenerateShapesFile(threadPool, kSourceHash);
+		generateMs = std::min<double>(generateMs, timer.GetMilliseconds());
+	}
+
+	std::string error;
+	CHECK(MeshFileWriter::WriteFile(kBenchmarkFilePath, file, &error));
+
+	double loadMs[2] = { 1e9, 1e9 };
+	for (int validateContents = 0; validateContents < 2; ++validateContents)
+	{
+		for (int run = 0; run < 50; ++run)
+		{
+			BenchmarkTimer timer;
+			MappedFile mappedFile;
+			std::vector<BYTE> upload;
+			bool isLoaded = mappedFile.Open(kBenchmarkFilePath, &error) &&
+				LoadShapes(mappedFile.GetData(), mappedFile.GetByteSize(), kSourceHash, validateContents != 0, upload);
+			loadMs[validateContents] = std::min<double>(loadMs[validateContents], timer.GetMilliseconds());
+			CHECK(isLoaded);
+		}
+	}
+	DeleteFileW(kBenchmarkFilePath.c_str());
+
+	std::printf("  %zu byte file\n", file.size());
+	std::printf("  regenerate:                        %8.3f ms\n", generateMs);
+	std::printf("  mapped load, full validation:      %8.3f ms\n", loadMs[1]);
+	std::printf("  mapped load, structure validation: %8.3f ms\n", loadMs[0]);
+}
@@ -0,0 +1,234 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace DirectX;
+using uint32 = GeometryGenerator::uint32;
+
+namespace
+{
+	const std::vector<float> kLodRatios = { 0.5f, 0.25f, 0.125f };
+
+	struct Vec3
+	{
+		double x, y, z;
+	};
+
+	Vec3 ToVec3(const XMFLOAT3& p)
+	{
+		return { p.x, p.y, p.z };
+	}
+
+	Vec3 Subtract(const Vec3& a, const Vec3& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	double Dot(const Vec3& a, const Vec3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	// Distance from p to the closest point of triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+	double PointTriangleDistance(const Vec3& p, const Vec3& a, const Vec3& b, const Vec3& c)
+	{
+		Vec3 ab = Subtract(b, a);
+		Vec3 ac = Subtract(c, a);
+		Vec3 ap = Subtract(p, a);
+		double d1 = Dot(ab, ap);
+		double d2 = Dot(ac, ap);
+
+		Vec3 closest;
+		Vec3 bp = Subtract(p, b);
+		double d3 = Dot(ab, bp);
+		double d4 = Dot(ac, bp);
+		Vec3 cp = Subtract(p, c);
+		double d5 = Dot(ab, cp);
+		double d6 = Dot(ac, cp);
+		double va = d3 * d6 - d5 * d4;
+		double vb = d5 * d2 - d1 * d6;
+		double vc = d1 * d4 - d3 * d2;
+		if (d1 <= 0.0 && d2 <= 0.0)
+		{
+			closest = a;
+		}
+		else if (d3 >= 0.0 && d4 <= d3)
+		{
+			closest = b;
+		}
+		else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+		{
+			double v = d1 / (d1 - d3);
+			closest = { a.x + v * ab.x, a.y + v * ab.y, a.z + v * ab.z };
+		}
+		else if (d6 >= 0.0 && d5 <= d6)
+		{
+			closest = c;
+		}
+		else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+		{
+			double w = d2 / (d2 - d6);
+			closest = { a.x + w * ac.x, a.y + w * ac.y, a.z + w * ac.z };
+		}
+		else if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0)
+		{
+			double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+			closest = { b.x + w * (c.x - b.x), b.y + w * (c.y - b.y), b.z + w * (c.z - b.z) };
+		}
+		else
+		{
+			double denom = 1.0 / (va + vb + vc);
+			double v = vb * denom;
+			double w = vc * denom;
+			closest = { a.x + ab.x * v + ac.x * w, a.y + ab.y * v + ac.y * w, a.z + ab.z * v + ac.z * w };
+		}
+
+		Vec3 d = Subtract(p, closest);
+		return std::sqrt(Dot(d, d));
+	}
+
+	// Largest distance from a vertex of the source mesh to the simplified surface, by testing
+	// every vertex against every remaining triangle
+	double MeasureMaxError(const GeometryGenerator::MeshData& meshData, const std::vector<uint32>& indices)
+	{
+		double maxError = 0.0;
+		for (const GeometryGenerator::Vertex& v : meshData.Vertices)
+		{
+			Vec3 p = ToVec3(v.Position);
+			double error = 1e30;
+			for (size_t i = 0; i + 2 < indices.size() && error > 0.0; i += 3)
+			{
+				error = std::min<double>(error, PointTriangleDistance(p, ToVec3(meshData.Vertices[indices[i]].Position),
+					ToVec3(meshData.Vertices[indices[i + 1]].Position), ToVec3(meshData.Vertices[indices[i + 2]].Position)));
+			}
+			maxError = std::max<double>(maxError, error);
+		}
+		return maxError;
+	}
+
+	std::vector<GeometryGenerator::MeshData> CreateTestMeshes()
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData bumpyGrid = geoGen.CreateGrid(4.0f, 4.0f, 21, 21);
+		for (GeometryGenerator::Vertex& v : bumpyGrid.Vertices)
+		{
+			v.Position.y = 0.2f * sinf(2.0f * v.Position.x) * cosf(1.5f * v.Position.z);
+		}
+
+		return
+		{
+			geoGen.CreateSphere(1.0f, 24, 16),
+			geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 6),
+			geoGen.CreateGeosphere(1.0f, 3),
+			bumpyGrid
+		};
+	}
+}
+
+//=========================================================================================
+TEST(MeshSimplifierTriangleCounts)
+{
+	for (const GeometryGenerator::MeshData& meshData : CreateTestMeshes())
+	{
+		size_t triangleCount = meshData.Indices32.size() / 3;
+		std::vector<MeshSimplifier::Lod> lods = MeshSimplifier::BuildLodChain(meshData, kLodRatios);
+		CHECK(lods.size() == kLodRatios.size());
+
+		// Each LOD lands on its target, an edge collapse removes at most two triangles
+		bool hasTargetCounts = true;
+		bool hasValidIndices = true;
+		for (const MeshSimplifier::Lod& lod : lods)
+		{
+			size_t target = (size_t)(lod.TargetRatio * triangleCount);
+			size_t lodTriangleCount = lod.Indices32.size() / 3;
+			hasTargetCounts = hasTargetCounts && lod.Indices32.size() % 3 == 0 && lodTriangleCount <= target && lodTriangleCount + 2 >= target;
+			for (size_t i = 0; i + 2 < lod.Indices32.size(); i += 3)
+			{
+				uint32 a = lod.Indices32[i];
+				uint32 b = lod.Indices32[i + 1];
+				uint32 c = lod.Indices32[i + 2];
+				hasValidIndices = hasValidIndices && a < meshData.Vertices.size() && b < meshData.Vertices.size() &&
+					c < meshData.Vertices.size() && a != b && b != c && a != c;
+			}
+		}
+		CHECK(hasTargetCounts);
+		CHECK(hasValidIndices);
+
+		// Simplify on its own reaches the same triangles as the chain's first step
+		std::vector<uint32> simplified = MeshSimplifier::Simplify(meshData, (size_t)(kLodRatios[0] * triangleCount));
+		CHECK(!lods.empty() && simplified == lods[0].Indices32);
+
+		// Asking for more triangles than there are leaves the mesh as it is
+		CHECK(MeshSimplifier::Simplify(meshData, triangleCount).size() == meshData.Indices32.size());
+	}
+}
+
+//=========================================================================================
+TEST(MeshSimplifierErrorBound)
+{
+	for (const GeometryGenerator::MeshData& meshData : CreateTestMeshes())
+	{
+		std::vector<MeshSimplifier::Lod> lods = MeshSimplifier::BuildLodChain(meshData, kLodRatios);
+
+		// The reported error is the distance the brute force search finds, and it only grows
+		// along the chain, which the LOD selection relies on
+		bool hasMatchingErrors = true;
+		bool hasGrowingErrors = true;
+		float previousError = 0.0f;
+		for (const MeshSimplifier::Lod& lod : lods)
+		{
+			double expected = MeasureMaxError(meshData, lod.Indices32);
+			hasMatchingErrors = hasMatchingErrors && std::fabs(expected - lod.MaxError) <= 1e-4 * (1.0 + expected);
+			hasGrowingErrors = hasGrowingErrors && lod.MaxError >= previousError;
+			previousError = lod.MaxError;
+		}
+		CHECK(hasMatchingErrors);
+		CHECK(hasGrowingErrors);
+
+		float maxError = -1.0f;
+		MeshSimplifier::Simplify(meshData, meshData.Indices32.size() / 6, &maxError);
+		CHECK(!lods.empty() && maxError == lods[0].MaxError);
+	}
+
+	// Collapsing a flat grid moves nothing off the plane
+	GeometryGenerator geoGen;
+	float flatError = -1.0f;
+	GeometryGenerator::MeshData flatGrid = geoGen.CreateGrid(4.0f, 4.0f, 17, 17);
+	std::vector<uint32> flatIndices = MeshSimplifier::Simplify(flatGrid, flatGrid.Indices32.size() / 12, &flatError);
+	CHECK(flatIndices.size() / 3 <= flatGrid.Indices32.size() / 12);
+	CHECK(flatError >= 0.0f && flatError <= 1e-5f);
+}
+
+//=========================================================================================
+BENCHMARK(MeshSimplifierBenchmark)
+{
+	// Source triangles simplified per second, down to an eighth in one LOD chain
+	GeometryGenerator geoGen;
+	for (uint32 sliceCount : { 64u, 128u, 256u })
+	{
+		GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, sliceCount, sliceCount);
+		size_t triangleCount = sphere.Indices32.size() / 3;
+		int runs = sliceCount <= 64 ? 10 : 2;
+
+		BenchmarkTimer simplifyTimer;
+		size_t lodTriangleCount = 0;
+		for (int run = 0; run < runs; ++run)
+		{
+			lodTriangleCount += MeshSimplifier::Simplify(sphere, triangleCount / 8).size() / 3;
+		}
+		double simplifyMs = simplifyTimer.GetMilliseconds() / runs;
+
+		BenchmarkTimer chainTimer;
+		for (int run = 0; run < runs; ++run)
+		{
+			lodTriangleCount += MeshSimplifier::BuildLodChain(sphere, kLodRatios).size();
+		}
+		double chainMs = chainTimer.GetMilliseconds() / runs;
+
+		std::printf("  sphere %ux%u, %zu triangles: Simplify %.1f ms (%.2f M triangles/s), BuildLodChain %.1f ms (%.2f M triangles/s)\n",
+			sliceCount, sliceCount, triangleCount, simplifyMs, triangleCount / (simplifyMs * 1000.0), chainMs, triangleCount / (chainMs * 1000.0));
+	}
+}
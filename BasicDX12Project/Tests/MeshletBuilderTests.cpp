@@ -0,0 +1,343 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+
+using namespace DirectX;
+using uint32 = GeometryGenerator::uint32;
+
+namespace
+{
+	std::vector<GeometryGenerator::MeshData> CreateShapes()
+	{
+		GeometryGenerator geoGen;
+		return
+		{
+			geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3),
+			geoGen.CreateGrid(20.0f, 30.0f, 60, 40),
+			geoGen.CreateSphere(0.5f, 20, 20),
+			geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20),
+			geoGen.CreateGeosphere(0.5f, 3)
+		};
+	}
+
+	// The triangles of an index list with each one rotated to start at its smallest index,
+	// sorted, so lists with the same triangles in any order and rotation compare equal
+	std::vector<std::array<uint32, 3>> GetSortedTriangles(const std::vector<uint32>& indices)
+	{
+		std::vector<std::array<uint32, 3>> triangles;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			std::array<uint32, 3> t = { indices[i], indices[i + 1], indices[i + 2] };
+			while (t[0] > t[1] || t[0] > t[2])
+			{
+				t = { t[1], t[2], t[0] };
+			}
+			triangles.push_back(t);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	XMVECTOR GetTriangleNormal(const GeometryGenerator::MeshData& meshData, uint32 a, uint32 b, uint32 c)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&meshData.Vertices[a].Position);
+		XMVECTOR p1 = XMLoadFloat3(&meshData.Vertices[b].Position);
+		XMVECTOR p2 = XMLoadFloat3(&meshData.Vertices[c].Position);
+		return XMVector3Normalize(XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0)));
+	}
+
+	// Camera frustum in world space for an eye looking at the origin
+	BoundingFrustum CreateViewFrustum(const XMFLOAT3& eye, float fovY)
+	{
+		XMMATRIX view = XMMatrixLookAtLH(XMLoadFloat3(&eye), XMVectorZero(), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		BoundingFrustum frustum;
+		BoundingFrustum::CreateFromMatrix(frustum, XMMatrixPerspectiveFovLH(fovY, 1.0f, 0.1f, 100.0f));
+		BoundingFrustum worldFrustum;
+		frustum.Transform(worldFrustum, XMMatrixInverse(nullptr, view));
+		return worldFrustum;
+	}
+
+	std::vector<XMFLOAT3> GetEyePositions(float distance)
+	{
+		std::vector<XMFLOAT3> eyes;
+		for (int i = 0; i < 16; ++i)
+		{
+			float theta = 0.4f * i;
+			float y = -0.9f + 0.12f * i;
+			float r = sqrtf(1.0f - y * y);
+			eyes.push_back(XMFLOAT3(distance * r * cosf(theta), distance * y, distance * r * sinf(theta)));
+		}
+		return eyes;
+	}
+}
+
+//=========================================================================================
+TEST(MeshletBuilderCoverage)
+{
+	for (const GeometryGenerator::MeshData& meshData : CreateShapes())
+	{
+		MeshletData meshletData = MeshletBuilder::Build(meshData);
+
+		// The meshlet index list is a reordering of the source triangles, nothing lost or doubled
+		std::vector<uint32> meshletIndices = MeshletBuilder::GetMeshletIndices(meshletData);
+		CHECK(GetSortedTriangles(meshletIndices) == GetSortedTriangles(meshData.Indices32));
+
+		// Meshlets are packed back to back within their limits, and only address their own vertices
+		bool isPacked = meshletData.Bounds.size() == meshletData.Meshlets.size();
+		bool isWithinLimits = true;
+		uint32 vertexOffset = 0;
+		uint32 triangleOffset = 0;
+		for (const Meshlet& meshlet : meshletData.Meshlets)
+		{
+			isPacked = isPacked && meshlet.VertexOffset == vertexOffset && meshlet.TriangleOffset == triangleOffset && meshlet.TriangleCount > 0;
+			isWithinLimits = isWithinLimits && meshlet.VertexCount <= MeshletBuilder::kDefaultMaxVertices &&
+				meshlet.TriangleCount <= MeshletBuilder::kDefaultMaxTriangles;
+			for (uint32 i = 0; i < meshlet.TriangleCount * 3; ++i)
+			{
+				isWithinLimits = isWithinLimits && meshletData.TriangleIndices[meshlet.TriangleOffset * 3 + i] < meshlet.VertexCount;
+			}
+			vertexOffset += meshlet.VertexCount;
+			triangleOffset += meshlet.TriangleCount;
+		}
+		CHECK(isPacked);
+		CHECK(isWithinLimits);
+		CHECK(vertexOffset == meshletData.VertexIndices.size());
+		CHECK(triangleOffset * 3 == meshletData.TriangleIndices.size());
+	}
+}
+
+//=========================================================================================
+TEST(MeshletBuilderBounds)
+{
+	for (const GeometryGenerator::MeshData& meshData : CreateShapes())
+	{
+		MeshletData meshletData = MeshletBuilder::Build(meshData);
+
+		// Every vertex is inside its meshlet's sphere, and every triangle normal inside its cone
+		bool isInSphere = true;
+		bool isInCone = true;
+		for (size_t m = 0; m < meshletData.Meshlets.size(); ++m)
+		{
+			const Meshlet& meshlet = meshletData.Meshlets[m];
+			const MeshletBounds& bounds = meshletData.Bounds[m];
+			const std::uint32_t* vertices = &meshletData.VertexIndices[meshlet.VertexOffset];
+			for (uint32 v = 0; v < meshlet.VertexCount; ++v)
+			{
+				XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&meshData.Vertices[vertices[v]].Position), XMLoadFloat3(&bounds.Sphere.Center));
+				isInSphere = isInSphere && XMVectorGetX(XMVector3Length(offset)) <= bounds.Sphere.Radius * 1.0001f + 1e-5f;
+			}
+
+			if (bounds.ConeCutoff < 1.0f)
+			{
+				float minCos = sqrtf(1.0f - bounds.ConeCutoff * bounds.ConeCutoff);
+				const std::uint8_t* triangles = &meshletData.TriangleIndices[meshlet.TriangleOffset * 3];
+				for (uint32 t = 0; t < meshlet.TriangleCount; ++t)
+				{
+					XMVECTOR normal = GetTriangleNormal(meshData, vertices[triangles[t * 3]], vertices[triangles[t * 3 + 1]], vertices[triangles[t * 3 + 2]]);
+					isInCone = isInCone && XMVectorGetX(XMVector3Dot(normal, XMLoadFloat3(&bounds.ConeAxis))) >= minCos - 1e-4f;
+				}
+			}
+		}
+		CHECK(isInSphere);
+		CHECK(isInCone);
+	}
+}
+
+//=========================================================================================
+TEST(MeshletBuilderCulling)
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, 48, 32);
+	MeshletData meshletData = MeshletBuilder::Build(sphere);
+
+	uint32 backfaceCulledMeshlets = 0;
+	uint32 frustumCulledMeshlets = 0;
+	for (float fovY : { 0.25f * XM_PI, 0.05f * XM_PI })
+	{
+		for (const XMFLOAT3& eye : GetEyePositions(4.0f))
+		{
+			BoundingFrustum frustum = CreateViewFrustum(eye, fovY);
+			std::vector<uint32> visibleMeshlets;
+			MeshletCullStats stats;
+			MeshletBuilder::Cull(meshletData, frustum, eye, visibleMeshlets, &stats);
+			backfaceCulledMeshlets += stats.BackfaceCulledMeshlets;
+			frustumCulledMeshlets += stats.FrustumCulledMeshlets;
+
+			CHECK(std::is_sorted(visibleMeshlets.begin(), visibleMeshlets.end()));
+			CHECK(stats.MeshletCount == meshletData.Meshlets.size());
+			CHECK(stats.FrustumCulledMeshlets + stats.BackfaceCulledMeshlets + visibleMeshlets.size() == meshletData.Meshlets.size());
+
+			// Culling is conservative: a triangle that faces the eye with a corner inside the
+			// frustum is never in a culled meshlet
+			uint32 visibleTriangles = 0;
+			bool isConservative = true;
+			for (uint32 m = 0; m < (uint32)meshletData.Meshlets.size(); ++m)
+			{
+				const Meshlet& meshlet = meshletData.Meshlets[m];
+				bool isVisible = std::binary_search(visibleMeshlets.begin(), visibleMeshlets.end(), m);
+				if (isVisible)
+				{
+					visibleTriangles += meshlet.TriangleCount;
+					continue;
+				}
+
+				const std::uint32_t* vertices = &meshletData.VertexIndices[meshlet.VertexOffset];
+				const std::uint8_t* triangles = &meshletData.TriangleIndices[meshlet.TriangleOffset * 3];
+				for (uint32 t = 0; t < meshlet.TriangleCount; ++t)
+				{
+					uint32 a = vertices[triangles[t * 3]];
+					uint32 b = vertices[triangles[t * 3 + 1]];
+					uint32 c = vertices[triangles[t * 3 + 2]];
+					XMVECTOR toTriangle = XMVectorSubtract(XMLoadFloat3(&sphere.Vertices[a].Position), XMLoadFloat3(&eye));
+					bool isFrontFacing = XMVectorGetX(XMVector3Dot(GetTriangleNormal(sphere, a, b, c), toTriangle)) < -1e-4f;
+					bool isInFrustum = frustum.Contains(XMLoadFloat3(&sphere.Vertices[a].Position)) != DISJOINT ||
+						frustum.Contains(XMLoadFloat3(&sphere.Vertices[b].Position)) != DISJOINT ||
+						frustum.Contains(XMLoadFloat3(&sphere.Vertices[c].Position)) != DISJOINT;
+					isConservative = isConservative && !(isFrontFacing && isInFrustum);
+				}
+			}
+			CHECK(isConservative);
+			CHECK(stats.TriangleCount == sphere.Indices32.size() / 3);
+			CHECK(stats.CulledTriangles + visibleTriangles == stats.TriangleCount);
+		}
+	}
+
+	// From outside, the far side of the sphere goes; with the narrow view, the edges too
+	CHECK(backfaceCulledMeshlets > 0);
+	CHECK(frustumCulledMeshlets > 0);
+}
+
+//=========================================================================================
+TEST(MeshletBuilderDrawRanges)
+{
+	GeometryGenerator geoGen;
+	MeshletData meshletData = MeshletBuilder::Build(geoGen.CreateGrid(20.0f, 20.0f, 64, 64));
+	uint32 meshletCount = (uint32)meshletData.Meshlets.size();
+	CHECK(meshletCount > 20);
+
+	// Every other meshlet visible, a few runs, and none
+	std::vector<std::vector<uint32>> visibleSets(3);
+	for (uint32 m = 0; m < meshletCount; m += 2)
+	{
+		visibleSets[0].push_back(m);
+	}
+	visibleSets[1] = { 0, 1, 2, 7, 8, meshletCount - 1 };
+
+	for (const std::vector<uint32>& visibleMeshlets : visibleSets)
+	{
+		// Without merging, one range per run of neighbours, covering exactly the visible triangles
+		std::vector<MeshletDrawRange> runs;
+		MeshletBuilder::GetDrawRanges(meshletData, visibleMeshlets, runs, 0, UINT32_MAX);
+		uint32 runCount = 0;
+		uint32 visibleTriangles = 0;
+		for (size_t i = 0; i < visibleMeshlets.size(); ++i)
+		{
+			runCount += i == 0 || visibleMeshlets[i] != visibleMeshlets[i - 1] + 1;
+			visibleTriangles += meshletData.Meshlets[visibleMeshlets[i]].TriangleCount;
+		}
+		uint32 drawnTriangles = 0;
+		for (const MeshletDrawRange& range : runs)
+		{
+			drawnTriangles += range.TriangleCount;
+		}
+		CHECK(runs.size() == runCount);
+		CHECK(drawnTriangles == visibleTriangles);
+
+		for (uint32 maxDrawRanges : { 1u, 2u, 3u, MeshletBuilder::kDefaultMaxDrawRanges })
+		{
+			std::vector<MeshletDrawRange> drawRanges;
+			MeshletBuilder::GetDrawRanges(meshletData, visibleMeshlets, drawRanges, MeshletBuilder::kDefaultMaxDrawGap, maxDrawRanges);
+			CHECK(visibleMeshlets.empty() || (!drawRanges.empty() && drawRanges.size() <= maxDrawRanges));
+
+			// Ranges are ascending and disjoint, and each visible meshlet lies in one of them
+			bool isAscending = true;
+			for (size_t i = 1; i < drawRanges.size(); ++i)
+			{
+				isAscending = isAscending && drawRanges[i].TriangleOffset > drawRanges[i - 1].TriangleOffset + drawRanges[i - 1].TriangleCount;
+			}
+			bool isCovered = true;
+			for (uint32 m : visibleMeshlets)
+			{
+				const Meshlet& meshlet = meshletData.Meshlets[m];
+				bool isInRange = false;
+				for (const MeshletDrawRange& range : drawRanges)
+				{
+					isInRange = isInRange || (meshlet.TriangleOffset >= range.TriangleOffset &&
+						meshlet.TriangleOffset + meshlet.TriangleCount <= range.TriangleOffset + range.TriangleCount);
+				}
+				isCovered = isCovered && isInRange;
+			}
+			CHECK(isAscending);
+			CHECK(isCovered);
+		}
+	}
+}
+
+//=========================================================================================
+BENCHMARK(MeshletCullBenchmark)
+{
+	// Triangles culled per view from around the mesh, the cost of culling, and the draws the
+	// visible meshlets take before and after merging
+	GeometryGenerator geoGen;
+	struct NamedMesh
+	{
+		const char* Name;
+		GeometryGenerator::MeshData Mesh;
+	};
+	NamedMesh meshes[] =
+	{
+		{ "sphere 256x256", geoGen.CreateSphere(1.0f, 256, 256) },
+		{ "geosphere 6", geoGen.CreateGeosphere(1.0f, 6) },
+		{ "grid 256x256", geoGen.CreateGrid(2.0f, 2.0f, 256, 256) }
+	};
+
+	for (const NamedMesh& mesh : meshes)
+	{
+		MeshletData meshletData = MeshletBuilder::Build(mesh.Mesh);
+		std::vector<XMFLOAT3> eyes = GetEyePositions(3.0f);
+
+		MeshletCullStats stats;
+		std::vector<uint32> visibleMeshlets;
+		std::vector<MeshletDrawRange> drawRanges;
+		size_t runCount = 0;
+		size_t drawCount = 0;
+		size_t drawnTriangles = 0;
+		const int kRuns = 20;
+		double cullMs = 0.0;
+		for (int run = 0; run < kRuns; ++run)
+		{
+			for (const XMFLOAT3& eye : eyes)
+			{
+				BoundingFrustum frustum = CreateViewFrustum(eye, 0.25f * XM_PI);
+				visibleMeshlets.clear();
+
+				BenchmarkTimer cullTimer;
+				MeshletBuilder::Cull(meshletData, frustum, eye, visibleMeshlets, run == 0 ? &stats : nullptr);
+				cullMs += cullTimer.GetMilliseconds();
+
+				if (run == 0)
+				{
+					MeshletBuilder::GetDrawRanges(meshletData, visibleMeshlets, drawRanges, 0, UINT32_MAX);
+					runCount += drawRanges.size();
+					MeshletBuilder::GetDrawRanges(meshletData, visibleMeshlets, drawRanges);
+					drawCount += drawRanges.size();
+					for (const MeshletDrawRange& range : drawRanges)
+					{
+						drawnTriangles += range.TriangleCount;
+					}
+				}
+			}
+		}
+
+		std::printf("  %s, %zu meshlets: %.1f%% of triangles culled per view (%.1f%% frustum, %.1f%% backface meshlets), "
+			"%.3f ms per cull, %.1f runs -> %.1f draws per view drawing %.1f%% of triangles\n",
+			mesh.Name, meshletData.Meshlets.size(), 100.0 * stats.CulledTriangles / stats.TriangleCount,
+			100.0 * stats.FrustumCulledMeshlets / stats.MeshletCount, 100.0 * stats.BackfaceCulledMeshlets / stats.MeshletCount,
+			cullMs / (kRuns * eyes.size()), (double)runCount / eyes.size(), (double)drawCount / eyes.size(),
+			100.0 * drawnTriangles / stats.TriangleCount);
+	}
+}
@@ -0,0 +1,343 @@
+#include "TestRegistry.h"
+#include "MeshBounds.h"
+#include "RenderItemPool.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	const int kFrameResourceCount = 3;
+
+	// A render item as MyApp kept them before the pool: one heap allocation each, reached
+	// through a list of pointers
+	struct PointerRenderItem
+	{
+		XMFLOAT4X4 World = MathHelper::Identity4x4();
+		int NumFramesDirty = kFrameResourceCount;
+		XMFLOAT4X4 PositionDecode = MathHelper::Identity4x4();
+		BoundingBox Bounds;
+		UINT ObjCBIndex = 0;
+		RenderItemDrawArgs DrawArgs;
+		bool IsStatic = false;
+		GeometryKey Shape;
+	};
+
+	std::vector<XMFLOAT4X4> CreateScatteredWorlds(size_t count, std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		std::vector<XMFLOAT4X4> worlds(count);
+		for (XMFLOAT4X4& world : worlds)
+		{
+			XMStoreFloat4x4(&world, XMMatrixTranslation(position(random), position(random), position(random)));
+		}
+		return worlds;
+	}
+
+	bool IsSameMatrix(const XMFLOAT4X4& a, const XMFLOAT4X4& b)
+	{
+		return std::memcmp(&a, &b, sizeof(a)) == 0;
+	}
+
+	// Padded object constant slots, as in the mapped ObjectCB of a frame resource
+	const UINT kSlotByteSize = 256;
+
+	// Zeroed constant buffer with a slot per item, slot aligned like a mapped upload buffer.
+	// Only 16-byte alignment would split the streamed constants across cache lines and
+	// make them several times slower.
+	struct ConstantBuffer
+	{
+		std::vector<BYTE> Memory;
+		BYTE* Data;
+
+		explicit ConstantBuffer(size_t itemCount)
+		: Memory(itemCount * kSlotByteSize + kSlotByteSize, 0)
+		, Data(Memory.data() + (-(uintptr_t)Memory.data() & (kSlotByteSize - 1)))
+		{
+		}
+	};
+
+	// Items with distinct worlds and a non-identity decode, and the constants they should get
+	void AddTransformedItems(RenderItemPool& pool, size_t count, std::vector<XMFLOAT4X4>& expected)
+	{
+		std::mt19937 random(3);
+		for (size_t i = 0; i < count; ++i)
+		{
+			RenderItem renderItem;
+			XMStoreFloat4x4(&renderItem.World, XMMatrixMultiply(XMMatrixRotationY((float)i), XMMatrixTranslation((float)(random() % 100), 1.0f, 2.0f)));
+			XMStoreFloat4x4(&renderItem.PositionDecode, XMMatrixScaling(0.5f, 2.0f, 1.0f));
+			pool.Add(renderItem);
+
+			XMFLOAT4X4 constants;
+			XMStoreFloat4x4(&constants, XMMatrixTranspose(XMMatrixMultiply(XMLoadFloat4x4(&renderItem.PositionDecode), XMLoadFloat4x4(&renderItem.World))));
+			expected.push_back(constants);
+		}
+	}
+
+	bool HasSlotConstants(const ConstantBuffer& buffer, size_t index, const XMFLOAT4X4& expected)
+	{
+		const float* written = reinterpret_cast<const float*>(buffer.Data + index * kSlotByteSize);
+		for (int k = 0; k < 16; ++k)
+		{
+			if (fabsf(written[k] - (&expected.m[0][0])[k]) > 1e-4f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool HasConstants(const ConstantBuffer& buffer, const std::vector<XMFLOAT4X4>& expected)
+	{
+		for (size_t i = 0; i < expected.size(); ++i)
+		{
+			if (!HasSlotConstants(buffer, i, expected[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+//=========================================================================================
+TEST(RenderItemPoolHandles)
+{
+	std::mt19937 random(1);
+	std::vector<XMFLOAT4X4> worlds = CreateScatteredWorlds(5000, random);
+
+	RenderItemPool pool(kFrameResourceCount);
+	std::vector<RenderItemHandle> handles;
+	for (const XMFLOAT4X4& world : worlds)
+	{
+		RenderItem renderItem;
+		renderItem.World = world;
+		handles.push_back(pool.Add(renderItem));
+	}
+
+	// Removing items moves others, re-adding reuses slots. No removed handle may resolve,
+	// and every live handle still finds its own item.
+	bool hasStaleHandle = false;
+	for (int i = 0; i < 10000; ++i)
+	{
+		size_t item = random() % handles.size();
+		RenderItemHandle removed = handles[item];
+		pool.Remove(removed);
+		hasStaleHandle = hasStaleHandle || pool.IsValid(removed);
+
+		RenderItem renderItem;
+		renderItem.World = worlds[item];
+		handles[item] = pool.Add(renderItem);
+		hasStaleHandle = hasStaleHandle || pool.IsValid(removed);
+	}
+	CHECK(!hasStaleHandle);
+	CHECK(pool.GetCount() == worlds.size());
+
+	bool hasOwnItems = true;
+	for (size_t item = 0; item < handles.size(); ++item)
+	{
+		RenderItemPool::uint32 index = pool.GetIndex(handles[item]);
+		hasOwnItems = hasOwnItems && IsSameMatrix(pool.GetWorlds()[index], worlds[item]) && pool.GetHandle(index) == handles[item];
+	}
+	CHECK(hasOwnItems);
+
+	pool.Clear();
+	CHECK(pool.GetCount() == 0);
+	CHECK(!pool.IsValid(handles[0]));
+}
+
+//=========================================================================================
+BENCHMARK(RenderItemPoolBenchmark)
+{
+	// The per-frame sweeps over 100k items, the pool against the pointer list. The pointers
+	// are shuffled, as items end up in memory after a session of edits.
+	const size_t kItemCount = 100000;
+	const int kRuns = 50;
+	std::mt19937 random(1);
+	std::vector<XMFLOAT4X4> worlds = CreateScatteredWorlds(kItemCount, random);
+	BoundingBox bounds(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f));
+
+	std::vector<std::unique_ptr<PointerRenderItem>> pointerItems;
+	std::vector<std::unique_ptr<char[]>> otherAllocations;
+	RenderItemPool pool(kFrameResourceCount);
+	for (size_t i = 0; i < kItemCount; ++i)
+	{
+		auto pointerItem = std::make_unique<PointerRenderItem>();
+		pointerItem->World = worlds[i];
+		pointerItem->Bounds = bounds;
+		pointerItem->ObjCBIndex = (UINT)i;
+		pointerItems.push_back(std::move(pointerItem));
+		otherAllocations.emplace_back(new char[64 + random() % 512]);
+
+		RenderItem renderItem;
+		renderItem.World = worlds[i];
+		renderItem.Bounds = bounds;
+		pool.Add(renderItem);
+	}
+	std::shuffle(pointerItems.begin(), pointerItems.end(), random);
+
+	std::vector<XMFLOAT4X4> constants(kItemCount);
+	auto writeConstants = [&constants](UINT index, const XMFLOAT4X4& positionDecode, const XMFLOAT4X4& world)
+	{
+		XMMATRIX objectToWorld = XMMatrixMultiply(XMLoadFloat4x4(&positionDecode), XMLoadFloat4x4(&world));
+		XMStoreFloat4x4(&constants[index], XMMatrixTranspose(objectToWorld));
+	};
+
+	BoundingFrustum frustum(XMMatrixPerspectiveFovLH(0.25f * XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f));
+	std::vector<UINT> visibleItems;
+	visibleItems.reserve(kItemCount);
+	size_t visibleCount = 0;
+
+	double pointerConstantsMs = 0.0;
+	double poolConstantsMs = 0.0;
+	double pointerCullingMs = 0.0;
+	double poolCullingMs = 0.0;
+	for (int run = 0; run < kRuns; ++run)
+	{
+		BenchmarkTimer pointerConstantsTimer;
+		for (auto& item : pointerItems)
+		{
+			writeConstants(item->ObjCBIndex, item->PositionDecode, item->World);
+		}
+		pointerConstantsMs += pointerConstantsTimer.GetMilliseconds();
+
+		BenchmarkTimer poolConstantsTimer;
+		const XMFLOAT4X4* poolWorlds = pool.GetWorlds();
+		const XMFLOAT4X4* positionDecodes = pool.GetPositionDecodes();
+		for (UINT i = 0; i < pool.GetCount(); ++i)
+		{
+			writeConstants(i, positionDecodes[i], poolWorlds[i]);
+		}
+		poolConstantsMs += poolConstantsTimer.GetMilliseconds();
+
+		BenchmarkTimer pointerCullingTimer;
+		visibleItems.clear();
+		for (auto& item : pointerItems)
+		{
+			BoundingBox worldBounds;
+			MeshBounds::TransformBox(item->Bounds, XMLoadFloat4x4(&item->World), worldBounds);
+			if (frustum.Intersects(worldBounds))
+			{
+				visibleItems.push_back(item->ObjCBIndex);
+			}
+		}
+		pointerCullingMs += pointerCullingTimer.GetMilliseconds();
+		visibleCount = visibleItems.size();
+
+		BenchmarkTimer poolCullingTimer;
+		visibleItems.clear();
+		const BoundingBox* poolBounds = pool.GetBounds();
+		for (UINT i = 0; i < pool.GetCount(); ++i)
+		{
+			BoundingBox worldBounds;
+			MeshBounds::TransformBox(poolBounds[i], XMLoadFloat4x4(&poolWorlds[i]), worldBounds);
+			if (frustum.Intersects(worldBounds))
+			{
+				visibleItems.push_back(i);
+			}
+		}
+		poolCullingMs += poolCullingTimer.GetMilliseconds();
+		CHECK(visibleItems.size() == visibleCount);
+	}
+
+	// Random remove and add pairs
+	const int kChurnCount = 10000;
+	BenchmarkTimer churnTimer;
+	for (int i = 0; i < kChurnCount; ++i)
+	{
+		pool.Remove(pool.GetHandle((RenderItemPool::uint32)(random() % pool.GetCount())));
+		RenderItem renderItem;
+		renderItem.Bounds = bounds;
+		pool.Add(renderItem);
+	}
+	double churnMs = churnTimer.GetMilliseconds();
+
+	std::printf("  %zu items, %zu visible\n", kItemCount, visibleCount);
+	std::printf("  constants: pointers %.3f ms, pool %.3f ms\n", pointerConstantsMs / kRuns, poolConstantsMs / kRuns);
+	std::printf("  culling:   pointers %.3f ms, pool %.3f ms\n", pointerCullingMs / kRuns, poolCullingMs / kRuns);
+	std::printf("  remove + add: %.0f ns per operation\n", churnMs * 1e6 / (2 * kChurnCount));
+}
+
+//=========================================================================================
+TEST(RenderItemPoolWritesDirtyConstants)
+{
+	// Enough items to split across the pool
+	const size_t kItemCount = 20000;
+	RenderItemPool pool(1);
+	std::vector<XMFLOAT4X4> expected;
+	AddTransformedItems(pool, kItemCount, expected);
+
+	for (unsigned int threadCount : { 1u, 4u })
+	{
+		ThreadPool threadPool(threadCount);
+		ConstantBuffer buffer(kItemCount);
+		pool.WriteDirtyConstants(buffer.Data, kSlotByteSize, &threadPool);
+		CHECK(HasConstants(buffer, expected));
+	}
+
+	// Written to the single frame resource, nothing is dirty any more
+	pool.CountDownDirtyItems();
+	CHECK(pool.GetDirtyItems().empty());
+
+	// Only the moved item is written again
+	XMFLOAT4X4 world;
+	XMStoreFloat4x4(&world, XMMatrixTranslation(7.0f, 8.0f, 9.0f));
+	pool.SetWorld(pool.GetHandle(42), world);
+	CHECK(pool.GetDirtyItems().size() == 1);
+
+	ConstantBuffer buffer(kItemCount);
+	pool.WriteDirtyConstants(buffer.Data, kSlotByteSize);
+	XMFLOAT4X4 moved;
+	XMStoreFloat4x4(&moved, XMMatrixTranspose(XMMatrixMultiply(XMLoadFloat4x4(&pool.GetPositionDecodes()[42]), XMLoadFloat4x4(&world))));
+	CHECK(HasSlotConstants(buffer, 42, moved));
+
+	// The slots of clean items are left as they were
+	CHECK(HasSlotConstants(buffer, 41, XMFLOAT4X4()));
+}
+
+//=========================================================================================
+BENCHMARK(ObjectConstantsBenchmark)
+{
+	// Writing every item's constants from 10k to 1M items. The baseline is what
+	// UploadBuffer::CopyData amounts to: the product into a temporary, then a memcpy.
+	for (size_t itemCount : { 10000u, 100000u, 1000000u })
+	{
+		RenderItemPool pool(1);
+		std::vector<XMFLOAT4X4> expected;
+		AddTransformedItems(pool, itemCount, expected);
+		ConstantBuffer buffer(itemCount);
+		const int kRuns = itemCount >= 1000000 ? 10 : 50;
+
+		BenchmarkTimer copyTimer;
+		for (int run = 0; run < kRuns; ++run)
+		{
+			const XMFLOAT4X4* worlds = pool.GetWorlds();
+			const XMFLOAT4X4* positionDecodes = pool.GetPositionDecodes();
+			for (RenderItemPool::uint32 index : pool.GetDirtyItems())
+			{
+				XMFLOAT4X4 constants;
+				XMStoreFloat4x4(&constants, XMMatrixTranspose(XMMatrixMultiply(XMLoadFloat4x4(&positionDecodes[index]), XMLoadFloat4x4(&worlds[index]))));
+				std::memcpy(buffer.Data + (size_t)index * kSlotByteSize, &constants, sizeof(constants));
+			}
+		}
+		std::printf("  %7zu items: copy %.3f ms", itemCount, copyTimer.GetMilliseconds() / kRuns);
+
+		for (unsigned int threadCount : { 1u, 2u, 4u, 8u })
+		{
+			ThreadPool threadPool(threadCount);
+			BenchmarkTimer streamTimer;
+			for (int run = 0; run < kRuns; ++run)
+			{
+				pool.WriteDirtyConstants(buffer.Data, kSlotByteSize, &threadPool);
+			}
+			std::printf(", stream %u threads %.3f ms", threadCount, streamTimer.GetMilliseconds() / kRuns);
+			CHECK(HasConstants(buffer, expected));
+		}
+		std::printf("\n");
+	}
+}
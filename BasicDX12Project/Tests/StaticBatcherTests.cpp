@@ -0,0 +1,144 @@
+#include "TestRegistry.h"
+#include "StaticBatcher.h"
+#include <cmath>
+
+using namespace DirectX;
+using uint32 = StaticBatcher::uint32;
+
+namespace
+{
+	const XMFLOAT4 kColor(0.25f, 0.5f, 0.75f, 1.0f);
+
+	// Which side of the triangles the surface faces: the sign of the triangle normal against
+	// the direction from center, 0 for triangles too thin to tell
+	float GetWindingSign(const std::vector<XMFLOAT3>& positions, const std::vector<uint32>& indices, size_t i, FXMVECTOR center)
+	{
+		XMVECTOR a = XMLoadFloat3(&positions[indices[i]]);
+		XMVECTOR b = XMLoadFloat3(&positions[indices[i + 1]]);
+		XMVECTOR c = XMLoadFloat3(&positions[indices[i + 2]]);
+		XMVECTOR cross = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+		XMVECTOR centroid = XMVectorScale(XMVectorAdd(XMVectorAdd(a, b), c), 1.0f / 3.0f);
+		float side = XMVectorGetX(XMVector3Dot(cross, XMVectorSubtract(centroid, center)));
+		if (std::fabs(side) < 1e-6f)
+		{
+			return 0.0f;
+		}
+		return side > 0.0f ? 1.0f : -1.0f;
+	}
+}
+
+//=========================================================================================
+TEST(StaticBatcherMirroredWorld)
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, 24, 16);
+	GeometryGenerator::MeshDataSoA source = GeometryGenerator::MeshDataSoA::FromMeshData(sphere);
+
+	// Mirrored in x, stretched unevenly and turned, so the sphere becomes a tilted ellipsoid
+	const XMFLOAT3 center(5.0f, -2.0f, 3.0f);
+	XMFLOAT4X4 world;
+	XMStoreFloat4x4(&world, XMMatrixScaling(-1.0f, 3.0f, 0.5f) * XMMatrixRotationY(0.7f) * XMMatrixTranslation(center.x, center.y, center.z));
+
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+	int pipelineState = 0;
+	StaticBatcher batcher(VertexFormat::FullPrecision);
+	batcher.Add(sphere, identity, kColor, &pipelineState);
+	batcher.Add(sphere, world, kColor, &pipelineState);
+	batcher.Build();
+
+	CHECK(batcher.GetBatches().size() == 1);
+	if (batcher.GetBatches().size() != 1)
+	{
+		return;
+	}
+	const GeometryGenerator::MeshDataSoA& mesh = batcher.GetBatches()[0].Mesh;
+	const size_t vertexCount = sphere.Vertices.size();
+	const size_t indexCount = sphere.Indices32.size();
+	CHECK(mesh.VertexCount() == 2 * vertexCount);
+	CHECK(mesh.Indices32.size() == 2 * indexCount);
+	if (mesh.VertexCount() != 2 * vertexCount || mesh.Indices32.size() != 2 * indexCount)
+	{
+		return;
+	}
+
+	// The untransformed copy keeps its triangles as they were, and the mirrored copy's index
+	// into its own vertices
+	bool isFirstUnchanged = true;
+	bool isSecondRebased = true;
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		isFirstUnchanged = isFirstUnchanged && mesh.Indices32[i] == sphere.Indices32[i];
+		isSecondRebased = isSecondRebased && mesh.Indices32[indexCount + i] >= vertexCount && mesh.Indices32[indexCount + i] < 2 * vertexCount;
+	}
+	CHECK(isFirstUnchanged);
+	CHECK(isSecondRebased);
+
+	// Every triangle still faces outward, so the winding was flipped back along with the
+	// mirroring
+	std::vector<uint32> worldIndices(mesh.Indices32.begin() + indexCount, mesh.Indices32.end());
+	bool hasSameWinding = true;
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		float sourceSign = GetWindingSign(source.Positions, sphere.Indices32, i, XMVectorZero());
+		float worldSign = GetWindingSign(mesh.Positions, worldIndices, i, XMLoadFloat3(&center));
+		hasSameWinding = hasSameWinding && (sourceSign == 0.0f || worldSign == sourceSign);
+	}
+	CHECK(hasSameWinding);
+
+	// Normals went through the inverse transpose: unit length, pointing out of the ellipsoid
+	// and perpendicular to the transformed tangents. Transforming them like positions would
+	// tilt them off the surface.
+	bool hasSurfaceNormals = true;
+	for (size_t v = vertexCount; v < 2 * vertexCount; ++v)
+	{
+		XMVECTOR normal = XMLoadFloat3(&mesh.Normals[v]);
+		XMVECTOR tangent = XMLoadFloat3(&mesh.TangentUs[v]);
+		XMVECTOR outward = XMVectorSubtract(XMLoadFloat3(&mesh.Positions[v]), XMLoadFloat3(&center));
+		hasSurfaceNormals = hasSurfaceNormals && std::fabs(XMVectorGetX(XMVector3Length(normal)) - 1.0f) < 1e-4f &&
+			XMVectorGetX(XMVector3Dot(normal, outward)) > 0.0f && std::fabs(XMVectorGetX(XMVector3Dot(normal, tangent))) < 1e-4f;
+	}
+	CHECK(hasSurfaceNormals);
+
+	// For the poles the expected normal is known exactly: the y axis stretched by 3 is still
+	// the y axis
+	XMFLOAT3 topNormal = mesh.Normals[vertexCount];
+	CHECK(std::fabs(topNormal.x) < 1e-5f && std::fabs(topNormal.y - 1.0f) < 1e-5f && std::fabs(topNormal.z) < 1e-5f);
+}
+
+//=========================================================================================
+TEST(StaticBatcherBatches)
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 2.0f, 3.0f, 0);
+
+	XMFLOAT4X4 left, right;
+	XMStoreFloat4x4(&left, XMMatrixTranslation(-10.0f, 0.0f, 0.0f));
+	XMStoreFloat4x4(&right, XMMatrixTranslation(10.0f, 0.0f, 0.0f));
+
+	// Meshes are grouped by pipeline state, in the order the states were first seen
+	int opaque = 0;
+	int transparent = 0;
+	StaticBatcher batcher(VertexFormat::QuantizedPosition);
+	batcher.Add(box, left, kColor, &opaque);
+	batcher.Add(box, left, kColor, &transparent);
+	batcher.Add(box, right, kColor, &opaque);
+	batcher.Build();
+
+	const std::vector<StaticBatcher::Batch>& batches = batcher.GetBatches();
+	CHECK(batches.size() == 2);
+	if (batches.size() != 2)
+	{
+		return;
+	}
+	CHECK(batches[0].PipelineState == &opaque && batches[1].PipelineState == &transparent);
+	CHECK(batches[0].Mesh.VertexCount() == 2 * box.Vertices.size());
+	CHECK(batches[1].Mesh.VertexCount() == box.Vertices.size());
+
+	// The bounds cover both boxes of the batch and the vertices are encoded against them
+	const BoundingBox& bounds = batches[0].Bounds;
+	CHECK(bounds.Center.x == 0.0f && bounds.Extents.x == 10.5f && bounds.Extents.y == 1.0f && bounds.Extents.z == 1.5f);
+	CHECK(batches[0].Vertices.size() == batches[0].Mesh.VertexCount() * VertexCompression::GetVertexStride(VertexFormat::QuantizedPosition));
+	CHECK(batches[1].Bounds.Center.x == -10.0f);
+}
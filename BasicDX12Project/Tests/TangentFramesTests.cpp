@@ -0,0 +1,236 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "MeshSimplifier.h"
+#include "TangentFrames.h"
+#include "ThreadPool.h"
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	const GeometryGenerator::uint32 kSeamGridSize = 9;
+	const GeometryGenerator::uint32 kSeamColumn = 4;
+
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	// Unit length and perpendicular to the normal
+	bool IsOrthonormal(const GeometryGenerator::Vertex& v)
+	{
+		return fabsf(Dot(v.Normal, v.Normal) - 1.0f) < 1e-4f && fabsf(Dot(v.TangentU, v.TangentU) - 1.0f) < 1e-4f &&
+			fabsf(Dot(v.Normal, v.TangentU)) < 1e-4f;
+	}
+
+	// A bumpy grid cut along one column of vertices: the triangles right of the column use
+	// copies of its vertices, appended after the grid's own. With mirrorUVs the right side's
+	// u runs the other way, like a mirrored texture chart.
+	GeometryGenerator::MeshData CreateSeamGrid(bool mirrorUVs, std::vector<GeometryGenerator::uint32>* seamCopies)
+	{
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData meshData = geoGen.CreateGrid(4.0f, 4.0f, kSeamGridSize, kSeamGridSize);
+		for (GeometryGenerator::Vertex& v : meshData.Vertices)
+		{
+			v.Position.y = 0.3f * sinf(1.5f * v.Position.x) * cosf(v.Position.z);
+		}
+
+		const GeometryGenerator::uint32 n = kSeamGridSize;
+		for (GeometryGenerator::uint32 i = 0; i < n; ++i)
+		{
+			seamCopies->push_back((GeometryGenerator::uint32)meshData.Vertices.size());
+			meshData.Vertices.push_back(meshData.Vertices[i * n + kSeamColumn]);
+		}
+
+		// Quad j owns the six indices from 6 * (i * (n - 1) + j)
+		for (GeometryGenerator::uint32 i = 0; i + 1 < n; ++i)
+		{
+			for (GeometryGenerator::uint32 j = kSeamColumn; j + 1 < n; ++j)
+			{
+				for (size_t k = 0; k < 6; ++k)
+				{
+					GeometryGenerator::uint32& index = meshData.Indices32[6 * (i * (n - 1) + j) + k];
+					if (index % n == kSeamColumn)
+					{
+						index = (*seamCopies)[index / n];
+					}
+				}
+			}
+		}
+
+		if (mirrorUVs)
+		{
+			float seamU = meshData.Vertices[kSeamColumn].TexC.x;
+			for (GeometryGenerator::uint32 v = 0; v < (GeometryGenerator::uint32)meshData.Vertices.size(); ++v)
+			{
+				bool isRight = v >= n * n || v % n > kSeamColumn;
+				if (isRight)
+				{
+					meshData.Vertices[v].TexC.x = 2.0f * seamU - meshData.Vertices[v].TexC.x;
+				}
+			}
+		}
+
+		return meshData;
+	}
+}
+
+//=========================================================================================
+TEST(TangentFramesPooledMatchesSerial)
+{
+	// Large enough that both the triangle and the vertex loops are split across the pool
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData meshes[] =
+	{
+		geoGen.CreateSphere(1.0f, 300, 200),
+		geoGen.CreateGrid(10.0f, 10.0f, 256, 256)
+	};
+
+	ThreadPool threadPool(4);
+	for (GeometryGenerator::MeshData& serial : meshes)
+	{
+		for (GeometryGenerator::Vertex& v : serial.Vertices)
+		{
+			v.Position.y += 0.05f * sinf(7.0f * v.Position.x);
+		}
+
+		GeometryGenerator::MeshData pooled = serial;
+		TangentFrames::Compute(serial);
+		TangentFrames::Compute(pooled, &threadPool);
+		CHECK(std::memcmp(serial.Vertices.data(), pooled.Vertices.data(), serial.Vertices.size() * sizeof(GeometryGenerator::Vertex)) == 0);
+
+		TangentFrames::ComputeTangents(serial);
+		TangentFrames::ComputeTangents(pooled, &threadPool);
+		CHECK(std::memcmp(serial.Vertices.data(), pooled.Vertices.data(), serial.Vertices.size() * sizeof(GeometryGenerator::Vertex)) == 0);
+	}
+}
+
+//=========================================================================================
+TEST(TangentFramesUVSeams)
+{
+	// The same surface without the cut is what both sides of the seam should agree with
+	std::vector<GeometryGenerator::uint32> unused;
+	GeometryGenerator::MeshData whole = CreateSeamGrid(false, &unused);
+	whole.Vertices.resize(kSeamGridSize * kSeamGridSize);
+	for (GeometryGenerator::uint32& index : whole.Indices32)
+	{
+		if (index >= kSeamGridSize * kSeamGridSize)
+		{
+			index = (index - kSeamGridSize * kSeamGridSize) * kSeamGridSize + kSeamColumn;
+		}
+	}
+	TangentFrames::Compute(whole);
+
+	for (bool mirrorUVs : { false, true })
+	{
+		std::vector<GeometryGenerator::uint32> seamCopies;
+		GeometryGenerator::MeshData meshData = CreateSeamGrid(mirrorUVs, &seamCopies);
+		TangentFrames::Compute(meshData);
+
+		bool isOrthonormal = true;
+		for (const GeometryGenerator::Vertex& v : meshData.Vertices)
+		{
+			isOrthonormal = isOrthonormal && IsOrthonormal(v);
+		}
+		CHECK(isOrthonormal);
+
+		// Both copies of a seam vertex get the smooth normal of the uncut surface. Tangents
+		// line up across a seam with the same UV winding, and are not cancelled out across a
+		// mirrored one.
+		bool hasSmoothNormals = true;
+		bool hasMatchingTangents = true;
+		for (GeometryGenerator::uint32 i = 0; i < kSeamGridSize; ++i)
+		{
+			const GeometryGenerator::Vertex& left = meshData.Vertices[i * kSeamGridSize + kSeamColumn];
+			const GeometryGenerator::Vertex& right = meshData.Vertices[seamCopies[i]];
+			const GeometryGenerator::Vertex& expected = whole.Vertices[i * kSeamGridSize + kSeamColumn];
+
+			hasSmoothNormals = hasSmoothNormals && Dot(left.Normal, expected.Normal) > 0.99999f && Dot(right.Normal, expected.Normal) > 0.99999f;
+			if (mirrorUVs)
+			{
+				hasMatchingTangents = hasMatchingTangents && fabsf(Dot(left.TangentU, right.TangentU)) > 0.99f;
+			}
+			else
+			{
+				hasMatchingTangents = hasMatchingTangents && Dot(left.TangentU, expected.TangentU) > 0.99999f && Dot(right.TangentU, expected.TangentU) > 0.99999f;
+			}
+		}
+		CHECK(hasSmoothNormals);
+		CHECK(hasMatchingTangents);
+	}
+}
+
+//=========================================================================================
+TEST(TangentFramesCreasesAndAnalyticFrames)
+{
+	GeometryGenerator geoGen;
+
+	// The box's edges are 90 degree creases, so every face keeps its flat frame
+	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 2.0f, 3.0f, 1);
+	GeometryGenerator::MeshData computedBox = box;
+	TangentFrames::Compute(computedBox);
+	bool hasFlatFaces = true;
+	for (size_t i = 0; i < box.Vertices.size(); ++i)
+	{
+		hasFlatFaces = hasFlatFaces && Dot(box.Vertices[i].Normal, computedBox.Vertices[i].Normal) > 0.9999f &&
+			Dot(box.Vertices[i].TangentU, computedBox.Vertices[i].TangentU) > 0.9999f;
+	}
+	CHECK(hasFlatFaces);
+
+	// A smooth sphere comes out close to its analytic frames, away from the poles where the
+	// tangent direction is arbitrary
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, 40, 40);
+	GeometryGenerator::MeshData computedSphere = sphere;
+	TangentFrames::Compute(computedSphere);
+	bool hasSphereFrames = true;
+	for (size_t i = 0; i < sphere.Vertices.size(); ++i)
+	{
+		const GeometryGenerator::Vertex& expected = sphere.Vertices[i];
+		const GeometryGenerator::Vertex& computed = computedSphere.Vertices[i];
+		hasSphereFrames = hasSphereFrames && Dot(expected.Normal, computed.Normal) > 0.995f;
+		if (fabsf(expected.Normal.y) < 0.9f)
+		{
+			hasSphereFrames = hasSphereFrames && Dot(expected.TangentU, computed.TangentU) > 0.99f;
+		}
+	}
+	CHECK(hasSphereFrames);
+}
+
+//=========================================================================================
+TEST(TangentFramesLodMesh)
+{
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(1.0f, 40, 40);
+	std::vector<MeshSimplifier::Lod> lods = MeshSimplifier::BuildLodChain(sphere, { 0.25f });
+	CHECK(lods.size() == 1);
+	if (lods.empty())
+	{
+		return;
+	}
+
+	// Only the vertices the LOD uses are kept, the triangles are the same
+	GeometryGenerator::MeshData lodMesh = MeshSimplifier::CreateLodMesh(sphere, lods[0].Indices32);
+	CHECK(lodMesh.Indices32.size() == lods[0].Indices32.size());
+	CHECK(lodMesh.Vertices.size() < sphere.Vertices.size());
+
+	bool hasSameTriangles = true;
+	for (size_t i = 0; i < lodMesh.Indices32.size(); ++i)
+	{
+		const XMFLOAT3& a = lodMesh.Vertices[lodMesh.Indices32[i]].Position;
+		const XMFLOAT3& b = sphere.Vertices[lods[0].Indices32[i]].Position;
+		hasSameTriangles = hasSameTriangles && a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+	CHECK(hasSameTriangles);
+
+	// The frames follow the coarser surface, which still points away from the center
+	bool hasLodFrames = true;
+	for (const GeometryGenerator::Vertex& v : lodMesh.Vertices)
+	{
+		XMFLOAT3 outward;
+		XMStoreFloat3(&outward, XMVector3Normalize(XMLoadFloat3(&v.Position)));
+		hasLodFrames = hasLodFrames && IsOrthonormal(v) && Dot(v.Normal, outward) > 0.9f;
+	}
+	CHECK(hasLodFrames);
+}
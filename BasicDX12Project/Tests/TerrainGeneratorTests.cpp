@@ -0,0 +1,128 @@
+#include "TestRegistry.h"
+#include "TerrainGenerator.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstring>
+
+using namespace DirectX;
+using uint32 = TerrainGenerator::uint32;
+
+namespace
+{
+	struct TerrainVertex
+	{
+		XMFLOAT3 Position;
+		XMFLOAT3 Normal;
+		XMFLOAT4 Color;
+	};
+
+	TerrainGenerator::Settings GetSettings(TerrainGenerator::NoiseType type)
+	{
+		TerrainGenerator::Settings settings;
+		settings.Seed = 7;
+		settings.Type = type;
+		settings.Frequency = 0.015f;
+		settings.HeightOffset = -2.0f;
+		return settings;
+	}
+
+	std::vector<TerrainVertex> Generate(const TerrainGenerator& terrain, float size, uint32 m, uint32 n)
+	{
+		std::vector<TerrainVertex> vertices;
+		terrain.Generate(size, size, m, n, vertices, [](const XMFLOAT3& position, const XMFLOAT3& normal, const XMFLOAT4& color)
+		{
+			TerrainVertex vertex = { position, normal, color };
+			return vertex;
+		});
+		return vertices;
+	}
+
+	bool HasSameVertices(const std::vector<TerrainVertex>& a, const std::vector<TerrainVertex>& b)
+	{
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(TerrainVertex)) == 0;
+	}
+}
+
+//=========================================================================================
+TEST(TerrainGeneratorDeterminism)
+{
+	// Enough rows for the pool to split them, and a row length that leaves a scalar tail
+	// after the AVX2 loop
+	const float kSize = 160.0f;
+	const uint32 kRowCount = 257;
+	const uint32 kColumnCount = 301;
+
+	for (TerrainGenerator::NoiseType type : { TerrainGenerator::NoiseType::Fbm, TerrainGenerator::NoiseType::Ridged })
+	{
+		TerrainGenerator serialTerrain(GetSettings(type));
+		serialTerrain.SetUseAvx2(false);
+		std::vector<TerrainVertex> serial = Generate(serialTerrain, kSize, kRowCount, kColumnCount);
+
+		// The same vertices for any thread count, with and without AVX2
+		for (unsigned int threadCount : { 1u, 2u, 3u, 4u, 7u })
+		{
+			ThreadPool threadPool(threadCount);
+			for (bool useAvx2 : { false, true })
+			{
+				TerrainGenerator terrain(GetSettings(type));
+				terrain.SetThreadPool(&threadPool);
+				terrain.SetUseAvx2(useAvx2);
+				CHECK(HasSameVertices(Generate(terrain, kSize, kRowCount, kColumnCount), serial));
+			}
+		}
+
+		// The vertices sit on CreateGrid's positions and agree with the point queries
+		GeometryGenerator geoGen;
+		GeometryGenerator::MeshData grid = geoGen.CreateGrid<GeometryGenerator::StreamPosition>(kSize, kSize, kRowCount, kColumnCount);
+		bool isOnGrid = grid.Vertices.size() == serial.size();
+		bool hasMatchingQueries = true;
+		for (size_t i = 0; isOnGrid && i < serial.size(); ++i)
+		{
+			const XMFLOAT3& position = serial[i].Position;
+			isOnGrid = position.x == grid.Vertices[i].Position.x && position.z == grid.Vertices[i].Position.z;
+			if (i % 97 == 0)
+			{
+				XMFLOAT3 normal = serialTerrain.GetNormal(position.x, position.z);
+				hasMatchingQueries = hasMatchingQueries && serialTerrain.GetHeight(position.x, position.z) == position.y &&
+					std::memcmp(&normal, &serial[i].Normal, sizeof(XMFLOAT3)) == 0;
+			}
+		}
+		CHECK(isOnGrid);
+		CHECK(hasMatchingQueries);
+	}
+}
+
+//=========================================================================================
+BENCHMARK(TerrainGeneratorBenchmark)
+{
+	// Vertices per second for growing grids and pools, with the plain loops and with AVX2
+	const uint32 kGridSizes[] = { 256, 512, 1024 };
+	const unsigned int kThreadCounts[] = { 1, 2, 4, 8 };
+
+	for (uint32 gridSize : kGridSizes)
+	{
+		int runs = gridSize <= 256 ? 10 : 3;
+		for (unsigned int threadCount : kThreadCounts)
+		{
+			ThreadPool threadPool(threadCount);
+			double verticesPerSecond[2] = {};
+			for (bool useAvx2 : { false, true })
+			{
+				TerrainGenerator terrain(GetSettings(TerrainGenerator::NoiseType::Fbm));
+				terrain.SetThreadPool(threadCount > 1 ? &threadPool : nullptr);
+				terrain.SetUseAvx2(useAvx2);
+
+				size_t vertexCount = 0;
+				BenchmarkTimer timer;
+				for (int run = 0; run < runs; ++run)
+				{
+					vertexCount += Generate(terrain, 1000.0f, gridSize, gridSize).size();
+				}
+				verticesPerSecond[useAvx2 ? 1 : 0] = vertexCount / (timer.GetMilliseconds() * 1000.0);
+			}
+
+			std::printf("  %ux%u, %u threads: scalar %.2f M vertices/s, avx2 %.2f M vertices/s (%.2fx)\n", gridSize, gridSize, threadCount,
+				verticesPerSecond[0], verticesPerSecond[1], verticesPerSecond[1] / verticesPerSecond[0]);
+		}
+	}
+}
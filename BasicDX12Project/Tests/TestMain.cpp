@@ -0,0 +1,29 @@
+#include "TestRegistry.h"
+#include <cstdio>
+#include <cstring>
+
+//=========================================================================================
+int main(int argc, char** argv)
+{
+	// Without arguments every test runs, with them only the named tests and benchmarks
+	int runCount = 0;
+	for (const TestRegistry::TestCase& test : TestRegistry::GetTests())
+	{
+		bool isNamed = false;
+		for (int i = 1; i < argc; ++i)
+		{
+			isNamed = isNamed || std::strcmp(argv[i], test.Name) == 0;
+		}
+		if (argc > 1 ? !isNamed : test.IsBenchmark)
+		{
+			continue;
+		}
+
+		std::printf("%s\n", test.Name);
+		test.Run();
+		++runCount;
+	}
+
+	std::printf("%d run, %d failed checks\n", runCount, TestRegistry::GetFailureCount());
+	return TestRegistry::GetFailureCount() == 0 ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+#include "TestRegistry.h"
+#include <cstdio>
+
+int TestRegistry::FailureCount = 0;
+
+//=========================================================================================
+bool TestRegistry::Register(const char* name, void (*run)(), bool isBenchmark)
+{
+	GetMutableTests().push_back({ name, run, isBenchmark });
+	return true;
+}
+
+//=========================================================================================
+const std::vector<TestRegistry::TestCase>& TestRegistry::GetTests()
+{
+	return GetMutableTests();
+}
+
+//=========================================================================================
+std::vector<TestRegistry::TestCase>& TestRegistry::GetMutableTests()
+{
+	// Built on first use, the tests register themselves during static initialization
+	static std::vector<TestCase> tests;
+	return tests;
+}
+
+//=========================================================================================
+void TestRegistry::Fail(const char* expression, const char* file, int line)
+{
+	++FailureCount;
+	std::printf("  FAILED %s(%d): %s\n", file, line, expression);
+}
+
+//=========================================================================================
+int TestRegistry::GetFailureCount()
+{
+	return FailureCount;
+}
+
+//=========================================================================================
+BenchmarkTimer::BenchmarkTimer()
+: Start(std::chrono::steady_clock::now())
+{
+}
+
+//=========================================================================================
+double BenchmarkTimer::GetMilliseconds() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Minimal harness for the CPU side tests and benchmarks, which need no device or window.
+// Tests.exe runs every test, or the tests and benchmarks named on its command line.
+// Benchmarks only run when named, they take a while and print timings instead of checking.
+class TestRegistry
+{
+	public:
+		struct TestCase
+		{
+			const char* Name;
+			void (*Run)();
+			bool IsBenchmark;
+		};
+
+		static bool Register(const char* name, void (*run)(), bool isBenchmark);
+		static const std::vector<TestCase>& GetTests();
+
+		// Counts a failed CHECK and prints where it was. The test keeps going, so a run
+		// shows every failure.
+		static void Fail(const char* expression, const char* file, int line);
+		static int GetFailureCount();
+
+	private:
+		static std::vector<TestCase>& GetMutableTests();
+		static int FailureCount;
+};
+
+// Wall clock time since construction, for the benchmarks
+class BenchmarkTimer
+{
+	public:
+		BenchmarkTimer();
+		double GetMilliseconds() const;
+
+	private:
+		std::chrono::steady_clock::time_point Start;
+};
+
+#define TEST(name) \
+	static void name(); \
+	static const bool name##Registered = TestRegistry::Register(#name, name, false); \
+	static void name()
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static const bool name##Registered = TestRegistry::Register(#name, name, true); \
+	static void name()
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			TestRegistry::Fail(#condition, __FILE__, __LINE__); \
+		} \
+	} while (0)
@@ -0,0 +1,79 @@
+#include "TestRegistry.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace
+{
+	struct Chunks
+	{
+		std::mutex Mutex;
+		std::vector<std::pair<size_t, size_t>> Ranges;
+		bool IsAllOnCaller = true;
+	};
+
+	void RunChunks(ThreadPool* threadPool, size_t begin, size_t end, size_t grainSize, Chunks& chunks)
+	{
+		std::thread::id caller = std::this_thread::get_id();
+		ThreadPool::ParallelFor(threadPool, begin, end, grainSize, [&](size_t chunkBegin, size_t chunkEnd)
+		{
+			std::lock_guard<std::mutex> lock(chunks.Mutex);
+			chunks.Ranges.push_back({ chunkBegin, chunkEnd });
+			chunks.IsAllOnCaller = chunks.IsAllOnCaller && std::this_thread::get_id() == caller;
+		});
+		std::sort(chunks.Ranges.begin(), chunks.Ranges.end());
+	}
+
+	// The chunks cover [begin, end) once, in pieces of at least grainSize
+	bool IsSplit(const Chunks& chunks, size_t begin, size_t end, size_t grainSize)
+	{
+		size_t next = begin;
+		for (const std::pair<size_t, size_t>& range : chunks.Ranges)
+		{
+			if (range.first != next || range.second - range.first < grainSize)
+			{
+				return false;
+			}
+			next = range.second;
+		}
+		return next == end;
+	}
+}
+
+//=========================================================================================
+TEST(ThreadPoolChunks)
+{
+	ThreadPool threadPool(4);
+	const size_t kGrainSize = 100;
+
+	// Every chunk is at least the grain, also when the range isn't a multiple of it
+	for (size_t count : { 200, 250, 399, 1000, 12345 })
+	{
+		Chunks chunks;
+		RunChunks(&threadPool, 7, 7 + count, kGrainSize, chunks);
+		CHECK(chunks.Ranges.size() > 1);
+		CHECK(IsSplit(chunks, 7, 7 + count, kGrainSize));
+	}
+
+	// Below twice the grain the whole range runs on the caller in one piece, with or without
+	// a pool
+	for (ThreadPool* pool : { &threadPool, (ThreadPool*)nullptr })
+	{
+		for (size_t count : { 1, 99, 100, 199 })
+		{
+			Chunks chunks;
+			RunChunks(pool, 7, 7 + count, kGrainSize, chunks);
+			CHECK(chunks.Ranges.size() == 1);
+			CHECK(IsSplit(chunks, 7, 7 + count, 0));
+			CHECK(chunks.IsAllOnCaller);
+		}
+	}
+
+	// Empty ranges run nothing
+	Chunks empty;
+	RunChunks(&threadPool, 5, 5, kGrainSize, empty);
+	RunChunks(nullptr, 5, 5, kGrainSize, empty);
+	CHECK(empty.Ranges.empty());
+}
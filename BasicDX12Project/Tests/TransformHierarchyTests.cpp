@@ -0,0 +1,178 @@
+#include "TestRegistry.h"
+#include "ThreadPool.h"
+#include "TransformHierarchy.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+using uint32 = TransformHierarchy::uint32;
+
+namespace
+{
+	XMFLOAT4X4 CreateLocal(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> scale(0.8f, 1.25f);
+		XMFLOAT4X4 local;
+		XMStoreFloat4x4(&local, XMMatrixScaling(scale(random), scale(random), scale(random)) *
+			XMMatrixRotationY(3.14159265f * unit(random)) * XMMatrixTranslation(unit(random), unit(random), unit(random)));
+		return local;
+	}
+
+	// A forest of nodeCount nodes: a few roots, every other node below a random earlier node
+	void AddRandomNodes(TransformHierarchy& hierarchy, std::vector<uint32>& parents, uint32 nodeCount, std::mt19937& random)
+	{
+		for (uint32 k = 0; k < nodeCount; ++k)
+		{
+			uint32 node = (uint32)parents.size();
+			uint32 parent = TransformHierarchy::kNoParent;
+			if (node > 0 && random() % 50 != 0)
+			{
+				parent = random() % node;
+			}
+			parents.push_back(parent);
+			CHECK(hierarchy.AddNode(CreateLocal(random), parent) == node);
+		}
+	}
+
+	// World matrix by walking up to the root, the way the hierarchy is defined
+	XMMATRIX ComputeReferenceWorld(const TransformHierarchy& hierarchy, uint32 node)
+	{
+		XMMATRIX local = XMLoadFloat4x4(&hierarchy.GetLocal(node));
+		if (hierarchy.GetParent(node) == TransformHierarchy::kNoParent)
+		{
+			return local;
+		}
+		return XMMatrixMultiply(local, ComputeReferenceWorld(hierarchy, hierarchy.GetParent(node)));
+	}
+
+	bool HasReferenceWorlds(const TransformHierarchy& hierarchy)
+	{
+		for (uint32 node = 0; node < hierarchy.GetNodeCount(); ++node)
+		{
+			XMFLOAT4X4 expected;
+			XMStoreFloat4x4(&expected, ComputeReferenceWorld(hierarchy, node));
+			if (std::memcmp(&expected, &hierarchy.GetWorld(node), sizeof(XMFLOAT4X4)) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// The updated nodes are exactly the set nodes and everything below them, each once and
+	// after its parent
+	bool HasExpectedUpdates(const TransformHierarchy& hierarchy, const std::vector<uint32>& parents, const std::vector<bool>& isSet)
+	{
+		std::vector<bool> isMoved(parents.size(), false);
+		size_t movedCount = 0;
+		for (uint32 node = 0; node < parents.size(); ++node)
+		{
+			// Parents come before their children in id order
+			isMoved[node] = isSet[node] || (parents[node] != TransformHierarchy::kNoParent && isMoved[parents[node]]);
+			movedCount += isMoved[node] ? 1 : 0;
+		}
+
+		const std::vector<uint32>& updatedNodes = hierarchy.GetUpdatedNodes();
+		std::vector<bool> isUpdated(parents.size(), false);
+		for (uint32 node : updatedNodes)
+		{
+			bool hasParentFirst = parents[node] == TransformHierarchy::kNoParent || !isMoved[parents[node]] || isUpdated[parents[node]];
+			if (!isMoved[node] || isUpdated[node] || !hasParentFirst)
+			{
+				return false;
+			}
+			isUpdated[node] = true;
+		}
+		return updatedNodes.size() == movedCount;
+	}
+
+	void CheckRandomForest(uint32 nodeCount, ThreadPool* threadPool, std::mt19937::result_type seed)
+	{
+		std::mt19937 random(seed);
+		TransformHierarchy hierarchy;
+		hierarchy.SetThreadPool(threadPool);
+		std::vector<uint32> parents;
+
+		AddRandomNodes(hierarchy, parents, nodeCount, random);
+		hierarchy.Update();
+		CHECK(HasReferenceWorlds(hierarchy));
+		CHECK(HasExpectedUpdates(hierarchy, parents, std::vector<bool>(parents.size(), true)));
+
+		bool hasReferenceWorlds = true;
+		bool hasExpectedUpdates = true;
+		for (int round = 0; round < 10; ++round)
+		{
+			// A few nodes anywhere in the forest, or a large share of them
+			std::vector<bool> isSet(parents.size(), false);
+			size_t setCount = round % 3 == 2 ? parents.size() / 3 : 1 + random() % 8;
+			for (size_t k = 0; k < setCount; ++k)
+			{
+				uint32 node = random() % (uint32)parents.size();
+				hierarchy.SetLocal(node, CreateLocal(random));
+				isSet[node] = true;
+			}
+
+			// Nodes added in between are sorted in and the whole forest is recomputed
+			if (round == 5)
+			{
+				AddRandomNodes(hierarchy, parents, nodeCount / 4, random);
+				isSet.assign(parents.size(), true);
+			}
+
+			hierarchy.Update();
+			hasReferenceWorlds = hasReferenceWorlds && HasReferenceWorlds(hierarchy);
+			hasExpectedUpdates = hasExpectedUpdates && HasExpectedUpdates(hierarchy, parents, isSet);
+		}
+		CHECK(hasReferenceWorlds);
+		CHECK(hasExpectedUpdates);
+
+		// Nothing set, nothing updated
+		hierarchy.Update();
+		CHECK(hierarchy.GetUpdatedNodes().empty());
+	}
+}
+
+//=========================================================================================
+TEST(TransformHierarchyRandomForest)
+{
+	for (std::mt19937::result_type seed = 1; seed <= 5; ++seed)
+	{
+		CheckRandomForest(300, nullptr, seed);
+	}
+}
+
+//=========================================================================================
+TEST(TransformHierarchyPooledRandomForest)
+{
+	// Levels wide enough to be split across the pool
+	ThreadPool threadPool(4);
+	CheckRandomForest(40000, &threadPool, 25);
+}
+
+//=========================================================================================
+TEST(TransformHierarchyChain)
+{
+	// One long chain: setting the root moves every node, setting the tip only the tip
+	TransformHierarchy hierarchy;
+	XMFLOAT4X4 step;
+	XMStoreFloat4x4(&step, XMMatrixTranslation(1.0f, 0.0f, 0.0f));
+	uint32 parent = TransformHierarchy::kNoParent;
+	for (int k = 0; k < 100; ++k)
+	{
+		parent = hierarchy.AddNode(step, parent);
+	}
+	hierarchy.Update();
+	CHECK(hierarchy.GetWorld(99)._41 == 100.0f);
+
+	hierarchy.SetLocal(0, MathHelper::Identity4x4());
+	hierarchy.Update();
+	CHECK(hierarchy.GetUpdatedNodes().size() == 100);
+	CHECK(hierarchy.GetWorld(99)._41 == 99.0f);
+
+	hierarchy.SetLocal(99, MathHelper::Identity4x4());
+	hierarchy.Update();
+	CHECK(hierarchy.GetUpdatedNodes() == std::vector<uint32>({ 99 }));
+	CHECK(hierarchy.GetWorld(99)._41 == 98.0f);
+}
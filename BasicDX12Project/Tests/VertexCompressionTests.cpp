@@ -0,0 +1,259 @@
+#include "TestRegistry.h"
+#include "FromBook/GeometryGenerator.h"
+#include "MeshBounds.h"
+#include "VertexCompression.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+using std::uint32_t;
+
+namespace
+{
+	const VertexFormat kFormats[] = { VertexFormat::FullPrecision, VertexFormat::PackedColor, VertexFormat::QuantizedPosition };
+
+	// Angle bound of the 16-bit octahedral encoding, the measured worst case is about 0.004 degrees
+	const float kMaxNormalDegrees = 0.01f;
+
+	// Half floats keep 11 significant bits
+	const float kHalfRelativeError = 1.0f / 2048.0f;
+
+	// The shapes MyApp draws, plus the flat grid that exercises the flat axis of QuantizationExtents
+	std::vector<GeometryGenerator::MeshData> CreateShapes()
+	{
+		GeometryGenerator geoGen;
+		return
+		{
+			geoGen.CreateBox(1.5f, 0.5f, 1.5f, 3),
+			geoGen.CreateGrid(20.0f, 30.0f, 60, 40),
+			geoGen.CreateSphere(0.5f, 20, 20),
+			geoGen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20),
+			geoGen.CreateGeosphere(0.5f, 3)
+		};
+	}
+
+	BoundingBox ComputeBounds(const GeometryGenerator::MeshData& meshData)
+	{
+		return MeshBounds::ComputeBox(&meshData.Vertices[0].Position, meshData.Vertices.size(), sizeof(GeometryGenerator::Vertex));
+	}
+
+	// One SNORM16 step of the bounds, flat axes are quantized against 1
+	XMFLOAT3 GetPositionStep(const BoundingBox& bounds)
+	{
+		auto step = [](float extent) { return (extent > 1e-6f ? extent : 1.0f) / 32767.0f; };
+		return XMFLOAT3(step(bounds.Extents.x), step(bounds.Extents.y), step(bounds.Extents.z));
+	}
+
+	bool IsWithinStep(const XMFLOAT3& decoded, const XMFLOAT3& expected, const XMFLOAT3& step)
+	{
+		// Rounding is off by at most half a step, the other half is slack for float error
+		return fabsf(decoded.x - expected.x) <= step.x && fabsf(decoded.y - expected.y) <= step.y && fabsf(decoded.z - expected.z) <= step.z;
+	}
+
+	// From atan2 rather than acos, which can't resolve angles this small in float
+	float GetAngleDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		XMVECTOR va = XMLoadFloat3(&a);
+		XMVECTOR vb = XMLoadFloat3(&b);
+		float sine = XMVectorGetX(XMVector3Length(XMVector3Cross(va, vb)));
+		float cosine = XMVectorGetX(XMVector3Dot(va, vb));
+		return XMConvertToDegrees(atan2f(sine, cosine));
+	}
+
+	bool IsHalfRoundTrip(float decoded, float expected)
+	{
+		return fabsf(decoded - expected) <= kHalfRelativeError * (fabsf(expected) > 1.0f ? fabsf(expected) : 1.0f);
+	}
+
+	bool IsColorRoundTrip(const XMFLOAT4& decoded, const XMFLOAT4& expected)
+	{
+		const float kMaxError = 0.5f / 255.0f + 1e-6f;
+		return fabsf(decoded.x - expected.x) <= kMaxError && fabsf(decoded.y - expected.y) <= kMaxError &&
+			fabsf(decoded.z - expected.z) <= kMaxError && fabsf(decoded.w - expected.w) <= kMaxError;
+	}
+
+	// Position and color of vertex i of an EncodeColorVertices buffer
+	void DecodeColorVertex(VertexFormat format, const std::vector<std::uint8_t>& data, size_t i, const BoundingBox& bounds,
+		XMFLOAT3& position, XMFLOAT4& color)
+	{
+		const std::uint8_t* vertex = data.data() + i * VertexCompression::GetVertexStride(format);
+		switch (format)
+		{
+			case VertexFormat::PackedColor:
+			{
+				PackedColorVertex v;
+				std::memcpy(&v, vertex, sizeof(v));
+				position = v.Pos;
+				color = VertexCompression::DecodeColor(v.Color);
+				break;
+			}
+			case VertexFormat::QuantizedPosition:
+			{
+				QuantizedColorVertex v;
+				std::memcpy(&v, vertex, sizeof(v));
+				position = VertexCompression::DecodePosition(v.Pos, bounds);
+				color = VertexCompression::DecodeColor(v.Color);
+				break;
+			}
+			default:
+			{
+				std::memcpy(&position, vertex, sizeof(XMFLOAT3));
+				std::memcpy(&color, vertex + sizeof(XMFLOAT3), sizeof(XMFLOAT4));
+				break;
+			}
+		}
+	}
+}
+
+//=========================================================================================
+TEST(ColorVertexFormatsRoundTrip)
+{
+	const XMFLOAT4 kColor(0.1f, 0.45f, 0.8f, 1.0f);
+
+	for (const GeometryGenerator::MeshData& meshData : CreateShapes())
+	{
+		BoundingBox bounds = ComputeBounds(meshData);
+		XMFLOAT3 step = GetPositionStep(bounds);
+
+		for (VertexFormat format : kFormats)
+		{
+			std::vector<std::uint8_t> data(meshData.Vertices.size() * VertexCompression::GetVertexStride(format));
+			VertexCompression::EncodeColorVertices(format, meshData.Vertices, kColor, bounds, data.data());
+
+			// Only the quantized format may move a vertex, and by no more than one step
+			XMFLOAT4X4 decodeTransform = VertexCompression::GetPositionDecodeTransform(format, bounds);
+			XMMATRIX decode = XMLoadFloat4x4(&decodeTransform);
+			bool isQuantized = format == VertexFormat::QuantizedPosition;
+			bool positionsMatch = true;
+			bool decodeTransformMatches = true;
+			bool colorsMatch = true;
+			for (size_t i = 0; i < meshData.Vertices.size(); ++i)
+			{
+				const XMFLOAT3& expected = meshData.Vertices[i].Position;
+				XMFLOAT3 position;
+				XMFLOAT4 color;
+				DecodeColorVertex(format, data, i, bounds, position, color);
+
+				positionsMatch = positionsMatch && (isQuantized ? IsWithinStep(position, expected, step) : std::memcmp(&position, &expected, sizeof(position)) == 0);
+				colorsMatch = colorsMatch && (format == VertexFormat::FullPrecision ? std::memcmp(&color, &kColor, sizeof(color)) == 0 : IsColorRoundTrip(color, kColor));
+
+				// The vertex shader decodes the SNORM value the input assembler hands it with this transform
+				XMFLOAT3 shaderPosition;
+				XMFLOAT3 normalized = position;
+				if (isQuantized)
+				{
+					QuantizedColorVertex v;
+					std::memcpy(&v, data.data() + i * sizeof(v), sizeof(v));
+					normalized = XMFLOAT3(v.Pos[0] / 32767.0f, v.Pos[1] / 32767.0f, v.Pos[2] / 32767.0f);
+				}
+				XMStoreFloat3(&shaderPosition, XMVector3TransformCoord(XMLoadFloat3(&normalized), decode));
+				decodeTransformMatches = decodeTransformMatches && IsWithinStep(shaderPosition, position, step);
+			}
+			CHECK(positionsMatch);
+			CHECK(decodeTransformMatches);
+			CHECK(colorsMatch);
+		}
+	}
+}
+
+//=========================================================================================
+TEST(CompactMeshVertexRoundTrip)
+{
+	for (const GeometryGenerator::MeshData& meshData : CreateShapes())
+	{
+		BoundingBox bounds = ComputeBounds(meshData);
+		XMFLOAT3 step = GetPositionStep(bounds);
+
+		std::vector<CompactMeshVertex> compact(meshData.Vertices.size());
+		VertexCompression::EncodeMeshVertices(meshData.Vertices, bounds, compact.data());
+
+		float maxNormalDegrees = 0.0f;
+		float maxTangentDegrees = 0.0f;
+		bool positionsMatch = true;
+		bool texCoordsMatch = true;
+		for (size_t i = 0; i < compact.size(); ++i)
+		{
+			const GeometryGenerator::Vertex& expected = meshData.Vertices[i];
+			GeometryGenerator::Vertex decoded = VertexCompression::DecodeMeshVertex(compact[i], bounds);
+
+			positionsMatch = positionsMatch && IsWithinStep(decoded.Position, expected.Position, step);
+			texCoordsMatch = texCoordsMatch && IsHalfRoundTrip(decoded.TexC.x, expected.TexC.x) && IsHalfRoundTrip(decoded.TexC.y, expected.TexC.y);
+			maxNormalDegrees = std::max<float>(maxNormalDegrees, GetAngleDegrees(decoded.Normal, expected.Normal));
+
+			// The sphere's poles have no tangent to keep
+			if (XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&expected.TangentU))) > 0.0f)
+			{
+				maxTangentDegrees = std::max<float>(maxTangentDegrees, GetAngleDegrees(decoded.TangentU, expected.TangentU));
+			}
+		}
+		CHECK(positionsMatch);
+		CHECK(texCoordsMatch);
+		CHECK(maxNormalDegrees <= kMaxNormalDegrees);
+		CHECK(maxTangentDegrees <= kMaxNormalDegrees);
+	}
+}
+
+//=========================================================================================
+TEST(OctahedralRoundTrip)
+{
+	// The axes and diagonals sit on the octahedron's edges and folds
+	std::vector<XMFLOAT3> directions;
+	for (int x = -1; x <= 1; ++x)
+	{
+		for (int y = -1; y <= 1; ++y)
+		{
+			for (int z = -1; z <= 1; ++z)
+			{
+				if (x != 0 || y != 0 || z != 0)
+				{
+					directions.push_back(XMFLOAT3((float)x, (float)y, (float)z));
+				}
+			}
+		}
+	}
+
+	std::mt19937 random(7);
+	std::normal_distribution<float> gaussian;
+	for (int i = 0; i < 100000; ++i)
+	{
+		directions.push_back(XMFLOAT3(gaussian(random), gaussian(random), gaussian(random)));
+	}
+
+	float maxDegrees = 0.0f;
+	for (const XMFLOAT3& direction : directions)
+	{
+		XMFLOAT3 decoded = VertexCompression::DecodeOctahedral(VertexCompression::EncodeOctahedral(direction));
+		maxDegrees = std::max<float>(maxDegrees, GetAngleDegrees(decoded, direction));
+	}
+	CHECK(maxDegrees <= kMaxNormalDegrees);
+}
+
+//=========================================================================================
+TEST(Half2RoundTrip)
+{
+	// Tiled UVs go well past 1, the half's precision drops with magnitude
+	const float kValues[] = { 0.0f, 1.0f, -1.0f, 0.5f, 1.0f / 3.0f, 0.999f, 2.0f, 5.0f, 17.25f, 100.1f, -42.7f };
+	for (float u : kValues)
+	{
+		for (float v : kValues)
+		{
+			XMFLOAT2 decoded = VertexCompression::DecodeHalf2(VertexCompression::EncodeHalf2(XMFLOAT2(u, v)));
+			CHECK(IsHalfRoundTrip(decoded.x, u) && IsHalfRoundTrip(decoded.y, v));
+		}
+	}
+}
+
+//=========================================================================================
+TEST(ColorRoundTrip)
+{
+	// Every 8-bit level survives a decode and encode exactly
+	for (uint32_t level = 0; level < 256; ++level)
+	{
+		uint32_t packed = level | ((255 - level) << 8) | (((level * 7) & 0xFF) << 16) | (((level * 13) & 0xFF) << 24);
+		CHECK(VertexCompression::EncodeColor(VertexCompression::DecodeColor(packed)) == packed);
+	}
+
+	// Out of range channels clamp
+	CHECK(VertexCompression::EncodeColor(XMFLOAT4(-0.5f, 1.5f, 0.0f, 1.0f)) == 0xFF00FF00);
+}
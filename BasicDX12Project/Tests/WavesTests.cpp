@@ -0,0 +1,142 @@
+#include "TestRegistry.h"
+#include "ThreadPool.h"
+#include "Waves.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+
+using namespace DirectX;
+using uint32 = Waves::uint32;
+
+namespace
+{
+	// Constants of the "LandAndWaves" demo
+	const float kSpatialStep = 1.0f;
+	const float kTimeStep = 0.03f;
+	const float kSpeed = 4.0f;
+	const float kDamping = 0.2f;
+
+	std::unique_ptr<Waves> CreateWaves(uint32 rowCount, uint32 columnCount, ThreadPool* threadPool, bool useAvx)
+	{
+		std::unique_ptr<Waves> waves(new Waves(rowCount, columnCount, kSpatialStep, kTimeStep, kSpeed, kDamping));
+		waves->SetThreadPool(threadPool);
+		waves->SetUseAvx(useAvx);
+		return waves;
+	}
+
+	// Disturbs a random vertex away from the border, like the demo does every quarter second
+	void DisturbRandom(Waves& waves, std::mt19937& random)
+	{
+		std::uniform_int_distribution<uint32> row(2, waves.GetRowCount() - 3);
+		std::uniform_int_distribution<uint32> column(2, waves.GetColumnCount() - 3);
+		std::uniform_real_distribution<float> magnitude(0.2f, 0.5f);
+		uint32 i = row(random);
+		uint32 j = column(random);
+		waves.Disturb(i, j, magnitude(random));
+	}
+
+	bool HasSameSurface(const Waves& a, const Waves& b)
+	{
+		if (a.GetVertexCount() != b.GetVertexCount())
+		{
+			return false;
+		}
+
+		for (uint32 i = 0; i < a.GetVertexCount(); ++i)
+		{
+			XMFLOAT3 positionA = a.GetPosition(i);
+			XMFLOAT3 positionB = b.GetPosition(i);
+			XMFLOAT3 normalA = a.GetNormal(i);
+			XMFLOAT3 normalB = b.GetNormal(i);
+			if (std::memcmp(&positionA, &positionB, sizeof(XMFLOAT3)) != 0 || std::memcmp(&normalA, &normalB, sizeof(XMFLOAT3)) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+//=========================================================================================
+TEST(WavesAvxMatchesScalar)
+{
+	// Column counts that leave the AVX loop with a scalar tail of every length, and a grid
+	// big enough for its rows and tiles to be split across the pool
+	const uint32 kGridSizes[][2] = { { 16, 16 }, { 37, 53 }, { 64, 71 }, { 300, 301 } };
+
+	ThreadPool threadPool(4);
+	for (const uint32* size : kGridSizes)
+	{
+		for (ThreadPool* pool : { (ThreadPool*)nullptr, &threadPool })
+		{
+			std::unique_ptr<Waves> scalar = CreateWaves(size[0], size[1], nullptr, false);
+			std::unique_ptr<Waves> avx = CreateWaves(size[0], size[1], pool, true);
+
+			// Same disturbances at the same steps, normals updated at different intervals so
+			// the dirty tiles collect several steps' changes
+			std::mt19937 scalarRandom(size[0] * 1000 + size[1]);
+			std::mt19937 avxRandom(size[0] * 1000 + size[1]);
+			bool isSame = true;
+			for (int step = 0; step < 120 && isSame; ++step)
+			{
+				if (step % 8 == 0)
+				{
+					DisturbRandom(*scalar, scalarRandom);
+					DisturbRandom(*avx, avxRandom);
+				}
+
+				scalar->Step();
+				avx->Step();
+				if (step % 3 == 0)
+				{
+					scalar->UpdateNormals();
+					avx->UpdateNormals();
+					isSame = HasSameSurface(*scalar, *avx);
+				}
+			}
+			CHECK(isSame);
+			CHECK(scalar->GetVersion() == avx->GetVersion());
+		}
+	}
+}
+
+//=========================================================================================
+BENCHMARK(WavesStepBenchmark)
+{
+	// Milliseconds per step and normal update for growing grids and pools, with the plain
+	// loops and with AVX
+	const uint32 kGridSizes[] = { 128, 256, 512, 1024 };
+	const unsigned int kThreadCounts[] = { 1, 2, 4, 8 };
+	const int kSteps = 100;
+
+	for (uint32 gridSize : kGridSizes)
+	{
+		for (unsigned int threadCount : kThreadCounts)
+		{
+			ThreadPool threadPool(threadCount);
+			double ms[2] = {};
+			for (bool useAvx : { false, true })
+			{
+				std::unique_ptr<Waves> waves = CreateWaves(gridSize, gridSize, threadCount > 1 ? &threadPool : nullptr, useAvx);
+
+				// Disturb the whole grid first, so every step works on moving water
+				std::mt19937 random(gridSize);
+				for (uint32 k = 0; k < gridSize; ++k)
+				{
+					DisturbRandom(*waves, random);
+				}
+
+				BenchmarkTimer timer;
+				for (int step = 0; step < kSteps; ++step)
+				{
+					waves->Step();
+					waves->UpdateNormals();
+				}
+				ms[useAvx ? 1 : 0] = timer.GetMilliseconds() / kSteps;
+			}
+
+			std::printf("  %ux%u, %u threads: scalar %.3f ms, avx %.3f ms (%.2fx)\n", gridSize, gridSize, threadCount, ms[0], ms[1], ms[0] / ms[1]);
+		}
+	}
+}